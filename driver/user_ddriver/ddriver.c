@@ -10,6 +10,10 @@
 #include "errno.h"
 #include <pwd.h>
 #include <time.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 
 extern int errno;
 
@@ -46,18 +50,29 @@ extern int errno;
 
 #define CONFIG_DISK_SZ  (4 * 1024 * 1024)
 #define CONFIG_BLOCK_SZ (512)
+#define CONFIG_MAX_DEVS     16                        /* 同时打开的设备数上限 */
+#define CONFIG_ZONE_MAGIC   0x454E4F5A                /* "ZONE" */
+#define CONFIG_ZONE_TABLE   CONFIG_DISK_SZ            /* 分区表存放在设备容量之后，对使用者不可见 */
+#define CONFIG_QUEUE_DEPTH  32                        /* 设备默认同时服务的命令数 */
+#define CONFIG_MAX_QD       64                        /* 设备队列深度与每个队列服务线程数的上限 */
+#define CONFIG_MAX_RINGS    16                        /* 同时存在的提交/完成队列数上限 */
+#define CONFIG_MAX_ENTRIES  4096                      /* 提交队列容量上限 */
+#define CONFIG_READ_EXPIRE  50000                     /* deadline调度：读请求的期限，微秒 */
+#define CONFIG_WRITE_EXPIRE 500000                    /* deadline调度：写请求的期限，微秒 */
+#define CONFIG_WRITES_STARVED 16                      /* deadline调度：有写等待时至多连续服务的读请求数 */
 /******************************************************************************
 * SECTION: Macro Functions 
 *******************************************************************************/
 #define IGNORE_ARG(arg)         ((void)arg)
 #define IS_ADDR_ALIGN(addr)     (addr % CONFIG_BLOCK_SZ == 0)
+#define IS_SIZE_ALIGN(size)     (size != 0 && size % CONFIG_BLOCK_SZ == 0)
 #define ADDR_ROUND_UP(addr)     ((addr / CONFIG_BLOCK_SZ) * CONFIG_BLOCK_SZ)
 
-#define INC_READCNT(disk)       (disk.read_cnt++)
-#define INC_WRITECNT(disk)      (disk.write_cnt++)
-#define INC_SEEKCNT(disk)       (disk.seek_cnt++)
+#define INC_READCNT(d)          ((d)->read_cnt++)
+#define INC_WRITECNT(d)         ((d)->write_cnt++)
+#define INC_SEEKCNT(d)          ((d)->seek_cnt++)
 
-#define RW_DELAY(disk, rw_ops)  (usleep(disk.rw_ops##_lat * 1000))
+#define RW_DELAY(d, rw_ops)     (usleep((d)->rw_ops##_lat))
 /******************************************************************************
 * SECTION: Type definitions
 *******************************************************************************/
@@ -67,32 +82,105 @@ struct ddriver
     int  read_cnt;
     int  write_cnt;
     int  seek_cnt;
-    int  read_lat;
+    int  read_lat;                                   /* 以下延迟以微秒计，可经IOC_REQ_DEVICE_LAT修改 */
     int  write_lat;
     int  seek_lat;
     int  track_num;
     int  major_num;
     int  layout_size;
     int  iounit_size;
+    off_t head;                                      /* Disk head position */
+    char *map;                                       /* 后备文件前layout_size字节的共享映射，为NULL时定位读写经系统调用 */
+    struct ddriver_zone_info zinfo;                  /* zone_sz为0表示普通设备 */
+    struct ddriver_zone *zones;
+    char *zone_busy;                                 /* 各分区是否有写入在途，写指针在其落盘后才推进 */
+    int  nr_open;                                    /* 打开的顺序写分区数 */
+    int  queue_depth;                                /* 同时服务的命令数，超出的命令排队等待 */
+    int  inflight;                                   /* 正在服务的命令数 */
+    int  sched;                                      /* 调度策略，DDRIVER_SCHED_* */
+    struct ddriver_waiter *waiters;                  /* 等待队列槽的命令，按到达顺序 */
+    int  starved;                                    /* deadline：有写等待时已连续服务的读命令数 */
+    struct ddriver_sched_stats stats[DDRIVER_SCHED_NR];
+    pthread_mutex_t lock;                            /* guards head, counters, zones, queue slots and waiters */
+    pthread_cond_t slot;                             /* 有等待的命令得到服务 */
+    pthread_cond_t zone_idle;                        /* 某个分区的在途写入已落盘 */
+};
+
+/* 等待队列槽的命令，位于提交者的栈上 */
+struct ddriver_waiter
+{
+    off_t offset;
+    size_t size;
+    int write;
+    long arrive;                                     /* 到达时间，微秒 */
+    long deadline;
+    off_t from;                                      /* 得到服务时的磁头位置 */
+    int granted;
+    struct ddriver_waiter *next;
+};
+
+/* 提交/完成队列。sqes中[sq_head, sq_tail)已提交待执行，[sq_tail, sq_local)已取得尚未提交；
+ * 计数只增不减，容量为2的幂，按容量取模定位 */
+struct ddriver_ring
+{
+    int entries;
+    struct ddriver_sqe *sqes;
+    unsigned int sq_head;
+    unsigned int sq_tail;
+    unsigned int sq_local;
+    struct ddriver_cqe *cqes;                        /* 容量为2 * entries */
+    unsigned int cq_head;
+    unsigned int cq_tail;
+    int pending;                                     /* 已提交但完成事件尚未收取 */
+    int efd;                                         /* 未启用DDRIVER_QUEUE_EVENTFD时为-1 */
+    int stop;
+    int nr_workers;
+    pthread_t *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t sq_cond;                          /* 有新提交或要退出 */
+    pthread_cond_t cq_cond;                          /* 有新完成事件 */
+    pthread_cond_t cq_space;                         /* 完成队列空出位置 */
+};
+
+/* 分区表在后备文件中的格式：头部之后每个分区依次记录写指针与状态 */
+struct zone_table_hdr
+{
+    int magic;
+    struct ddriver_zone_info info;
 };
 /******************************************************************************
 * SECTION: Global Variable
 *******************************************************************************/
 /* reference: https://en.wikipedia.org/wiki/Hard_disk_drive_performance_characteristics */
-struct ddriver disk = {
+/* 每次打开设备时以此为模板建立一个设备对象 */
+static const struct ddriver disk_template = {
     .read_cnt    = 0,
     .write_cnt   = 0,
     .seek_cnt    = 0,
-    .read_lat    = 2,       /* 2ms */       
-    .write_lat   = 1,       /* 1ms */
-    .seek_lat    = 4,       /* 4.17ms per 360 degree */
+    .read_lat    = 2000,    /* 2ms */       
+    .write_lat   = 1000,    /* 1ms */
+    .seek_lat    = 4000,    /* 4.17ms per 360 degree */
     .major_num   = 0,
     .track_num   = 100,
     .layout_size = CONFIG_DISK_SZ,
-    .iounit_size = CONFIG_BLOCK_SZ
+    .iounit_size = CONFIG_BLOCK_SZ,
+    .head        = 0,
+    .map         = NULL,
+    .zinfo       = {0},
+    .zones       = NULL,
+    .zone_busy   = NULL,
+    .nr_open     = 0,
+    .queue_depth = CONFIG_QUEUE_DEPTH,
+    .inflight    = 0,
+    .sched       = DDRIVER_SCHED_FIFO,
+    .waiters     = NULL,
+    .starved     = 0
 };
 
-FILE *debugf = NULL;
+struct ddriver *devs[CONFIG_MAX_DEVS];                  /* 已打开的设备，按后备文件描述符查找 */
+pthread_mutex_t devs_lock = PTHREAD_MUTEX_INITIALIZER;   /* guards devs and debugf */
+FILE *debugf = NULL;                                     /* 所有设备共用，第一个设备打开时建立 */
+struct ddriver_ring *rings[CONFIG_MAX_RINGS];            /* 提交/完成队列，按句柄下标查找，由devs_lock保护 */
 /******************************************************************************
 * SECTION: Helper Functions
 *******************************************************************************/
@@ -104,71 +192,661 @@ int check_valid(size_t size) {
     return 0;
 }
 
-int emulate_rotate(int fd, off_t start, off_t end) {
-    int bytes_per_track = disk.layout_size / disk.track_num;
-    int lat_per_track = disk.seek_lat;
-    int distance = abs(end - start) % bytes_per_track; 
+/**
+ * @brief 磁头从start移动到end的距离，按磁道取模，模拟等待盘片转到目标位置
+ * 
+ * @param d 
+ * @param start 
+ * @param end 
+ * @return int 
+ */
+static int seek_distance(struct ddriver *d, off_t start, off_t end) {
+    int bytes_per_track = d->layout_size / d->track_num;
+
+    return labs(end - start) % bytes_per_track;
+}
+
+static long seek_time(struct ddriver *d, off_t start, off_t end) {
+    return (long)seek_distance(d, start, end) * d->seek_lat / (d->layout_size / d->track_num);
+}
+
+int emulate_rotate(struct ddriver *d, off_t start, off_t end) {
+    long lat = seek_time(d, start, end);
     
-    if (distance == 0) {
+    if (lat == 0) {
         return 0;
     }
 
-    usleep(distance * lat_per_track / bytes_per_track * 1000);
+    usleep(lat);
+    return 0;
+}
+/**
+ * @brief 按后备文件描述符找到设备对象
+ * 
+ * @param fd 
+ * @return struct ddriver* 未打开的描述符返回NULL
+ */
+static struct ddriver *ddriver_get(int fd) {
+    struct ddriver *d = NULL;
+
+    pthread_mutex_lock(&devs_lock);
+    for (int i = 0; i < CONFIG_MAX_DEVS && d == NULL; i++) {
+        if (devs[i] != NULL && devs[i]->ddriver_fd == fd) {
+            d = devs[i];
+        }
+    }
+    pthread_mutex_unlock(&devs_lock);
+    return d;
+}
+/******************************************************************************
+* SECTION: I/O scheduler, callers hold d->lock
+*******************************************************************************/
+static long now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+static void sched_account_seek(struct ddriver *d, off_t from, off_t to) {
+    struct ddriver_sched_stats *st = &d->stats[d->sched];
+
+    st->seek_bytes += seek_distance(d, from, to);
+    st->seek_us += seek_time(d, from, to);
+}
+/**
+ * @brief 命令开始服务：占用一个队列槽，磁头移到命令末尾，计入当前策略的统计
+ * 
+ * @param d 
+ * @param w 
+ * @param queued 命令是否排队等待过
+ */
+static void sched_start(struct ddriver *d, struct ddriver_waiter *w, int queued) {
+    struct ddriver_sched_stats *st = &d->stats[d->sched];
+    long wait;
+
+    d->inflight++;
+    w->from = d->head;
+    d->head = w->offset + w->size;
+    st->dispatched++;
+    sched_account_seek(d, w->from, w->offset);
+    if (queued) {
+        wait = now_us() - w->arrive;
+        st->queued++;
+        st->wait_us += wait;
+        if (wait > st->max_wait_us) {
+            st->max_wait_us = wait;
+        }
+    }
+}
+/**
+ * @brief C-LOOK：取磁头之后地址最小的命令，没有则回到地址最小的命令
+ * 
+ * @param d 
+ * @param write 只在读(0)或写(1)命令中选择，-1表示不区分
+ * @return struct ddriver_waiter* 没有符合的命令返回NULL
+ */
+static struct ddriver_waiter *sched_clook(struct ddriver *d, int write) {
+    struct ddriver_waiter *w, *ahead = NULL, *lowest = NULL;
+
+    for (w = d->waiters; w != NULL; w = w->next) {
+        if (write >= 0 && w->write != write) {
+            continue;
+        }
+        if (w->offset >= d->head && (ahead == NULL || w->offset < ahead->offset)) {
+            ahead = w;
+        }
+        if (lowest == NULL || w->offset < lowest->offset) {
+            lowest = w;
+        }
+    }
+    return ahead != NULL ? ahead : lowest;
+}
+/**
+ * @brief deadline：超过期限的命令按到达顺序最先服务，其中读优先；
+ *        否则读优先按C-LOOK服务，但有写等待时至多连续服务CONFIG_WRITES_STARVED个读
+ * 
+ * @param d 
+ * @return struct ddriver_waiter* 
+ */
+static struct ddriver_waiter *sched_deadline(struct ddriver *d) {
+    struct ddriver_waiter *w, *expired = NULL;
+    long now = now_us();
+    int reads = 0, writes = 0;
+
+    for (w = d->waiters; w != NULL; w = w->next) {
+        if (w->deadline <= now && (expired == NULL || (expired->write && !w->write))) {
+            expired = w;
+        }
+        if (w->write) {
+            writes++;
+        } else {
+            reads++;
+        }
+    }
+    if (expired != NULL) {
+        d->stats[DDRIVER_SCHED_DEADLINE].expired++;
+        w = expired;
+    } else if (reads > 0 && (writes == 0 || d->starved < CONFIG_WRITES_STARVED)) {
+        w = sched_clook(d, 0);
+    } else {
+        w = sched_clook(d, 1);
+    }
+    d->starved = w->write ? 0 : d->starved + (writes > 0);
+    return w;
+}
+/**
+ * @brief 有空闲队列槽时，按调度策略选出等待的命令开始服务
+ * 
+ * @param d 
+ */
+static void sched_dispatch(struct ddriver *d) {
+    struct ddriver_waiter *w, **pp;
+    int granted = 0;
+
+    while (d->waiters != NULL && d->inflight < d->queue_depth) {
+        switch (d->sched) {
+        case DDRIVER_SCHED_CLOOK:
+            w = sched_clook(d, -1);
+            break;
+        case DDRIVER_SCHED_DEADLINE:
+            w = sched_deadline(d);
+            break;
+        default:
+            w = d->waiters;
+            break;
+        }
+        for (pp = &d->waiters; *pp != w; pp = &(*pp)->next)
+            ;
+        *pp = w->next;
+        sched_start(d, w, 1);
+        w->granted = 1;
+        granted = 1;
+    }
+    if (granted) {
+        pthread_cond_broadcast(&d->slot);
+    }
+}
+/**
+ * @brief 占用设备的一个队列槽。队列已满或已有命令在等待时排队，由调度策略决定服务顺序
+ * 
+ * @param d 
+ * @param offset 
+ * @param size 
+ * @param write 
+ * @return off_t 开始服务时的磁头位置，调用者据此模拟寻道
+ */
+static off_t queue_enter(struct ddriver *d, off_t offset, size_t size, int write) {
+    struct ddriver_waiter w = {
+        .offset = offset,
+        .size = size,
+        .write = write,
+        .arrive = now_us(),
+        .granted = 0,
+        .next = NULL
+    };
+    struct ddriver_waiter **pp;
+
+    if (d->waiters == NULL && d->inflight < d->queue_depth) {
+        sched_start(d, &w, 0);
+        return w.from;
+    }
+    w.deadline = w.arrive + (write ? CONFIG_WRITE_EXPIRE : CONFIG_READ_EXPIRE);
+    for (pp = &d->waiters; *pp != NULL; pp = &(*pp)->next)
+        ;
+    *pp = &w;
+    while (!w.granted) {
+        pthread_cond_wait(&d->slot, &d->lock);
+    }
+    return w.from;
+}
+
+static void queue_leave(struct ddriver *d) {
+    d->inflight--;
+    sched_dispatch(d);
+}
+/******************************************************************************
+* SECTION: Zone emulation, callers hold d->lock except at open/close
+*******************************************************************************/
+#define ZONE_IS_SEQ(d, z)       ((d)->zones[z].type == DDRIVER_ZONE_TYPE_SEQ)
+#define ZONE_IS_OPEN(d, z)      ((d)->zones[z].cond == DDRIVER_ZONE_COND_IMP_OPEN || \
+                                 (d)->zones[z].cond == DDRIVER_ZONE_COND_EXP_OPEN)
+/**
+ * @brief 把一个分区的写指针与状态写入后备文件，断电后写指针不丢失
+ * 
+ * @param d 
+ * @param z 
+ */
+static void zone_save(struct ddriver *d, int z) {
+    int ent[2] = {d->zones[z].wp, d->zones[z].cond};
+    pwrite(d->ddriver_fd, ent, sizeof(ent), CONFIG_ZONE_TABLE + sizeof(struct zone_table_hdr) + z * sizeof(ent));
+}
+
+static void zone_save_all(struct ddriver *d) {
+    struct zone_table_hdr hdr = {CONFIG_ZONE_MAGIC, d->zinfo};
+    pwrite(d->ddriver_fd, &hdr, sizeof(hdr), CONFIG_ZONE_TABLE);
+    for (int z = 0; z < d->zinfo.nr_zones; z++) {
+        zone_save(d, z);
+    }
+}
+/**
+ * @brief 按分区几何建立分区表，顺序写分区全部为空
+ * 
+ * @param info 
+ * @return int 
+ */
+static int zone_setup(struct ddriver *d, struct ddriver_zone_info *info) {
+    free(d->zones);
+    free(d->zone_busy);
+    d->zones = NULL;
+    d->zone_busy = NULL;
+    d->nr_open = 0;
+    memset(&d->zinfo, 0, sizeof(d->zinfo));
+    if (info->zone_sz == 0) {
+        return 0;
+    }
+    if (info->zone_sz % CONFIG_BLOCK_SZ != 0 || CONFIG_DISK_SZ % info->zone_sz != 0 || 
+        info->nr_conv < 0 || info->nr_conv > CONFIG_DISK_SZ / info->zone_sz || info->max_open <= 0) {
+        return -EINVAL;
+    }
+    d->zinfo = *info;
+    d->zinfo.nr_zones = CONFIG_DISK_SZ / info->zone_sz;
+    d->zones = (struct ddriver_zone *)calloc(d->zinfo.nr_zones, sizeof(struct ddriver_zone));
+    d->zone_busy = (char *)calloc(d->zinfo.nr_zones, 1);
+    if (d->zones == NULL || d->zone_busy == NULL) {
+        free(d->zones);
+        free(d->zone_busy);
+        d->zones = NULL;
+        d->zone_busy = NULL;
+        memset(&d->zinfo, 0, sizeof(d->zinfo));
+        return -ENOMEM;
+    }
+    for (int z = 0; z < d->zinfo.nr_zones; z++) {
+        d->zones[z].start = z * info->zone_sz;
+        d->zones[z].len = info->zone_sz;
+        d->zones[z].wp = d->zones[z].start;
+        d->zones[z].type = z < info->nr_conv ? DDRIVER_ZONE_TYPE_CONV : DDRIVER_ZONE_TYPE_SEQ;
+        d->zones[z].cond = z < info->nr_conv ? DDRIVER_ZONE_COND_NOT_WP : DDRIVER_ZONE_COND_EMPTY;
+    }
+    return 0;
+}
+/**
+ * @brief 打开设备时读入分区表，没有分区表即为普通设备。
+ *        打开状态不跨越重启，已打开的分区恢复为关闭
+ * 
+ * @param d 
+ */
+static void zone_load(struct ddriver *d) {
+    struct zone_table_hdr hdr;
+    int ent[2];
+
+    zone_setup(d, &(struct ddriver_zone_info){0});
+    if (pread(d->ddriver_fd, &hdr, sizeof(hdr), CONFIG_ZONE_TABLE) != sizeof(hdr) || hdr.magic != CONFIG_ZONE_MAGIC ||
+        zone_setup(d, &hdr.info) != 0) {
+        return;
+    }
+    for (int z = 0; z < d->zinfo.nr_zones; z++) {
+        if (!ZONE_IS_SEQ(d, z) || pread(d->ddriver_fd, ent, sizeof(ent), 
+                                     CONFIG_ZONE_TABLE + sizeof(hdr) + z * sizeof(ent)) != sizeof(ent)) {
+            continue;
+        }
+        d->zones[z].wp = ent[0];
+        d->zones[z].cond = ent[1];
+        if (ZONE_IS_OPEN(d, z)) {
+            d->zones[z].cond = d->zones[z].wp == d->zones[z].start ? 
+                                 DDRIVER_ZONE_COND_EMPTY : DDRIVER_ZONE_COND_CLOSED;
+        }
+    }
+}
+/**
+ * @brief 占用一个打开资源。达到上限时关闭一个隐式打开的分区，都是显式打开则失败
+ * 
+ * @param d 
+ * @param z 要打开的分区
+ * @return int 
+ */
+static int zone_get_open(struct ddriver *d, int z) {
+    if (ZONE_IS_OPEN(d, z)) {
+        return 0;
+    }
+    if (d->nr_open >= d->zinfo.max_open) {
+        int victim;
+        for (victim = 0; victim < d->zinfo.nr_zones; victim++) {
+            if (d->zones[victim].cond == DDRIVER_ZONE_COND_IMP_OPEN) {
+                break;
+            }
+        }
+        if (victim == d->zinfo.nr_zones) {
+            return -EBUSY;
+        }
+        d->zones[victim].cond = DDRIVER_ZONE_COND_CLOSED;
+        zone_save(d, victim);
+        d->nr_open--;
+    }
+    d->nr_open++;
+    return 0;
+}
+
+static void zone_put_open(struct ddriver *d, int z) {
+    if (ZONE_IS_OPEN(d, z)) {
+        d->nr_open--;
+    }
+}
+/**
+ * @brief 检查写入位置：顺序写分区只能从写指针处写，且不能跨越分区边界。
+ *        通过检查的写入占用该分区，落盘后由zone_finish_write推进写指针并释放；
+ *        同一分区的下一个写入等前一个落盘后再检查。调用者持有d->lock
+ * 
+ * @param d 
+ * @param offset 
+ * @param size 
+ * @return int 
+ */
+static int zone_check_write(struct ddriver *d, off_t offset, size_t size) {
+    int z;
+
+    if (d->zinfo.zone_sz == 0) {
+        return 0;
+    }
+    z = offset / d->zinfo.zone_sz;
+    if (z >= d->zinfo.nr_zones || !ZONE_IS_SEQ(d, z)) {
+        return 0;
+    }
+    if (offset + (off_t)size > (off_t)d->zones[z].start + d->zones[z].len) {
+        user_alert("write [%ld, +%ld) crosses the end of zone %d", offset, size, z);
+        return -EIO;
+    }
+    while (d->zone_busy[z]) {
+        pthread_cond_wait(&d->zone_idle, &d->lock);
+    }
+    if (d->zones[z].cond == DDRIVER_ZONE_COND_FULL || offset != d->zones[z].wp) {
+        user_alert("unaligned write at %ld, zone %d wp %d", offset, z, d->zones[z].wp);
+        return -EIO;
+    }
+    if (!ZONE_IS_OPEN(d, z)) {
+        if (zone_get_open(d, z) != 0) {
+            user_alert("too many open zones writing zone %d", z);
+            return -EBUSY;
+        }
+        d->zones[z].cond = DDRIVER_ZONE_COND_IMP_OPEN;
+    }
+    d->zone_busy[z] = 1;
+    return 0;
+}
+/**
+ * @brief 通过zone_check_write的写入落盘后推进写指针，写满时关闭分区。调用者持有d->lock
+ * 
+ * @param d 
+ * @param offset 
+ * @param size 
+ * @param ok 数据是否已完整写入，失败时写指针不动
+ */
+static void zone_finish_write(struct ddriver *d, off_t offset, size_t size, int ok) {
+    int z;
+
+    if (d->zinfo.zone_sz == 0) {
+        return;
+    }
+    z = offset / d->zinfo.zone_sz;
+    if (z >= d->zinfo.nr_zones || !ZONE_IS_SEQ(d, z)) {
+        return;
+    }
+    if (ok) {
+        d->zones[z].wp += size;
+        if (d->zones[z].wp == d->zones[z].start + d->zones[z].len) {
+            zone_put_open(d, z);
+            d->zones[z].cond = DDRIVER_ZONE_COND_FULL;
+        }
+        zone_save(d, z);
+    }
+    d->zone_busy[z] = 0;
+    pthread_cond_broadcast(&d->zone_idle);
+}
+/**
+ * @brief 顺序写分区中写指针之后的内容读出为0
+ * 
+ * @param buf 
+ * @param offset 
+ * @param size 
+ */
+static void zone_clip_read(struct ddriver *d, char *buf, off_t offset, size_t size) {
+    off_t cur, end;
+    int z;
+
+    for (cur = offset; d->zinfo.zone_sz != 0 && cur < offset + (off_t)size; cur = end) {
+        z = cur / d->zinfo.zone_sz;
+        end = d->zones[z].start + d->zones[z].len;
+        end = end < offset + (off_t)size ? end : offset + (off_t)size;
+        if (ZONE_IS_SEQ(d, z) && d->zones[z].wp < end) {
+            off_t from = d->zones[z].wp > cur ? d->zones[z].wp : cur;
+            memset(buf + (from - offset), 0, end - from);
+        }
+    }
+}
+/**
+ * @brief 范围内没有顺序写分区写指针之后的部分。那部分须读出为0，不能原地映射
+ * 
+ * @param d 
+ * @param offset 
+ * @param size 
+ * @return int 
+ */
+static int zone_readable(struct ddriver *d, off_t offset, size_t size) {
+    off_t cur, end;
+    int z;
+
+    for (cur = offset; d->zinfo.zone_sz != 0 && cur < offset + (off_t)size; cur = end) {
+        z = cur / d->zinfo.zone_sz;
+        end = d->zones[z].start + d->zones[z].len;
+        end = end < offset + (off_t)size ? end : offset + (off_t)size;
+        if (ZONE_IS_SEQ(d, z) && d->zones[z].wp < end) {
+            return 0;
+        }
+    }
+    return 1;
+}
+/**
+ * @brief 分区管理命令
+ * 
+ * @param d 
+ * @param cmd 
+ * @param arg 
+ * @return int 
+ */
+static int zone_ioctl(struct ddriver *d, unsigned long cmd, void *arg) {
+    struct ddriver_zone_report *rep;
+    int z, first, last, ret;
+
+    if (cmd == IOC_REQ_ZONE_CONFIG) {
+        ret = zone_setup(d, (struct ddriver_zone_info *)arg);
+        if (ret == 0 && d->zinfo.zone_sz != 0) {
+            zone_save_all(d);
+        }
+        else if (ret == 0) {
+            ftruncate(d->ddriver_fd, CONFIG_DISK_SZ);
+        }
+        return ret;
+    }
+    if (d->zinfo.zone_sz == 0) {
+        return -ENOTTY;
+    }
+    if (cmd == IOC_REQ_ZONE_REPORT) {
+        rep = (struct ddriver_zone_report *)arg;
+        if (rep->start_zone < 0) {
+            return -EINVAL;
+        }
+        last = rep->start_zone + rep->nr_zones;
+        last = last < d->zinfo.nr_zones ? last : d->zinfo.nr_zones;
+        rep->nr_zones = last > rep->start_zone ? last - rep->start_zone : 0;
+        memcpy(rep->zones, d->zones + rep->start_zone, rep->nr_zones * sizeof(struct ddriver_zone));
+        return 0;
+    }
+
+    z = *(int *)arg;
+    first = z < 0 ? 0 : z;
+    last = z < 0 ? d->zinfo.nr_zones - 1 : z;
+    if (first >= d->zinfo.nr_zones) {
+        return -EINVAL;
+    }
+    for (z = first; z <= last; z++) {
+        if (!ZONE_IS_SEQ(d, z)) {
+            if (first == last) {
+                return -EINVAL;
+            }
+            continue;
+        }
+        switch (cmd)
+        {
+        case IOC_REQ_ZONE_RESET:
+            zone_put_open(d, z);
+            d->zones[z].wp = d->zones[z].start;
+            d->zones[z].cond = DDRIVER_ZONE_COND_EMPTY;
+            break;
+        case IOC_REQ_ZONE_OPEN:
+            if (d->zones[z].cond == DDRIVER_ZONE_COND_FULL || zone_get_open(d, z) != 0) {
+                return d->zones[z].cond == DDRIVER_ZONE_COND_FULL ? -EINVAL : -EBUSY;
+            }
+            d->zones[z].cond = DDRIVER_ZONE_COND_EXP_OPEN;
+            break;
+        case IOC_REQ_ZONE_CLOSE:
+            if (ZONE_IS_OPEN(d, z)) {
+                zone_put_open(d, z);
+                d->zones[z].cond = d->zones[z].wp == d->zones[z].start ? 
+                                     DDRIVER_ZONE_COND_EMPTY : DDRIVER_ZONE_COND_CLOSED;
+            }
+            break;
+        case IOC_REQ_ZONE_FINISH:
+            zone_put_open(d, z);
+            d->zones[z].wp = d->zones[z].start + d->zones[z].len;
+            d->zones[z].cond = DDRIVER_ZONE_COND_FULL;
+            break;
+        default:
+            return -ENOTTY;
+        }
+        zone_save(d, z);
+    }
     return 0;
 }
 /******************************************************************************
 * SECTION: Global Function Implementation
 *******************************************************************************/
 /**
- * @brief 打开驱动
+ * @brief 打开驱动。每次打开建立独立的设备对象，磁头、计数与分区状态互不影响，
+ *        可同时打开多个后备文件模拟多块磁盘
  * 
- * @return int 文件描述符
+ * @param path 后备文件路径，NULL表示$HOME/ddriver
+ * @return int 文件描述符，即后续调用使用的设备句柄
  */
 int ddriver_open(char *path) {
-    int fd, ret = 0;
+    struct ddriver *d;
+    int fd, slot, ret = 0;
     char device_path[128] = {0};
     char log_path[128] = {0};
     
     sprintf(device_path, "%s/" DEVICE_NAME, getpwuid(getuid())->pw_dir);
     sprintf(log_path, "%s/" DEVICE_LOG, getpwuid(getuid())->pw_dir);
-    
-    if (strcmp(device_path, path) != 0) {
-        user_panic("wrong path [%s], should be [%s]", path, device_path);
-        return -1;
+    if (path == NULL) {
+        path = device_path;
     }
 
-    if (access(device_path, F_OK) == 0) {
-        fd = open(device_path, O_RDWR);
+    if (access(path, F_OK) == 0) {
+        fd = open(path, O_RDWR);
     }
     else {
-        fd = open(device_path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+        fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0644);
     }
     if (fd < 0) {
-        user_panic("can't open device: %d", fd);
+        user_panic("can't open device [%s]: %d", path, fd);
         return fd;
     }
     ret = posix_fallocate(fd, 0, CONFIG_DISK_SZ);
     if (ret < 0) {
         user_panic("low space");
+        close(fd);
         return ret;
     }
 
-    debugf = fopen(log_path, "w+");
-    if (debugf == NULL) {
-        user_panic("can't init log: %s", log_path);
-        return -1;
+    d = (struct ddriver *)malloc(sizeof(struct ddriver));
+    if (d == NULL) {
+        close(fd);
+        return -ENOMEM;
     }
+    *d = disk_template;
+    d->ddriver_fd = fd;
+    d->map = mmap(NULL, d->layout_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (d->map == MAP_FAILED) {
+        user_panic("can't map device [%s], falling back to pread/pwrite", path);
+        d->map = NULL;
+    }
+    pthread_mutex_init(&d->lock, NULL);
+    pthread_cond_init(&d->slot, NULL);
+    pthread_cond_init(&d->zone_idle, NULL);
+    zone_load(d);
 
+    pthread_mutex_lock(&devs_lock);
+    for (slot = 0; slot < CONFIG_MAX_DEVS && devs[slot] != NULL; slot++)
+        ;
+    if (slot < CONFIG_MAX_DEVS && debugf == NULL) {
+        debugf = fopen(log_path, "w+");
+        if (debugf == NULL) {
+            user_panic("can't init log: %s", log_path);
+            slot = CONFIG_MAX_DEVS;
+        }
+    }
+    if (slot < CONFIG_MAX_DEVS) {
+        devs[slot] = d;
+    }
+    pthread_mutex_unlock(&devs_lock);
+    if (slot == CONFIG_MAX_DEVS) {
+        user_panic("can't open more than %d devices", CONFIG_MAX_DEVS);
+        zone_setup(d, &(struct ddriver_zone_info){0});
+        pthread_cond_destroy(&d->slot);
+        pthread_cond_destroy(&d->zone_idle);
+        pthread_mutex_destroy(&d->lock);
+        if (d->map != NULL) {
+            munmap(d->map, d->layout_size);
+        }
+        free(d);
+        close(fd);
+        return -1;
+    }
     return fd;
 }
 /**
- * @brief 关闭驱动
+ * @brief 关闭驱动，最后一个设备关闭时关闭日志。未经ddriver_commit提交的写入留在页缓存中，由内核择时写回
  * 
  * @param fd 
  * @return int 
  */
 int ddriver_close(int fd) {
-    return close(fd) && fclose(debugf);
+    struct ddriver *d = ddriver_get(fd);
+    int remain = 0;
+
+    if (d == NULL) {
+        return -EBADF;
+    }
+    pthread_mutex_lock(&devs_lock);
+    for (int i = 0; i < CONFIG_MAX_DEVS; i++) {
+        if (devs[i] == d) {
+            devs[i] = NULL;
+        }
+        remain += devs[i] != NULL;
+    }
+    if (remain == 0 && debugf != NULL) {
+        fclose(debugf);
+        debugf = NULL;
+    }
+    pthread_mutex_unlock(&devs_lock);
+
+    zone_setup(d, &(struct ddriver_zone_info){0});
+    pthread_cond_destroy(&d->slot);
+    pthread_cond_destroy(&d->zone_idle);
+    pthread_mutex_destroy(&d->lock);
+    if (d->map != NULL) {
+        munmap(d->map, d->layout_size);
+    }
+    free(d);
+    return close(fd);
 }
 /**
  * @brief 磁盘头SEEK
@@ -179,23 +857,31 @@ int ddriver_close(int fd) {
  * @return int 
  */
 int ddriver_seek(int fd, off_t offset, int whence){
+    struct ddriver *d = ddriver_get(fd);
     int ret = 0;
     int cur = 0;
 
+    if (d == NULL) {
+        return -EBADF;
+    }
     if (!IS_ADDR_ALIGN(offset)) {
         user_alert("offset %ld must be aligned to block size %d", 
                       offset, CONFIG_BLOCK_SZ);
         return -EINVAL;
     }
 
-    INC_SEEKCNT(disk);
     cur = lseek(fd, 0, SEEK_CUR);
     ret = lseek(fd, offset, whence);
     if (ret < 0) {
         user_panic("seek error: %s", strerror(errno));
         return ret;
     }
-    emulate_rotate(fd, cur, ret);
+    pthread_mutex_lock(&d->lock);
+    INC_SEEKCNT(d);
+    sched_account_seek(d, cur, ret);
+    d->head = ret;
+    pthread_mutex_unlock(&d->lock);
+    emulate_rotate(d, cur, ret);
     return ret;
 }
 /**
@@ -207,14 +893,34 @@ int ddriver_seek(int fd, off_t offset, int whence){
  * @return int 
  */
 int ddriver_write(int fd, char *buf, size_t size){
-    int res = check_valid(size);
+    struct ddriver *d = ddriver_get(fd);
+    off_t pos;
+    int res;
+
+    if (d == NULL) {
+        return -EBADF;
+    }
+    res = check_valid(size);
     if(res < 0)
         return res;
+
+    pos = lseek(fd, 0, SEEK_CUR);
+    pthread_mutex_lock(&d->lock);
+    res = zone_check_write(d, pos, size);
+    if (res == 0)
+        queue_enter(d, d->head, size, 1);
+    pthread_mutex_unlock(&d->lock);
+    if (res < 0)
+        return res;
         
-    RW_DELAY(disk, write);
-    write(fd, buf, size);
+    RW_DELAY(d, write);
+    res = write(fd, buf, size);
+    pthread_mutex_lock(&d->lock);
+    queue_leave(d);
+    zone_finish_write(d, pos, size, res == (int)size);
+    INC_WRITECNT(d);
+    pthread_mutex_unlock(&d->lock);
 
-    INC_WRITECNT(disk);
     return CONFIG_BLOCK_SZ;
 }
 /**
@@ -226,16 +932,208 @@ int ddriver_write(int fd, char *buf, size_t size){
  * @return int 
  */
 int ddriver_read(int fd, char *buf, size_t size){
-    int res = check_valid(size);
+    struct ddriver *d = ddriver_get(fd);
+    off_t pos;
+    int res;
+
+    if (d == NULL) {
+        return -EBADF;
+    }
+    res = check_valid(size);
     if(res < 0)
         return res;
 
-    RW_DELAY(disk, read);
+    pthread_mutex_lock(&d->lock);
+    pos = d->head;
+    queue_enter(d, pos, size, 0);
+    pthread_mutex_unlock(&d->lock);
+    RW_DELAY(d, read);
     read(fd, buf, size);
+    pthread_mutex_lock(&d->lock);
+    zone_clip_read(d, buf, pos, size);
+    queue_leave(d);
+    INC_READCNT(d);
+    pthread_mutex_unlock(&d->lock);
 
-    INC_READCNT(disk);
     return CONFIG_BLOCK_SZ;
 }
+/**
+ * @brief 定位读，不依赖也不改变文件偏移，可由多个线程并发调用。
+ *        磁头从当前位置移动到offset计入寻道，每个IO单位计入一次读延迟；
+ *        延迟在锁外等待，至多queue_depth个命令同时等待，模拟可同时接受多个命令的设备；
+ *        其余命令排队，按调度策略决定服务顺序。数据经共享映射拷贝，不再逐次系统调用
+ * 
+ * @param fd 
+ * @param buf 
+ * @param size IO单位的整数倍
+ * @param offset 与IO单位对齐
+ * @return int 读出的字节数
+ */
+int ddriver_pread(int fd, char *buf, size_t size, off_t offset){
+    struct ddriver *d = ddriver_get(fd);
+    off_t cur;
+    int units = size / CONFIG_BLOCK_SZ;
+    int ret;
+
+    if (d == NULL) {
+        return -EBADF;
+    }
+    if (!IS_ADDR_ALIGN(offset) || !IS_SIZE_ALIGN(size)) {
+        user_alert("pread offset %ld size %ld must be aligned to %d", 
+                      offset, size, CONFIG_BLOCK_SZ);
+        return -EINVAL;
+    }
+    if (offset + (off_t)size > d->layout_size) {
+        user_alert("pread offset %ld size %ld beyond device size %d", offset, size, d->layout_size);
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&d->lock);
+    cur = queue_enter(d, offset, size, 0);
+    if (cur != offset) {
+        INC_SEEKCNT(d);
+    }
+    d->read_cnt += units;
+    pthread_mutex_unlock(&d->lock);
+
+    emulate_rotate(d, cur, offset);
+    usleep(d->read_lat * units);
+    if (d->map != NULL) {
+        memcpy(buf, d->map + offset, size);
+        ret = size;
+    } else {
+        ret = pread(fd, buf, size, offset);
+    }
+    pthread_mutex_lock(&d->lock);
+    zone_clip_read(d, buf, offset, size);
+    queue_leave(d);
+    pthread_mutex_unlock(&d->lock);
+    return ret;
+}
+/**
+ * @brief 定位写，语义与ddriver_pread对称
+ * 
+ * @param fd 
+ * @param buf 
+ * @param size IO单位的整数倍
+ * @param offset 与IO单位对齐
+ * @return int 写入的字节数
+ */
+int ddriver_pwrite(int fd, char *buf, size_t size, off_t offset){
+    struct ddriver *d = ddriver_get(fd);
+    off_t cur;
+    int units = size / CONFIG_BLOCK_SZ;
+    int ret;
+
+    if (d == NULL) {
+        return -EBADF;
+    }
+    if (!IS_ADDR_ALIGN(offset) || !IS_SIZE_ALIGN(size)) {
+        user_alert("pwrite offset %ld size %ld must be aligned to %d", 
+                      offset, size, CONFIG_BLOCK_SZ);
+        return -EINVAL;
+    }
+    if (offset + (off_t)size > d->layout_size) {
+        user_alert("pwrite offset %ld size %ld beyond device size %d", offset, size, d->layout_size);
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&d->lock);
+    if (zone_check_write(d, offset, size) < 0) {
+        pthread_mutex_unlock(&d->lock);
+        return -EIO;
+    }
+    cur = queue_enter(d, offset, size, 1);
+    if (cur != offset) {
+        INC_SEEKCNT(d);
+    }
+    d->write_cnt += units;
+    pthread_mutex_unlock(&d->lock);
+
+    emulate_rotate(d, cur, offset);
+    usleep(d->write_lat * units);
+    if (d->map != NULL) {
+        memcpy(d->map + offset, buf, size);
+        ret = size;
+    } else {
+        ret = pwrite(fd, buf, size, offset);
+    }
+    pthread_mutex_lock(&d->lock);
+    queue_leave(d);
+    zone_finish_write(d, offset, size, ret == (int)size);
+    pthread_mutex_unlock(&d->lock);
+    return ret;
+}
+/**
+ * @brief 原地读：不拷贝数据，返回设备内容的只读指针。寻道、读延迟与队列槽的占用同ddriver_pread，
+ *        返回时模拟的读取已经完成。指针在设备关闭前有效，其内容随之后的写入变化
+ * 
+ * @param fd 
+ * @param offset 与IO单位对齐
+ * @param size IO单位的整数倍
+ * @return const char* 失败返回NULL并设置errno。设备未能映射为ENODEV，
+ *         范围越过顺序写分区的写指针为ENODATA，调用者应改用ddriver_pread
+ */
+const char *ddriver_map(int fd, off_t offset, size_t size){
+    struct ddriver *d = ddriver_get(fd);
+    off_t cur;
+    int units = size / CONFIG_BLOCK_SZ;
+
+    if (d == NULL || d->map == NULL) {
+        errno = d == NULL ? EBADF : ENODEV;
+        return NULL;
+    }
+    if (!IS_ADDR_ALIGN(offset) || !IS_SIZE_ALIGN(size) || offset + (off_t)size > d->layout_size) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    pthread_mutex_lock(&d->lock);
+    if (!zone_readable(d, offset, size)) {
+        pthread_mutex_unlock(&d->lock);
+        errno = ENODATA;
+        return NULL;
+    }
+    cur = queue_enter(d, offset, size, 0);
+    if (cur != offset) {
+        INC_SEEKCNT(d);
+    }
+    d->read_cnt += units;
+    pthread_mutex_unlock(&d->lock);
+
+    emulate_rotate(d, cur, offset);
+    usleep(d->read_lat * units);
+    pthread_mutex_lock(&d->lock);
+    queue_leave(d);
+    pthread_mutex_unlock(&d->lock);
+    return d->map + offset;
+}
+/**
+ * @brief 提交一段范围：ddriver_pwrite写入共享映射后数据只在页缓存中，以msync同步写到后备文件。
+ *        真实的刷写不计入模拟延迟，基准测试结果与未提交时可比
+ * 
+ * @param fd 
+ * @param offset 
+ * @param size 
+ * @return int 0成功，否则失败
+ */
+int ddriver_commit(int fd, off_t offset, size_t size){
+    struct ddriver *d = ddriver_get(fd);
+    long page = sysconf(_SC_PAGESIZE);
+    off_t start;
+
+    if (d == NULL) {
+        return -EBADF;
+    }
+    if (offset < 0 || offset + (off_t)size > d->layout_size) {
+        return -EINVAL;
+    }
+    if (d->map == NULL) {
+        return fdatasync(fd) == 0 ? 0 : -errno;
+    }
+    start = offset / page * page;
+    return msync(d->map + start, offset + size - start, MS_SYNC) == 0 ? 0 : -errno;
+}
 /**
  * @brief 
  * 
@@ -245,16 +1143,27 @@ int ddriver_read(int fd, char *buf, size_t size){
  * @return int 
  */
 int ddriver_ioctl(int fd, unsigned long cmd, void *arg){
+    struct ddriver *d = ddriver_get(fd);
     struct ddriver_state state;
+    struct ddriver_head head;
+    struct ddriver_lat lat;
+    struct ddriver_sched_stats stats;
+    int depth;
+    int policy;
+    int ret;
+
+    if (d == NULL) {
+        return -EBADF;
+    }
     switch (cmd)
     {
     case IOC_REQ_DEVICE_SIZE:                         /* Device Size */
-        memcpy(arg, &disk.layout_size, sizeof(int));
+        memcpy(arg, &d->layout_size, sizeof(int));
         break;
     case IOC_REQ_DEVICE_STATE:                        /* Device State */
-        state.read_cnt = disk.read_cnt;
-        state.write_cnt = disk.write_cnt;
-        state.seek_cnt = disk.seek_cnt;
+        state.read_cnt = d->read_cnt;
+        state.write_cnt = d->write_cnt;
+        state.seek_cnt = d->seek_cnt;
         memcpy(arg, &state, sizeof(struct ddriver_state));
         break;
     case IOC_REQ_DEVICE_RESET:                        /* Reset Device */
@@ -265,15 +1174,371 @@ int ddriver_ioctl(int fd, unsigned long cmd, void *arg){
             write(fd, buf, 4096);
         }
         lseek(fd, 0, SEEK_SET);
-        disk.read_cnt = 0;
-        disk.write_cnt = 0;
-        disk.seek_cnt = 0;
+        d->head = 0;
+        d->read_cnt = 0;
+        d->write_cnt = 0;
+        d->seek_cnt = 0;
+        pthread_mutex_lock(&d->lock);
+        memset(d->stats, 0, sizeof(d->stats));
+        pthread_mutex_unlock(&d->lock);
+        if (d->zinfo.zone_sz != 0) {
+            int all = -1;
+            pthread_mutex_lock(&d->lock);
+            zone_ioctl(d, IOC_REQ_ZONE_RESET, &all);
+            pthread_mutex_unlock(&d->lock);
+        }
         break;
     case IOC_REQ_DEVICE_IO_SZ:
-        memcpy(arg, &disk.iounit_size, sizeof(int));
+        memcpy(arg, &d->iounit_size, sizeof(int));
+        break;
+    case IOC_REQ_ZONE_INFO:                           /* Zone geometry, zone_sz 0 if not zoned */
+        memcpy(arg, &d->zinfo, sizeof(struct ddriver_zone_info));
+        break;
+    case IOC_REQ_DEVICE_HEAD:                         /* Head position, as seen by emulate_rotate */
+        pthread_mutex_lock(&d->lock);
+        head.pos = d->head;
+        pthread_mutex_unlock(&d->lock);
+        head.track_sz = d->layout_size / d->track_num;
+        memcpy(arg, &head, sizeof(struct ddriver_head));
+        break;
+    case IOC_REQ_DEVICE_LAT:                          /* Latency profile, e.g. a fast tier */
+        memcpy(&lat, arg, sizeof(struct ddriver_lat));
+        if (lat.read_us < 0 || lat.write_us < 0 || lat.seek_us < 0) {
+            return -EINVAL;
+        }
+        d->read_lat = lat.read_us;
+        d->write_lat = lat.write_us;
+        d->seek_lat = lat.seek_us;
+        break;
+    case IOC_REQ_QUEUE_DEPTH:                         /* Commands served at once, the rest wait for a slot */
+        memcpy(&depth, arg, sizeof(int));
+        if (depth < 1 || depth > CONFIG_MAX_QD) {
+            return -EINVAL;
+        }
+        pthread_mutex_lock(&d->lock);
+        d->queue_depth = depth;
+        sched_dispatch(d);
+        pthread_mutex_unlock(&d->lock);
+        break;
+    case IOC_REQ_SCHED_POLICY:                        /* Order in which waiting commands are served */
+        memcpy(&policy, arg, sizeof(int));
+        if (policy < 0 || policy >= DDRIVER_SCHED_NR) {
+            return -EINVAL;
+        }
+        pthread_mutex_lock(&d->lock);
+        d->sched = policy;
+        d->starved = 0;
+        pthread_mutex_unlock(&d->lock);
+        break;
+    case IOC_REQ_SCHED_STATS:                         /* Counters of one policy, kept apart per policy */
+        memcpy(&policy, arg, sizeof(int));
+        if (policy < 0 || policy >= DDRIVER_SCHED_NR) {
+            return -EINVAL;
+        }
+        pthread_mutex_lock(&d->lock);
+        stats = d->stats[policy];
+        pthread_mutex_unlock(&d->lock);
+        stats.policy = policy;
+        memcpy(arg, &stats, sizeof(struct ddriver_sched_stats));
         break;
+    case IOC_REQ_ZONE_CONFIG:
+    case IOC_REQ_ZONE_REPORT:
+    case IOC_REQ_ZONE_RESET:
+    case IOC_REQ_ZONE_OPEN:
+    case IOC_REQ_ZONE_CLOSE:
+    case IOC_REQ_ZONE_FINISH:
+        pthread_mutex_lock(&d->lock);
+        ret = zone_ioctl(d, cmd, arg);
+        pthread_mutex_unlock(&d->lock);
+        return ret;
     default:
         break;
     }
     return 0;
-}
\ No newline at end of file
+}
+/******************************************************************************
+* SECTION: Async submission/completion queues
+*******************************************************************************/
+static struct ddriver_ring *ring_get(int ring) {
+    struct ddriver_ring *r = NULL;
+
+    pthread_mutex_lock(&devs_lock);
+    if (ring >= 0 && ring < CONFIG_MAX_RINGS) {
+        r = rings[ring];
+    }
+    pthread_mutex_unlock(&devs_lock);
+    return r;
+}
+/**
+ * @brief 队列服务线程：取出已提交的请求，以定位读写执行，完成后放入完成队列。
+ *        多个服务线程同时在设备延迟中等待，延迟因而重叠，重叠程度受设备队列深度限制
+ * 
+ * @param arg 
+ * @return void* 
+ */
+static void *ring_worker(void *arg) {
+    struct ddriver_ring *r = (struct ddriver_ring *)arg;
+    struct ddriver_sqe sqe;
+    struct ddriver_cqe cqe;
+    unsigned int cq_entries = 2 * r->entries;
+    uint64_t one = 1;
+
+    pthread_mutex_lock(&r->lock);
+    while (1) {
+        while (r->sq_head == r->sq_tail && !r->stop) {
+            pthread_cond_wait(&r->sq_cond, &r->lock);
+        }
+        if (r->sq_head == r->sq_tail) {
+            break;
+        }
+        sqe = r->sqes[r->sq_head % r->entries];
+        r->sq_head++;
+        pthread_mutex_unlock(&r->lock);
+
+        cqe.user_data = sqe.user_data;
+        if (sqe.opcode == DDRIVER_OP_READ) {
+            cqe.res = ddriver_pread(sqe.fd, sqe.buf, sqe.size, sqe.offset);
+        }
+        else if (sqe.opcode == DDRIVER_OP_WRITE) {
+            cqe.res = ddriver_pwrite(sqe.fd, sqe.buf, sqe.size, sqe.offset);
+        }
+        else {
+            cqe.res = -EINVAL;
+        }
+
+        pthread_mutex_lock(&r->lock);
+        while (r->cq_tail - r->cq_head == cq_entries && !r->stop) {
+            pthread_cond_wait(&r->cq_space, &r->lock);
+        }
+        if (r->cq_tail - r->cq_head < cq_entries) {
+            r->cqes[r->cq_tail % cq_entries] = cqe;
+            r->cq_tail++;
+            pthread_cond_signal(&r->cq_cond);
+            if (r->efd >= 0) {
+                write(r->efd, &one, sizeof(one));
+            }
+        }
+    }
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+static void ring_free(struct ddriver_ring *r) {
+    if (r->efd >= 0) {
+        close(r->efd);
+    }
+    pthread_cond_destroy(&r->cq_space);
+    pthread_cond_destroy(&r->cq_cond);
+    pthread_cond_destroy(&r->sq_cond);
+    pthread_mutex_destroy(&r->lock);
+    free(r->workers);
+    free(r->cqes);
+    free(r->sqes);
+    free(r);
+}
+
+static void ring_stop(struct ddriver_ring *r) {
+    pthread_mutex_lock(&r->lock);
+    r->stop = 1;
+    pthread_cond_broadcast(&r->sq_cond);
+    pthread_cond_broadcast(&r->cq_space);
+    pthread_mutex_unlock(&r->lock);
+    for (int i = 0; i < r->nr_workers; i++) {
+        pthread_join(r->workers[i], NULL);
+    }
+}
+/**
+ * @brief 建立一对提交/完成队列，容量向上取为2的幂，服务线程数为容量与CONFIG_MAX_QD中的较小者
+ * 
+ * @param entries 
+ * @param flags DDRIVER_QUEUE_EVENTFD
+ * @return int 队列句柄
+ */
+int ddriver_queue_init(int entries, int flags) {
+    struct ddriver_ring *r;
+    int ring, size = 1;
+
+    if (entries < 1 || entries > CONFIG_MAX_ENTRIES || (flags & ~DDRIVER_QUEUE_EVENTFD) != 0) {
+        return -EINVAL;
+    }
+    while (size < entries) {
+        size <<= 1;
+    }
+    r = (struct ddriver_ring *)calloc(1, sizeof(struct ddriver_ring));
+    if (r == NULL) {
+        return -ENOMEM;
+    }
+    r->entries = size;
+    r->nr_workers = size < CONFIG_MAX_QD ? size : CONFIG_MAX_QD;
+    r->sqes = (struct ddriver_sqe *)calloc(size, sizeof(struct ddriver_sqe));
+    r->cqes = (struct ddriver_cqe *)calloc(2 * size, sizeof(struct ddriver_cqe));
+    r->workers = (pthread_t *)calloc(r->nr_workers, sizeof(pthread_t));
+    r->efd = (flags & DDRIVER_QUEUE_EVENTFD) ? eventfd(0, EFD_CLOEXEC) : -1;
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->sq_cond, NULL);
+    pthread_cond_init(&r->cq_cond, NULL);
+    pthread_cond_init(&r->cq_space, NULL);
+    if (r->sqes == NULL || r->cqes == NULL || r->workers == NULL || 
+        ((flags & DDRIVER_QUEUE_EVENTFD) && r->efd < 0)) {
+        ring_free(r);
+        return -ENOMEM;
+    }
+
+    for (int i = 0; i < r->nr_workers; i++) {
+        if (pthread_create(&r->workers[i], NULL, ring_worker, r) != 0) {
+            r->nr_workers = i;
+            ring_stop(r);
+            ring_free(r);
+            return -EAGAIN;
+        }
+    }
+
+    pthread_mutex_lock(&devs_lock);
+    for (ring = 0; ring < CONFIG_MAX_RINGS && rings[ring] != NULL; ring++)
+        ;
+    if (ring < CONFIG_MAX_RINGS) {
+        rings[ring] = r;
+    }
+    pthread_mutex_unlock(&devs_lock);
+    if (ring == CONFIG_MAX_RINGS) {
+        user_panic("can't create more than %d queues", CONFIG_MAX_RINGS);
+        ring_stop(r);
+        ring_free(r);
+        return -EMFILE;
+    }
+    return ring;
+}
+/**
+ * @brief 取一个空闲的提交项，内容清零
+ * 
+ * @param ring 
+ * @return struct ddriver_sqe* 提交队列已满返回NULL
+ */
+struct ddriver_sqe *ddriver_get_sqe(int ring) {
+    struct ddriver_ring *r = ring_get(ring);
+    struct ddriver_sqe *sqe = NULL;
+
+    if (r == NULL) {
+        return NULL;
+    }
+    pthread_mutex_lock(&r->lock);
+    if (r->sq_local - r->sq_head < (unsigned int)r->entries) {
+        sqe = &r->sqes[r->sq_local % r->entries];
+        memset(sqe, 0, sizeof(struct ddriver_sqe));
+        r->sq_local++;
+    }
+    pthread_mutex_unlock(&r->lock);
+    return sqe;
+}
+/**
+ * @brief 提交取得的全部提交项，唤醒服务线程后立即返回
+ * 
+ * @param ring 
+ * @return int 提交数
+ */
+int ddriver_submit(int ring) {
+    struct ddriver_ring *r = ring_get(ring);
+    int n;
+
+    if (r == NULL) {
+        return -EBADF;
+    }
+    pthread_mutex_lock(&r->lock);
+    n = r->sq_local - r->sq_tail;
+    r->sq_tail = r->sq_local;
+    r->pending += n;
+    if (n > 0) {
+        pthread_cond_broadcast(&r->sq_cond);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return n;
+}
+
+static void ring_reap(struct ddriver_ring *r, struct ddriver_cqe *cqe) {
+    *cqe = r->cqes[r->cq_head % (2 * r->entries)];
+    r->cq_head++;
+    r->pending--;
+    pthread_cond_signal(&r->cq_space);
+}
+/**
+ * @brief 轮询完成事件
+ * 
+ * @param ring 
+ * @param cqe 
+ * @return int 没有完成事件返回-EAGAIN
+ */
+int ddriver_peek_cqe(int ring, struct ddriver_cqe *cqe) {
+    struct ddriver_ring *r = ring_get(ring);
+    int ret = 0;
+
+    if (r == NULL) {
+        return -EBADF;
+    }
+    pthread_mutex_lock(&r->lock);
+    if (r->cq_head == r->cq_tail) {
+        ret = -EAGAIN;
+    }
+    else {
+        ring_reap(r, cqe);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return ret;
+}
+/**
+ * @brief 等待完成事件
+ * 
+ * @param ring 
+ * @param cqe 
+ * @return int 没有已提交未收取的请求时返回-EAGAIN，避免永远等待
+ */
+int ddriver_wait_cqe(int ring, struct ddriver_cqe *cqe) {
+    struct ddriver_ring *r = ring_get(ring);
+
+    if (r == NULL) {
+        return -EBADF;
+    }
+    pthread_mutex_lock(&r->lock);
+    if (r->pending == 0) {
+        pthread_mutex_unlock(&r->lock);
+        return -EAGAIN;
+    }
+    while (r->cq_head == r->cq_tail) {
+        pthread_cond_wait(&r->cq_cond, &r->lock);
+    }
+    ring_reap(r, cqe);
+    pthread_mutex_unlock(&r->lock);
+    return 0;
+}
+/**
+ * @brief 完成通知用的eventfd，计数为尚未读走的完成事件数
+ * 
+ * @param ring 
+ * @return int 
+ */
+int ddriver_queue_eventfd(int ring) {
+    struct ddriver_ring *r = ring_get(ring);
+
+    if (r == NULL) {
+        return -EBADF;
+    }
+    return r->efd >= 0 ? r->efd : -EINVAL;
+}
+/**
+ * @brief 执行完已提交的请求后释放队列，尚未提交的提交项被丢弃
+ * 
+ * @param ring 
+ * @return int 
+ */
+int ddriver_queue_exit(int ring) {
+    struct ddriver_ring *r = ring_get(ring);
+
+    if (r == NULL) {
+        return -EBADF;
+    }
+    pthread_mutex_lock(&devs_lock);
+    rings[ring] = NULL;
+    pthread_mutex_unlock(&devs_lock);
+    ring_stop(r);
+    ring_free(r);
+    return 0;
+}
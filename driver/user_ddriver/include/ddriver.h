@@ -8,7 +8,18 @@ int ddriver_open(char *path);
 int ddriver_seek(int fd, off_t offset, int whence);
 int ddriver_write(int fd, char *buf, size_t size);
 int ddriver_read(int fd, char *buf, size_t size);
+int ddriver_pread(int fd, char *buf, size_t size, off_t offset);
+int ddriver_pwrite(int fd, char *buf, size_t size, off_t offset);
+const char *ddriver_map(int fd, off_t offset, size_t size);
+int ddriver_commit(int fd, off_t offset, size_t size);
 int ddriver_ioctl(int fd, unsigned long cmd, void *ret);
 int ddriver_close(int fd);
+int ddriver_queue_init(int entries, int flags);
+struct ddriver_sqe *ddriver_get_sqe(int ring);
+int ddriver_submit(int ring);
+int ddriver_peek_cqe(int ring, struct ddriver_cqe *cqe);
+int ddriver_wait_cqe(int ring, struct ddriver_cqe *cqe);
+int ddriver_queue_eventfd(int ring);
+int ddriver_queue_exit(int ring);
 
 #endif /* _DDRIVER_H_ */
\ No newline at end of file
@@ -1,7 +1,8 @@
 #ifndef _DDRIVER_CTL_H_ 
 #define _DDRIVER_CTL_H_
 
-#include <sys/ioctl.h>   
+#include <sys/ioctl.h>
+#include <sys/types.h>   
 /******************************************************************************
 * SECTION: IO ctl protocol definitions
 *******************************************************************************/
@@ -13,9 +14,108 @@ struct ddriver_state
     int seek_cnt;
 };
 
+#define DDRIVER_ZONE_TYPE_CONV  1
+#define DDRIVER_ZONE_TYPE_SEQ   2
+
+#define DDRIVER_ZONE_COND_NOT_WP    0
+#define DDRIVER_ZONE_COND_EMPTY     1
+#define DDRIVER_ZONE_COND_IMP_OPEN  2
+#define DDRIVER_ZONE_COND_EXP_OPEN  3
+#define DDRIVER_ZONE_COND_CLOSED    4
+#define DDRIVER_ZONE_COND_FULL      5
+
+struct ddriver_zone_info
+{
+    int zone_sz;
+    int nr_zones;
+    int nr_conv;
+    int max_open;
+};
+
+struct ddriver_zone
+{
+    int start;
+    int len;
+    int wp;
+    int type;
+    int cond;
+};
+
+struct ddriver_zone_report
+{
+    int start_zone;
+    int nr_zones;
+    struct ddriver_zone zones[];
+};
+
+struct ddriver_head
+{
+    int pos;
+    int track_sz;
+};
+
+struct ddriver_lat
+{
+    int read_us;
+    int write_us;
+    int seek_us;
+};
+
+#define DDRIVER_SCHED_FIFO      0
+#define DDRIVER_SCHED_CLOOK     1
+#define DDRIVER_SCHED_DEADLINE  2
+#define DDRIVER_SCHED_NR        3
+
+struct ddriver_sched_stats
+{
+    int policy;
+    int dispatched;
+    int queued;
+    int expired;
+    long long seek_bytes;
+    long long seek_us;
+    long long wait_us;
+    long long max_wait_us;
+};
+
 #define IOC_REQ_DEVICE_SIZE     _IOR(IOC_MAGIC, 0, int)
 #define IOC_REQ_DEVICE_STATE    _IOR(IOC_MAGIC, 1, struct ddriver_state)
 #define IOC_REQ_DEVICE_RESET    _IO(IOC_MAGIC, 2)
 #define IOC_REQ_DEVICE_IO_SZ    _IOR(IOC_MAGIC, 3, int)
+#define IOC_REQ_ZONE_INFO       _IOR(IOC_MAGIC, 4, struct ddriver_zone_info)
+#define IOC_REQ_ZONE_CONFIG     _IOW(IOC_MAGIC, 5, struct ddriver_zone_info)
+#define IOC_REQ_ZONE_REPORT     _IOWR(IOC_MAGIC, 6, struct ddriver_zone_report)
+#define IOC_REQ_ZONE_RESET      _IOW(IOC_MAGIC, 7, int)
+#define IOC_REQ_ZONE_OPEN       _IOW(IOC_MAGIC, 8, int)
+#define IOC_REQ_ZONE_CLOSE      _IOW(IOC_MAGIC, 9, int)
+#define IOC_REQ_ZONE_FINISH     _IOW(IOC_MAGIC, 10, int)
+#define IOC_REQ_DEVICE_HEAD     _IOR(IOC_MAGIC, 11, struct ddriver_head)
+#define IOC_REQ_DEVICE_LAT      _IOW(IOC_MAGIC, 12, struct ddriver_lat)
+#define IOC_REQ_QUEUE_DEPTH     _IOW(IOC_MAGIC, 13, int)
+#define IOC_REQ_SCHED_POLICY    _IOW(IOC_MAGIC, 14, int)
+#define IOC_REQ_SCHED_STATS     _IOWR(IOC_MAGIC, 15, struct ddriver_sched_stats)
+/******************************************************************************
+* SECTION: Async queue definitions
+*******************************************************************************/
+#define DDRIVER_OP_READ         0
+#define DDRIVER_OP_WRITE        1
+
+#define DDRIVER_QUEUE_EVENTFD   0x1
+
+struct ddriver_sqe
+{
+    int opcode;
+    int fd;
+    char *buf;
+    size_t size;
+    off_t offset;
+    unsigned long user_data;
+};
+
+struct ddriver_cqe
+{
+    unsigned long user_data;
+    int res;
+};
 
 #endif
\ No newline at end of file
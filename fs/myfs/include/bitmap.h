@@ -35,6 +35,11 @@ Set the bit at `bitno` of bitmap, i.e, set it to 1. If `bitno` is greater than s
 */
 int set_bit(uint8_t **bitmap, uint64_t bitno);
 
+/*
+Test the bit at `bitno` of bitmap, return 1 if it is set, otherwise 0. If `bitno` is greater than size of the bitmap, undefined behaviour occurs.
+*/
+int test_bit(uint8_t *bitmap, uint64_t bitno);
+
 /*
 Get the first bit of `bitmap` that is set to 1.
 */
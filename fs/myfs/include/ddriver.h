@@ -5,10 +5,10 @@
 #include "stdio.h"
 
 /**
- * @brief 打开ddriver设备
+ * @brief 打开ddriver设备，可同时打开多个后备文件，各自独立模拟
  * 
- * @param path ddriver设备路径
- * @return int 0成功，否则失败
+ * @param path ddriver设备路径，NULL时为$HOME/ddriver
+ * @return int 成功返回设备句柄，否则返回负数
  */
 int ddriver_open(char *path);
 
@@ -42,6 +42,48 @@ int ddriver_write(int fd, char *buf, size_t size);
  */
 int ddriver_read(int fd, char *buf, size_t size);
 
+/**
+ * @brief 定位读，不改变磁头以外的设备状态，可由多个线程并发调用
+ * 
+ * @param fd ddriver设备handler
+ * @param buf 要读出的数据Buf
+ * @param size 要读出的数据大小，需为设备IO单位的整数倍
+ * @param offset 读取位置，注意要和设备IO单位对齐
+ * @return int 读出的字节数，失败返回负数
+ */
+int ddriver_pread(int fd, char *buf, size_t size, off_t offset);
+
+/**
+ * @brief 定位写，语义与ddriver_pread对称
+ * 
+ * @param fd ddriver设备handler
+ * @param buf 要写入的数据Buf
+ * @param size 要写入的数据大小，需为设备IO单位的整数倍
+ * @param offset 写入位置，注意要和设备IO单位对齐
+ * @return int 写入的字节数，失败返回负数
+ */
+int ddriver_pwrite(int fd, char *buf, size_t size, off_t offset);
+
+/**
+ * @brief 原地读，返回设备内容的只读指针而不拷贝，延迟与ddriver_pread相同
+ * 
+ * @param fd ddriver设备handler
+ * @param offset 读取位置，注意要和设备IO单位对齐
+ * @param size 要读出的数据大小，需为设备IO单位的整数倍
+ * @return const char* 在设备关闭前有效，失败返回NULL，此时应改用ddriver_pread
+ */
+const char *ddriver_map(int fd, off_t offset, size_t size);
+
+/**
+ * @brief 将一段范围内已写入的数据同步到后备文件
+ * 
+ * @param fd ddriver设备handler
+ * @param offset 范围起点
+ * @param size 范围大小
+ * @return int 0成功，否则失败
+ */
+int ddriver_commit(int fd, off_t offset, size_t size);
+
 /**
  * @brief ddriver IO控制
  * 
@@ -60,4 +102,64 @@ int ddriver_ioctl(int fd, unsigned long cmd, void *ret);
  */
 int ddriver_close(int fd);
 
+/**
+ * @brief 建立一对提交/完成队列。队列与设备无关，每个提交项自带设备句柄；
+ *        提交后立即返回，由队列的服务线程执行，受设备队列深度(IOC_REQ_QUEUE_DEPTH)限制
+ * 
+ * @param entries 提交队列容量，完成队列容量为其两倍
+ * @param flags DDRIVER_QUEUE_EVENTFD等
+ * @return int 队列句柄，失败返回负数
+ */
+int ddriver_queue_init(int entries, int flags);
+
+/**
+ * @brief 取一个空闲的提交项，填写后经ddriver_submit提交。同一队列应由一个线程使用
+ * 
+ * @param ring 队列句柄
+ * @return struct ddriver_sqe* 提交队列已满时返回NULL，可先收取完成事件
+ */
+struct ddriver_sqe *ddriver_get_sqe(int ring);
+
+/**
+ * @brief 提交此前取得的全部提交项
+ * 
+ * @param ring 队列句柄
+ * @return int 本次提交的数量，失败返回负数
+ */
+int ddriver_submit(int ring);
+
+/**
+ * @brief 轮询一个完成事件，不等待
+ * 
+ * @param ring 队列句柄
+ * @param cqe 完成事件
+ * @return int 0成功，没有完成事件时返回-EAGAIN
+ */
+int ddriver_peek_cqe(int ring, struct ddriver_cqe *cqe);
+
+/**
+ * @brief 等待一个完成事件
+ * 
+ * @param ring 队列句柄
+ * @param cqe 完成事件
+ * @return int 0成功，没有已提交的请求时返回-EAGAIN
+ */
+int ddriver_wait_cqe(int ring, struct ddriver_cqe *cqe);
+
+/**
+ * @brief 以DDRIVER_QUEUE_EVENTFD建立的队列的eventfd，可用poll/epoll等待完成，再经ddriver_peek_cqe收取
+ * 
+ * @param ring 队列句柄
+ * @return int eventfd，未启用时返回负数
+ */
+int ddriver_queue_eventfd(int ring);
+
+/**
+ * @brief 等待已提交的请求执行完毕并释放队列，未收取的完成事件被丢弃
+ * 
+ * @param ring 队列句柄
+ * @return int 0成功，否则失败
+ */
+int ddriver_queue_exit(int ring);
+
 #endif /* _DDRIVER_H_ */
@@ -2,6 +2,7 @@
 #define _DDRIVER_CTL_H_
 
 #include <sys/ioctl.h>
+#include <sys/types.h>
 /******************************************************************************
 * SECTION: IO ctl protocol definitions
 *******************************************************************************/
@@ -12,9 +13,103 @@ struct ddriver_state {
     int seek_cnt;
 };
 
+/* 分区设备：开头nr_conv个常规分区可随机写，其余为顺序写分区，只能在写指针处追加 */
+#define DDRIVER_ZONE_TYPE_CONV  1
+#define DDRIVER_ZONE_TYPE_SEQ   2
+
+#define DDRIVER_ZONE_COND_NOT_WP    0   /* 常规分区没有写指针 */
+#define DDRIVER_ZONE_COND_EMPTY     1
+#define DDRIVER_ZONE_COND_IMP_OPEN  2   /* 写入时隐式打开 */
+#define DDRIVER_ZONE_COND_EXP_OPEN  3   /* 经IOC_REQ_ZONE_OPEN显式打开 */
+#define DDRIVER_ZONE_COND_CLOSED    4
+#define DDRIVER_ZONE_COND_FULL      5
+
+struct ddriver_zone_info {
+    int zone_sz;    /* 分区字节数，0表示普通设备 */
+    int nr_zones;
+    int nr_conv;    /* 常规分区数 */
+    int max_open;   /* 同时打开的顺序写分区上限 */
+};
+
+struct ddriver_zone {
+    int start;      /* 字节偏移 */
+    int len;
+    int wp;         /* 写指针，字节偏移 */
+    int type;       /* DDRIVER_ZONE_TYPE_* */
+    int cond;       /* DDRIVER_ZONE_COND_* */
+};
+
+struct ddriver_zone_report {
+    int start_zone;             /* 从该分区开始报告 */
+    int nr_zones;               /* 调用时为zones[]容量，返回实际填写数 */
+    struct ddriver_zone zones[];
+};
+
+struct ddriver_head {
+    int pos;        /* 磁头位置，字节偏移 */
+    int track_sz;   /* 每磁道字节数，寻道时延按距离模磁道大小计 */
+};
+
+struct ddriver_lat {
+    int read_us;    /* 每个IO单位的读延迟，微秒 */
+    int write_us;   /* 每个IO单位的写延迟，微秒 */
+    int seek_us;    /* 移动一整个磁道的延迟，微秒 */
+};
+
+/* 设备队列已满时，等待的请求按调度策略依次得到服务 */
+#define DDRIVER_SCHED_FIFO      0   /* 按到达顺序 */
+#define DDRIVER_SCHED_CLOOK     1   /* 电梯：从磁头位置向高地址服务，到头后回到最低地址 */
+#define DDRIVER_SCHED_DEADLINE  2   /* 读优先，超过期限的请求最先服务，防止写饿死 */
+#define DDRIVER_SCHED_NR        3
+
+struct ddriver_sched_stats {
+    int policy;                 /* 调用时给出要查询的策略，各策略的统计分别累计 */
+    int dispatched;             /* 服务的请求数 */
+    int queued;                 /* 其中排队等待过的请求数 */
+    int expired;                /* deadline：因超过期限而优先服务的请求数 */
+    long long seek_bytes;       /* 磁头移动距离，与寻道时延一样按磁道取模 */
+    long long seek_us;          /* 模拟的寻道时延之和，微秒 */
+    long long wait_us;          /* 排队等待时间之和，微秒 */
+    long long max_wait_us;
+};
+
 #define IOC_REQ_DEVICE_SIZE     _IOR(IOC_MAGIC, 0, int)                     /* 请求查看设备大小 */
 #define IOC_REQ_DEVICE_STATE    _IOR(IOC_MAGIC, 1, struct ddriver_state)    /* 请求设备状态，返回 ddriver_state */
 #define IOC_REQ_DEVICE_RESET    _IO(IOC_MAGIC, 2)                           /* 请求重置设备 */
 #define IOC_REQ_DEVICE_IO_SZ    _IOR(IOC_MAGIC, 3, int)                     /* 请求设备IO大小 */
+#define IOC_REQ_ZONE_INFO       _IOR(IOC_MAGIC, 4, struct ddriver_zone_info)  /* 分区几何，普通设备zone_sz为0 */
+#define IOC_REQ_ZONE_CONFIG     _IOW(IOC_MAGIC, 5, struct ddriver_zone_info)  /* 把模拟设备设为分区模式，zone_sz为0时恢复普通设备 */
+#define IOC_REQ_ZONE_REPORT     _IOWR(IOC_MAGIC, 6, struct ddriver_zone_report) /* 报告各分区状态与写指针 */
+#define IOC_REQ_ZONE_RESET      _IOW(IOC_MAGIC, 7, int)                     /* 重置分区写指针，-1表示全部 */
+#define IOC_REQ_ZONE_OPEN       _IOW(IOC_MAGIC, 8, int)                     /* 显式打开分区 */
+#define IOC_REQ_ZONE_CLOSE      _IOW(IOC_MAGIC, 9, int)                     /* 关闭分区，释放打开资源 */
+#define IOC_REQ_ZONE_FINISH     _IOW(IOC_MAGIC, 10, int)                    /* 把写指针移到分区末尾 */
+#define IOC_REQ_DEVICE_HEAD     _IOR(IOC_MAGIC, 11, struct ddriver_head)    /* 磁头位置，供多副本选择最近的成员 */
+#define IOC_REQ_DEVICE_LAT      _IOW(IOC_MAGIC, 12, struct ddriver_lat)     /* 设置延迟模型，模拟快速设备 */
+#define IOC_REQ_QUEUE_DEPTH     _IOW(IOC_MAGIC, 13, int)                    /* 设备同时服务的命令数，排队命令的延迟相互重叠 */
+#define IOC_REQ_SCHED_POLICY    _IOW(IOC_MAGIC, 14, int)                    /* 设置调度策略，DDRIVER_SCHED_* */
+#define IOC_REQ_SCHED_STATS     _IOWR(IOC_MAGIC, 15, struct ddriver_sched_stats) /* 查询某一调度策略的统计 */
+
+/******************************************************************************
+* SECTION: 异步提交/完成队列
+*******************************************************************************/
+#define DDRIVER_OP_READ         0
+#define DDRIVER_OP_WRITE        1
+
+#define DDRIVER_QUEUE_EVENTFD   0x1     /* ddriver_queue_init标志：每个完成事件使eventfd计数加1 */
+
+struct ddriver_sqe {
+    int opcode;                 /* DDRIVER_OP_* */
+    int fd;                     /* ddriver_open返回的设备句柄 */
+    char *buf;
+    size_t size;                /* 与ddriver_pread/ddriver_pwrite的要求相同 */
+    off_t offset;
+    unsigned long user_data;    /* 原样带回完成事件 */
+};
+
+struct ddriver_cqe {
+    unsigned long user_data;
+    int res;                    /* 同ddriver_pread/ddriver_pwrite的返回值 */
+};
 
 #endif
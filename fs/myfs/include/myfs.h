@@ -10,6 +10,10 @@
 #include "string.h"
 #include "fuse.h"
 #include <stddef.h>
+#include <time.h>
+#include <sys/statvfs.h>
+#include <pthread.h>
+#include <poll.h>
 #include "ddriver.h"
 #include "errno.h"
 #include "types.h"
@@ -33,26 +37,202 @@ char *myfs_get_fname(const char *path);
 
 int myfs_calc_lvl(const char *path);
 
+struct myfs_dentry *new_dentry(const char *fname, MYFS_FILE_TYPE ftype);
+
+void free_dentry(struct myfs_dentry *dentry);
+
 int myfs_driver_read(int offset, uint8_t *out_content, int size);
 
 int myfs_driver_write(int offset, uint8_t *in_content, int size);
 
+int myfs_driver_pread(int offset, uint8_t *out_content, int size);
+
+const uint8_t *myfs_driver_map(int offset, int size);
+
+int myfs_driver_batch(struct myfs_vec *vecs, int num, boolean write);
+
 int myfs_mount(struct custom_options options);
 
 int myfs_umount(void);
 
+int myfs_map_load_all(void);
+
+void myfs_map_inode_set(int ino);
+
+void myfs_map_inode_clear(int ino);
+
+void myfs_map_data_set(int blk);
+
+void myfs_map_data_clear(int blk);
+
 int myfs_alloc_dentry(struct myfs_inode *inode, struct myfs_dentry *dentry);
 
 struct myfs_inode *myfs_alloc_inode(struct myfs_dentry *dentry);
 
+void myfs_io_init(struct myfs_io_list *list);
+
+int myfs_io_add(struct myfs_io_list *list, int offset, const uint8_t *in_content, int size);
+
+int myfs_io_submit(struct myfs_io_list *list);
+
+int myfs_sync_inode_io(struct myfs_inode *inode, struct myfs_io_list *list);
+
 int myfs_sync_inode(struct myfs_inode *inode);
 
+int myfs_drop_dentry(struct myfs_inode *inode, struct myfs_dentry *dentry);
+
+int myfs_drop_inode(struct myfs_inode *inode);
+
+void myfs_orphan_add(struct myfs_inode *inode);
+
+void myfs_orphan_del(struct myfs_inode *inode);
+
 struct myfs_inode *myfs_read_inode(struct myfs_dentry *dentry, int ino);
 
+struct myfs_inode *myfs_read_inode_by(struct myfs_dentry *dentry, int ino, myfs_reader_t reader);
+
+struct myfs_inode *myfs_parse_inode(struct myfs_dentry *dentry, const struct myfs_inode_d *inode_d,
+                                    myfs_reader_t reader);
+
+boolean myfs_update_atime(struct myfs_inode *inode);
+
+void myfs_update_mtime(struct myfs_inode *inode);
+
+void myfs_dirent_init(uint8_t *blk);
+
+int myfs_dirent_add(uint8_t *blk, const char *fname, int ino, MYFS_FILE_TYPE ftype);
+
+boolean myfs_dir_fits(struct myfs_inode *inode, const char *fname);
+
+int myfs_dir_size(struct myfs_inode *inode);
+
 struct myfs_dentry *myfs_get_dentry(struct myfs_inode *inode, int dir);
 
 struct myfs_dentry *myfs_lookup(const char *path, boolean *is_find, boolean *is_root);
 
+int myfs_sync_meta(struct myfs_inode *inode);
+
+/******************************************************************************
+ * SECTION: myfs_cache.c
+ *******************************************************************************/
+int myfs_cache_init(void);
+
+void myfs_cache_destroy(void);
+
+int myfs_cache_read(int blkno, uint8_t *out_content, int bias, int size);
+
+int myfs_cache_readahead(int *blknos, int num);
+
+void myfs_cache_prefetch(int *blknos, int num);
+
+void myfs_cache_invalidate(int offset, int size);
+
+void myfs_cache_update(int blkno, uint8_t *content);
+
+void myfs_readahead(struct myfs_file *file, int first, int last);
+
+int myfs_file_write(struct myfs_file *file, const uint8_t *in_content, int size, int offset);
+
+int myfs_file_flush(struct myfs_file *file);
+
+int myfs_inode_flush(struct myfs_inode *inode);
+
+void myfs_inode_lock(int ino);
+
+void myfs_inode_unlock(int ino);
+
+/******************************************************************************
+ * SECTION: myfs_alloc.c
+ *******************************************************************************/
+char *myfs_name_alloc(const char *name);
+
+void myfs_name_free(char *fname);
+
+void myfs_name_destroy(void);
+
+void *myfs_slab_alloc(int type);
+
+void myfs_slab_free(int type, void *obj);
+
+void myfs_slab_drain(void);
+
+void myfs_slab_destroy(void);
+
+uint8_t *myfs_scratch_get(int size);
+
+/******************************************************************************
+ * SECTION: myfs_preload.c
+ *******************************************************************************/
+int myfs_preload(void);
+
+/******************************************************************************
+ * SECTION: myfs_ckpt.c
+ *******************************************************************************/
+int myfs_ckpt_save(struct myfs_io_list *list);
+
+int myfs_ckpt_load(struct myfs_dentry *root_dentry, int size);
+
+uint32_t myfs_ckpt_checksum(const uint8_t *data, int size);
+
+/******************************************************************************
+ * SECTION: myfs_lfs.c
+ *******************************************************************************/
+int myfs_lfs_format(struct myfs_super_d *myfs_super_d, boolean zoned);
+
+int myfs_lfs_mount(boolean is_init);
+
+int myfs_lfs_umount(void);
+
+int myfs_lfs_checkpoint(void);
+
+int myfs_lfs_read(int offset, uint8_t *out_content, int size);
+
+int myfs_lfs_write(int offset, uint8_t *in_content, int size);
+
+void myfs_lfs_discard(int offset, int size);
+
+/******************************************************************************
+ * SECTION: myfs_stripe.c
+ *******************************************************************************/
+int myfs_stripe_open(const char *devices, int unit, boolean mirror, int depth);
+
+void myfs_stripe_close(void);
+
+int myfs_stripe_commit(void);
+
+int myfs_stripe_sched(const char *name);
+
+int myfs_stripe_pread(uint8_t *out_content, int size, int offset);
+
+int myfs_stripe_pwrite(uint8_t *in_content, int size, int offset);
+
+int myfs_stripe_ioctl(unsigned long cmd, void *arg);
+
+int myfs_stripe_rw(uint8_t *content, int size, int offset, boolean write);
+
+int myfs_stripe_batch(struct myfs_vec *vecs, int num, boolean write);
+
+void myfs_stripe_dirty(int offset, int size);
+
+int myfs_dirty_init(struct myfs_dirty_map *map, int size);
+
+void myfs_dirty_destroy(struct myfs_dirty_map *map);
+
+void myfs_dirty_mark(struct myfs_dirty_map *map, int offset, int size);
+
+int myfs_dirty_commit(struct myfs_dirty_map *map, int fd);
+
+/******************************************************************************
+ * SECTION: myfs_tier.c
+ *******************************************************************************/
+int myfs_tier_open(const char *device, int size, int rate);
+
+void myfs_tier_close(void);
+
+int myfs_tier_commit(void);
+
+int myfs_tier_rw(uint8_t *content, int size, int offset, boolean write);
+
 /******************************************************************************
  * SECTION: myfs.c
  *******************************************************************************/
@@ -63,6 +243,7 @@ void myfs_destroy(void *);
 int myfs_mkdir(const char *, mode_t);
 
 int myfs_getattr(const char *, struct stat *);
+int myfs_fgetattr(const char *, struct stat *, struct fuse_file_info *);
 
 int myfs_readdir(const char *, void *, fuse_fill_dir_t, off_t, struct fuse_file_info *);
 
@@ -86,8 +267,16 @@ int myfs_truncate(const char *, off_t);
 
 int myfs_open(const char *, struct fuse_file_info *);
 
+int myfs_release(const char *, struct fuse_file_info *);
+
+int myfs_flush(const char *, struct fuse_file_info *);
+
+int myfs_fsync(const char *, int, struct fuse_file_info *);
+
 int myfs_opendir(const char *, struct fuse_file_info *);
 
+int myfs_statfs(const char *, struct statvfs *);
+
 /******************************************************************************
  * SECTION: myfs_debug.c
  *******************************************************************************/
@@ -10,6 +10,14 @@
  *******************************************************************************/
 typedef int boolean;
 typedef uint16_t flag16;
+typedef int (*myfs_reader_t)(int offset, uint8_t *out_content, int size);
+
+enum myfs_slab_type
+{
+    MYFS_SLAB_DENTRY,
+    MYFS_SLAB_INODE,
+    MYFS_SLAB_NR
+};
 
 typedef enum myfs_file_type
 {
@@ -26,7 +34,10 @@ typedef enum myfs_file_type
 #define UINT32_BITS 32
 #define UINT8_BITS 8
 
-#define MYFS_MAGIC_NUM 0x52415453
+#define MYFS_MAGIC_NUM 0x32415453    /* 变长目录项格式 */
+#define MYFS_MAGIC_FIXED 0x52415453  /* 定长目录项的旧格式，不能挂载 */
+#define MYFS_CKPT_MAGIC 0x54504B43
+#define MYFS_LFS_MAGIC 0x5346534C
 #define MYFS_SUPER_OFS 0
 #define MYFS_ROOT_INO 0
 
@@ -40,12 +51,63 @@ typedef enum myfs_file_type
 #define MYFS_ERROR_UNSUPPORTED ENXIO
 #define MYFS_ERROR_IO EIO       /* Error Input/Output */
 #define MYFS_ERROR_INVAL EINVAL /* Invalid Args */
+#define MYFS_ERROR_NAMETOOLONG ENAMETOOLONG
+#define MYFS_ERROR_NOTDIR ENOTDIR
+#define MYFS_ERROR_NOTEMPTY ENOTEMPTY
+#define MYFS_ERROR_BUSY EBUSY
 
 #define MYFS_MAX_FILE_NAME 128
 #define MYFS_INODE_PER_FILE 1
 #define MYFS_DATA_PER_FILE 4
 #define MYFS_DEFAULT_PERM 0777
 
+#define MYFS_MAX_WRITE (128 * 1024)     /* 单个FUSE写请求的上限 */
+#define MYFS_MAX_READAHEAD (128 * 1024) /* 内核预读窗口上限 */
+#define MYFS_ENTRY_TIMEOUT 10           /* 内核目录项缓存时长(秒) */
+#define MYFS_ATTR_TIMEOUT 10            /* 内核属性缓存时长(秒) */
+#define MYFS_ATIME_WINDOW (24 * 60 * 60) /* relatime: atime最多每天刷新一次 */
+
+#define MYFS_CACHE_BLKS 256   /* 缓存块数 */
+#define MYFS_CACHE_HASH 64    /* 缓存哈希桶数 */
+#define MYFS_RA_INIT_BLKS 2   /* 顺序读首个预读窗口 */
+#define MYFS_RA_MAX_BLKS MYFS_DATA_PER_FILE /* 预读窗口上限，不超过单个文件的块数 */
+#define MYFS_RA_QUEUE 16      /* 后台预读请求队列长度 */
+#define MYFS_WB_BLKS 4        /* 每个打开文件的写聚合缓冲区块数 */
+#define MYFS_INODE_LOCKS 64   /* inode锁按ino散列的个数，锁不随inode释放 */
+#define MYFS_ORPHAN_MAX 16    /* 超级块中可记录的已删除但仍打开的文件数 */
+#define MYFS_IO_LIST_INIT 64  /* 写回链表初始容量 */
+#define MYFS_NAME_CHUNK (64 * 1024) /* 名字区每次扩展的字节数 */
+#define MYFS_SLAB_SZ (16 * 1024)     /* 每个slab的字节数，slab按此对齐 */
+#define MYFS_MAG_SZ 32               /* 每个线程弹匣可缓存的对象数 */
+#define MYFS_SCRATCH_INIT (4 * 1024) /* 驱动I/O暂存区初始大小 */
+#define MYFS_PRELOAD_WORKERS 8       /* 预加载目录树的I/O线程数 */
+#define MYFS_CKPT_PER_INODE 96       /* 检查点区按每个inode预留的字节数 */
+#define MYFS_CKPT_LOADED 0x1         /* 检查点记录含inode内容，其子项紧随其后 */
+#define MYFS_MAP_CHUNK_SZ (4 * 1024)  /* 位图空闲索引按此字节数分段 */
+#define MYFS_LFS_SEG_BLKS 32          /* 日志结构模式下每段的块数 */
+#define MYFS_LFS_OP 25                /* 日志区预留不映射的百分比，保证清理总能找到可回收的段 */
+#define MYFS_LFS_RESERVE 2            /* 只供清理线程使用的空闲段数 */
+#define MYFS_LFS_CLEAN_LOW 10         /* 空闲段低于该百分比时开始清理 */
+#define MYFS_LFS_CLEAN_HIGH 20        /* 清理到空闲段达到该百分比为止 */
+#define MYFS_LFS_CLEAN_INTERVAL 100   /* 清理线程的检查间隔(毫秒) */
+#define MYFS_ZONE_SZ (64 * 1024)      /* --zoned把普通模拟设备配置为分区设备时的分区大小 */
+#define MYFS_ZONE_MAX_OPEN 4          /* 同上，同时打开的分区上限，日志只需要2个 */
+#define MYFS_STRIPE_MAX 8             /* 条带化的最多成员设备数 */
+#define MYFS_STRIPE_UNIT 4096         /* 默认条带单元字节数 */
+#define MYFS_TIER_MAGIC 0x52454954    /* 快速设备上的映射表 */
+#define MYFS_TIER_EXTENT 1024         /* 分层存储的迁移单位，与块大小相同，整块写入无需先读出旧内容 */
+#define MYFS_TIER_RATE 100            /* 默认每秒最多迁移的扩展块数 */
+#define MYFS_TIER_PROMOTE_HEAT 2      /* 热度达到该值才会被提升 */
+#define MYFS_TIER_PLACE_MAX 32        /* 单次写入最多直接放到快速设备的扩展块数 */
+#define MYFS_TIER_RESERVED (-2)       /* 槽已预留给正在进行的提升 */
+#define MYFS_TIER_READ_US 100         /* --tier-device配置的快速设备延迟(微秒)，无寻道 */
+#define MYFS_TIER_WRITE_US 100
+#define MYFS_TIER_SEEK_US 0
+#define MYFS_QUEUE_DEPTH 8            /* 默认设备队列深度 */
+#define MYFS_QUEUE_ENTRIES 32         /* 每个异步队列的容量，超出设备队列深度的请求在设备前排队 */
+#define MYFS_QUEUE_RINGS 2            /* 每个成员设备上批量I/O可同时使用的异步队列数 */
+#define MYFS_COMMIT_UNIT 4096         /* 记录设备上未提交写入的粒度，与页大小相同 */
+
 #define MYFS_IOC_MAGIC 'S'
 #define MYFS_IOC_SEEK _IO(SFS_IOC_MAGIC, 0)
 #define MYFS_FLAG_BUF_DIRTY 0x1
@@ -62,15 +124,32 @@ typedef enum myfs_file_type
 #define MYFS_ROUND_DOWN(value, round) (value % round == 0 ? value : (value / round) * round)
 #define MYFS_ROUND_UP(value, round) (value % round == 0 ? value : (value / round + 1) * round)
 
-#define MYFS_BLKS_SZ(blks) (blks * MYFS_BLK_SZ())
-#define MYFS_ASSIGN_FNAME(pmyfs_dentry, _fname) \
-    memcpy(pmyfs_dentry->fname, _fname, strlen(_fname))
-#define MYFS_INO_OFS(ino) (myfs_super.inode_offset + (ino)*MYFS_BLKS_SZ(1))
-#define MYFS_DATA_OFS(ino) (myfs_super.data_offset + (ino)*MYFS_BLKS_SZ(1))
+#define MYFS_BLKS_SZ(blks) ((blks) * MYFS_BLK_SZ())
+#define MYFS_BLK_NO(offset) ((offset) / MYFS_BLK_SZ())
+#define MYFS_GROUP_OFS(group) ((group)*MYFS_BLKS_SZ(myfs_super.group_blks))
+#define MYFS_INO_OFS(ino)                                                      \
+    (MYFS_GROUP_OFS((ino) / myfs_super.ino_stride) + myfs_super.inode_offset + \
+     ((ino) % myfs_super.ino_stride) * MYFS_BLKS_SZ(1))
+#define MYFS_DATA_OFS(ino)                                                     \
+    (MYFS_GROUP_OFS((ino) / myfs_super.data_stride) + myfs_super.data_offset + \
+     ((ino) % myfs_super.data_stride) * MYFS_BLKS_SZ(1))
+#define MYFS_DRIVER_STACKED() (myfs_super.stripe_members > 1 || myfs_super.tiered) /* 需经myfs_stripe_*访问设备 */
+#define MYFS_LFS_OWNS(offset) (myfs_super.lfs && (offset) >= myfs_super.seg_offset) /* 日志区中的虚拟地址 */
+#define MYFS_FNAME_LEN(fname) (((uint8_t *)(fname))[-1]) /* 名字区中的文件名长度 */
+#define MYFS_NAME_SLOT(len) MYFS_ROUND_UP((len) + 2, sizeof(void *)) /* 名字在名字区中占用的字节数 */
+#define MYFS_NAME_CLASSES (MYFS_NAME_SLOT(MYFS_MAX_FILE_NAME - 1) / sizeof(void *) + 1)
+#define MYFS_CKPT_REC_LEN(name_len, target_len) \
+    MYFS_ROUND_UP((sizeof(struct myfs_ckpt_rec_d) + (name_len) + (target_len)), 8)
+#define MYFS_DIRENT_LEN(name_len) MYFS_ROUND_UP((sizeof(struct myfs_dentry_d) + (name_len)), 4)
 
 #define MYFS_IS_DIR(pinode) (pinode->dentry->ftype == MYFS_DIR)
 #define MYFS_IS_REG(pinode) (pinode->dentry->ftype == MYFS_REG_FILE)
 #define MYFS_IS_SYM_LINK(pinode) (pinode->dentry->ftype == MYFS_SYM_LINK)
+/* 已从目录中删除、仍被打开的文件：其dentry不再挂在父目录下。根目录同样没有父目录，需排除 */
+#define MYFS_IS_UNLINKED(pinode) (pinode->dentry->parent == NULL && pinode != myfs_super.root_dentry->inode)
+
+/* ino 0 会被很多工具视为无效inode，对外报告时整体加1，根目录即为1 */
+#define MYFS_STAT_INO(ino) ((ino) + 1)
 
 /******************************************************************************
  * SECTION: FS Specific Structure - In memory structure
@@ -79,14 +158,137 @@ struct myfs_dentry;
 struct myfs_inode;
 struct myfs_super;
 
+struct myfs_buf
+{
+    int blkno;  /* 设备块号，-1表示空闲 */
+    flag16 flag;
+    uint8_t *data;
+    struct myfs_buf *hash_next;
+    struct myfs_buf *lru_prev;
+    struct myfs_buf *lru_next;
+};
+
+struct myfs_file
+{
+    struct myfs_inode *inode;
+    struct myfs_file *next; /* 同一inode的下一个打开文件 */
+    int prev_blk; /* 上次读请求的最后一块，-1表示尚未读过 */
+    int ra_start; /* 当前预读窗口起始块（文件内块号） */
+    int ra_size;  /* 当前预读窗口块数，0表示未进入顺序读 */
+    int ra_async; /* 读到该块时后台预读下一窗口 */
+    uint8_t *wbuf; /* 写聚合缓冲区，大小为MYFS_WB_BLKS个块 */
+    int wb_offset; /* 缓冲数据在文件中的起始偏移 */
+    int wb_size;   /* 缓冲数据长度，0表示缓冲区为空 */
+};
+
+struct myfs_io
+{
+    int offset;    /* 设备偏移 */
+    int size;
+    int seq;       /* 加入顺序，重叠部分以后加入者为准 */
+    uint8_t *data; /* 待写内容的副本，由写回链表持有 */
+};
+
+/* 批量I/O中的一个请求 */
+struct myfs_vec
+{
+    int offset; /* 设备偏移 */
+    int size;
+    uint8_t *buf;
+};
+
+struct myfs_io_list
+{
+    struct myfs_io *ios;
+    int cnt;
+    int cap;
+};
+
+/* 设备上已写入共享映射、尚未提交的范围，提交时只同步其中的连续段 */
+struct myfs_dirty_map
+{
+    uint8_t *units; /* 每个MYFS_COMMIT_UNIT一字节，非0表示有未提交的写入 */
+    int cnt;
+    int size;       /* 设备字节数 */
+};
+
+struct myfs_map_index
+{
+    int bits;        /* 位图有效位数 */
+    int chunk_bits;  /* 每段位数，分组时一段即一个块组 */
+    int chunks;      /* 分段数 */
+    int group_blks;  /* 每个块组的位图块数 */
+    int *free;       /* 各段空闲位数，-1表示该段尚未完整读入 */
+    uint64_t *avail; /* 顶层摘要：各段可能含空闲位 */
+};
+
+struct myfs_name_chunk
+{
+    struct myfs_name_chunk *next;
+    int used;
+    uint8_t data[];
+};
+
+struct myfs_slab
+{
+    struct myfs_slab *next;
+    struct myfs_slab *prev;
+    struct myfs_slab_cache *cache;
+    int inuse;    /* 已分配出去（含在弹匣中）的对象数 */
+    void *free;   /* 空闲对象链 */
+    uint8_t objs[];
+};
+
+struct myfs_slab_cache
+{
+    const char *name;
+    int obj_sz;
+    pthread_mutex_t lock;
+    struct myfs_slab *partial; /* 尚有空闲对象的slab */
+    struct myfs_slab *full;    /* 对象已全部分出的slab */
+    struct
+    {
+        int slabs;
+        int peak_slabs;
+        int slabs_freed;
+        long inuse;
+        long allocs;
+        long frees;
+        long mag_hits; /* 无需持锁、直接由弹匣满足的分配 */
+    } stat;
+};
+
+struct myfs_magazine
+{
+    int cnt;
+    unsigned long epoch;
+    void *objs[MYFS_MAG_SZ];
+};
+
 struct custom_options
 {
     const char *device;
+    int preload; /* 挂载时并行读入整棵目录树 */
+    int dump_maps; /* 挂载后打印inode与数据位图，调试用 */
+    int groups;    /* 格式化时的块组数，0或1表示不分组 */
+    int lfs;       /* 格式化为日志结构布局，见myfs_lfs.c */
+    int zoned;     /* 按分区设备格式化，普通模拟设备先配置为分区设备 */
+    int stripe_unit; /* device给出多个设备时的条带单元字节数，0表示默认 */
+    int mirror;      /* device给出的多个设备互为镜像(RAID-1)，而不是条带 */
+    const char *tier_device; /* 快速设备，见myfs_tier.c */
+    int tier_size;   /* 快速设备用作快速层的字节数，0表示整个设备 */
+    int tier_rate;   /* 每秒最多迁移的扩展块数，0表示默认 */
+    int queue_depth; /* 设备队列深度，0表示默认，1表示设备逐个服务，批量I/O排队等待 */
+    const char *sched; /* 设备的调度策略：fifo、clook或deadline，见myfs_stripe_sched */
 };
 
 struct myfs_super
 {
-    int driver_fd;
+    int driver_fd;       /* 条带化时为第一个成员设备 */
+    int stripe_members;  /* 成员设备数，见myfs_stripe.c */
+    int stripe_unit;     /* 条带单元字节数，单个设备或镜像时为0 */
+    boolean mirror;      /* 各成员设备内容相同 */
+    boolean tiered;      /* 经快速设备分层，见myfs_tier.c */
 
     int sz_io;
     int sz_disk;
@@ -94,59 +296,87 @@ struct myfs_super
     int sz_usage;
 
     int max_ino;
+    int max_data;  /* 数据区块数 */
+    int free_ino;  /* 空闲inode数，随位图增量维护 */
+    int free_data; /* 空闲数据块数，随位图增量维护 */
     uint8_t *map_inode;
+    uint8_t *map_inode_loaded; /* 摘要位图：各位图块是否已读入，按需经块缓存读取 */
+    uint8_t *map_inode_dirty;  /* 摘要位图：各位图块是否需要写回 */
+    struct myfs_map_index map_inode_idx;
     int map_inode_blks;
     int map_inode_offset;
 
     uint8_t *map_data;
+    uint8_t *map_data_loaded;
+    uint8_t *map_data_dirty;
+    struct myfs_map_index map_data_idx;
     int map_data_blks;
     int map_data_offset;
 
-    int inode_offset;
+    int inode_offset; /* 块组0中的偏移，其余块组相同位置 */
     int data_offset;
 
+    int groups;      /* 块组数，不分组时为1 */
+    int group_blks;  /* 每个块组的块数 */
+    int ino_stride;  /* 每个块组在inode位图中占用的位数，ino按此划分块组 */
+    int data_stride; /* 每个块组在数据位图中占用的位数 */
+
+    int ckpt_offset; /* 检查点区，旧格式的设备上为0 */
+    int ckpt_blks;
+    uint32_t generation; /* 每次挂载递增，检查点须与之一致才有效 */
+
+    boolean lfs;         /* 日志结构模式：inode表与数据区位于虚拟地址，由myfs_lfs.c映射到日志 */
+    int seg_offset;      /* 日志区起点，也是虚拟地址的起点 */
+    int seg_blks;
+    int segs;
+    int lfs_ckpt_offset; /* 两个交替写入的日志检查点槽 */
+    int lfs_ckpt_blks;   /* 每个槽的块数 */
+    boolean zoned;       /* 每段对应一个顺序写分区，段重用前先重置写指针 */
+
     boolean is_mounted;
 
+    struct myfs_inode *orphans[MYFS_ORPHAN_MAX]; /* 已删除但仍打开的文件，随超级块写出 */
+    int orphan_cnt;
+
     struct myfs_dentry *root_dentry;
 };
 
 struct myfs_inode
 {
-    int ino;                              /* 在inode位图中的下标 */
-    int size;                             /* 文件已占用空间 */
-    char target_path[MYFS_MAX_FILE_NAME]; /* store target path when it is a symlink */
+    int ino;                     /* 在inode位图中的下标 */
     int dir_cnt;
     struct myfs_dentry *dentry;  /* 指向该inode的dentry */
     struct myfs_dentry *dentrys; /* 所有目录项 */
-    uint8_t *data;
+    int size;                    /* 文件已占用空间 */
     int block_pointer[MYFS_DATA_PER_FILE];
+    boolean dirty;           /* 内存中的inode或其目录项已修改，尚未写回 */
+    struct myfs_file *files; /* 打开该inode的所有文件 */
+    char *target_path;       /* 符号链接目标，单独分配，其余类型为NULL */
+    time_t atime;            /* 最近访问时间，按relatime规则惰性更新 */
+    time_t mtime;            /* 最近修改内容时间 */
+    time_t ctime;            /* 最近修改inode时间 */
 };
 
 struct myfs_dentry
 {
-    char fname[MYFS_MAX_FILE_NAME];
+    char *fname;                 /* 名字区中的文件名 */
     struct myfs_dentry *parent;  /* 父亲Inode的dentry */
     struct myfs_dentry *brother; /* 兄弟 */
+    struct myfs_inode *inode;    /* 指向inode */
     int ino;
-    struct myfs_inode *inode; /* 指向inode */
-    MYFS_FILE_TYPE ftype;
+    uint8_t ftype; /* MYFS_FILE_TYPE */
 };
 
-static inline struct myfs_dentry *new_dentry(char *fname, MYFS_FILE_TYPE ftype)
-{
-    struct myfs_dentry *dentry = (struct myfs_dentry *)malloc(sizeof(struct myfs_dentry));
-    memset(dentry, 0, sizeof(struct myfs_dentry));
-    MYFS_ASSIGN_FNAME(dentry, fname);
-    dentry->ftype = ftype;
-    dentry->ino = -1;
-    dentry->inode = NULL;
-    dentry->parent = NULL;
-    dentry->brother = NULL;
-}
-
 /******************************************************************************
  * SECTION: FS Specific Structure - Disk structure
  *******************************************************************************/
+/* 已删除但仍打开的文件，异常退出后挂载时据此释放其inode与数据块 */
+struct myfs_orphan_d
+{
+    int ino;
+    int block_pointer[MYFS_DATA_PER_FILE];
+};
+
 struct myfs_super_d
 {
     uint32_t magic_num;
@@ -161,6 +391,80 @@ struct myfs_super_d
 
     int inode_offset;
     int data_offset;
+
+    int ckpt_offset;
+    int ckpt_blks;
+    int ckpt_size;       /* 检查点有效字节数，0表示无检查点 */
+    uint32_t generation;
+    uint32_t ckpt_gen;   /* 检查点写入时的generation */
+    int clean;           /* 正常卸载为1，挂载后立即清0 */
+    int groups;          /* 块组数，旧格式的设备上为0 */
+    int group_blks;
+    int group_data;      /* 每个块组的数据块数 */
+    int lfs;             /* 日志结构布局为1 */
+    int seg_offset;
+    int seg_blks;
+    int segs;
+    int lfs_ckpt_offset;
+    int lfs_ckpt_blks;
+    int zoned;           /* 分区设备上的日志结构布局为1 */
+    int stripe_members;  /* 格式化时的成员设备数，旧格式的设备上为0 */
+    int stripe_unit;
+    int mirror;          /* 各成员设备互为镜像为1 */
+    int tiered;          /* 格式化时带有快速设备为1 */
+    int free_ino;
+    int free_data;
+    int free_valid;      /* free_ino与free_data有效为1，旧格式的设备上为0 */
+    int orphan_cnt;      /* 旧格式的设备上为0 */
+    struct myfs_orphan_d orphans[MYFS_ORPHAN_MAX];
+};
+
+/* 检查点：卸载时按先序写出的整棵目录树，挂载时一次顺序读入 */
+struct myfs_ckpt_d
+{
+    uint32_t magic;
+    uint32_t generation;
+    int size;          /* 含头部的总字节数 */
+    int cnt;           /* 记录数 */
+    uint32_t checksum; /* 头部之后内容的FNV-1a校验和 */
+    uint32_t reserved; /* 补齐到8字节，使其后的记录对齐 */
+};
+
+/* 日志检查点：头部之后依次为虚拟块映射表int[vblks]与段使用表myfs_lfs_seg_d[segs] */
+struct myfs_lfs_ckpt_d
+{
+    uint32_t magic;
+    uint32_t seq;      /* 每写一次递增，挂载时取较新的一个槽 */
+    int vblks;
+    int segs;
+    int cur_seg;       /* 前台写入的日志头 */
+    int cur_off;
+    int gc_seg;        /* 清理搬移的日志头，-1表示尚未打开 */
+    int gc_off;
+    uint32_t log_seq;  /* 日志写入序号 */
+    uint32_t checksum; /* 头部之后内容的FNV-1a校验和 */
+};
+
+struct myfs_lfs_seg_d
+{
+    int live;     /* 有效块数 */
+    uint32_t seq; /* 最近一次写入时的日志序号，用于估计段的年龄 */
+};
+
+struct myfs_ckpt_rec_d
+{
+    int64_t atime;
+    int64_t mtime;
+    int64_t ctime;
+    int ino;
+    int size;
+    int dir_cnt; /* 紧随其后的子项记录数 */
+    int block_pointer[MYFS_DATA_PER_FILE];
+    uint8_t ftype;
+    uint8_t flag;       /* MYFS_CKPT_LOADED */
+    uint8_t name_len;
+    uint8_t target_len; /* 符号链接目标长度 */
+    char data[];        /* 文件名，其后为符号链接目标 */
 };
 
 struct myfs_inode_d
@@ -171,14 +475,20 @@ struct myfs_inode_d
     int dir_cnt;
     MYFS_FILE_TYPE ftype;
     int block_pointer[MYFS_DATA_PER_FILE];
+    int64_t atime;
+    int64_t mtime;
+    int64_t ctime;
 };
 
+/* 变长目录项，仿照ext4：记录在块内首尾相接，最后一条的rec_len延伸至块尾；
+ * name_len为0表示空闲记录。目录块在同步时由内存中的目录项整块重新拼出，删除无需原地修改记录 */
 struct myfs_dentry_d
 {
-    char fname[MYFS_MAX_FILE_NAME];
-    MYFS_FILE_TYPE ftype;
-    int ino; /* 指向的ino号 */
-    int valid;
+    int ino;          /* 指向的ino号 */
+    uint16_t rec_len; /* 本记录长度，含其后的空闲空间 */
+    uint8_t name_len; /* 文件名长度，不含'\0' */
+    uint8_t ftype;
+    char fname[];     /* 文件名，不以'\0'结尾 */
 };
 
 #endif /* _TYPES_H_ */
@@ -38,6 +38,14 @@ int set_bit(uint8_t **bitmap, uint64_t bitno)
     return 0;
 }
 
+int test_bit(uint8_t *bitmap, uint64_t bitno)
+{
+    uint64_t index = bitno / 8;
+    int bit_index = bitno % 8;
+
+    return !!(bitmap[index] & (1 << bit_index));
+}
+
 uint64_t get_first_unset_bit(uint8_t *bitmap, uint64_t bitmap_size)
 {
     uint64_t index = 0;
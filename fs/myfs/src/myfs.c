@@ -13,6 +13,18 @@
  *******************************************************************************/
 static const struct fuse_opt option_spec[] = {/* 用于FUSE文件系统解析参数 */
                                               OPTION("--device=%s", device),
+                                              OPTION("--preload", preload),
+                                              OPTION("--dump-maps", dump_maps),
+                                              OPTION("--groups=%d", groups),
+                                              OPTION("--lfs", lfs),
+                                              OPTION("--zoned", zoned),
+                                              OPTION("--stripe-unit=%d", stripe_unit),
+                                              OPTION("--mirror", mirror),
+                                              OPTION("--tier-device=%s", tier_device),
+                                              OPTION("--tier-size=%d", tier_size),
+                                              OPTION("--tier-rate=%d", tier_rate),
+                                              OPTION("--queue-depth=%d", queue_depth),
+                                              OPTION("--sched=%s", sched),
                                               FUSE_OPT_END};
 
 struct custom_options myfs_options; /* 全局选项 */
@@ -25,26 +37,35 @@ static struct fuse_operations operations = {
     .destroy = myfs_destroy, /* umount文件系统 */
     .mkdir = myfs_mkdir,     /* 建目录，mkdir */
     .getattr = myfs_getattr, /* 获取文件属性，类似stat，必须完成 */
+    .fgetattr = myfs_fgetattr, /* 按打开的文件获取属性，已删除的文件仍可fstat */
     .readdir = myfs_readdir, /* 填充dentrys */
     .mknod = myfs_mknod,     /* 创建文件，touch相关 */
-    .write = NULL,           /* 写入文件 */
-    .read = NULL,            /* 读文件 */
-    .utimens = myfs_utimens, /* 修改时间，忽略，避免touch报错 */
-    .truncate = NULL,        /* 改变文件大小 */
-    .unlink = NULL,          /* 删除文件 */
-    .rmdir = NULL,           /* 删除目录， rm -r */
+    .write = myfs_write,     /* 写入文件 */
+    .read = myfs_read,       /* 读文件 */
+    .utimens = myfs_utimens, /* 修改时间 */
+    .truncate = myfs_truncate, /* 改变文件大小 */
+    .unlink = myfs_unlink,   /* 删除文件 */
+    .rmdir = myfs_rmdir,     /* 删除目录， rm -r */
     .rename = NULL,          /* 重命名，mv */
 
-    .open = NULL,
+    .open = myfs_open,
+    .release = myfs_release,
+    .flush = myfs_flush,
+    .fsync = myfs_fsync,
     .opendir = NULL,
-    .access = NULL};
+    .access = NULL,
+    .statfs = myfs_statfs, /* 文件系统容量，df相关 */
+    .flag_nullpath_ok = 1}; /* 已删除的打开文件没有路径，按fh操作 */
 /******************************************************************************
  * SECTION: 必做函数实现
  *******************************************************************************/
 /**
  * @brief 挂载（mount）文件系统
  *
- * @param conn_info 可忽略，一些建立连接相关的信息
+ * 同时与内核协商连接参数：开启big_writes与异步读，放大单次读写请求，
+ * 减少每MB数据的FUSE往返次数；若libfuse支持，则开启内核writeback cache
+ *
+ * @param conn_info 建立连接相关的信息，内核提供的能力在capable中
  * @return void*
  */
 void *myfs_init(struct fuse_conn_info *conn_info)
@@ -55,6 +76,33 @@ void *myfs_init(struct fuse_conn_info *conn_info)
         fuse_exit(fuse_get_context()->fuse);
         return NULL;
     }
+
+    // libfuse已按接收缓冲区大小限制了max_write，这里只能往小调
+    if (conn_info->max_write > MYFS_MAX_WRITE)
+    {
+        conn_info->max_write = MYFS_MAX_WRITE;
+    }
+    if (conn_info->max_readahead > MYFS_MAX_READAHEAD)
+    {
+        conn_info->max_readahead = MYFS_MAX_READAHEAD;
+    }
+    if (conn_info->capable & FUSE_CAP_BIG_WRITES)
+    {
+        conn_info->want |= FUSE_CAP_BIG_WRITES;
+    }
+    if (conn_info->capable & FUSE_CAP_ASYNC_READ)
+    {
+        conn_info->want |= FUSE_CAP_ASYNC_READ;
+        conn_info->async_read = 1;
+    }
+#ifdef FUSE_CAP_WRITEBACK_CACHE
+    if (conn_info->capable & FUSE_CAP_WRITEBACK_CACHE)
+    {
+        conn_info->want |= FUSE_CAP_WRITEBACK_CACHE;
+    }
+#endif
+    MYFS_DBG("[%s] max_write: %u, max_readahead: %u, want: 0x%x\n", __func__,
+             conn_info->max_write, conn_info->max_readahead, conn_info->want);
     return NULL;
 }
 
@@ -91,6 +139,10 @@ int myfs_mkdir(const char *path, mode_t mode)
     struct myfs_dentry *dentry;
     struct myfs_inode *inode;
 
+    if (last_dentry == NULL)
+    {
+        return -MYFS_ERROR_IO;
+    }
     if (is_find)
     {
         return -MYFS_ERROR_EXISTS;
@@ -101,59 +153,86 @@ int myfs_mkdir(const char *path, mode_t mode)
         return -MYFS_ERROR_UNSUPPORTED;
     }
 
-    if (last_dentry->inode->dir_cnt > 5)
+    fname = myfs_get_fname(path);
+    if (strlen(fname) >= MYFS_MAX_FILE_NAME)
+    {
+        return -MYFS_ERROR_NAMETOOLONG;
+    }
+    if (!myfs_dir_fits(last_dentry->inode, fname))
     {
         return -MYFS_ERROR_NOSPACE;
     }
-    
-    fname = myfs_get_fname(path);
+
     dentry = new_dentry(fname, MYFS_DIR);
+    if (dentry == NULL)
+    {
+        return -MYFS_ERROR_NOSPACE;
+    }
     dentry->parent = last_dentry;
     inode = myfs_alloc_inode(dentry);
+    if (inode == NULL)
+    {
+        free_dentry(dentry);
+        return -MYFS_ERROR_NOSPACE;
+    }
     myfs_alloc_dentry(last_dentry->inode, dentry);
+    myfs_update_mtime(last_dentry->inode);
 
     return MYFS_ERROR_NONE;
 }
 
 /**
- * @brief 获取文件或目录的属性，该函数非常重要
+ * @brief 按inode填充属性，已删除的打开文件link数为0
  *
- * @param path 相对于挂载点的路径
+ * @param inode
  * @param myfs_stat 返回状态
- * @return int 0成功，否则失败
  */
-int myfs_getattr(const char *path, struct stat *myfs_stat)
+static void myfs_fill_stat(struct myfs_inode *inode, struct stat *myfs_stat)
 {
-    boolean is_find, is_root;
-    struct myfs_dentry *dentry = myfs_lookup(path, &is_find, &is_root);
-    if (is_find == FALSE)
-    {
-        return -MYFS_ERROR_NOTFOUND;
-    }
-
-    if (MYFS_IS_DIR(dentry->inode))
+    if (MYFS_IS_DIR(inode))
     {
         myfs_stat->st_mode = S_IFDIR | MYFS_DEFAULT_PERM;
-        myfs_stat->st_size = dentry->inode->dir_cnt * sizeof(struct myfs_dentry_d);
+        myfs_stat->st_size = myfs_dir_size(inode);
     }
-    else if (MYFS_IS_REG(dentry->inode))
+    else if (MYFS_IS_REG(inode))
     {
         myfs_stat->st_mode = S_IFREG | MYFS_DEFAULT_PERM;
-        myfs_stat->st_size = dentry->inode->size;
+        myfs_stat->st_size = inode->size;
     }
-    else if (MYFS_IS_SYM_LINK(dentry->inode))
+    else if (MYFS_IS_SYM_LINK(inode))
     {
         myfs_stat->st_mode = S_IFLNK | MYFS_DEFAULT_PERM;
-        myfs_stat->st_size = dentry->inode->size;
+        myfs_stat->st_size = inode->size;
     }
 
-    myfs_stat->st_nlink = 1;
+    // 属性在两次调用之间保持稳定，内核与make/rsync才能据此缓存
+    myfs_stat->st_ino = MYFS_STAT_INO(inode->ino);
+    myfs_stat->st_nlink = MYFS_IS_UNLINKED(inode) ? 0 : 1;
     myfs_stat->st_uid = getuid();
     myfs_stat->st_gid = getgid();
-    myfs_stat->st_atime = time(NULL);
-    myfs_stat->st_mtime = time(NULL);
+    myfs_stat->st_atime = inode->atime;
+    myfs_stat->st_mtime = inode->mtime;
+    myfs_stat->st_ctime = inode->ctime;
     myfs_stat->st_blksize = MYFS_BLK_SZ();
+}
+
+/**
+ * @brief 获取文件或目录的属性，该函数非常重要
+ *
+ * @param path 相对于挂载点的路径
+ * @param myfs_stat 返回状态
+ * @return int 0成功，否则失败
+ */
+int myfs_getattr(const char *path, struct stat *myfs_stat)
+{
+    boolean is_find, is_root;
+    struct myfs_dentry *dentry = myfs_lookup(path, &is_find, &is_root);
+    if (is_find == FALSE)
+    {
+        return -MYFS_ERROR_NOTFOUND;
+    }
 
+    myfs_fill_stat(dentry->inode, myfs_stat);
     if (is_root)
     {
         myfs_stat->st_size = myfs_super.sz_usage;
@@ -163,6 +242,26 @@ int myfs_getattr(const char *path, struct stat *myfs_stat)
     return MYFS_ERROR_NONE;
 }
 
+/**
+ * @brief 获取打开文件的属性，文件已被删除时路径为NULL
+ *
+ * @param path 相对于挂载点的路径
+ * @param myfs_stat 返回状态
+ * @param fi 文件信息
+ * @return int 0成功，否则失败
+ */
+int myfs_fgetattr(const char *path, struct stat *myfs_stat, struct fuse_file_info *fi)
+{
+    struct myfs_file *file = (struct myfs_file *)(uintptr_t)fi->fh;
+
+    if (file == NULL)
+    {
+        return myfs_getattr(path, myfs_stat);
+    }
+    myfs_fill_stat(file->inode, myfs_stat);
+    return MYFS_ERROR_NONE;
+}
+
 /**
  * @brief 遍历目录项，填充至buf，并交给FUSE输出
  *
@@ -187,12 +286,16 @@ int myfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offs
     boolean is_find, is_root;
     int cur_dir = offset;
 
-    struct myfs_dentry *dentry = myfs_lookup("/", &is_find, &is_root);
+    struct myfs_dentry *dentry = myfs_lookup(path, &is_find, &is_root);
     struct myfs_dentry *sub_dentry;
     struct myfs_inode *inode;
-    if (1)
+    if (is_find)
     {
         inode = dentry->inode;
+        if (cur_dir == 0)
+        {
+            myfs_update_atime(inode);
+        }
         sub_dentry = myfs_get_dentry(inode, cur_dir);
         if (sub_dentry)
         {
@@ -220,12 +323,24 @@ int myfs_mknod(const char *path, mode_t mode, dev_t dev)
     struct myfs_inode *inode;
     char *fname;
 
+    if (last_dentry == NULL)
+    {
+        return -MYFS_ERROR_IO;
+    }
     if (is_find == TRUE)
     {
         return -MYFS_ERROR_EXISTS;
     }
 
     fname = myfs_get_fname(path);
+    if (strlen(fname) >= MYFS_MAX_FILE_NAME)
+    {
+        return -MYFS_ERROR_NAMETOOLONG;
+    }
+    if (!myfs_dir_fits(last_dentry->inode, fname))
+    {
+        return -MYFS_ERROR_NOSPACE;
+    }
 
     if (S_ISREG(mode))
     {
@@ -239,60 +354,237 @@ int myfs_mknod(const char *path, mode_t mode, dev_t dev)
     {
         dentry = new_dentry(fname, MYFS_REG_FILE);
     }
+    if (dentry == NULL)
+    {
+        return -MYFS_ERROR_NOSPACE;
+    }
     dentry->parent = last_dentry;
     inode = myfs_alloc_inode(dentry);
+    if (inode == NULL)
+    {
+        free_dentry(dentry);
+        return -MYFS_ERROR_NOSPACE;
+    }
     myfs_alloc_dentry(last_dentry->inode, dentry);
+    myfs_update_mtime(last_dentry->inode);
 
     return MYFS_ERROR_NONE;
 }
 
 /**
- * @brief 修改时间，为了不让touch报错
+ * @brief 修改时间
  *
  * @param path 相对于挂载点的路径
- * @param tv 实践
+ * @param tv tv[0]为atime，tv[1]为mtime
  * @return int 0成功，否则失败
  */
 int myfs_utimens(const char *path, const struct timespec tv[2])
+{
+    boolean is_find, is_root;
+    struct myfs_dentry *dentry = myfs_lookup(path, &is_find, &is_root);
+    struct myfs_inode *inode;
+    time_t now = time(NULL);
+
+    if (is_find == FALSE)
+    {
+        return -MYFS_ERROR_NOTFOUND;
+    }
+
+    inode = dentry->inode;
+    if (tv == NULL)
+    {
+        inode->atime = inode->mtime = now;
+    }
+    else
+    {
+        if (tv[0].tv_nsec != UTIME_OMIT)
+        {
+            inode->atime = tv[0].tv_nsec == UTIME_NOW ? now : tv[0].tv_sec;
+        }
+        if (tv[1].tv_nsec != UTIME_OMIT)
+        {
+            inode->mtime = tv[1].tv_nsec == UTIME_NOW ? now : tv[1].tv_sec;
+        }
+    }
+    inode->ctime = now;
+    inode->dirty = TRUE;
+    return MYFS_ERROR_NONE;
+}
+/**
+ * @brief 获取文件系统容量信息，直接取超级块中增量维护的空闲计数，O(1)
+ *
+ * @param path 可忽略
+ * @param stbuf 返回容量信息
+ * @return int 0成功，否则失败
+ */
+int myfs_statfs(const char *path, struct statvfs *stbuf)
 {
     (void)path;
+    memset(stbuf, 0, sizeof(struct statvfs));
+    stbuf->f_bsize = MYFS_BLK_SZ();
+    stbuf->f_frsize = MYFS_BLK_SZ();
+    stbuf->f_blocks = myfs_super.max_data;
+    stbuf->f_bfree = myfs_super.free_data;
+    stbuf->f_bavail = myfs_super.free_data;
+    stbuf->f_files = myfs_super.max_ino;
+    stbuf->f_ffree = myfs_super.free_ino;
+    stbuf->f_favail = myfs_super.free_ino;
+    stbuf->f_namemax = MYFS_MAX_FILE_NAME - 1;
     return MYFS_ERROR_NONE;
 }
 /******************************************************************************
  * SECTION: 选做函数实现
  *******************************************************************************/
 /**
- * @brief 写入文件
+ * @brief 写入文件，先在打开文件的缓冲区中聚合，设备只看到整块写
  *
  * @param path 相对于挂载点的路径
  * @param buf 写入的内容
  * @param size 写入的字节数
  * @param offset 相对文件的偏移
- * @param fi 可忽略
+ * @param fi fi->fh为myfs_open中建立的myfs_file
  * @return int 写入大小
  */
 int myfs_write(const char *path, const char *buf, size_t size, off_t offset,
                struct fuse_file_info *fi)
 {
-    /* 选做 */
-    return size;
+    boolean is_find, is_root;
+    struct myfs_dentry *dentry;
+    struct myfs_file *file = (struct myfs_file *)(uintptr_t)fi->fh;
+    struct myfs_file temp_file;
+    struct myfs_inode *inode;
+    int ret;
+
+    if (file == NULL)
+    { /* 未经open的写，直接写回 */
+        dentry = myfs_lookup(path, &is_find, &is_root);
+        if (is_find == FALSE)
+        {
+            return -MYFS_ERROR_NOTFOUND;
+        }
+        memset(&temp_file, 0, sizeof(struct myfs_file));
+        temp_file.inode = dentry->inode;
+        file = &temp_file;
+    }
+    inode = file->inode;
+
+    if (MYFS_IS_DIR(inode))
+    {
+        return -MYFS_ERROR_ISDIR;
+    }
+    if (offset + size > MYFS_BLKS_SZ(MYFS_DATA_PER_FILE))
+    {
+        return -MYFS_ERROR_NOSPACE;
+    }
+
+    // 同一inode的其他打开者可能同时在读（会写回本缓冲区）、写或关闭
+    myfs_inode_lock(inode->ino);
+    if (inode->size < offset)
+    {
+        myfs_inode_unlock(inode->ino);
+        return -MYFS_ERROR_SEEK;
+    }
+    ret = myfs_file_write(file, (const uint8_t *)buf, size, offset);
+    if (file == &temp_file)
+    {
+        if (ret == MYFS_ERROR_NONE)
+        {
+            ret = myfs_file_flush(file);
+        }
+        free(temp_file.wbuf);
+    }
+    if (ret == MYFS_ERROR_NONE)
+    {
+        if (offset + size > inode->size)
+        {
+            inode->size = offset + size;
+        }
+        myfs_update_mtime(inode);
+    }
+    myfs_inode_unlock(inode->ino);
+    return ret != MYFS_ERROR_NONE ? ret : (int)size;
 }
 
 /**
- * @brief 读取文件
+ * @brief 读取文件，数据经由缓存读取，顺序读时自动预读
  *
  * @param path 相对于挂载点的路径
  * @param buf 读取的内容
  * @param size 读取的字节数
  * @param offset 相对文件的偏移
- * @param fi 可忽略
+ * @param fi fi->fh为myfs_open中建立的myfs_file
  * @return int 读取大小
  */
 int myfs_read(const char *path, char *buf, size_t size, off_t offset,
               struct fuse_file_info *fi)
 {
-    /* 选做 */
-    return size;
+    boolean is_find, is_root;
+    struct myfs_dentry *dentry;
+    struct myfs_file *file = (struct myfs_file *)(uintptr_t)fi->fh;
+    struct myfs_file temp_file;
+    struct myfs_inode *inode;
+    int blk, first, last, bias, len, ret;
+    int done = 0;
+
+    if (file == NULL)
+    { /* 未经open的读，不做顺序检测 */
+        dentry = myfs_lookup(path, &is_find, &is_root);
+        if (is_find == FALSE)
+        {
+            return -MYFS_ERROR_NOTFOUND;
+        }
+        memset(&temp_file, 0, sizeof(struct myfs_file));
+        temp_file.inode = dentry->inode;
+        temp_file.prev_blk = -1;
+        file = &temp_file;
+    }
+    inode = file->inode;
+
+    if (MYFS_IS_DIR(inode))
+    {
+        return -MYFS_ERROR_ISDIR;
+    }
+
+    // 同一打开文件上的并发读共用预读窗口，与写、关闭一样在inode锁内进行
+    myfs_inode_lock(inode->ino);
+    if (offset >= inode->size)
+    {
+        myfs_inode_unlock(inode->ino);
+        return 0;
+    }
+    if (offset + size > inode->size)
+    {
+        size = inode->size - offset;
+    }
+
+    // 其他打开者缓冲中尚未写回的数据需先落到缓存
+    ret = myfs_inode_flush(inode);
+
+    first = offset / MYFS_BLK_SZ();
+    last = (offset + size - 1) / MYFS_BLK_SZ();
+    if (ret == MYFS_ERROR_NONE)
+    {
+        myfs_readahead(file, first, last);
+    }
+
+    for (blk = first; ret == MYFS_ERROR_NONE && blk <= last; blk++)
+    {
+        bias = blk == first ? offset % MYFS_BLK_SZ() : 0;
+        len = MYFS_BLK_SZ() - bias;
+        if (len > (int)size - done)
+        {
+            len = size - done;
+        }
+        ret = myfs_cache_read(MYFS_BLK_NO(MYFS_DATA_OFS(inode->block_pointer[blk])), (uint8_t *)buf + done, bias,
+                              len);
+        done += len;
+    }
+    if (ret == MYFS_ERROR_NONE)
+    {
+        myfs_update_atime(inode);
+    }
+    myfs_inode_unlock(inode->ino);
+    return ret != MYFS_ERROR_NONE ? -MYFS_ERROR_IO : done;
 }
 
 /**
@@ -303,8 +595,34 @@ int myfs_read(const char *path, char *buf, size_t size, off_t offset,
  */
 int myfs_unlink(const char *path)
 {
-    /* 选做 */
-    return 0;
+    boolean is_find, is_root;
+    struct myfs_dentry *dentry = myfs_lookup(path, &is_find, &is_root);
+    struct myfs_dentry *parent;
+
+    if (!is_find)
+    {
+        return -MYFS_ERROR_NOTFOUND;
+    }
+    if (MYFS_IS_DIR(dentry->inode))
+    {
+        return -MYFS_ERROR_ISDIR;
+    }
+    parent = dentry->parent;
+    myfs_drop_dentry(parent->inode, dentry);
+    myfs_update_mtime(parent->inode);
+    // 仍被打开的文件只摘下目录项，inode与数据块留到最后一次关闭时在myfs_release中释放
+    myfs_inode_lock(dentry->ino);
+    if (dentry->inode->files != NULL)
+    {
+        dentry->parent = NULL;
+        myfs_orphan_add(dentry->inode);
+        myfs_inode_unlock(dentry->ino);
+        return MYFS_ERROR_NONE;
+    }
+    myfs_inode_unlock(dentry->ino);
+    myfs_drop_inode(dentry->inode);
+    free_dentry(dentry);
+    return MYFS_ERROR_NONE;
 }
 
 /**
@@ -321,8 +639,32 @@ int myfs_unlink(const char *path)
  */
 int myfs_rmdir(const char *path)
 {
-    /* 选做 */
-    return 0;
+    boolean is_find, is_root;
+    struct myfs_dentry *dentry = myfs_lookup(path, &is_find, &is_root);
+    struct myfs_dentry *parent;
+
+    if (!is_find)
+    {
+        return -MYFS_ERROR_NOTFOUND;
+    }
+    if (is_root)
+    {
+        return -MYFS_ERROR_BUSY;
+    }
+    if (!MYFS_IS_DIR(dentry->inode))
+    {
+        return -MYFS_ERROR_NOTDIR;
+    }
+    if (dentry->inode->dir_cnt != 0)
+    {
+        return -MYFS_ERROR_NOTEMPTY;
+    }
+    parent = dentry->parent;
+    myfs_drop_dentry(parent->inode, dentry);
+    myfs_drop_inode(dentry->inode);
+    free_dentry(dentry);
+    myfs_update_mtime(parent->inode);
+    return MYFS_ERROR_NONE;
 }
 
 /**
@@ -342,14 +684,145 @@ int myfs_rename(const char *from, const char *to)
  * @brief 打开文件，可以在这里维护fi的信息，例如，fi->fh可以理解为一个64位指针，可以把自己想保存的数据结构
  * 保存在fh中
  *
+ * 这里在fh中保存myfs_file，记录该次打开的顺序读与预读状态
+ *
  * @param path 相对于挂载点的路径
  * @param fi 文件信息
  * @return int 0成功，否则失败
  */
 int myfs_open(const char *path, struct fuse_file_info *fi)
 {
-    /* 选做 */
-    return 0;
+    boolean is_find, is_root;
+    struct myfs_dentry *dentry = myfs_lookup(path, &is_find, &is_root);
+    struct myfs_file *file;
+
+    if (is_find == FALSE)
+    {
+        return -MYFS_ERROR_NOTFOUND;
+    }
+    if (MYFS_IS_DIR(dentry->inode))
+    {
+        return -MYFS_ERROR_ISDIR;
+    }
+
+    file = (struct myfs_file *)malloc(sizeof(struct myfs_file));
+    memset(file, 0, sizeof(struct myfs_file));
+    file->inode = dentry->inode;
+    file->prev_blk = -1;
+    file->ra_async = -1;
+    myfs_inode_lock(file->inode->ino);
+    file->next = file->inode->files;
+    file->inode->files = file;
+    myfs_inode_unlock(file->inode->ino);
+    fi->fh = (uint64_t)(uintptr_t)file;
+    return MYFS_ERROR_NONE;
+}
+
+/**
+ * @brief 关闭文件，写回缓冲区并释放myfs_open中建立的myfs_file。
+ * 已被删除的文件在最后一次关闭时释放其inode与数据块
+ *
+ * @param path 相对于挂载点的路径
+ * @param fi 文件信息
+ * @return int 0成功，否则失败
+ */
+int myfs_release(const char *path, struct fuse_file_info *fi)
+{
+    struct myfs_file *file = (struct myfs_file *)(uintptr_t)fi->fh;
+    struct myfs_inode *inode;
+    struct myfs_dentry *dentry;
+    struct myfs_file **pp;
+    int ino, ret;
+    (void)path;
+
+    if (file == NULL)
+    {
+        return MYFS_ERROR_NONE;
+    }
+    inode = file->inode;
+    ino = inode->ino;
+    myfs_inode_lock(ino);
+    ret = myfs_file_flush(file);
+    for (pp = &inode->files; *pp != NULL; pp = &(*pp)->next)
+    {
+        if (*pp == file)
+        {
+            *pp = file->next;
+            break;
+        }
+    }
+    if (inode->files == NULL && MYFS_IS_UNLINKED(inode))
+    {
+        myfs_orphan_del(inode);
+        dentry = inode->dentry;
+        myfs_drop_inode(inode);
+        free_dentry(dentry);
+    }
+    myfs_inode_unlock(ino);
+    free(file->wbuf);
+    free(file);
+    fi->fh = 0;
+    return ret;
+}
+
+/**
+ * @brief close时调用，写回缓冲区，使写入错误能在close中返回
+ *
+ * @param path 相对于挂载点的路径
+ * @param fi 文件信息
+ * @return int 0成功，否则失败
+ */
+int myfs_flush(const char *path, struct fuse_file_info *fi)
+{
+    struct myfs_file *file = (struct myfs_file *)(uintptr_t)fi->fh;
+    int ret;
+    (void)path;
+
+    if (file == NULL)
+    {
+        return MYFS_ERROR_NONE;
+    }
+    myfs_inode_lock(file->inode->ino);
+    ret = myfs_file_flush(file);
+    myfs_inode_unlock(file->inode->ino);
+    return ret;
+}
+
+/**
+ * @brief 同步文件：写回缓冲区，写出inode及其依赖的位图、日志检查点与超级块，再提交设备上写过的范围使其持久
+ *
+ * @param path 相对于挂载点的路径，没有打开文件时据此查找inode
+ * @param datasync 可忽略
+ * @param fi 文件信息
+ * @return int 0成功，否则失败
+ */
+int myfs_fsync(const char *path, int datasync, struct fuse_file_info *fi)
+{
+    struct myfs_file *file = (struct myfs_file *)(uintptr_t)fi->fh;
+    struct myfs_inode *inode = NULL;
+    struct myfs_dentry *dentry;
+    boolean is_find, is_root;
+    int ret = MYFS_ERROR_NONE;
+    (void)datasync;
+
+    if (file != NULL)
+    {
+        inode = file->inode;
+        myfs_inode_lock(inode->ino);
+        ret = myfs_file_flush(file);
+        myfs_inode_unlock(inode->ino);
+    }
+    else if (path != NULL)
+    {
+        dentry = myfs_lookup(path, &is_find, &is_root);
+        inode = is_find ? dentry->inode : NULL;
+    }
+    // 没有inode可写时仍要提交：此前经其它打开文件写出的数据、挂载时使检查点失效的超级块都只在共享映射中
+    if (ret == MYFS_ERROR_NONE)
+    {
+        ret = myfs_sync_meta(inode);
+    }
+    return ret != MYFS_ERROR_NONE ? ret : myfs_stripe_commit();
 }
 
 /**
@@ -374,8 +847,53 @@ int myfs_opendir(const char *path, struct fuse_file_info *fi)
  */
 int myfs_truncate(const char *path, off_t offset)
 {
-    /* 选做 */
-    return 0;
+    boolean is_find, is_root;
+    struct myfs_dentry *dentry = myfs_lookup(path, &is_find, &is_root);
+    struct myfs_inode *inode;
+    struct myfs_file temp_file;
+    uint8_t *zeros;
+    int ret = MYFS_ERROR_NONE;
+
+    if (is_find == FALSE)
+    {
+        return -MYFS_ERROR_NOTFOUND;
+    }
+    inode = dentry->inode;
+    if (MYFS_IS_DIR(inode))
+    {
+        return -MYFS_ERROR_ISDIR;
+    }
+    if (offset > MYFS_BLKS_SZ(MYFS_DATA_PER_FILE))
+    {
+        return -MYFS_ERROR_NOSPACE;
+    }
+    myfs_inode_lock(inode->ino);
+    if (myfs_inode_flush(inode) != MYFS_ERROR_NONE)
+    {
+        myfs_inode_unlock(inode->ino);
+        return -MYFS_ERROR_IO;
+    }
+
+    if (offset > inode->size)
+    { /* 扩展部分补零 */
+        zeros = (uint8_t *)calloc(1, offset - inode->size);
+        memset(&temp_file, 0, sizeof(struct myfs_file));
+        temp_file.inode = inode;
+        ret = myfs_file_write(&temp_file, zeros, offset - inode->size, inode->size);
+        if (ret == MYFS_ERROR_NONE)
+        {
+            ret = myfs_file_flush(&temp_file);
+        }
+        free(temp_file.wbuf);
+        free(zeros);
+    }
+    if (ret == MYFS_ERROR_NONE)
+    {
+        inode->size = offset;
+        myfs_update_mtime(inode);
+    }
+    myfs_inode_unlock(inode->ino);
+    return ret;
 }
 
 /**
@@ -402,6 +920,7 @@ int myfs_access(const char *path, int type)
 int main(int argc, char **argv)
 {
     int ret;
+    char timeout_opt[64];
     struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
 
     myfs_options.device = strdup("/home/meteor/ddriver");
@@ -409,6 +928,12 @@ int main(int argc, char **argv)
     if (fuse_opt_parse(&args, &myfs_options, option_spec, NULL) == -1)
         return -MYFS_ERROR_INVAL;
 
+    // 所有修改都经由myfs，内核可放心缓存目录项与属性；use_ino使st_ino生效
+    // 没有rename，libfuse无法把仍打开的文件改名隐藏，hard_remove使删除直接交给myfs_unlink处理
+    snprintf(timeout_opt, sizeof(timeout_opt), "-ouse_ino,hard_remove,entry_timeout=%d,attr_timeout=%d",
+             MYFS_ENTRY_TIMEOUT, MYFS_ATTR_TIMEOUT);
+    fuse_opt_add_arg(&args, timeout_opt);
+
     ret = fuse_main(args.argc, args.argv, &operations, NULL);
     fuse_opt_free_args(&args);
     return ret;
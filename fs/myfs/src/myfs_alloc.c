@@ -0,0 +1,459 @@
+/**
+ * 内存对象分配
+ *
+ * 文件名统一存放在全局名字区中：按块追加，每个名字前有一字节长度，末尾保留'\0'，
+ * dentry只保存指向名字首字节的指针。每个名字占用的空间向上取整到指针大小，释放的
+ * 空间按占用字节数挂入各自的空闲链，之后同样大小的名字优先复用，卸载时整体归还。
+ *
+ * dentry与inode由按类型划分的slab分配：每个slab是按MYFS_SLAB_SZ对齐的一段内存，
+ * 对象地址向下取整即得其所属slab。每个线程为每种类型持有一个弹匣，分配与释放
+ * 先在弹匣中完成，弹匣空或满时才持锁与slab批量交换对象；slab中对象全部归还后
+ * 整块释放。
+ *
+ * 驱动读写的非对齐请求借助每线程一块的暂存区补齐到IO单位，暂存区按IO单位对齐，
+ * 只在需要更大空间时重新分配，线程退出时归还。
+ */
+
+#include "../include/myfs.h"
+
+extern struct myfs_super myfs_super;
+
+static struct myfs_name_chunk *name_chunks; /* 链表头为当前追加的块 */
+static uint8_t *name_free[MYFS_NAME_CLASSES]; /* 按占用字节数/指针大小划分的空闲空间链 */
+static pthread_mutex_t name_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct
+{
+    int chunks;
+    long live;   /* 在用名字占用的字节数 */
+    long dead;   /* 空闲链中的字节数 */
+    long reused; /* 从空闲链复用的次数 */
+} name_stat;
+
+static struct myfs_slab_cache slab_caches[MYFS_SLAB_NR] = {
+    [MYFS_SLAB_DENTRY] = {.name = "dentry", .obj_sz = sizeof(struct myfs_dentry), .lock = PTHREAD_MUTEX_INITIALIZER},
+    [MYFS_SLAB_INODE] = {.name = "inode", .obj_sz = sizeof(struct myfs_inode), .lock = PTHREAD_MUTEX_INITIALIZER},
+};
+static unsigned long slab_epoch; /* 每次销毁递增，令各线程弹匣中残留的对象失效 */
+static pthread_key_t slab_key;
+static pthread_once_t slab_key_once = PTHREAD_ONCE_INIT;
+static __thread struct myfs_magazine slab_mags[MYFS_SLAB_NR];
+static __thread boolean slab_mags_registered;
+
+static pthread_key_t scratch_key;
+static pthread_once_t scratch_key_once = PTHREAD_ONCE_INIT;
+static __thread uint8_t *scratch_buf;
+static __thread int scratch_sz;
+
+/******************************************************************************
+ * SECTION: 名字区
+ *******************************************************************************/
+/**
+ * @brief 在名字区中保存一个文件名
+ *
+ * @param name
+ * @return char* 以'\0'结尾的文件名，MYFS_FNAME_LEN可取其长度；空间不足返回NULL
+ */
+char *myfs_name_alloc(const char *name)
+{
+    int len = strlen(name);
+    int need, cls;
+    struct myfs_name_chunk *chunk;
+    uint8_t *slot;
+
+    if (len >= MYFS_MAX_FILE_NAME)
+    {
+        return NULL;
+    }
+    need = MYFS_NAME_SLOT(len); /* 长度前缀与'\0'，取整到指针大小 */
+    cls = need / sizeof(void *);
+    pthread_mutex_lock(&name_lock);
+    slot = name_free[cls];
+    if (slot != NULL)
+    {
+        // 空闲空间开头存放下一个空闲空间的地址，名字区中的位置未必按指针对齐
+        memcpy(&name_free[cls], slot, sizeof(uint8_t *));
+        name_stat.dead -= need;
+        name_stat.reused++;
+    }
+    else
+    {
+        chunk = name_chunks;
+        if (chunk == NULL || chunk->used + need > MYFS_NAME_CHUNK)
+        {
+            chunk = (struct myfs_name_chunk *)malloc(sizeof(struct myfs_name_chunk) + MYFS_NAME_CHUNK);
+            if (chunk == NULL)
+            {
+                pthread_mutex_unlock(&name_lock);
+                return NULL;
+            }
+            chunk->used = 0;
+            chunk->next = name_chunks;
+            name_chunks = chunk;
+            name_stat.chunks++;
+        }
+        slot = &chunk->data[chunk->used];
+        chunk->used += need;
+    }
+    slot[0] = (uint8_t)len;
+    memcpy(slot + 1, name, len + 1);
+    name_stat.live += need;
+    pthread_mutex_unlock(&name_lock);
+    return (char *)(slot + 1);
+}
+
+/**
+ * @brief 释放文件名，其空间挂入同样大小的空闲链，供之后的名字复用
+ *
+ * @param fname
+ */
+void myfs_name_free(char *fname)
+{
+    int need;
+    uint8_t *slot;
+    if (fname == NULL)
+    {
+        return;
+    }
+    need = MYFS_NAME_SLOT(MYFS_FNAME_LEN(fname));
+    slot = (uint8_t *)fname - 1;
+    pthread_mutex_lock(&name_lock);
+    memcpy(slot, &name_free[need / sizeof(void *)], sizeof(uint8_t *));
+    name_free[need / sizeof(void *)] = slot;
+    name_stat.live -= need;
+    name_stat.dead += need;
+    pthread_mutex_unlock(&name_lock);
+}
+
+/**
+ * @brief 归还整个名字区
+ *
+ */
+void myfs_name_destroy(void)
+{
+    struct myfs_name_chunk *chunk;
+    MYFS_DBG("[%s] chunks: %d, live: %ld, dead: %ld, reused: %ld\n", __func__, name_stat.chunks, name_stat.live,
+             name_stat.dead, name_stat.reused);
+    pthread_mutex_lock(&name_lock);
+    while (name_chunks)
+    {
+        chunk = name_chunks;
+        name_chunks = chunk->next;
+        free(chunk);
+    }
+    memset(name_free, 0, sizeof(name_free));
+    memset(&name_stat, 0, sizeof(name_stat));
+    pthread_mutex_unlock(&name_lock);
+}
+
+/******************************************************************************
+ * SECTION: slab，调用者需持有cache->lock
+ *******************************************************************************/
+static inline struct myfs_slab *myfs_slab_of(void *obj)
+{
+    return (struct myfs_slab *)((uintptr_t)obj & ~((uintptr_t)MYFS_SLAB_SZ - 1));
+}
+
+static inline int myfs_slab_per(struct myfs_slab_cache *cache)
+{
+    int obj_sz = MYFS_ROUND_UP(cache->obj_sz, (int)sizeof(void *));
+    return (MYFS_SLAB_SZ - (int)sizeof(struct myfs_slab)) / obj_sz;
+}
+
+static void myfs_slab_link(struct myfs_slab **head, struct myfs_slab *slab)
+{
+    slab->prev = NULL;
+    slab->next = *head;
+    if (*head)
+    {
+        (*head)->prev = slab;
+    }
+    *head = slab;
+}
+
+static void myfs_slab_unlink(struct myfs_slab **head, struct myfs_slab *slab)
+{
+    if (slab->prev)
+    {
+        slab->prev->next = slab->next;
+    }
+    else
+    {
+        *head = slab->next;
+    }
+    if (slab->next)
+    {
+        slab->next->prev = slab->prev;
+    }
+    slab->next = slab->prev = NULL;
+}
+
+static struct myfs_slab *myfs_slab_grow(struct myfs_slab_cache *cache)
+{
+    struct myfs_slab *slab;
+    int obj_sz = MYFS_ROUND_UP(cache->obj_sz, (int)sizeof(void *));
+    int per = myfs_slab_per(cache);
+    uint8_t *obj;
+    if (posix_memalign((void **)&slab, MYFS_SLAB_SZ, MYFS_SLAB_SZ) != 0)
+    {
+        return NULL;
+    }
+    slab->cache = cache;
+    slab->inuse = 0;
+    slab->free = NULL;
+    // 空闲对象经由对象首字链接
+    obj = slab->objs + (per - 1) * obj_sz;
+    for (int i = 0; i < per; i++, obj -= obj_sz)
+    {
+        *(void **)obj = slab->free;
+        slab->free = obj;
+    }
+    myfs_slab_link(&cache->partial, slab);
+    cache->stat.slabs++;
+    if (cache->stat.slabs > cache->stat.peak_slabs)
+    {
+        cache->stat.peak_slabs = cache->stat.slabs;
+    }
+    return slab;
+}
+
+static void *myfs_slab_get(struct myfs_slab_cache *cache)
+{
+    struct myfs_slab *slab = cache->partial;
+    void *obj;
+    if (slab == NULL && (slab = myfs_slab_grow(cache)) == NULL)
+    {
+        return NULL;
+    }
+    obj = slab->free;
+    slab->free = *(void **)obj;
+    slab->inuse++;
+    if (slab->free == NULL)
+    {
+        myfs_slab_unlink(&cache->partial, slab);
+        myfs_slab_link(&cache->full, slab);
+    }
+    return obj;
+}
+
+static void myfs_slab_put(struct myfs_slab_cache *cache, void *obj)
+{
+    struct myfs_slab *slab = myfs_slab_of(obj);
+    if (slab->free == NULL)
+    {
+        myfs_slab_unlink(&cache->full, slab);
+        myfs_slab_link(&cache->partial, slab);
+    }
+    *(void **)obj = slab->free;
+    slab->free = obj;
+    if (--slab->inuse == 0)
+    {
+        // 整个slab已空，直接归还
+        myfs_slab_unlink(&cache->partial, slab);
+        free(slab);
+        cache->stat.slabs--;
+        cache->stat.slabs_freed++;
+    }
+}
+
+/******************************************************************************
+ * SECTION: 线程弹匣
+ *******************************************************************************/
+static void myfs_magazine_flush(int type, int keep)
+{
+    struct myfs_slab_cache *cache = &slab_caches[type];
+    struct myfs_magazine *mag = &slab_mags[type];
+    if (mag->cnt <= keep)
+    {
+        return;
+    }
+    pthread_mutex_lock(&cache->lock);
+    if (mag->epoch == slab_epoch)
+    {
+        while (mag->cnt > keep)
+        {
+            myfs_slab_put(cache, mag->objs[--mag->cnt]);
+        }
+    }
+    else
+    {
+        mag->cnt = 0;
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+static void myfs_magazine_exit(void *arg)
+{
+    (void)arg;
+    myfs_slab_drain();
+}
+
+static void myfs_magazine_key_init(void)
+{
+    pthread_key_create(&slab_key, myfs_magazine_exit);
+}
+
+static inline struct myfs_magazine *myfs_magazine_get(int type)
+{
+    struct myfs_magazine *mag = &slab_mags[type];
+    if (!slab_mags_registered)
+    {
+        // 线程退出时把弹匣中的对象还给slab
+        pthread_once(&slab_key_once, myfs_magazine_key_init);
+        pthread_setspecific(slab_key, slab_mags);
+        slab_mags_registered = TRUE;
+    }
+    if (mag->epoch != slab_epoch)
+    {
+        mag->cnt = 0;
+        mag->epoch = slab_epoch;
+    }
+    return mag;
+}
+
+/**
+ * @brief 分配一个对象，优先取自本线程弹匣，弹匣为空时从slab批量补充半匣
+ *
+ * @param type MYFS_SLAB_DENTRY或MYFS_SLAB_INODE
+ * @return void* 内容未初始化；内存不足时返回NULL
+ */
+void *myfs_slab_alloc(int type)
+{
+    struct myfs_slab_cache *cache = &slab_caches[type];
+    struct myfs_magazine *mag = myfs_magazine_get(type);
+    void *obj;
+
+    if (mag->cnt == 0)
+    {
+        pthread_mutex_lock(&cache->lock);
+        while (mag->cnt < MYFS_MAG_SZ / 2 && (obj = myfs_slab_get(cache)) != NULL)
+        {
+            mag->objs[mag->cnt++] = obj;
+        }
+        pthread_mutex_unlock(&cache->lock);
+        if (mag->cnt == 0)
+        {
+            return NULL;
+        }
+    }
+    else
+    {
+        __atomic_add_fetch(&cache->stat.mag_hits, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_add_fetch(&cache->stat.allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&cache->stat.inuse, 1, __ATOMIC_RELAXED);
+    return mag->objs[--mag->cnt];
+}
+
+/**
+ * @brief 释放一个对象到本线程弹匣，弹匣满时先把半匣还给slab
+ *
+ * @param type
+ * @param obj
+ */
+void myfs_slab_free(int type, void *obj)
+{
+    struct myfs_slab_cache *cache = &slab_caches[type];
+    struct myfs_magazine *mag;
+    if (obj == NULL)
+    {
+        return;
+    }
+    mag = myfs_magazine_get(type);
+    if (mag->cnt == MYFS_MAG_SZ)
+    {
+        myfs_magazine_flush(type, MYFS_MAG_SZ / 2);
+    }
+    mag->objs[mag->cnt++] = obj;
+    __atomic_add_fetch(&cache->stat.frees, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&cache->stat.inuse, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief 清空本线程的弹匣，使已全部释放的slab得以归还，删除整棵子树后调用
+ *
+ */
+void myfs_slab_drain(void)
+{
+    for (int type = 0; type < MYFS_SLAB_NR; type++)
+    {
+        myfs_magazine_flush(type, 0);
+    }
+}
+
+/**
+ * @brief 输出统计并归还全部slab，各线程弹匣中残留的对象随之失效
+ *
+ */
+void myfs_slab_destroy(void)
+{
+    struct myfs_slab *slab;
+    for (int type = 0; type < MYFS_SLAB_NR; type++)
+    {
+        struct myfs_slab_cache *cache = &slab_caches[type];
+        MYFS_DBG("[%s] %s: obj_sz: %d, per_slab: %d, slabs: %d, peak: %d, freed: %d, "
+                 "inuse: %ld, allocs: %ld, frees: %ld, magazine hits: %ld\n",
+                 __func__, cache->name, cache->obj_sz, myfs_slab_per(cache), cache->stat.slabs,
+                 cache->stat.peak_slabs, cache->stat.slabs_freed, cache->stat.inuse, cache->stat.allocs,
+                 cache->stat.frees, cache->stat.mag_hits);
+        pthread_mutex_lock(&cache->lock);
+        while ((slab = cache->partial) != NULL)
+        {
+            myfs_slab_unlink(&cache->partial, slab);
+            free(slab);
+        }
+        while ((slab = cache->full) != NULL)
+        {
+            myfs_slab_unlink(&cache->full, slab);
+            free(slab);
+        }
+        memset(&cache->stat, 0, sizeof(cache->stat));
+        pthread_mutex_unlock(&cache->lock);
+    }
+    slab_epoch++;
+}
+
+/******************************************************************************
+ * SECTION: 驱动I/O暂存区
+ *******************************************************************************/
+static void myfs_scratch_exit(void *buf)
+{
+    free(buf);
+}
+
+static void myfs_scratch_key_init(void)
+{
+    pthread_key_create(&scratch_key, myfs_scratch_exit);
+}
+
+/**
+ * @brief 取本线程的暂存区，至少size字节，按IO单位对齐。内容不保留，
+ * 下一次调用前有效
+ *
+ * @param size
+ * @return uint8_t* 内存不足时返回NULL
+ */
+uint8_t *myfs_scratch_get(int size)
+{
+    uint8_t *buf;
+    int sz;
+    if (size <= scratch_sz)
+    {
+        return scratch_buf;
+    }
+    sz = scratch_sz == 0 ? MYFS_SCRATCH_INIT : scratch_sz;
+    while (sz < size)
+    {
+        sz *= 2;
+    }
+    if (posix_memalign((void **)&buf, MYFS_IO_SZ(), sz) != 0)
+    {
+        return NULL;
+    }
+    pthread_once(&scratch_key_once, myfs_scratch_key_init);
+    free(scratch_buf);
+    pthread_setspecific(scratch_key, buf);
+    scratch_buf = buf;
+    scratch_sz = sz;
+    return buf;
+}
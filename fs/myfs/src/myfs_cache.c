@@ -0,0 +1,720 @@
+/**
+ * 数据块缓存、顺序预读与写聚合
+ *
+ * 缓存以设备块号为键，按LRU淘汰。顺序读时按自适应窗口把后续块一次性读入，
+ * 连续的块只需一次seek；读到窗口中的标记块时，由后台线程预读下一窗口。
+ * 写入先在每个打开文件的缓冲区中聚合，攒满或不再连续时才以整块写回设备。
+ * 同一inode的打开文件链表、各文件的写缓冲与大小由inode锁保护，读时会写回其他打开者的缓冲。
+ */
+
+#include "../include/myfs.h"
+
+extern struct myfs_super myfs_super;
+
+/* 后台预读请求 */
+struct myfs_ra_req
+{
+    int num;
+    int blknos[MYFS_RA_MAX_BLKS];
+};
+
+static struct myfs_buf *cache_bufs;                  /* 全部缓存块 */
+static uint8_t *cache_data;                          /* 缓存块数据区 */
+static struct myfs_buf *cache_hash[MYFS_CACHE_HASH]; /* 哈希链 */
+static struct myfs_buf cache_lru;                    /* 哨兵，lru_next为最近使用 */
+static unsigned long cache_gen;                      /* 每次失效递增，用于丢弃过期的预读结果 */
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct myfs_ra_req ra_queue[MYFS_RA_QUEUE];
+static int ra_head, ra_tail, ra_cnt;
+static boolean ra_running;
+static boolean ra_stop;
+static pthread_t ra_thread;
+static pthread_cond_t ra_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_mutex_t inode_locks[MYFS_INODE_LOCKS];
+
+static struct
+{
+    int hit;
+    int miss;
+    int ra_ios;   /* 预读发出的设备读次数 */
+    int ra_blks;  /* 预读读入的块数 */
+    int ra_async; /* 后台预读请求数 */
+} cache_stat;
+
+/******************************************************************************
+ * SECTION: 缓存内部操作，调用者需持有cache_lock
+ *******************************************************************************/
+static inline struct myfs_buf **myfs_cache_bucket(int blkno)
+{
+    return &cache_hash[(unsigned int)blkno % MYFS_CACHE_HASH];
+}
+
+static struct myfs_buf *myfs_cache_find(int blkno)
+{
+    struct myfs_buf *buf = *myfs_cache_bucket(blkno);
+    while (buf)
+    {
+        if (buf->blkno == blkno)
+        {
+            return buf;
+        }
+        buf = buf->hash_next;
+    }
+    return NULL;
+}
+
+static void myfs_cache_unhash(struct myfs_buf *buf)
+{
+    struct myfs_buf **pp = myfs_cache_bucket(buf->blkno);
+    while (*pp)
+    {
+        if (*pp == buf)
+        {
+            *pp = buf->hash_next;
+            break;
+        }
+        pp = &(*pp)->hash_next;
+    }
+    buf->hash_next = NULL;
+    buf->blkno = -1;
+    buf->flag &= ~MYFS_FLAG_BUF_OCCUPY;
+}
+
+static inline void myfs_cache_lru_unlink(struct myfs_buf *buf)
+{
+    buf->lru_prev->lru_next = buf->lru_next;
+    buf->lru_next->lru_prev = buf->lru_prev;
+}
+
+static inline void myfs_cache_lru_head(struct myfs_buf *buf)
+{
+    buf->lru_next = cache_lru.lru_next;
+    buf->lru_prev = &cache_lru;
+    cache_lru.lru_next->lru_prev = buf;
+    cache_lru.lru_next = buf;
+}
+
+static inline void myfs_cache_lru_tail(struct myfs_buf *buf)
+{
+    buf->lru_prev = cache_lru.lru_prev;
+    buf->lru_next = &cache_lru;
+    cache_lru.lru_prev->lru_next = buf;
+    cache_lru.lru_prev = buf;
+}
+
+/**
+ * @brief 放入一个块，淘汰最久未用的块
+ *
+ * @param blkno 设备块号
+ * @param content 块内容，大小为MYFS_BLK_SZ()
+ */
+static void myfs_cache_insert(int blkno, uint8_t *content)
+{
+    struct myfs_buf *buf = myfs_cache_find(blkno);
+    struct myfs_buf **bucket;
+
+    if (buf == NULL)
+    {
+        buf = cache_lru.lru_prev;
+        if (buf->flag & MYFS_FLAG_BUF_OCCUPY)
+        {
+            myfs_cache_unhash(buf);
+        }
+        buf->blkno = blkno;
+        buf->flag |= MYFS_FLAG_BUF_OCCUPY;
+        bucket = myfs_cache_bucket(blkno);
+        buf->hash_next = *bucket;
+        *bucket = buf;
+    }
+    memcpy(buf->data, content, MYFS_BLK_SZ());
+    myfs_cache_lru_unlink(buf);
+    myfs_cache_lru_head(buf);
+}
+
+/******************************************************************************
+ * SECTION: 后台预读线程
+ *******************************************************************************/
+static void *myfs_cache_ra_worker(void *arg)
+{
+    struct myfs_ra_req req;
+    (void)arg;
+
+    while (TRUE)
+    {
+        pthread_mutex_lock(&cache_lock);
+        while (ra_cnt == 0 && !ra_stop)
+        {
+            pthread_cond_wait(&ra_cond, &cache_lock);
+        }
+        if (ra_stop)
+        {
+            pthread_mutex_unlock(&cache_lock);
+            break;
+        }
+        req = ra_queue[ra_head];
+        ra_head = (ra_head + 1) % MYFS_RA_QUEUE;
+        ra_cnt--;
+        pthread_mutex_unlock(&cache_lock);
+
+        myfs_cache_readahead(req.blknos, req.num);
+    }
+    return NULL;
+}
+
+/******************************************************************************
+ * SECTION: 对外接口
+ *******************************************************************************/
+/**
+ * @brief 初始化缓存并启动后台预读线程，需在设备打开后调用
+ *
+ * @return int
+ */
+int myfs_cache_init(void)
+{
+    int i;
+
+    cache_bufs = (struct myfs_buf *)calloc(MYFS_CACHE_BLKS, sizeof(struct myfs_buf));
+    cache_data = (uint8_t *)malloc(MYFS_BLKS_SZ(MYFS_CACHE_BLKS));
+    if (cache_bufs == NULL || cache_data == NULL)
+    {
+        free(cache_bufs);
+        free(cache_data);
+        cache_bufs = NULL;
+        cache_data = NULL;
+        return -MYFS_ERROR_NOSPACE;
+    }
+
+    memset(cache_hash, 0, sizeof(cache_hash));
+    memset(&cache_stat, 0, sizeof(cache_stat));
+    cache_lru.lru_next = cache_lru.lru_prev = &cache_lru;
+    for (i = 0; i < MYFS_CACHE_BLKS; i++)
+    {
+        cache_bufs[i].blkno = -1;
+        cache_bufs[i].data = cache_data + i * MYFS_BLK_SZ();
+        myfs_cache_lru_tail(&cache_bufs[i]);
+    }
+
+    for (i = 0; i < MYFS_INODE_LOCKS; i++)
+    {
+        pthread_mutex_init(&inode_locks[i], NULL);
+    }
+
+    ra_head = ra_tail = ra_cnt = 0;
+    ra_stop = FALSE;
+    ra_running = pthread_create(&ra_thread, NULL, myfs_cache_ra_worker, NULL) == 0;
+    if (!ra_running)
+    {
+        MYFS_DBG("[%s] readahead thread not started, prefetch disabled\n", __func__);
+    }
+    return MYFS_ERROR_NONE;
+}
+
+/**
+ * @brief 停止后台预读线程并释放缓存
+ */
+void myfs_cache_destroy(void)
+{
+    if (ra_running)
+    {
+        pthread_mutex_lock(&cache_lock);
+        ra_stop = TRUE;
+        pthread_cond_broadcast(&ra_cond);
+        pthread_mutex_unlock(&cache_lock);
+        pthread_join(ra_thread, NULL);
+        ra_running = FALSE;
+    }
+
+    MYFS_DBG("[%s] hit: %d, miss: %d, readahead ios: %d, blks: %d, async: %d\n", __func__,
+             cache_stat.hit, cache_stat.miss, cache_stat.ra_ios, cache_stat.ra_blks, cache_stat.ra_async);
+
+    pthread_mutex_lock(&cache_lock);
+    free(cache_bufs);
+    free(cache_data);
+    cache_bufs = NULL;
+    cache_data = NULL;
+    memset(cache_hash, 0, sizeof(cache_hash));
+    pthread_mutex_unlock(&cache_lock);
+}
+
+/**
+ * @brief 经由缓存读取一个块中的部分内容，未命中时同步读入整块
+ *
+ * @param blkno 设备块号
+ * @param out_content 输出
+ * @param bias 块内偏移
+ * @param size 读取大小，bias + size不超过块大小
+ * @return int
+ */
+int myfs_cache_read(int blkno, uint8_t *out_content, int bias, int size)
+{
+    struct myfs_buf *buf;
+    uint8_t *temp_content;
+    unsigned long gen;
+
+    pthread_mutex_lock(&cache_lock);
+    buf = myfs_cache_find(blkno);
+    if (buf)
+    {
+        memcpy(out_content, buf->data + bias, size);
+        myfs_cache_lru_unlink(buf);
+        myfs_cache_lru_head(buf);
+        cache_stat.hit++;
+        pthread_mutex_unlock(&cache_lock);
+        return MYFS_ERROR_NONE;
+    }
+    cache_stat.miss++;
+    gen = cache_gen;
+    pthread_mutex_unlock(&cache_lock);
+
+    temp_content = (uint8_t *)malloc(MYFS_BLK_SZ());
+    if (temp_content == NULL)
+    {
+        return -MYFS_ERROR_NOSPACE;
+    }
+    if (myfs_driver_read(MYFS_BLKS_SZ(blkno), temp_content, MYFS_BLK_SZ()) != MYFS_ERROR_NONE)
+    {
+        free(temp_content);
+        return -MYFS_ERROR_IO;
+    }
+    memcpy(out_content, temp_content + bias, size);
+
+    pthread_mutex_lock(&cache_lock);
+    if (gen == cache_gen && cache_bufs != NULL)
+    {
+        myfs_cache_insert(blkno, temp_content);
+    }
+    pthread_mutex_unlock(&cache_lock);
+    free(temp_content);
+    return MYFS_ERROR_NONE;
+}
+
+/**
+ * @brief 同步预读一组块。已缓存的块跳过，设备块号连续的块合并为一次读，
+ * 各段经myfs_driver_batch同时发出
+ *
+ * @param blknos 设备块号
+ * @param num 块数
+ * @return int 读入的块数
+ */
+int myfs_cache_readahead(int *blknos, int num)
+{
+    int i = 0, j, k, run, done = 0, cnt = 0;
+    struct myfs_vec *vecs;
+    uint8_t *temp_content;
+    unsigned long gen;
+
+    if (num <= 0)
+    {
+        return 0;
+    }
+    temp_content = (uint8_t *)malloc(MYFS_BLKS_SZ(num));
+    vecs = (struct myfs_vec *)malloc(num * sizeof(struct myfs_vec));
+    if (temp_content == NULL || vecs == NULL)
+    {
+        free(temp_content);
+        free(vecs);
+        return 0;
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    while (cache_bufs != NULL && i < num)
+    {
+        if (myfs_cache_find(blknos[i]))
+        {
+            i++;
+            continue;
+        }
+        run = 1;
+        while (i + run < num && blknos[i + run] == blknos[i] + run && !myfs_cache_find(blknos[i + run]))
+        {
+            run++;
+        }
+        vecs[cnt].offset = MYFS_BLKS_SZ(blknos[i]);
+        vecs[cnt].size = MYFS_BLKS_SZ(run);
+        vecs[cnt].buf = temp_content + MYFS_BLKS_SZ(i);
+        cnt++;
+        i += run;
+    }
+    gen = cache_gen;
+    pthread_mutex_unlock(&cache_lock);
+
+    if (cnt > 0 && myfs_driver_batch(vecs, cnt, FALSE) == MYFS_ERROR_NONE)
+    {
+        pthread_mutex_lock(&cache_lock);
+        cache_stat.ra_ios += cnt;
+        // 读的过程中若有写入使缓存失效，丢弃这次读到的可能过期的内容
+        for (j = 0; j < cnt; j++)
+        {
+            run = vecs[j].size / MYFS_BLK_SZ();
+            i = (vecs[j].buf - temp_content) / MYFS_BLK_SZ();
+            for (k = 0; gen == cache_gen && cache_bufs != NULL && k < run; k++)
+            {
+                myfs_cache_insert(blknos[i + k], vecs[j].buf + MYFS_BLKS_SZ(k));
+            }
+            done += run;
+        }
+        cache_stat.ra_blks += done;
+        pthread_mutex_unlock(&cache_lock);
+    }
+
+    free(vecs);
+    free(temp_content);
+    return done;
+}
+
+/**
+ * @brief 提交后台预读请求，队列满时直接丢弃
+ *
+ * @param blknos 设备块号
+ * @param num 块数，不超过MYFS_RA_MAX_BLKS
+ */
+void myfs_cache_prefetch(int *blknos, int num)
+{
+    struct myfs_ra_req *req;
+
+    if (num <= 0)
+    {
+        return;
+    }
+    pthread_mutex_lock(&cache_lock);
+    if (ra_running && ra_cnt < MYFS_RA_QUEUE)
+    {
+        req = &ra_queue[ra_tail];
+        req->num = num > MYFS_RA_MAX_BLKS ? MYFS_RA_MAX_BLKS : num;
+        memcpy(req->blknos, blknos, req->num * sizeof(int));
+        ra_tail = (ra_tail + 1) % MYFS_RA_QUEUE;
+        ra_cnt++;
+        cache_stat.ra_async++;
+        pthread_cond_signal(&ra_cond);
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+/**
+ * @brief 整块写穿后用新内容更新缓存
+ *
+ * @param blkno 设备块号
+ * @param content 块内容，大小为MYFS_BLK_SZ()
+ */
+void myfs_cache_update(int blkno, uint8_t *content)
+{
+    pthread_mutex_lock(&cache_lock);
+    if (cache_bufs != NULL)
+    {
+        myfs_cache_insert(blkno, content);
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+/**
+ * @brief 设备范围被写入，使对应缓存块失效
+ *
+ * @param offset 设备偏移
+ * @param size 大小
+ */
+void myfs_cache_invalidate(int offset, int size)
+{
+    struct myfs_buf *buf;
+    int blkno;
+
+    if (size <= 0)
+    {
+        return;
+    }
+    pthread_mutex_lock(&cache_lock);
+    if (cache_bufs != NULL)
+    {
+        for (blkno = MYFS_BLK_NO(offset); blkno <= MYFS_BLK_NO(offset + size - 1); blkno++)
+        {
+            buf = myfs_cache_find(blkno);
+            if (buf)
+            {
+                myfs_cache_unhash(buf);
+                myfs_cache_lru_unlink(buf);
+                myfs_cache_lru_tail(buf);
+            }
+        }
+    }
+    cache_gen++;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+/**
+ * @brief 文件顺序读检测与自适应预读
+ *
+ * 本次请求紧接上次请求时视为顺序读：
+ *  1) 窗口为空或已被读完，同步读入新窗口，窗口大小从MYFS_RA_INIT_BLKS起翻倍，
+ *     上限MYFS_RA_MAX_BLKS，并在窗口中部设置标记块
+ *  2) 读到标记块时，后台预读紧随其后的下一个窗口，标记移到新窗口起始处
+ * 非顺序读时重置窗口，只读请求本身涉及的块
+ * 窗口状态记录在打开文件中，调用者需持有该文件inode的锁
+ *
+ * @param file 打开的文件
+ * @param first 本次请求的第一块（文件内块号）
+ * @param last 本次请求的最后一块（文件内块号）
+ */
+void myfs_readahead(struct myfs_file *file, int first, int last)
+{
+    struct myfs_inode *inode = file->inode;
+    int file_blks = MYFS_ROUND_UP(inode->size, MYFS_BLK_SZ()) / MYFS_BLK_SZ();
+    int blknos[MYFS_RA_MAX_BLKS];
+    int req_blks = last - first + 1;
+    int end, i, num = 0;
+    boolean is_seq = (file->prev_blk == -1 && first == 0) ||
+                     first == file->prev_blk || first == file->prev_blk + 1;
+
+    if (file_blks > MYFS_DATA_PER_FILE)
+    {
+        file_blks = MYFS_DATA_PER_FILE;
+    }
+    file->prev_blk = last;
+
+    if (!is_seq)
+    {
+        file->ra_size = 0;
+        file->ra_async = -1;
+        return;
+    }
+
+    if (file->ra_size == 0 || first >= file->ra_start + file->ra_size)
+    {
+        file->ra_size = file->ra_size == 0 ? MYFS_RA_INIT_BLKS : file->ra_size * 2;
+        if (file->ra_size > MYFS_RA_MAX_BLKS)
+        {
+            file->ra_size = MYFS_RA_MAX_BLKS;
+        }
+        if (file->ra_size < req_blks)
+        {
+            file->ra_size = req_blks > MYFS_RA_MAX_BLKS ? MYFS_RA_MAX_BLKS : req_blks;
+        }
+        file->ra_start = first;
+        file->ra_async = first + file->ra_size / 2;
+        if (file->ra_async <= last)
+        {
+            file->ra_async = last + 1;
+        }
+
+        end = file->ra_start + file->ra_size;
+        for (i = file->ra_start; i < end && i < file_blks; i++)
+        {
+            blknos[num++] = MYFS_BLK_NO(MYFS_DATA_OFS(inode->block_pointer[i]));
+        }
+        myfs_cache_readahead(blknos, num);
+    }
+    else if (first <= file->ra_async && file->ra_async <= last)
+    {
+        file->ra_start += file->ra_size;
+        file->ra_size *= 2;
+        if (file->ra_size > MYFS_RA_MAX_BLKS)
+        {
+            file->ra_size = MYFS_RA_MAX_BLKS;
+        }
+        file->ra_async = file->ra_start;
+
+        end = file->ra_start + file->ra_size;
+        for (i = file->ra_start; i < end && i < file_blks; i++)
+        {
+            blknos[num++] = MYFS_BLK_NO(MYFS_DATA_OFS(inode->block_pointer[i]));
+        }
+        myfs_cache_prefetch(blknos, num);
+    }
+}
+
+/******************************************************************************
+ * SECTION: 写聚合
+ *******************************************************************************/
+/**
+ * @brief 把打开文件缓冲区中的数据以整块写回设备
+ *
+ * 首尾不完整的块先经由缓存读出原内容再合并，设备块号连续的块合并为一次写，各段同时发出
+ *
+ * @param file 打开的文件
+ * @return int
+ */
+int myfs_file_flush(struct myfs_file *file)
+{
+    struct myfs_inode *inode = file->inode;
+    int first, last, blks, end, i, run, cnt = 0;
+    int ret = MYFS_ERROR_NONE;
+    struct myfs_vec *vecs;
+    uint8_t *temp_content;
+    int *blknos;
+
+    if (file->wb_size == 0)
+    {
+        return MYFS_ERROR_NONE;
+    }
+
+    end = file->wb_offset + file->wb_size;
+    first = file->wb_offset / MYFS_BLK_SZ();
+    last = (end - 1) / MYFS_BLK_SZ();
+    blks = last - first + 1;
+    temp_content = (uint8_t *)malloc(MYFS_BLKS_SZ(blks));
+    blknos = (int *)malloc(blks * sizeof(int));
+    vecs = (struct myfs_vec *)malloc(blks * sizeof(struct myfs_vec));
+    if (temp_content == NULL || blknos == NULL || vecs == NULL)
+    {
+        free(vecs);
+        free(blknos);
+        free(temp_content);
+        return -MYFS_ERROR_NOSPACE;
+    }
+    for (i = 0; i < blks; i++)
+    {
+        blknos[i] = MYFS_BLK_NO(MYFS_DATA_OFS(inode->block_pointer[first + i]));
+    }
+
+    // 首尾块的原内容读不出来时不能写回，否则会用垃圾数据覆盖块内其余部分；缓冲区保留以便重试
+    if (file->wb_offset % MYFS_BLK_SZ() != 0)
+    {
+        ret = myfs_cache_read(blknos[0], temp_content, 0, MYFS_BLK_SZ());
+    }
+    if (ret == MYFS_ERROR_NONE && end % MYFS_BLK_SZ() != 0 && (blks > 1 || file->wb_offset % MYFS_BLK_SZ() == 0))
+    {
+        // 写到文件末尾时块内其后没有需要保留的内容，补0即可，小文件整体重写时省去一次读
+        if (end < inode->size)
+        {
+            ret = myfs_cache_read(blknos[blks - 1], temp_content + MYFS_BLKS_SZ(blks - 1), 0, MYFS_BLK_SZ());
+        }
+        else
+        {
+            memset(temp_content + end - MYFS_BLKS_SZ(first), 0, MYFS_BLKS_SZ(last + 1) - end);
+        }
+    }
+    if (ret != MYFS_ERROR_NONE)
+    {
+        free(vecs);
+        free(blknos);
+        free(temp_content);
+        return -MYFS_ERROR_IO;
+    }
+    memcpy(temp_content + file->wb_offset % MYFS_BLK_SZ(), file->wbuf, file->wb_size);
+
+    for (i = 0; i < blks; i += run)
+    {
+        run = 1;
+        while (i + run < blks && blknos[i + run] == blknos[i] + run)
+        {
+            run++;
+        }
+        vecs[cnt].offset = MYFS_BLKS_SZ(blknos[i]);
+        vecs[cnt].size = MYFS_BLKS_SZ(run);
+        vecs[cnt].buf = temp_content + MYFS_BLKS_SZ(i);
+        cnt++;
+    }
+    ret = myfs_driver_batch(vecs, cnt, TRUE) == MYFS_ERROR_NONE ? MYFS_ERROR_NONE : -MYFS_ERROR_IO;
+    // 写穿后缓存中是最新内容，随后的读无需再访问设备
+    for (i = 0; ret == MYFS_ERROR_NONE && i < blks; i++)
+    {
+        myfs_cache_update(blknos[i], temp_content + MYFS_BLKS_SZ(i));
+    }
+
+    free(vecs);
+    free(blknos);
+    free(temp_content);
+    file->wb_size = 0;
+    return ret;
+}
+
+/**
+ * @brief 取得inode锁。锁按ino散列，不在inode中，持锁期间可以释放inode本身
+ *
+ * @param ino
+ */
+void myfs_inode_lock(int ino)
+{
+    pthread_mutex_lock(&inode_locks[ino % MYFS_INODE_LOCKS]);
+}
+
+/**
+ * @brief 释放inode锁
+ *
+ * @param ino
+ */
+void myfs_inode_unlock(int ino)
+{
+    pthread_mutex_unlock(&inode_locks[ino % MYFS_INODE_LOCKS]);
+}
+
+/**
+ * @brief 写回打开该inode的所有文件的缓冲区，读或改变大小前调用，调用者持有inode锁
+ *
+ * @param inode
+ * @return int
+ */
+int myfs_inode_flush(struct myfs_inode *inode)
+{
+    struct myfs_file *file;
+    int ret = MYFS_ERROR_NONE;
+
+    for (file = inode->files; file != NULL; file = file->next)
+    {
+        if (myfs_file_flush(file) != MYFS_ERROR_NONE)
+        {
+            ret = -MYFS_ERROR_IO;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief 写入打开文件的缓冲区。与缓冲数据不连续或缓冲区已满时先写回
+ *
+ * @param file 打开的文件
+ * @param in_content 写入内容
+ * @param size 大小
+ * @param offset 文件内偏移，offset + size不超过文件容量
+ * @return int
+ */
+int myfs_file_write(struct myfs_file *file, const uint8_t *in_content, int size, int offset)
+{
+    int cap = MYFS_BLKS_SZ(MYFS_WB_BLKS);
+    int len;
+
+    if (file->wbuf == NULL)
+    {
+        file->wbuf = (uint8_t *)malloc(cap);
+        if (file->wbuf == NULL)
+        {
+            return -MYFS_ERROR_NOSPACE;
+        }
+        file->wb_size = 0;
+    }
+
+    while (size > 0)
+    {
+        if (file->wb_size != 0 && offset != file->wb_offset + file->wb_size)
+        {
+            if (myfs_file_flush(file) != MYFS_ERROR_NONE)
+            {
+                return -MYFS_ERROR_IO;
+            }
+        }
+        if (file->wb_size == 0)
+        {
+            file->wb_offset = offset;
+        }
+
+        len = cap - file->wb_size;
+        if (len > size)
+        {
+            len = size;
+        }
+        memcpy(file->wbuf + file->wb_size, in_content, len);
+        file->wb_size += len;
+        in_content += len;
+        offset += len;
+        size -= len;
+
+        if (file->wb_size == cap)
+        {
+            if (myfs_file_flush(file) != MYFS_ERROR_NONE)
+            {
+                return -MYFS_ERROR_IO;
+            }
+        }
+    }
+    return MYFS_ERROR_NONE;
+}
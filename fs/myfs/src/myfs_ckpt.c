@@ -0,0 +1,295 @@
+/**
+ * 目录树检查点
+ *
+ * 正常卸载时，把内存中的整棵目录树按先序序列化写入检查点区：每条记录含文件名、
+ * ino、类型与inode内容，目录记录之后紧跟其子项。尚未读入内存的子树只记录dentry，
+ * 挂载后仍按原路径惰性读取。挂载时若超级块标记为正常卸载且generation一致，
+ * 则一次顺序读入检查点重建目录树，否则退回逐个读取inode与目录块。
+ */
+
+#include "../include/myfs.h"
+
+extern struct myfs_super myfs_super;
+
+/* 序列化缓冲区，容量受检查点区大小限制 */
+struct myfs_ckpt_buf
+{
+    uint8_t *data;
+    int size;
+    int cap;
+    int cnt;
+};
+
+/**
+ * @brief FNV-1a校验和，日志检查点同样使用
+ *
+ * @param data
+ * @param size
+ * @return uint32_t
+ */
+uint32_t myfs_ckpt_checksum(const uint8_t *data, int size)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int myfs_ckpt_put(struct myfs_ckpt_buf *buf, struct myfs_dentry *dentry)
+{
+    struct myfs_inode *inode = dentry->inode;
+    struct myfs_ckpt_rec_d *rec;
+    struct myfs_dentry *dentry_cursor;
+    int name_len = MYFS_FNAME_LEN(dentry->fname);
+    int target_len = inode != NULL && inode->target_path != NULL ? strlen(inode->target_path) : 0;
+    int len = MYFS_CKPT_REC_LEN(name_len, target_len);
+    int ret;
+
+    if (buf->size + len > buf->cap)
+    {
+        return -MYFS_ERROR_NOSPACE;
+    }
+    rec = (struct myfs_ckpt_rec_d *)(buf->data + buf->size);
+    memset(rec, 0, len);
+    // 根目录的dentry不记录ino，以inode为准
+    rec->ino = inode != NULL ? inode->ino : dentry->ino;
+    rec->ftype = dentry->ftype;
+    rec->name_len = name_len;
+    memcpy(rec->data, dentry->fname, name_len);
+    buf->size += len;
+    buf->cnt++;
+    if (inode == NULL)
+    {
+        return MYFS_ERROR_NONE;
+    }
+
+    rec->flag = MYFS_CKPT_LOADED;
+    rec->size = inode->size;
+    rec->dir_cnt = inode->dir_cnt;
+    rec->atime = inode->atime;
+    rec->mtime = inode->mtime;
+    rec->ctime = inode->ctime;
+    for (int i = 0; i < MYFS_DATA_PER_FILE; i++)
+    {
+        rec->block_pointer[i] = inode->block_pointer[i];
+    }
+    rec->target_len = target_len;
+    if (target_len != 0)
+    {
+        memcpy(rec->data + name_len, inode->target_path, target_len);
+    }
+    for (dentry_cursor = inode->dentrys; dentry_cursor != NULL; dentry_cursor = dentry_cursor->brother)
+    {
+        if ((ret = myfs_ckpt_put(buf, dentry_cursor)) != MYFS_ERROR_NONE)
+        {
+            return ret;
+        }
+    }
+    return MYFS_ERROR_NONE;
+}
+
+/**
+ * @brief 把整棵目录树序列化为检查点，加入写回链表
+ *
+ * @param list
+ * @return int 检查点写入的字节数；设备无检查点区或目录树超出其容量时返回负数
+ */
+int myfs_ckpt_save(struct myfs_io_list *list)
+{
+    struct myfs_ckpt_buf buf;
+    struct myfs_ckpt_d *ckpt_d;
+    int ret;
+
+    if (myfs_super.ckpt_blks == 0)
+    {
+        return -MYFS_ERROR_UNSUPPORTED;
+    }
+    buf.cap = MYFS_BLKS_SZ(myfs_super.ckpt_blks);
+    buf.data = (uint8_t *)malloc(buf.cap);
+    if (buf.data == NULL)
+    {
+        return -MYFS_ERROR_NOSPACE;
+    }
+    buf.size = sizeof(struct myfs_ckpt_d);
+    buf.cnt = 0;
+    ret = myfs_ckpt_put(&buf, myfs_super.root_dentry);
+    if (ret != MYFS_ERROR_NONE)
+    {
+        MYFS_DBG("[%s] tree exceeds checkpoint area, skipped\n", __func__);
+        free(buf.data);
+        return ret;
+    }
+
+    ckpt_d = (struct myfs_ckpt_d *)buf.data;
+    ckpt_d->magic = MYFS_CKPT_MAGIC;
+    ckpt_d->generation = myfs_super.generation;
+    ckpt_d->size = buf.size;
+    ckpt_d->cnt = buf.cnt;
+    ckpt_d->reserved = 0;
+    ckpt_d->checksum = myfs_ckpt_checksum(buf.data + sizeof(struct myfs_ckpt_d), buf.size - sizeof(struct myfs_ckpt_d));
+    // 补齐到整块，与inode表、数据区相邻的写可以拼接
+    ret = MYFS_ROUND_UP(buf.size, MYFS_BLK_SZ());
+    memset(buf.data + buf.size, 0, ret - buf.size);
+    if (myfs_io_add(list, myfs_super.ckpt_offset, buf.data, ret) != MYFS_ERROR_NONE)
+    {
+        free(buf.data);
+        return -MYFS_ERROR_NOSPACE;
+    }
+    free(buf.data);
+    return buf.size;
+}
+
+/**
+ * @brief 释放重建到一半的子树，只释放内存，不改动位图
+ *
+ * @param dentry
+ * @param owned dentry由myfs_ckpt_get新建时一并释放，否则只摘下其inode
+ */
+static void myfs_ckpt_free(struct myfs_dentry *dentry, boolean owned)
+{
+    struct myfs_inode *inode = dentry->inode;
+    struct myfs_dentry *sub_dentry;
+
+    if (inode != NULL)
+    {
+        while ((sub_dentry = inode->dentrys) != NULL)
+        {
+            inode->dentrys = sub_dentry->brother;
+            myfs_ckpt_free(sub_dentry, TRUE);
+        }
+        free(inode->target_path);
+        myfs_slab_free(MYFS_SLAB_INODE, inode);
+        dentry->inode = NULL;
+    }
+    if (owned)
+    {
+        free_dentry(dentry);
+    }
+}
+
+/**
+ * @brief 按先序读出一条记录及其下的子树
+ *
+ * @param cur 当前读到的位置，随之前移
+ * @param end 检查点有效内容的末尾
+ * @param dentry 已有的dentry（根目录），为NULL时按记录新建
+ * @return struct myfs_dentry* 失败时返回NULL，已建立的部分均已释放，传入的dentry->inode为NULL
+ */
+static struct myfs_dentry *myfs_ckpt_get(uint8_t **cur, uint8_t *end, struct myfs_dentry *dentry)
+{
+    struct myfs_ckpt_rec_d *rec = (struct myfs_ckpt_rec_d *)*cur;
+    struct myfs_inode *inode;
+    struct myfs_dentry *sub_dentry;
+    char fname[MYFS_MAX_FILE_NAME];
+    boolean owned = dentry == NULL;
+
+    if (*cur + sizeof(struct myfs_ckpt_rec_d) > end ||
+        *cur + MYFS_CKPT_REC_LEN(rec->name_len, rec->target_len) > end || rec->name_len >= MYFS_MAX_FILE_NAME)
+    {
+        return NULL;
+    }
+    *cur += MYFS_CKPT_REC_LEN(rec->name_len, rec->target_len);
+    if (dentry == NULL)
+    {
+        memcpy(fname, rec->data, rec->name_len);
+        fname[rec->name_len] = '\0';
+        dentry = new_dentry(fname, rec->ftype);
+        if (dentry == NULL)
+        {
+            return NULL;
+        }
+    }
+    dentry->ino = rec->ino;
+    if (!(rec->flag & MYFS_CKPT_LOADED))
+    {
+        return dentry;
+    }
+
+    inode = (struct myfs_inode *)myfs_slab_alloc(MYFS_SLAB_INODE);
+    if (inode == NULL)
+    {
+        myfs_ckpt_free(dentry, owned);
+        return NULL;
+    }
+    inode->ino = rec->ino;
+    inode->size = rec->size;
+    inode->dir_cnt = 0;
+    inode->atime = rec->atime;
+    inode->mtime = rec->mtime;
+    inode->ctime = rec->ctime;
+    for (int i = 0; i < MYFS_DATA_PER_FILE; i++)
+    {
+        inode->block_pointer[i] = rec->block_pointer[i];
+    }
+    inode->target_path = NULL;
+    if (rec->target_len != 0)
+    {
+        inode->target_path = strndup(rec->data + rec->name_len, rec->target_len);
+    }
+    inode->dentry = dentry;
+    inode->dentrys = NULL;
+    inode->files = NULL;
+    dentry->inode = inode;
+    for (int i = 0; i < rec->dir_cnt; i++)
+    {
+        sub_dentry = myfs_ckpt_get(cur, end, NULL);
+        if (sub_dentry == NULL)
+        {
+            myfs_ckpt_free(dentry, owned);
+            return NULL;
+        }
+        sub_dentry->parent = dentry;
+        myfs_alloc_dentry(inode, sub_dentry);
+    }
+    inode->dirty = FALSE;
+    return dentry;
+}
+
+/**
+ * @brief 以一次顺序读载入检查点并重建目录树，调用者已确认超级块标记为正常卸载
+ *
+ * @param root_dentry 根目录dentry，成功时其inode及以下结构由检查点填充
+ * @param size 超级块中记录的检查点字节数
+ * @return int 检查点缺失或已损坏时返回负数，调用者应退回常规路径
+ */
+int myfs_ckpt_load(struct myfs_dentry *root_dentry, int size)
+{
+    struct myfs_ckpt_d *ckpt_d;
+    uint8_t *data, *cur;
+    int size_aligned = MYFS_ROUND_UP(size, MYFS_BLK_SZ());
+    int ret = -MYFS_ERROR_INVAL;
+
+    if (size < (int)sizeof(struct myfs_ckpt_d) || size_aligned > MYFS_BLKS_SZ(myfs_super.ckpt_blks))
+    {
+        return ret;
+    }
+    data = (uint8_t *)malloc(size_aligned);
+    if (data == NULL)
+    {
+        return -MYFS_ERROR_NOSPACE;
+    }
+    if (myfs_driver_read(myfs_super.ckpt_offset, data, size_aligned) != MYFS_ERROR_NONE)
+    {
+        free(data);
+        return -MYFS_ERROR_IO;
+    }
+    ckpt_d = (struct myfs_ckpt_d *)data;
+    // 校验通过后才开始重建。记录越界或内存不足时重建会中途失败，已建立的部分由myfs_ckpt_get释放，
+    // 根目录dentry不再带有inode，调用者退回常规路径
+    if (ckpt_d->magic == MYFS_CKPT_MAGIC && ckpt_d->generation == myfs_super.generation && ckpt_d->size == size &&
+        ckpt_d->checksum == myfs_ckpt_checksum(data + sizeof(struct myfs_ckpt_d), size - sizeof(struct myfs_ckpt_d)))
+    {
+        cur = data + sizeof(struct myfs_ckpt_d);
+        if (myfs_ckpt_get(&cur, data + size, root_dentry) != NULL && root_dentry->inode != NULL)
+        {
+            MYFS_DBG("[%s] generation: %u, records: %d, bytes: %d\n", __func__, ckpt_d->generation, ckpt_d->cnt,
+                     size);
+            ret = MYFS_ERROR_NONE;
+        }
+    }
+    free(data);
+    return ret;
+}
@@ -0,0 +1,887 @@
+/**
+ * 日志结构写模式
+ *
+ * 以--lfs格式化时，inode表与数据区不再有固定位置，只是从seg_offset开始的一段虚拟地址。
+ * 每次写入都以整块追加到日志头，由块映射表记录每个虚拟块的最新位置，其中inode表部分
+ * 即inode map。位图、超级块与目录树检查点仍在固定位置原地写。日志区按段管理，
+ * 每段记录有效块数与最近写入序号；空闲段低于低水位时，后台清理线程按代价收益选出段，
+ * 把其中仍有效的块追加到日志头后整段回收。映射表与段使用表写入超级块记录的两个
+ * 检查点槽之一，挂载时取序号较新且校验通过的一份。被覆盖或清空的段要等下一次
+ * 检查点写出后才能重用，因此崩溃后上一份检查点引用的块总是完好的。
+ *
+ * 前台写入与清理搬移各有一个日志头，搬移出来的冷数据不与新写入的数据混在同一段。
+ * 以--zoned格式化或设备本身是分区设备时，每段恰为一个顺序写分区：日志头只在写指针处
+ * 追加，段回收后重用前重置分区写指针，固定位置的元数据放在开头的常规分区中。
+ */
+
+#include "../include/myfs.h"
+
+extern struct myfs_super myfs_super;
+
+enum myfs_lfs_seg_state
+{
+    MYFS_LFS_SEG_FREE,
+    MYFS_LFS_SEG_USED,
+    MYFS_LFS_SEG_PENDING /* 已无有效块，但仍可能被磁盘上的检查点引用 */
+};
+
+enum myfs_lfs_head
+{
+    MYFS_LFS_HEAD_USER, /* 前台写入 */
+    MYFS_LFS_HEAD_GC,   /* 清理搬移 */
+    MYFS_LFS_HEADS
+};
+
+struct myfs_lfs_seg
+{
+    int live;     /* 有效块数 */
+    uint32_t seq; /* 最近一次写入时的日志序号 */
+    int state;    /* myfs_lfs_seg_state */
+};
+
+static int *lfs_map;                 /* 虚拟块 -> 日志块，-1表示未写入，读出全0 */
+static int *lfs_rmap;                /* 日志块 -> 虚拟块，-1表示无效 */
+static struct myfs_lfs_seg *lfs_segs;
+static int lfs_vblks;
+static int lfs_head_seg[MYFS_LFS_HEADS]; /* 日志头所在段，-1表示尚未打开 */
+static int lfs_head_off[MYFS_LFS_HEADS];
+static int lfs_free_segs;
+static int lfs_pending_segs;
+static uint32_t lfs_log_seq;         /* 每次追加递增 */
+static uint32_t lfs_ckpt_seq;
+static uint8_t *lfs_seg_buf;         /* 清理时读入整段 */
+static int *lfs_seg_vblks;
+static uint8_t *lfs_ckpt_buf;
+static pthread_rwlock_t lfs_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static boolean cleaner_running;
+static boolean cleaner_stop;
+static pthread_t cleaner_thread;
+static pthread_mutex_t cleaner_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cleaner_cond = PTHREAD_COND_INITIALIZER;
+
+static struct
+{
+    long written;   /* 文件系统写入的块数 */
+    long relocated; /* 清理时搬移的块数 */
+    int cleaned;    /* 回收的段数 */
+    int stalls;     /* 前台写入等不及后台清理、同步清理的次数 */
+    int ckpts;
+    int resets;     /* 分区写指针重置次数 */
+} lfs_stat;
+
+/******************************************************************************
+ * SECTION: 日志内部操作，调用者需持有lfs_lock
+ *******************************************************************************/
+static int myfs_lfs_dev_read(int blk, uint8_t *out_content, int blks)
+{
+    if (myfs_stripe_pread(out_content, MYFS_BLKS_SZ(blks), myfs_super.seg_offset + MYFS_BLKS_SZ(blk)) !=
+        MYFS_ERROR_NONE)
+    {
+        return -MYFS_ERROR_IO;
+    }
+    return MYFS_ERROR_NONE;
+}
+
+static int myfs_lfs_dev_write(int blk, uint8_t *in_content, int blks)
+{
+    if (myfs_stripe_pwrite(in_content, MYFS_BLKS_SZ(blks), myfs_super.seg_offset + MYFS_BLKS_SZ(blk)) !=
+        MYFS_ERROR_NONE)
+    {
+        return -MYFS_ERROR_IO;
+    }
+    return MYFS_ERROR_NONE;
+}
+
+static boolean myfs_lfs_is_head(int seg)
+{
+    return seg == lfs_head_seg[MYFS_LFS_HEAD_USER] || seg == lfs_head_seg[MYFS_LFS_HEAD_GC];
+}
+
+/**
+ * @brief 段对应的分区号，分区模式下段与分区一一对应
+ *
+ * @param seg
+ * @return int
+ */
+static int myfs_lfs_zone(int seg)
+{
+    return myfs_super.seg_offset / MYFS_BLKS_SZ(myfs_super.seg_blks) + seg;
+}
+
+/**
+ * @brief 日志块失效，所在段清空后转为待回收
+ *
+ * @param blk 日志块号
+ */
+static void myfs_lfs_kill(int blk)
+{
+    int seg = blk / myfs_super.seg_blks;
+
+    lfs_rmap[blk] = -1;
+    if (--lfs_segs[seg].live == 0 && !myfs_lfs_is_head(seg))
+    {
+        lfs_segs[seg].state = MYFS_LFS_SEG_PENDING;
+        lfs_pending_segs++;
+    }
+}
+
+/**
+ * @brief 把虚拟块指向新的日志块，旧位置失效
+ *
+ * @param vblk
+ * @param blk 日志块号，-1表示丢弃
+ */
+static void myfs_lfs_remap(int vblk, int blk)
+{
+    if (lfs_map[vblk] >= 0)
+    {
+        myfs_lfs_kill(lfs_map[vblk]);
+    }
+    lfs_map[vblk] = blk;
+    if (blk >= 0)
+    {
+        lfs_rmap[blk] = vblk;
+        lfs_segs[blk / myfs_super.seg_blks].live++;
+    }
+}
+
+static int myfs_lfs_read_blk(int vblk, uint8_t *out_content)
+{
+    if (lfs_map[vblk] < 0)
+    {
+        memset(out_content, 0, MYFS_BLK_SZ());
+        return MYFS_ERROR_NONE;
+    }
+    return myfs_lfs_dev_read(lfs_map[vblk], out_content, 1);
+}
+
+/**
+ * @brief 写出映射表与段使用表，此后待回收的段不再被引用，转为空闲
+ *
+ * @return int
+ */
+static int myfs_lfs_ckpt(void)
+{
+    struct myfs_lfs_ckpt_d *ckpt_d = (struct myfs_lfs_ckpt_d *)lfs_ckpt_buf;
+    struct myfs_lfs_seg_d *seg_d;
+    int *map_d;
+    int size = sizeof(struct myfs_lfs_ckpt_d) + lfs_vblks * sizeof(int) +
+               myfs_super.segs * sizeof(struct myfs_lfs_seg_d);
+    int slot;
+
+    map_d = (int *)(lfs_ckpt_buf + sizeof(struct myfs_lfs_ckpt_d));
+    memcpy(map_d, lfs_map, lfs_vblks * sizeof(int));
+    seg_d = (struct myfs_lfs_seg_d *)(map_d + lfs_vblks);
+    for (int seg = 0; seg < myfs_super.segs; seg++)
+    {
+        seg_d[seg].live = lfs_segs[seg].live;
+        seg_d[seg].seq = lfs_segs[seg].seq;
+    }
+    ckpt_d->magic = MYFS_LFS_MAGIC;
+    ckpt_d->seq = ++lfs_ckpt_seq;
+    ckpt_d->vblks = lfs_vblks;
+    ckpt_d->segs = myfs_super.segs;
+    ckpt_d->cur_seg = lfs_head_seg[MYFS_LFS_HEAD_USER];
+    ckpt_d->cur_off = lfs_head_off[MYFS_LFS_HEAD_USER];
+    ckpt_d->gc_seg = lfs_head_seg[MYFS_LFS_HEAD_GC];
+    ckpt_d->gc_off = lfs_head_off[MYFS_LFS_HEAD_GC];
+    ckpt_d->log_seq = lfs_log_seq;
+    ckpt_d->checksum = myfs_ckpt_checksum(lfs_ckpt_buf + sizeof(struct myfs_lfs_ckpt_d),
+                                          size - sizeof(struct myfs_lfs_ckpt_d));
+    // 两个槽交替写，写到一半时另一个槽仍完好
+    slot = ckpt_d->seq % 2;
+    size = MYFS_ROUND_UP(size, MYFS_BLK_SZ());
+    if (myfs_stripe_pwrite(lfs_ckpt_buf, size, myfs_super.lfs_ckpt_offset +
+                                                    MYFS_BLKS_SZ(slot * myfs_super.lfs_ckpt_blks)) != MYFS_ERROR_NONE)
+    {
+        return -MYFS_ERROR_IO;
+    }
+
+    for (int seg = 0; seg < myfs_super.segs && lfs_pending_segs > 0; seg++)
+    {
+        if (lfs_segs[seg].state == MYFS_LFS_SEG_PENDING)
+        {
+            lfs_segs[seg].state = MYFS_LFS_SEG_FREE;
+            lfs_pending_segs--;
+            lfs_free_segs++;
+        }
+    }
+    lfs_stat.ckpts++;
+    return MYFS_ERROR_NONE;
+}
+
+/**
+ * @brief 按代价收益选出清理的段：(1 - u) * age / (1 + u)，u为有效块比例
+ *
+ * @return int 段号，没有可回收空间的段时返回-1
+ */
+static int myfs_lfs_victim(void)
+{
+    double score, best_score = -1;
+    double u;
+    int best = -1;
+
+    for (int seg = 0; seg < myfs_super.segs; seg++)
+    {
+        if (lfs_segs[seg].state != MYFS_LFS_SEG_USED || myfs_lfs_is_head(seg) ||
+            lfs_segs[seg].live == myfs_super.seg_blks)
+        {
+            continue;
+        }
+        u = (double)lfs_segs[seg].live / myfs_super.seg_blks;
+        score = (1 - u) * (double)(lfs_log_seq - lfs_segs[seg].seq + 1) / (1 + u);
+        if (score > best_score)
+        {
+            best_score = score;
+            best = seg;
+        }
+    }
+    return best;
+}
+
+static int myfs_lfs_append(const int *vblks, uint8_t *in_content, int num, boolean cleaner);
+
+/**
+ * @brief 把一个段中仍有效的块追加到清理日志头，该段随之转为待回收
+ *
+ * @param seg
+ * @return int
+ */
+static int myfs_lfs_clean_seg(int seg)
+{
+    int base = seg * myfs_super.seg_blks;
+    int num = 0;
+    int ret;
+
+    if ((ret = myfs_lfs_dev_read(base, lfs_seg_buf, myfs_super.seg_blks)) != MYFS_ERROR_NONE)
+    {
+        return ret;
+    }
+    for (int i = 0; i < myfs_super.seg_blks; i++)
+    {
+        if (lfs_rmap[base + i] < 0)
+        {
+            continue;
+        }
+        if (num != i)
+        {
+            memcpy(lfs_seg_buf + MYFS_BLKS_SZ(num), lfs_seg_buf + MYFS_BLKS_SZ(i), MYFS_BLK_SZ());
+        }
+        lfs_seg_vblks[num++] = lfs_rmap[base + i];
+    }
+    if ((ret = myfs_lfs_append(lfs_seg_vblks, lfs_seg_buf, num, TRUE)) != MYFS_ERROR_NONE)
+    {
+        return ret;
+    }
+    lfs_stat.relocated += num;
+    lfs_stat.cleaned++;
+    return MYFS_ERROR_NONE;
+}
+
+/**
+ * @brief 日志头所在段已写满，换到下一个空闲段。前台写入不能动用预留段，
+ * 空闲段不足时先写检查点回收待回收段，仍不足则同步清理。分区模式下先重置新段的写指针
+ *
+ * @param cleaner 是否为清理时的搬移
+ * @return int
+ */
+static int myfs_lfs_next_seg(boolean cleaner)
+{
+    int head = cleaner ? MYFS_LFS_HEAD_GC : MYFS_LFS_HEAD_USER;
+    int reserve = cleaner ? 0 : MYFS_LFS_RESERVE;
+    int seg, zone, ret;
+
+    if (lfs_free_segs <= reserve && lfs_pending_segs > 0 && (ret = myfs_lfs_ckpt()) != MYFS_ERROR_NONE)
+    {
+        return ret;
+    }
+    while (lfs_free_segs <= reserve && !cleaner)
+    {
+        if ((seg = myfs_lfs_victim()) < 0)
+        {
+            return -MYFS_ERROR_NOSPACE;
+        }
+        lfs_stat.stalls++;
+        if ((ret = myfs_lfs_clean_seg(seg)) != MYFS_ERROR_NONE || (ret = myfs_lfs_ckpt()) != MYFS_ERROR_NONE)
+        {
+            return ret;
+        }
+    }
+    if (lfs_free_segs == 0)
+    {
+        return -MYFS_ERROR_NOSPACE;
+    }
+
+    // 从当前段往后找，空闲段较多时日志大致按地址顺序前进
+    for (seg = (lfs_head_seg[head] + 1) % myfs_super.segs; lfs_segs[seg].state != MYFS_LFS_SEG_FREE;
+         seg = (seg + 1) % myfs_super.segs)
+        ;
+    zone = myfs_lfs_zone(seg);
+    if (myfs_super.zoned && myfs_stripe_ioctl(IOC_REQ_ZONE_RESET, &zone) != 0)
+    {
+        return -MYFS_ERROR_IO;
+    }
+    lfs_stat.resets += myfs_super.zoned;
+    if (lfs_head_seg[head] >= 0 && lfs_segs[lfs_head_seg[head]].live == 0)
+    {
+        lfs_segs[lfs_head_seg[head]].state = MYFS_LFS_SEG_PENDING;
+        lfs_pending_segs++;
+    }
+    lfs_segs[seg].state = MYFS_LFS_SEG_USED;
+    lfs_free_segs--;
+    lfs_head_seg[head] = seg;
+    lfs_head_off[head] = 0;
+
+    if (lfs_free_segs * 100 < myfs_super.segs * MYFS_LFS_CLEAN_LOW)
+    {
+        pthread_mutex_lock(&cleaner_lock);
+        pthread_cond_signal(&cleaner_cond);
+        pthread_mutex_unlock(&cleaner_lock);
+    }
+    return MYFS_ERROR_NONE;
+}
+
+/**
+ * @brief 把num个虚拟块依次追加到日志头，同一段内的块一次写出
+ *
+ * @param vblks 各块的虚拟块号
+ * @param in_content 各块内容，首尾相接
+ * @param num
+ * @param cleaner 是否为清理时的搬移，追加到清理日志头
+ * @return int
+ */
+static int myfs_lfs_append(const int *vblks, uint8_t *in_content, int num, boolean cleaner)
+{
+    int head = cleaner ? MYFS_LFS_HEAD_GC : MYFS_LFS_HEAD_USER;
+    int done = 0, run, blk, ret;
+
+    while (done < num)
+    {
+        if (lfs_head_off[head] == myfs_super.seg_blks && (ret = myfs_lfs_next_seg(cleaner)) != MYFS_ERROR_NONE)
+        {
+            return ret;
+        }
+        run = myfs_super.seg_blks - lfs_head_off[head];
+        run = run < num - done ? run : num - done;
+        blk = lfs_head_seg[head] * myfs_super.seg_blks + lfs_head_off[head];
+        if ((ret = myfs_lfs_dev_write(blk, in_content + MYFS_BLKS_SZ(done), run)) != MYFS_ERROR_NONE)
+        {
+            return ret;
+        }
+        lfs_head_off[head] += run;
+        lfs_segs[lfs_head_seg[head]].seq = ++lfs_log_seq;
+        for (int i = 0; i < run; i++)
+        {
+            myfs_lfs_remap(vblks[done + i], blk + i);
+        }
+        done += run;
+    }
+    return MYFS_ERROR_NONE;
+}
+
+/******************************************************************************
+ * SECTION: 后台清理线程
+ *******************************************************************************/
+static void *myfs_lfs_cleaner(void *arg)
+{
+    struct timespec deadline;
+    boolean active = FALSE; /* 已低于低水位，清理到高水位为止 */
+    boolean stop;
+    int avail, seg;
+    (void)arg;
+
+    while (TRUE)
+    {
+        pthread_mutex_lock(&cleaner_lock);
+        if (!active && !cleaner_stop)
+        {
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += MYFS_LFS_CLEAN_INTERVAL * 1000000L;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&cleaner_cond, &cleaner_lock, &deadline);
+        }
+        stop = cleaner_stop;
+        pthread_mutex_unlock(&cleaner_lock);
+        if (stop)
+        {
+            break;
+        }
+
+        // 每次只清理一个段，其间前台读写可以穿插进来
+        pthread_rwlock_wrlock(&lfs_lock);
+        avail = lfs_free_segs + lfs_pending_segs;
+        active = active || avail * 100 < myfs_super.segs * MYFS_LFS_CLEAN_LOW;
+        if (active)
+        {
+            seg = avail * 100 < myfs_super.segs * MYFS_LFS_CLEAN_HIGH ? myfs_lfs_victim() : -1;
+            if (seg < 0 || myfs_lfs_clean_seg(seg) != MYFS_ERROR_NONE)
+            {
+                active = FALSE;
+                if (lfs_pending_segs > 0)
+                {
+                    myfs_lfs_ckpt();
+                }
+            }
+        }
+        pthread_rwlock_unlock(&lfs_lock);
+    }
+    return NULL;
+}
+
+static void myfs_lfs_free(void)
+{
+    free(lfs_map);
+    free(lfs_rmap);
+    free(lfs_segs);
+    free(lfs_seg_buf);
+    free(lfs_seg_vblks);
+    free(lfs_ckpt_buf);
+    lfs_map = lfs_rmap = lfs_seg_vblks = NULL;
+    lfs_segs = NULL;
+    lfs_seg_buf = lfs_ckpt_buf = NULL;
+}
+
+/******************************************************************************
+ * SECTION: 对外接口
+ *******************************************************************************/
+/**
+ * @brief 按日志结构布局格式化。元数据区大小先按整个设备都可映射估计上界，
+ * 其余划分为段，虚拟地址空间只占日志区的(100 - MYFS_LFS_OP)%
+ *
+ * | Super(1) | Inode Map | Data Map | Checkpoint | LFS Checkpoint(2) | Segments |
+ * 虚拟地址: | Inodes | Data |，从Segments起点开始
+ *
+ * 分区模式下每段为一个分区，元数据须能放进开头的常规分区，Segments从第一个顺序写分区开始。
+ * 普通模拟设备先按MYFS_ZONE_SZ配置为分区设备，常规分区数取刚好容纳元数据的个数
+ *
+ * @param myfs_super_d 输出的超级块
+ * @param zoned 按分区设备格式化
+ * @return int 设备太小或常规分区放不下元数据时返回-MYFS_ERROR_INVAL
+ */
+int myfs_lfs_format(struct myfs_super_d *myfs_super_d, boolean zoned)
+{
+    struct ddriver_zone_info zone_info;
+    int blk_bits = MYFS_BLK_SZ() * UINT8_BITS;
+    int disk_blks = MYFS_DISK_SZ() / MYFS_BLK_SZ();
+    int est_vblks = disk_blks * (100 - MYFS_LFS_OP) / 100;
+    int est_ino = est_vblks / (MYFS_DATA_PER_FILE + MYFS_INODE_PER_FILE);
+    int map_inode_blks = (est_ino + blk_bits - 1) / blk_bits;
+    int map_data_blks = (est_ino * MYFS_DATA_PER_FILE + blk_bits - 1) / blk_bits;
+    int ckpt_blks = MYFS_ROUND_UP(est_ino * MYFS_CKPT_PER_INODE, MYFS_BLK_SZ()) / MYFS_BLK_SZ();
+    int seg_blks = MYFS_LFS_SEG_BLKS;
+    int lfs_ckpt_size, lfs_ckpt_blks, meta_blks, seg_start, segs, inode_num;
+
+    memset(&zone_info, 0, sizeof(zone_info));
+    if (zoned)
+    {
+        myfs_stripe_ioctl(IOC_REQ_ZONE_INFO, &zone_info);
+        seg_blks = (zone_info.zone_sz != 0 ? zone_info.zone_sz : MYFS_ZONE_SZ) / MYFS_BLK_SZ();
+    }
+    lfs_ckpt_size = sizeof(struct myfs_lfs_ckpt_d) + est_vblks * sizeof(int) +
+                    (disk_blks / seg_blks) * sizeof(struct myfs_lfs_seg_d);
+    lfs_ckpt_blks = MYFS_ROUND_UP(lfs_ckpt_size, MYFS_BLK_SZ()) / MYFS_BLK_SZ();
+    meta_blks = 1 + map_inode_blks + map_data_blks + ckpt_blks + 2 * lfs_ckpt_blks;
+    seg_start = meta_blks;
+    segs = (disk_blks - meta_blks) / seg_blks;
+    if (zoned)
+    {
+        if (zone_info.zone_sz == 0)
+        {
+            zone_info.zone_sz = MYFS_ZONE_SZ;
+            zone_info.nr_conv = (meta_blks + seg_blks - 1) / seg_blks;
+            zone_info.max_open = MYFS_ZONE_MAX_OPEN;
+            if (myfs_stripe_ioctl(IOC_REQ_ZONE_CONFIG, &zone_info) != 0 ||
+                myfs_stripe_ioctl(IOC_REQ_ZONE_INFO, &zone_info) != 0)
+            {
+                MYFS_DBG("[%s] cannot configure the device as zoned\n", __func__);
+                return -MYFS_ERROR_INVAL;
+            }
+        }
+        if (zone_info.zone_sz % MYFS_BLK_SZ() != 0 || meta_blks > zone_info.nr_conv * seg_blks)
+        {
+            MYFS_DBG("[%s] metadata (%d blks) does not fit in %d conventional zones\n", __func__, meta_blks,
+                     zone_info.nr_conv);
+            return -MYFS_ERROR_INVAL;
+        }
+        seg_start = zone_info.nr_conv * seg_blks;
+        segs = zone_info.nr_zones - zone_info.nr_conv;
+    }
+    inode_num = segs * seg_blks * (100 - MYFS_LFS_OP) / 100 / (MYFS_DATA_PER_FILE + MYFS_INODE_PER_FILE);
+
+    if (segs <= MYFS_LFS_RESERVE + 1 || inode_num < 1)
+    {
+        return -MYFS_ERROR_INVAL;
+    }
+    myfs_super_d->max_ino = inode_num;
+    myfs_super_d->map_inode_blks = map_inode_blks;
+    myfs_super_d->map_inode_offset = MYFS_SUPER_OFS + MYFS_BLKS_SZ(1);
+    myfs_super_d->map_data_blks = map_data_blks;
+    myfs_super_d->map_data_offset = myfs_super_d->map_inode_offset + MYFS_BLKS_SZ(map_inode_blks);
+    myfs_super_d->ckpt_offset = myfs_super_d->map_data_offset + MYFS_BLKS_SZ(map_data_blks);
+    myfs_super_d->ckpt_blks = ckpt_blks;
+    myfs_super_d->lfs_ckpt_offset = myfs_super_d->ckpt_offset + MYFS_BLKS_SZ(ckpt_blks);
+    myfs_super_d->lfs_ckpt_blks = lfs_ckpt_blks;
+    myfs_super_d->seg_offset = MYFS_SUPER_OFS + MYFS_BLKS_SZ(seg_start);
+    myfs_super_d->seg_blks = seg_blks;
+    myfs_super_d->segs = segs;
+    myfs_super_d->inode_offset = myfs_super_d->seg_offset;
+    myfs_super_d->data_offset = myfs_super_d->inode_offset + MYFS_BLKS_SZ(inode_num);
+    myfs_super_d->free_ino = inode_num;
+    myfs_super_d->free_data = inode_num * MYFS_DATA_PER_FILE;
+    myfs_super_d->groups = 1;
+    myfs_super_d->group_blks = disk_blks;
+    myfs_super_d->group_data = inode_num * MYFS_DATA_PER_FILE;
+    myfs_super_d->lfs = TRUE;
+    myfs_super_d->zoned = zoned;
+    MYFS_DBG("[%s] %ssegs: %d x %d blks, inodes: %d, data: %d, ckpt slot: %d blks\n", __func__,
+             zoned ? "zoned, " : "", segs, seg_blks, inode_num, myfs_super_d->free_data, lfs_ckpt_blks);
+    return MYFS_ERROR_NONE;
+}
+
+/**
+ * @brief 载入较新的日志检查点并启动清理线程，需在超级块字段就绪后、任何inode读写之前调用。
+ * 分区模式下日志头从分区写指针处继续，检查点之后追加的块不再可写
+ *
+ * @param is_init 新格式化的设备，日志为空
+ * @return int 两个检查点槽都无效时返回-MYFS_ERROR_IO
+ */
+int myfs_lfs_mount(boolean is_init)
+{
+    struct myfs_lfs_ckpt_d *ckpt_d = NULL;
+    struct myfs_lfs_seg_d *seg_d;
+    uint8_t *slots[2];
+    int log_blks = myfs_super.segs * myfs_super.seg_blks;
+    int slot_sz = MYFS_BLKS_SZ(myfs_super.lfs_ckpt_blks);
+    int size, blk;
+    int report_buf[(sizeof(struct ddriver_zone_report) + sizeof(struct ddriver_zone)) / sizeof(int)];
+    struct ddriver_zone_report *report = (struct ddriver_zone_report *)report_buf;
+
+    lfs_vblks = (myfs_super.data_offset - myfs_super.seg_offset) / MYFS_BLK_SZ() + myfs_super.max_data;
+    size = sizeof(struct myfs_lfs_ckpt_d) + lfs_vblks * sizeof(int) + myfs_super.segs * sizeof(struct myfs_lfs_seg_d);
+    lfs_map = (int *)malloc(lfs_vblks * sizeof(int));
+    lfs_rmap = (int *)malloc(log_blks * sizeof(int));
+    lfs_segs = (struct myfs_lfs_seg *)calloc(myfs_super.segs, sizeof(struct myfs_lfs_seg));
+    lfs_seg_buf = (uint8_t *)malloc(MYFS_BLKS_SZ(myfs_super.seg_blks));
+    lfs_seg_vblks = (int *)malloc(myfs_super.seg_blks * sizeof(int));
+    lfs_ckpt_buf = (uint8_t *)calloc(2, slot_sz);
+    if (lfs_map == NULL || lfs_rmap == NULL || lfs_segs == NULL || lfs_seg_buf == NULL || lfs_seg_vblks == NULL ||
+        lfs_ckpt_buf == NULL || MYFS_ROUND_UP(size, MYFS_BLK_SZ()) > slot_sz)
+    {
+        myfs_lfs_free();
+        return -MYFS_ERROR_NOSPACE;
+    }
+    memset(&lfs_stat, 0, sizeof(lfs_stat));
+    memset(lfs_map, 0xff, lfs_vblks * sizeof(int));
+    memset(lfs_rmap, 0xff, log_blks * sizeof(int));
+    for (int head = 0; head < MYFS_LFS_HEADS; head++)
+    {
+        lfs_head_seg[head] = -1;
+        lfs_head_off[head] = myfs_super.seg_blks;
+    }
+    lfs_log_seq = 0;
+    lfs_ckpt_seq = 0;
+
+    if (!is_init)
+    {
+        // 先只读两个槽的头部，按序号从新到旧尝试，较新的一个校验通过时只需读入一个槽
+        slots[0] = lfs_ckpt_buf;
+        slots[1] = lfs_ckpt_buf + slot_sz;
+        for (int i = 0; i < 2; i++)
+        {
+            if (myfs_stripe_pread(slots[i], MYFS_IO_SZ(), myfs_super.lfs_ckpt_offset + i * slot_sz) !=
+                MYFS_ERROR_NONE)
+            {
+                myfs_lfs_free();
+                return -MYFS_ERROR_IO;
+            }
+        }
+        if ((int32_t)(((struct myfs_lfs_ckpt_d *)slots[1])->seq - ((struct myfs_lfs_ckpt_d *)slots[0])->seq) > 0)
+        {
+            slots[0] = lfs_ckpt_buf + slot_sz;
+            slots[1] = lfs_ckpt_buf;
+        }
+        for (int i = 0; i < 2 && ckpt_d == NULL; i++)
+        {
+            struct myfs_lfs_ckpt_d *cand = (struct myfs_lfs_ckpt_d *)slots[i];
+            if (cand->magic == MYFS_LFS_MAGIC && cand->vblks == lfs_vblks && cand->segs == myfs_super.segs &&
+                myfs_stripe_pread(slots[i], MYFS_ROUND_UP(size, MYFS_BLK_SZ()),
+                                  myfs_super.lfs_ckpt_offset + (slots[i] - lfs_ckpt_buf)) == MYFS_ERROR_NONE &&
+                cand->checksum == myfs_ckpt_checksum(slots[i] + sizeof(struct myfs_lfs_ckpt_d),
+                                                     size - sizeof(struct myfs_lfs_ckpt_d)))
+            {
+                ckpt_d = cand;
+            }
+        }
+        if (ckpt_d == NULL)
+        {
+            MYFS_DBG("[%s] no valid log checkpoint\n", __func__);
+            myfs_lfs_free();
+            return -MYFS_ERROR_IO;
+        }
+        memcpy(lfs_map, (uint8_t *)ckpt_d + sizeof(struct myfs_lfs_ckpt_d), lfs_vblks * sizeof(int));
+        seg_d = (struct myfs_lfs_seg_d *)((uint8_t *)ckpt_d + sizeof(struct myfs_lfs_ckpt_d) +
+                                          lfs_vblks * sizeof(int));
+        for (int seg = 0; seg < myfs_super.segs; seg++)
+        {
+            lfs_segs[seg].seq = seg_d[seg].seq;
+        }
+        // 有效块数与反向映射由映射表重建，不依赖段使用表中的计数
+        for (int vblk = 0; vblk < lfs_vblks; vblk++)
+        {
+            blk = lfs_map[vblk];
+            if (blk >= log_blks)
+            {
+                lfs_map[vblk] = blk = -1;
+            }
+            if (blk >= 0)
+            {
+                lfs_rmap[blk] = vblk;
+                lfs_segs[blk / myfs_super.seg_blks].live++;
+            }
+        }
+        lfs_head_seg[MYFS_LFS_HEAD_USER] = ckpt_d->cur_seg;
+        lfs_head_off[MYFS_LFS_HEAD_USER] = ckpt_d->cur_off;
+        lfs_head_seg[MYFS_LFS_HEAD_GC] = ckpt_d->gc_seg;
+        lfs_head_off[MYFS_LFS_HEAD_GC] = ckpt_d->gc_off;
+        lfs_log_seq = ckpt_d->log_seq;
+        lfs_ckpt_seq = ckpt_d->seq;
+    }
+
+    for (int head = 0; head < MYFS_LFS_HEADS && myfs_super.zoned; head++)
+    {
+        if (lfs_head_seg[head] < 0)
+        {
+            continue;
+        }
+        report->start_zone = myfs_lfs_zone(lfs_head_seg[head]);
+        report->nr_zones = 1;
+        if (myfs_stripe_ioctl(IOC_REQ_ZONE_REPORT, report) != 0 || report->nr_zones != 1)
+        {
+            myfs_lfs_free();
+            return -MYFS_ERROR_IO;
+        }
+        lfs_head_off[head] =
+            MYFS_ROUND_UP((report->zones[0].wp - report->zones[0].start), MYFS_BLK_SZ()) / MYFS_BLK_SZ();
+    }
+
+    // 检查点之后写入日志头的块没有被引用，可以直接覆盖
+    lfs_free_segs = 0;
+    lfs_pending_segs = 0;
+    for (int seg = 0; seg < myfs_super.segs; seg++)
+    {
+        lfs_segs[seg].state = lfs_segs[seg].live > 0 || myfs_lfs_is_head(seg) ? MYFS_LFS_SEG_USED
+                                                                               : MYFS_LFS_SEG_FREE;
+        lfs_free_segs += lfs_segs[seg].state == MYFS_LFS_SEG_FREE;
+    }
+    MYFS_DBG("[%s] ckpt seq: %u, free segs: %d/%d, head: %d+%d, gc head: %d+%d\n", __func__, lfs_ckpt_seq,
+             lfs_free_segs, myfs_super.segs, lfs_head_seg[MYFS_LFS_HEAD_USER], lfs_head_off[MYFS_LFS_HEAD_USER],
+             lfs_head_seg[MYFS_LFS_HEAD_GC], lfs_head_off[MYFS_LFS_HEAD_GC]);
+
+    cleaner_stop = FALSE;
+    cleaner_running = pthread_create(&cleaner_thread, NULL, myfs_lfs_cleaner, NULL) == 0;
+    if (!cleaner_running)
+    {
+        MYFS_DBG("[%s] cleaner thread not started, cleaning only on demand\n", __func__);
+    }
+    return MYFS_ERROR_NONE;
+}
+
+/**
+ * @brief 停止清理线程，写出最后一份检查点并释放映射表。分区模式下关闭日志头所在分区
+ *
+ * @return int
+ */
+int myfs_lfs_umount(void)
+{
+    int ret, zone;
+
+    if (cleaner_running)
+    {
+        pthread_mutex_lock(&cleaner_lock);
+        cleaner_stop = TRUE;
+        pthread_cond_signal(&cleaner_cond);
+        pthread_mutex_unlock(&cleaner_lock);
+        pthread_join(cleaner_thread, NULL);
+        cleaner_running = FALSE;
+    }
+
+    ret = myfs_lfs_checkpoint();
+    for (int head = 0; head < MYFS_LFS_HEADS && myfs_super.zoned; head++)
+    {
+        if (lfs_head_seg[head] >= 0)
+        {
+            zone = myfs_lfs_zone(lfs_head_seg[head]);
+            myfs_stripe_ioctl(IOC_REQ_ZONE_CLOSE, &zone);
+        }
+    }
+    MYFS_DBG("[%s] written: %ld, relocated: %ld, cleaned segs: %d, stalls: %d, checkpoints: %d, "
+             "zone resets: %d, write amplification: %.2f\n", __func__, lfs_stat.written, lfs_stat.relocated,
+             lfs_stat.cleaned, lfs_stat.stalls, lfs_stat.ckpts, lfs_stat.resets,
+             lfs_stat.written ? (double)(lfs_stat.written + lfs_stat.relocated) / lfs_stat.written : 1.0);
+    myfs_lfs_free();
+    return ret;
+}
+
+/**
+ * @brief 立即写出一份日志检查点
+ *
+ * @return int
+ */
+int myfs_lfs_checkpoint(void)
+{
+    int ret;
+
+    pthread_rwlock_wrlock(&lfs_lock);
+    ret = myfs_lfs_ckpt();
+    pthread_rwlock_unlock(&lfs_lock);
+    return ret;
+}
+
+/**
+ * @brief 读虚拟地址。映射到连续日志块的部分合并为一次读，未写入的块读出全0
+ *
+ * @param offset 不小于seg_offset
+ * @param out_content
+ * @param size
+ * @return int
+ */
+int myfs_lfs_read(int offset, uint8_t *out_content, int size)
+{
+    int first = (offset - myfs_super.seg_offset) / MYFS_BLK_SZ();
+    int last = (offset + size - 1 - myfs_super.seg_offset) / MYFS_BLK_SZ();
+    int vblk, run, blk, vofs, lo, hi;
+    int ret = MYFS_ERROR_NONE;
+    uint8_t *temp_content;
+
+    if (size <= 0 || last >= lfs_vblks)
+    {
+        return size == 0 ? MYFS_ERROR_NONE : -MYFS_ERROR_INVAL;
+    }
+    pthread_rwlock_rdlock(&lfs_lock);
+    for (vblk = first; vblk <= last && ret == MYFS_ERROR_NONE; vblk += run)
+    {
+        blk = lfs_map[vblk];
+        for (run = 1; vblk + run <= last; run++)
+        {
+            if (blk < 0 ? lfs_map[vblk + run] >= 0 : lfs_map[vblk + run] != blk + run)
+            {
+                break;
+            }
+        }
+        vofs = myfs_super.seg_offset + MYFS_BLKS_SZ(vblk);
+        lo = offset > vofs ? offset : vofs;
+        hi = offset + size < vofs + MYFS_BLKS_SZ(run) ? offset + size : vofs + MYFS_BLKS_SZ(run);
+        if (blk < 0)
+        {
+            memset(out_content + lo - offset, 0, hi - lo);
+        }
+        else if (lo == vofs && hi == vofs + MYFS_BLKS_SZ(run))
+        {
+            ret = myfs_lfs_dev_read(blk, out_content + lo - offset, run);
+        }
+        else
+        {
+            temp_content = myfs_scratch_get(MYFS_BLKS_SZ(run));
+            if (temp_content == NULL)
+            {
+                ret = -MYFS_ERROR_NOSPACE;
+                break;
+            }
+            if ((ret = myfs_lfs_dev_read(blk, temp_content, run)) == MYFS_ERROR_NONE)
+            {
+                memcpy(out_content + lo - offset, temp_content + lo - vofs, hi - lo);
+            }
+        }
+    }
+    pthread_rwlock_unlock(&lfs_lock);
+    return ret;
+}
+
+/**
+ * @brief 写虚拟地址：涉及的块整块追加到日志头，首尾不完整的块先读出旧内容。
+ * 写入范围内的缓存块同时失效
+ *
+ * @param offset 不小于seg_offset
+ * @param in_content
+ * @param size
+ * @return int
+ */
+int myfs_lfs_write(int offset, uint8_t *in_content, int size)
+{
+    int first = (offset - myfs_super.seg_offset) / MYFS_BLK_SZ();
+    int last = (offset + size - 1 - myfs_super.seg_offset) / MYFS_BLK_SZ();
+    int bias = (offset - myfs_super.seg_offset) % MYFS_BLK_SZ();
+    int num = last - first + 1;
+    uint8_t *temp_content = in_content;
+    int *vblks;
+    int ret = MYFS_ERROR_NONE;
+
+    if (size <= 0 || last >= lfs_vblks)
+    {
+        return size == 0 ? MYFS_ERROR_NONE : -MYFS_ERROR_INVAL;
+    }
+    vblks = (int *)malloc(num * sizeof(int));
+    if (bias != 0 || size % MYFS_BLK_SZ() != 0)
+    {
+        temp_content = (uint8_t *)malloc(MYFS_BLKS_SZ(num));
+    }
+    if (vblks == NULL || temp_content == NULL)
+    {
+        free(vblks);
+        return -MYFS_ERROR_NOSPACE;
+    }
+    for (int i = 0; i < num; i++)
+    {
+        vblks[i] = first + i;
+    }
+
+    pthread_rwlock_wrlock(&lfs_lock);
+    if (temp_content != in_content)
+    {
+        if (bias != 0)
+        {
+            ret = myfs_lfs_read_blk(first, temp_content);
+        }
+        if ((bias + size) % MYFS_BLK_SZ() != 0 && (num > 1 || bias == 0) && ret == MYFS_ERROR_NONE)
+        {
+            ret = myfs_lfs_read_blk(last, temp_content + MYFS_BLKS_SZ(num - 1));
+        }
+        memcpy(temp_content + bias, in_content, size);
+    }
+    if (ret == MYFS_ERROR_NONE && (ret = myfs_lfs_append(vblks, temp_content, num, FALSE)) == MYFS_ERROR_NONE)
+    {
+        lfs_stat.written += num;
+    }
+    myfs_cache_invalidate(offset, size);
+    pthread_rwlock_unlock(&lfs_lock);
+
+    if (temp_content != in_content)
+    {
+        free(temp_content);
+    }
+    free(vblks);
+    return ret;
+}
+
+/**
+ * @brief 丢弃虚拟地址范围内整块的映射，文件系统释放inode或数据块时调用，
+ * 所占日志空间由清理回收
+ *
+ * @param offset
+ * @param size
+ */
+void myfs_lfs_discard(int offset, int size)
+{
+    int first = MYFS_ROUND_UP((offset - myfs_super.seg_offset), MYFS_BLK_SZ()) / MYFS_BLK_SZ();
+    int end = (offset + size - myfs_super.seg_offset) / MYFS_BLK_SZ();
+
+    pthread_rwlock_wrlock(&lfs_lock);
+    for (int vblk = first; vblk < end && vblk < lfs_vblks; vblk++)
+    {
+        myfs_lfs_remap(vblk, -1);
+    }
+    myfs_cache_invalidate(offset, size);
+    pthread_rwlock_unlock(&lfs_lock);
+}
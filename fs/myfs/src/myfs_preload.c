@@ -0,0 +1,255 @@
+/**
+ * 挂载时预加载目录树
+ *
+ * 以--preload挂载时，由MYFS_PRELOAD_WORKERS个线程按广度优先读入全部inode与目录项。
+ * 每个线程持有一个双端队列：自己从队头取任务，保持按层推进；队列为空时从其他
+ * 线程的队尾窃取。读盘使用定位读，各线程的I/O互不等待设备锁，时延得以重叠。
+ * 读入一个目录后，其下全部子项的inode经myfs_driver_batch一次发出：请求同时进入设备队列，
+ * 超出队列深度的部分由--sched选择的调度策略排定服务顺序，C-LOOK按地址扫描可省去往返寻道。
+ */
+
+#include "../include/myfs.h"
+
+extern struct myfs_super myfs_super;
+
+/* 每个线程的任务队列，任务为待读入inode的dentry */
+struct myfs_preload_deque
+{
+    pthread_mutex_t lock;
+    struct myfs_dentry **tasks;
+    int head;
+    int cnt;
+    int cap;
+};
+
+static struct myfs_preload_deque preload_deques[MYFS_PRELOAD_WORKERS];
+static int preload_pending; /* 已入队但尚未处理完的任务数 */
+
+static struct
+{
+    int inodes;
+    int steals;
+    int errors;
+} preload_stat;
+
+static boolean myfs_preload_push(struct myfs_preload_deque *dq, struct myfs_dentry *dentry)
+{
+    pthread_mutex_lock(&dq->lock);
+    if (dq->cnt == dq->cap)
+    {
+        int cap = dq->cap == 0 ? MYFS_IO_LIST_INIT : dq->cap * 2;
+        struct myfs_dentry **tasks = (struct myfs_dentry **)malloc(cap * sizeof(struct myfs_dentry *));
+        if (tasks == NULL)
+        {
+            pthread_mutex_unlock(&dq->lock);
+            return FALSE;
+        }
+        for (int i = 0; i < dq->cnt; i++)
+        {
+            tasks[i] = dq->tasks[(dq->head + i) % dq->cap];
+        }
+        free(dq->tasks);
+        dq->tasks = tasks;
+        dq->head = 0;
+        dq->cap = cap;
+    }
+    dq->tasks[(dq->head + dq->cnt) % dq->cap] = dentry;
+    dq->cnt++;
+    __atomic_add_fetch(&preload_pending, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&dq->lock);
+    return TRUE;
+}
+
+static struct myfs_dentry *myfs_preload_pop(struct myfs_preload_deque *dq, boolean steal)
+{
+    struct myfs_dentry *dentry = NULL;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->cnt > 0)
+    {
+        if (steal)
+        {
+            dentry = dq->tasks[(dq->head + dq->cnt - 1) % dq->cap];
+        }
+        else
+        {
+            dentry = dq->tasks[dq->head];
+            dq->head = (dq->head + 1) % dq->cap;
+        }
+        dq->cnt--;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return dentry;
+}
+
+/**
+ * @brief 批量读入目录下尚未读入的子项inode。读不出或建立失败的子项留待各自的任务逐个重读
+ *
+ * @param dir
+ */
+static void myfs_preload_inodes(struct myfs_inode *dir)
+{
+    struct myfs_dentry *sub_dentry;
+    struct myfs_vec *vecs;
+    uint8_t *bufs;
+    int size = MYFS_ROUND_UP(sizeof(struct myfs_inode_d), MYFS_IO_SZ());
+    int cnt = 0, i;
+
+    for (sub_dentry = dir->dentrys; sub_dentry != NULL; sub_dentry = sub_dentry->brother)
+    {
+        cnt += sub_dentry->inode == NULL;
+    }
+    if (cnt < 2)
+    {
+        return;
+    }
+    vecs = (struct myfs_vec *)malloc(cnt * sizeof(struct myfs_vec));
+    bufs = (uint8_t *)malloc(cnt * size);
+    if (vecs != NULL && bufs != NULL)
+    {
+        i = 0;
+        for (sub_dentry = dir->dentrys; sub_dentry != NULL; sub_dentry = sub_dentry->brother)
+        {
+            if (sub_dentry->inode == NULL)
+            {
+                vecs[i].offset = MYFS_INO_OFS(sub_dentry->ino);
+                vecs[i].size = size;
+                vecs[i].buf = bufs + i * size;
+                i++;
+            }
+        }
+        if (myfs_driver_batch(vecs, cnt, FALSE) == MYFS_ERROR_NONE)
+        {
+            i = 0;
+            for (sub_dentry = dir->dentrys; sub_dentry != NULL; sub_dentry = sub_dentry->brother)
+            {
+                if (sub_dentry->inode != NULL)
+                {
+                    continue;
+                }
+                sub_dentry->inode = myfs_parse_inode(sub_dentry, (const struct myfs_inode_d *)vecs[i++].buf,
+                                                     myfs_driver_pread);
+                if (sub_dentry->inode != NULL)
+                {
+                    __atomic_add_fetch(&preload_stat.inodes, 1, __ATOMIC_RELAXED);
+                }
+            }
+        }
+    }
+    free(bufs);
+    free(vecs);
+}
+
+static void myfs_preload_one(struct myfs_preload_deque *dq, struct myfs_dentry *dentry)
+{
+    struct myfs_dentry *sub_dentry;
+    // 子dentry只由父目录的读入者创建并入队，不会被两个线程同时处理
+    if (dentry->inode == NULL)
+    {
+        dentry->inode = myfs_read_inode_by(dentry, dentry->ino, myfs_driver_pread);
+        if (dentry->inode == NULL)
+        {
+            __atomic_add_fetch(&preload_stat.errors, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        __atomic_add_fetch(&preload_stat.inodes, 1, __ATOMIC_RELAXED);
+    }
+    if (MYFS_IS_DIR(dentry->inode))
+    {
+        myfs_preload_inodes(dentry->inode);
+        for (sub_dentry = dentry->inode->dentrys; sub_dentry != NULL; sub_dentry = sub_dentry->brother)
+        {
+            if (!myfs_preload_push(dq, sub_dentry))
+            {
+                __atomic_add_fetch(&preload_stat.errors, 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+}
+
+static void *myfs_preload_worker(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    struct myfs_preload_deque *dq = &preload_deques[id];
+    struct myfs_dentry *dentry;
+
+    while (__atomic_load_n(&preload_pending, __ATOMIC_SEQ_CST) > 0)
+    {
+        dentry = myfs_preload_pop(dq, FALSE);
+        for (int i = 1; dentry == NULL && i < MYFS_PRELOAD_WORKERS; i++)
+        {
+            dentry = myfs_preload_pop(&preload_deques[(id + i) % MYFS_PRELOAD_WORKERS], TRUE);
+            if (dentry != NULL)
+            {
+                __atomic_add_fetch(&preload_stat.steals, 1, __ATOMIC_RELAXED);
+            }
+        }
+        if (dentry == NULL)
+        {
+            // 暂无可取的任务，但其他线程仍可能产生新任务
+            sched_yield();
+            continue;
+        }
+        myfs_preload_one(dq, dentry);
+        __atomic_sub_fetch(&preload_pending, 1, __ATOMIC_SEQ_CST);
+    }
+    myfs_slab_drain();
+    return NULL;
+}
+
+/**
+ * @brief 并行读入根目录以下的整棵目录树，填充dentry与inode缓存
+ *
+ * @return int 有inode读不出或任务未能入队时返回-MYFS_ERROR_IO，未读入的部分仍可在查找时按需读入
+ */
+int myfs_preload(void)
+{
+    pthread_t workers[MYFS_PRELOAD_WORKERS];
+    struct myfs_dentry *dentry;
+    struct timespec begin, end;
+    int started = 0, i = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    memset(&preload_stat, 0, sizeof(preload_stat));
+    preload_pending = 0;
+    for (int w = 0; w < MYFS_PRELOAD_WORKERS; w++)
+    {
+        pthread_mutex_init(&preload_deques[w].lock, NULL);
+    }
+    // 根目录已在挂载时读入，其子项轮流分给各线程
+    myfs_preload_inodes(myfs_super.root_dentry->inode);
+    for (dentry = myfs_super.root_dentry->inode->dentrys; dentry != NULL; dentry = dentry->brother)
+    {
+        if (!myfs_preload_push(&preload_deques[i++ % MYFS_PRELOAD_WORKERS], dentry))
+        {
+            preload_stat.errors++;
+        }
+    }
+    for (int w = 0; w < MYFS_PRELOAD_WORKERS; w++)
+    {
+        if (pthread_create(&workers[started], NULL, myfs_preload_worker, (void *)(intptr_t)w) == 0)
+        {
+            started++;
+        }
+    }
+    if (started == 0)
+    {
+        // 无法创建线程时在当前线程中完成
+        myfs_preload_worker((void *)(intptr_t)0);
+    }
+    for (int w = 0; w < started; w++)
+    {
+        pthread_join(workers[w], NULL);
+    }
+    for (int w = 0; w < MYFS_PRELOAD_WORKERS; w++)
+    {
+        free(preload_deques[w].tasks);
+        preload_deques[w].tasks = NULL;
+        preload_deques[w].head = preload_deques[w].cnt = preload_deques[w].cap = 0;
+        pthread_mutex_destroy(&preload_deques[w].lock);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    MYFS_DBG("[%s] workers: %d, inodes: %d, steals: %d, errors: %d, elapsed: %ld ms\n", __func__, started,
+             preload_stat.inodes, preload_stat.steals, preload_stat.errors,
+             (end.tv_sec - begin.tv_sec) * 1000 + (end.tv_nsec - begin.tv_nsec) / 1000000);
+    return preload_stat.errors == 0 ? MYFS_ERROR_NONE : -MYFS_ERROR_IO;
+}
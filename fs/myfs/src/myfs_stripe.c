@@ -0,0 +1,1048 @@
+/**
+ * 多设备条带化与镜像
+ *
+ * --device给出以逗号分隔的多个后备文件时，各成员设备按条带单元轮流拼接成一个大设备(RAID-0)：
+ * 逻辑偏移offset所在的条带单元u = offset / unit位于成员u % n，成员上的偏移为
+ * (u / n) * unit + offset % unit。一个请求在每个成员上涉及的范围总是连续的，因此拆分后
+ * 每个成员只需一次定位读写；同一请求涉及多个成员时交给各成员的I/O线程并行执行，
+ * 大块顺序传输的时延随成员数下降。只涉及一个条带单元的小请求在调用者线程中直接完成。
+ * 只有一个设备时全部直通ddriver。
+ *
+ * 以--mirror挂载时各成员互为镜像(RAID-1)：写并行发往全部成员，读只发往一个成员。
+ * 选择依据是ddriver模拟的磁头位置，取寻道距离最短(与emulate_rotate一样按磁道取模)的成员，
+ * 距离相同时取已分担读请求较少的成员。多个线程的随机读因此分散在各成员上，且各自寻道更短。
+ *
+ * 预读、写回等互不相关的一组请求经myfs_stripe_batch批量发出，借用ddriver的提交/完成队列：
+ * 每个成员有自己的队列，请求按条带单元(镜像时按读写)拆到各成员后分别提交，再收取完成事件，
+ * 设备按--queue-depth同时服务多个命令，各请求的寻道与传输时延在成员内、成员间都相互重叠，
+ * 而不是依次累加。完成事件经各队列的eventfd通知，一次poll等待全部成员。分层时逐个执行。
+ *
+ * 超出设备队列深度的请求在设备前排队，服务顺序由--sched选择的调度策略决定：fifo按到达顺序，
+ * clook按地址单向扫描以缩短磁头移动，deadline读优先并为每个请求设期限。--queue-depth=1
+ * 模拟只有一个磁头、逐个服务命令的磁盘，此时调度策略的影响最明显。卸载时打印各策略的统计。
+ */
+
+#include "../include/myfs.h"
+
+extern struct myfs_super myfs_super;
+
+/* 同一请求拆出的各成员I/O，全部完成后唤醒调用者 */
+struct myfs_stripe_batch
+{
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    int pending;
+    int ret;
+};
+
+struct myfs_stripe_io
+{
+    uint8_t *buf;
+    int size;   /* 0表示该成员不参与本次请求 */
+    int offset; /* 成员设备上的偏移 */
+    int chunks; /* 涉及的条带单元数，多于1个时经buf中转 */
+    boolean write;
+    struct myfs_stripe_batch *batch;
+    struct myfs_stripe_io *next;
+};
+
+struct myfs_stripe_member
+{
+    int fd;
+    pthread_t thread;
+    boolean running;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct myfs_stripe_io *head; /* 待执行的I/O，先进先出 */
+    struct myfs_stripe_io *tail;
+    boolean stop;
+    int reads; /* 镜像时分到该成员的读请求数 */
+    int rings[MYFS_QUEUE_RINGS]; /* 批量I/O用的异步队列，各成员下标相同的一组由一个批量请求独占 */
+    struct myfs_dirty_map dirty; /* 写入后尚未提交的范围 */
+};
+
+/* 批量请求拆到一个成员上的I/O */
+struct myfs_stripe_piece
+{
+    uint8_t *buf; /* 指向调用者缓冲区 */
+    int size;
+    int offset; /* 成员设备上的偏移，镜像时即逻辑偏移 */
+    int member;
+};
+
+static struct myfs_stripe_member stripe_members[MYFS_STRIPE_MAX];
+static int stripe_cnt;
+static int stripe_member_sz; /* 每个成员参与条带的字节数 */
+static boolean stripe_mirror;
+
+static const char *stripe_sched_names[DDRIVER_SCHED_NR] = {"fifo", "clook", "deadline"};
+static int stripe_ring_cnt;                /* 每个成员的队列数，0表示批量请求逐个执行 */
+static int stripe_ring_busy;               /* 正被使用的队列下标，按位表示 */
+static pthread_mutex_t stripe_ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stripe_ring_free = PTHREAD_COND_INITIALIZER;
+
+static struct
+{
+    int batches;
+    int ios;
+} stripe_stat;
+
+/******************************************************************************
+ * SECTION: 未提交范围
+ *******************************************************************************/
+/**
+ * @brief 为一个设备建立未提交范围的记录，初始时全部已提交
+ *
+ * @param map
+ * @param size 设备字节数
+ * @return int
+ */
+int myfs_dirty_init(struct myfs_dirty_map *map, int size)
+{
+    map->size = size;
+    map->cnt = MYFS_ROUND_UP(size, MYFS_COMMIT_UNIT) / MYFS_COMMIT_UNIT;
+    map->units = (uint8_t *)calloc(map->cnt > 0 ? map->cnt : 1, sizeof(uint8_t));
+    if (map->units == NULL)
+    {
+        map->cnt = 0;
+        return -MYFS_ERROR_NOSPACE;
+    }
+    return MYFS_ERROR_NONE;
+}
+
+void myfs_dirty_destroy(struct myfs_dirty_map *map)
+{
+    free(map->units);
+    map->units = NULL;
+    map->cnt = 0;
+}
+
+/**
+ * @brief 记录一次已完成的写入，须在写入返回之后调用，提交时才不会漏掉。可多线程并发
+ *
+ * @param map
+ * @param offset
+ * @param size
+ */
+void myfs_dirty_mark(struct myfs_dirty_map *map, int offset, int size)
+{
+    if (map->units == NULL || size <= 0)
+    {
+        return;
+    }
+    for (int u = offset / MYFS_COMMIT_UNIT; u <= (offset + size - 1) / MYFS_COMMIT_UNIT && u < map->cnt; u++)
+    {
+        __atomic_store_n(&map->units[u], 1, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * @brief 只提交有未提交写入的连续段。各单位先清除标记再同步，同步期间的新写入会重新标记，
+ * 留给下一次提交；同步失败的段恢复标记
+ *
+ * @param map
+ * @param fd
+ * @return int 任一段失败返回-MYFS_ERROR_IO
+ */
+int myfs_dirty_commit(struct myfs_dirty_map *map, int fd)
+{
+    int ret = MYFS_ERROR_NONE;
+    int first, last, size;
+
+    for (first = 0; first < map->cnt; first = last)
+    {
+        if (!__atomic_exchange_n(&map->units[first], 0, __ATOMIC_ACQ_REL))
+        {
+            last = first + 1;
+            continue;
+        }
+        for (last = first + 1; last < map->cnt && __atomic_exchange_n(&map->units[last], 0, __ATOMIC_ACQ_REL); last++)
+            ;
+        size = last * MYFS_COMMIT_UNIT > map->size ? map->size - first * MYFS_COMMIT_UNIT
+                                                    : (last - first) * MYFS_COMMIT_UNIT;
+        if (ddriver_commit(fd, first * MYFS_COMMIT_UNIT, size) != 0)
+        {
+            myfs_dirty_mark(map, first * MYFS_COMMIT_UNIT, size);
+            ret = -MYFS_ERROR_IO;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief 记录不经myfs_stripe_*、直接写到单个设备上的范围
+ *
+ * @param offset
+ * @param size
+ */
+void myfs_stripe_dirty(int offset, int size)
+{
+    myfs_dirty_mark(&stripe_members[0].dirty, offset, size);
+}
+
+/******************************************************************************
+ * SECTION: 成员I/O线程
+ *******************************************************************************/
+static int myfs_stripe_member_rw(struct myfs_stripe_member *member, uint8_t *buf, int size, int offset,
+                                 boolean write)
+{
+    int ret = write ? ddriver_pwrite(member->fd, (char *)buf, size, offset)
+                    : ddriver_pread(member->fd, (char *)buf, size, offset);
+    if (ret != size)
+    {
+        return -MYFS_ERROR_IO;
+    }
+    if (write)
+    {
+        myfs_dirty_mark(&member->dirty, offset, size);
+    }
+    return MYFS_ERROR_NONE;
+}
+
+static void *myfs_stripe_worker(void *arg)
+{
+    struct myfs_stripe_member *member = (struct myfs_stripe_member *)arg;
+    struct myfs_stripe_io *io;
+    int ret;
+
+    while (TRUE)
+    {
+        pthread_mutex_lock(&member->lock);
+        while (member->head == NULL && !member->stop)
+        {
+            pthread_cond_wait(&member->cond, &member->lock);
+        }
+        io = member->head;
+        if (io != NULL)
+        {
+            member->head = io->next;
+            member->tail = member->head == NULL ? NULL : member->tail;
+        }
+        pthread_mutex_unlock(&member->lock);
+        if (io == NULL)
+        {
+            break;
+        }
+
+        ret = myfs_stripe_member_rw(member, io->buf, io->size, io->offset, io->write);
+        pthread_mutex_lock(&io->batch->lock);
+        if (ret != MYFS_ERROR_NONE)
+        {
+            io->batch->ret = ret;
+        }
+        if (--io->batch->pending == 0)
+        {
+            pthread_cond_signal(&io->batch->done);
+        }
+        pthread_mutex_unlock(&io->batch->lock);
+    }
+    return NULL;
+}
+
+static void myfs_stripe_submit(struct myfs_stripe_member *member, struct myfs_stripe_io *io)
+{
+    io->next = NULL;
+    pthread_mutex_lock(&member->lock);
+    if (member->tail == NULL)
+    {
+        member->head = io;
+    }
+    else
+    {
+        member->tail->next = io;
+    }
+    member->tail = io;
+    pthread_cond_signal(&member->cond);
+    pthread_mutex_unlock(&member->lock);
+}
+
+/******************************************************************************
+ * SECTION: 请求拆分
+ *******************************************************************************/
+/**
+ * @brief 在调用者缓冲区与各成员的中转缓冲区之间按条带单元复制
+ *
+ * @param ios 各成员的I/O
+ * @param content 调用者缓冲区
+ * @param size
+ * @param offset 逻辑偏移
+ * @param to_member TRUE为写入前汇集到中转缓冲区，FALSE为读出后分散回调用者缓冲区
+ */
+static void myfs_stripe_copy(struct myfs_stripe_io *ios, uint8_t *content, int size, int offset, boolean to_member)
+{
+    int unit = myfs_super.stripe_unit;
+    int pos, next, u;
+    struct myfs_stripe_io *io;
+    uint8_t *member_buf;
+
+    for (pos = offset; pos < offset + size; pos = next)
+    {
+        u = pos / unit;
+        next = (u + 1) * unit < offset + size ? (u + 1) * unit : offset + size;
+        io = &ios[u % stripe_cnt];
+        if (io->chunks == 1)
+        {
+            continue;
+        }
+        member_buf = io->buf + (u / stripe_cnt) * unit + pos % unit - io->offset;
+        if (to_member)
+        {
+            memcpy(member_buf, content + pos - offset, next - pos);
+        }
+        else
+        {
+            memcpy(content + pos - offset, member_buf, next - pos);
+        }
+    }
+}
+
+/**
+ * @brief 把各成员的I/O交给成员线程并等待全部完成
+ *
+ * @param ios 各成员的I/O，chunks为0的成员不参与
+ * @param write
+ * @return int 任一成员失败则返回其错误
+ */
+static int myfs_stripe_run(struct myfs_stripe_io *ios, boolean write)
+{
+    struct myfs_stripe_batch batch;
+    int m;
+
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.done, NULL);
+    batch.pending = 0;
+    batch.ret = MYFS_ERROR_NONE;
+    for (m = 0; m < stripe_cnt; m++)
+    {
+        batch.pending += ios[m].chunks > 0;
+    }
+    for (m = 0; m < stripe_cnt; m++)
+    {
+        if (ios[m].chunks > 0)
+        {
+            ios[m].write = write;
+            ios[m].batch = &batch;
+            myfs_stripe_submit(&stripe_members[m], &ios[m]);
+        }
+    }
+    pthread_mutex_lock(&batch.lock);
+    while (batch.pending > 0)
+    {
+        pthread_cond_wait(&batch.done, &batch.lock);
+    }
+    pthread_mutex_unlock(&batch.lock);
+    pthread_cond_destroy(&batch.done);
+    pthread_mutex_destroy(&batch.lock);
+    return batch.ret;
+}
+
+/**
+ * @brief 镜像读选择成员：寻道距离按ddriver的模型计算，相同时取已分担读请求较少的成员
+ *
+ * @param offset
+ * @return struct myfs_stripe_member*
+ */
+static struct myfs_stripe_member *myfs_stripe_pick(int offset)
+{
+    struct ddriver_head head;
+    struct myfs_stripe_member *best = NULL;
+    int distance, best_distance = 0;
+
+    for (int m = 0; m < stripe_cnt; m++)
+    {
+        if (ddriver_ioctl(stripe_members[m].fd, IOC_REQ_DEVICE_HEAD, &head) != 0 || head.track_sz <= 0)
+        {
+            continue;
+        }
+        distance = abs(offset - head.pos) % head.track_sz;
+        if (best == NULL || distance < best_distance ||
+            (distance == best_distance &&
+             __atomic_load_n(&stripe_members[m].reads, __ATOMIC_RELAXED) <
+                 __atomic_load_n(&best->reads, __ATOMIC_RELAXED)))
+        {
+            best = &stripe_members[m];
+            best_distance = distance;
+        }
+    }
+    return best != NULL ? best : &stripe_members[0];
+}
+
+/**
+ * @brief 镜像读写：读由一个成员在调用者线程中完成，出错时依次改读其余成员；写由全部成员并行完成
+ *
+ * @param content
+ * @param size
+ * @param offset
+ * @param write
+ * @return int
+ */
+static int myfs_stripe_mirror_rw(uint8_t *content, int size, int offset, boolean write)
+{
+    struct myfs_stripe_io ios[MYFS_STRIPE_MAX];
+    struct myfs_stripe_member *member;
+    int first, ret;
+
+    if (!write)
+    {
+        member = myfs_stripe_pick(offset);
+        __atomic_add_fetch(&member->reads, 1, __ATOMIC_RELAXED);
+        ret = myfs_stripe_member_rw(member, content, size, offset, FALSE);
+        first = member - stripe_members;
+        for (int i = 1; i < stripe_cnt && ret != MYFS_ERROR_NONE; i++)
+        {
+            member = &stripe_members[(first + i) % stripe_cnt];
+            MYFS_DBG("[%s] mirror %d read failed at %d, retrying on %d\n", __func__,
+                     (first + i - 1) % stripe_cnt, offset, (first + i) % stripe_cnt);
+            ret = myfs_stripe_member_rw(member, content, size, offset, FALSE);
+        }
+        return ret;
+    }
+    memset(ios, 0, sizeof(ios));
+    for (int m = 0; m < stripe_cnt; m++)
+    {
+        ios[m].buf = content;
+        ios[m].size = size;
+        ios[m].offset = offset;
+        ios[m].chunks = 1;
+    }
+    return myfs_stripe_run(ios, TRUE);
+}
+
+/**
+ * @brief 按条带拆分为每个成员一次I/O并行执行。只涉及一个条带单元的成员直接使用调用者的缓冲区。
+ * 绕过快速层直接访问主设备，供myfs_tier.c使用
+ *
+ * @param content
+ * @param size IO单位的整数倍
+ * @param offset 与IO单位对齐
+ * @param write
+ * @return int
+ */
+int myfs_stripe_rw(uint8_t *content, int size, int offset, boolean write)
+{
+    struct myfs_stripe_io ios[MYFS_STRIPE_MAX];
+    int unit = myfs_super.stripe_unit;
+    int pos, next, u, m;
+    int ret = MYFS_ERROR_NONE;
+
+    if (stripe_cnt == 1)
+    {
+        return myfs_stripe_member_rw(&stripe_members[0], content, size, offset, write);
+    }
+    if (stripe_mirror)
+    {
+        return myfs_stripe_mirror_rw(content, size, offset, write);
+    }
+    if (offset / unit == (offset + size - 1) / unit)
+    {
+        u = offset / unit;
+        return myfs_stripe_member_rw(&stripe_members[u % stripe_cnt], content, size,
+                                     (u / stripe_cnt) * unit + offset % unit, write);
+    }
+
+    memset(ios, 0, sizeof(ios));
+    for (pos = offset; pos < offset + size; pos = next)
+    {
+        u = pos / unit;
+        next = (u + 1) * unit < offset + size ? (u + 1) * unit : offset + size;
+        m = u % stripe_cnt;
+        if (ios[m].chunks++ == 0)
+        {
+            ios[m].offset = (u / stripe_cnt) * unit + pos % unit;
+            ios[m].buf = content + pos - offset;
+        }
+        ios[m].size += next - pos;
+    }
+    for (m = 0; m < stripe_cnt; m++)
+    {
+        if (ios[m].chunks > 1 && (ios[m].buf = (uint8_t *)malloc(ios[m].size)) == NULL)
+        {
+            ret = -MYFS_ERROR_NOSPACE;
+        }
+    }
+    if (ret == MYFS_ERROR_NONE)
+    {
+        if (write)
+        {
+            myfs_stripe_copy(ios, content, size, offset, TRUE);
+        }
+        ret = myfs_stripe_run(ios, write);
+        if (!write && ret == MYFS_ERROR_NONE)
+        {
+            myfs_stripe_copy(ios, content, size, offset, FALSE);
+        }
+    }
+    for (m = 0; m < stripe_cnt; m++)
+    {
+        if (ios[m].chunks > 1)
+        {
+            free(ios[m].buf);
+        }
+    }
+    return ret;
+}
+
+/******************************************************************************
+ * SECTION: 批量I/O
+ *******************************************************************************/
+static int myfs_stripe_ring_get(void)
+{
+    int i;
+
+    pthread_mutex_lock(&stripe_ring_lock);
+    while (stripe_ring_busy == (1 << stripe_ring_cnt) - 1)
+    {
+        pthread_cond_wait(&stripe_ring_free, &stripe_ring_lock);
+    }
+    for (i = 0; stripe_ring_busy & (1 << i); i++)
+        ;
+    stripe_ring_busy |= 1 << i;
+    stripe_stat.batches++;
+    pthread_mutex_unlock(&stripe_ring_lock);
+    return i;
+}
+
+static void myfs_stripe_ring_put(int i)
+{
+    pthread_mutex_lock(&stripe_ring_lock);
+    stripe_ring_busy &= ~(1 << i);
+    pthread_cond_signal(&stripe_ring_free);
+    pthread_mutex_unlock(&stripe_ring_lock);
+}
+
+static void myfs_stripe_piece_add(struct myfs_stripe_piece *pieces, int *cnt, uint8_t *buf, int size, int offset,
+                                  int member)
+{
+    pieces[*cnt].buf = buf;
+    pieces[*cnt].size = size;
+    pieces[*cnt].offset = offset;
+    pieces[*cnt].member = member;
+    (*cnt)++;
+}
+
+/**
+ * @brief 把一组请求拆成各成员上的I/O：条带时每个条带单元一个，直接读写调用者缓冲区；
+ * 镜像写发往全部成员，镜像读发往myfs_stripe_pick选出的成员；只有一个设备时原样发出
+ *
+ * @param vecs
+ * @param num
+ * @param write
+ * @param out 输出，同一成员的I/O相邻且保持请求顺序，由调用者释放
+ * @param ends 输出，成员m的I/O为(*out)[m == 0 ? 0 : ends[m - 1]]到(*out)[ends[m]]之前
+ * @return int 拆出的I/O数，内存不足返回-MYFS_ERROR_NOSPACE
+ */
+static int myfs_stripe_split(struct myfs_vec *vecs, int num, boolean write, struct myfs_stripe_piece **out,
+                             int *ends)
+{
+    struct myfs_stripe_piece *pieces, *sorted;
+    struct myfs_stripe_member *member;
+    int unit = myfs_super.stripe_unit;
+    int total = 0, cnt = 0, pos, end, next, u, m, i;
+    int cursor[MYFS_STRIPE_MAX];
+
+    for (i = 0; i < num; i++)
+    {
+        if (stripe_mirror)
+        {
+            total += write ? stripe_cnt : 1;
+        }
+        else
+        {
+            total += stripe_cnt == 1 ? 1 : (vecs[i].offset + vecs[i].size - 1) / unit - vecs[i].offset / unit + 1;
+        }
+    }
+    pieces = (struct myfs_stripe_piece *)malloc(2 * total * sizeof(struct myfs_stripe_piece));
+    if (pieces == NULL)
+    {
+        return -MYFS_ERROR_NOSPACE;
+    }
+    for (i = 0; i < num; i++)
+    {
+        end = vecs[i].offset + vecs[i].size;
+        if (stripe_mirror && !write)
+        {
+            member = myfs_stripe_pick(vecs[i].offset);
+            __atomic_add_fetch(&member->reads, 1, __ATOMIC_RELAXED);
+            myfs_stripe_piece_add(pieces, &cnt, vecs[i].buf, vecs[i].size, vecs[i].offset, member - stripe_members);
+        }
+        else if (stripe_mirror || stripe_cnt == 1)
+        {
+            for (m = 0; m < stripe_cnt; m++)
+            {
+                myfs_stripe_piece_add(pieces, &cnt, vecs[i].buf, vecs[i].size, vecs[i].offset, m);
+            }
+        }
+        else
+        {
+            for (pos = vecs[i].offset; pos < end; pos = next)
+            {
+                u = pos / unit;
+                next = (u + 1) * unit < end ? (u + 1) * unit : end;
+                myfs_stripe_piece_add(pieces, &cnt, vecs[i].buf + pos - vecs[i].offset, next - pos,
+                                      (u / stripe_cnt) * unit + pos % unit, u % stripe_cnt);
+            }
+        }
+    }
+
+    // 按成员归类到后半段
+    memset(ends, 0, stripe_cnt * sizeof(int));
+    for (i = 0; i < total; i++)
+    {
+        ends[pieces[i].member]++;
+    }
+    for (m = 0; m < stripe_cnt; m++)
+    {
+        cursor[m] = m == 0 ? 0 : ends[m - 1];
+        ends[m] += cursor[m];
+    }
+    sorted = pieces + total;
+    for (i = 0; i < total; i++)
+    {
+        sorted[cursor[pieces[i].member]++] = pieces[i];
+    }
+    memcpy(pieces, sorted, total * sizeof(struct myfs_stripe_piece));
+    *out = pieces;
+    return total;
+}
+
+/**
+ * @brief 同时发出一组互不相关的定位读写。各成员的提交队列有空位就补充，完成事件经eventfd通知，
+ * poll等到任一成员有完成事件后轮询收取该成员已有的全部完成事件。镜像读失败时改读其余成员
+ *
+ * @param vecs 偏移与大小均需IO单位对齐
+ * @param num
+ * @param write
+ * @return int 任一请求失败则返回-MYFS_ERROR_IO
+ */
+int myfs_stripe_batch(struct myfs_vec *vecs, int num, boolean write)
+{
+    struct myfs_stripe_piece *pieces, *piece;
+    struct ddriver_sqe *sqe;
+    struct ddriver_cqe cqe;
+    struct pollfd pfds[MYFS_STRIPE_MAX];
+    int ends[MYFS_STRIPE_MAX], next[MYFS_STRIPE_MAX];
+    int total, done = 0, i, m, ring, slot;
+    uint64_t events;
+    int ret = MYFS_ERROR_NONE;
+
+    if (stripe_ring_cnt == 0 || myfs_super.tiered || num == 1)
+    {
+        for (i = 0; i < num; i++)
+        {
+            if ((write ? myfs_stripe_pwrite(vecs[i].buf, vecs[i].size, vecs[i].offset)
+                       : myfs_stripe_pread(vecs[i].buf, vecs[i].size, vecs[i].offset)) != MYFS_ERROR_NONE)
+            {
+                ret = -MYFS_ERROR_IO;
+            }
+        }
+        return ret;
+    }
+
+    total = myfs_stripe_split(vecs, num, write, &pieces, ends);
+    if (total < 0)
+    {
+        return total;
+    }
+    slot = myfs_stripe_ring_get();
+    for (m = 0; m < stripe_cnt; m++)
+    {
+        next[m] = m == 0 ? 0 : ends[m - 1];
+        pfds[m].fd = ddriver_queue_eventfd(stripe_members[m].rings[slot]);
+        pfds[m].events = POLLIN;
+    }
+    while (done < total)
+    {
+        for (m = 0; m < stripe_cnt; m++)
+        {
+            ring = stripe_members[m].rings[slot];
+            while (next[m] < ends[m] && (sqe = ddriver_get_sqe(ring)) != NULL)
+            {
+                piece = &pieces[next[m]];
+                sqe->opcode = write ? DDRIVER_OP_WRITE : DDRIVER_OP_READ;
+                sqe->fd = stripe_members[m].fd;
+                sqe->buf = (char *)piece->buf;
+                sqe->size = piece->size;
+                sqe->offset = piece->offset;
+                sqe->user_data = next[m]++;
+            }
+            ddriver_submit(ring);
+        }
+        if (poll(pfds, stripe_cnt, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            ret = -MYFS_ERROR_IO;
+            break;
+        }
+        for (m = 0; m < stripe_cnt; m++)
+        {
+            if (!(pfds[m].revents & POLLIN) || read(pfds[m].fd, &events, sizeof(events)) != sizeof(events))
+            {
+                continue;
+            }
+            while (ddriver_peek_cqe(stripe_members[m].rings[slot], &cqe) == 0)
+            {
+                piece = &pieces[cqe.user_data];
+                if (cqe.res != piece->size &&
+                    (!stripe_mirror || write ||
+                     myfs_stripe_mirror_rw(piece->buf, piece->size, piece->offset, FALSE) != MYFS_ERROR_NONE))
+                {
+                    ret = -MYFS_ERROR_IO;
+                }
+                else if (write)
+                {
+                    myfs_dirty_mark(&stripe_members[m].dirty, piece->offset, piece->size);
+                }
+                done++;
+            }
+        }
+    }
+    // poll失败时仍要收回已提交的请求，队列才能交给下一个批量请求
+    for (m = 0; m < stripe_cnt && done < total; m++)
+    {
+        while (ddriver_wait_cqe(stripe_members[m].rings[slot], &cqe) == 0)
+        {
+            if (write && cqe.res == pieces[cqe.user_data].size)
+            {
+                myfs_dirty_mark(&stripe_members[m].dirty, pieces[cqe.user_data].offset, cqe.res);
+            }
+        }
+    }
+    __atomic_add_fetch(&stripe_stat.ios, total, __ATOMIC_RELAXED);
+    myfs_stripe_ring_put(slot);
+    free(pieces);
+    return ret;
+}
+
+/******************************************************************************
+ * SECTION: 对外接口
+ *******************************************************************************/
+/**
+ * @brief 打开全部成员设备，多于一个时各启动一个I/O线程；每个成员各建立批量I/O用的异步队列
+ *
+ * @param devices 以逗号分隔的后备文件路径
+ * @param unit 条带单元字节数，0表示MYFS_STRIPE_UNIT，须为块大小的整数倍
+ * @param mirror 各成员互为镜像，忽略unit
+ * @param depth 各设备的队列深度，0表示MYFS_QUEUE_DEPTH
+ * @return int 成员过多或条带单元不合法时返回-MYFS_ERROR_INVAL
+ */
+int myfs_stripe_open(const char *devices, int unit, boolean mirror, int depth)
+{
+    char *list, *path, *save;
+    int fd, sz_disk, sz_io, m;
+    int ret = MYFS_ERROR_NONE;
+
+    list = strdup(devices != NULL ? devices : "");
+    if (list == NULL)
+    {
+        return -MYFS_ERROR_NOSPACE;
+    }
+    stripe_cnt = 0;
+    for (path = strtok_r(list, ",", &save); path != NULL && ret == MYFS_ERROR_NONE; path = strtok_r(NULL, ",", &save))
+    {
+        if (stripe_cnt == MYFS_STRIPE_MAX)
+        {
+            MYFS_DBG("[%s] at most %d devices\n", __func__, MYFS_STRIPE_MAX);
+            ret = -MYFS_ERROR_INVAL;
+        }
+        else if ((fd = ddriver_open(path)) < 0)
+        {
+            ret = -MYFS_ERROR_IO;
+        }
+        else
+        {
+            memset(&stripe_members[stripe_cnt], 0, sizeof(struct myfs_stripe_member));
+            stripe_members[stripe_cnt++].fd = fd;
+        }
+    }
+    free(list);
+    if (stripe_cnt == 0)
+    {
+        return ret != MYFS_ERROR_NONE ? ret : -MYFS_ERROR_INVAL;
+    }
+
+    ddriver_ioctl(stripe_members[0].fd, IOC_REQ_DEVICE_SIZE, &stripe_member_sz);
+    ddriver_ioctl(stripe_members[0].fd, IOC_REQ_DEVICE_IO_SZ, &sz_io);
+    for (int m = 1; m < stripe_cnt; m++)
+    {
+        ddriver_ioctl(stripe_members[m].fd, IOC_REQ_DEVICE_SIZE, &sz_disk);
+        stripe_member_sz = sz_disk < stripe_member_sz ? sz_disk : stripe_member_sz;
+    }
+    stripe_mirror = mirror && stripe_cnt > 1;
+    unit = unit > 0 && !stripe_mirror ? unit : MYFS_STRIPE_UNIT;
+    if (stripe_cnt > 1 && (unit % (2 * sz_io) != 0 || unit > stripe_member_sz))
+    {
+        MYFS_DBG("[%s] stripe unit %d must be a multiple of the block size\n", __func__, unit);
+        ret = -MYFS_ERROR_INVAL;
+    }
+    if (ret != MYFS_ERROR_NONE)
+    {
+        for (int m = 0; m < stripe_cnt; m++)
+        {
+            ddriver_close(stripe_members[m].fd);
+        }
+        stripe_cnt = 0;
+        return ret;
+    }
+    stripe_member_sz = MYFS_ROUND_DOWN(stripe_member_sz, unit);
+    myfs_super.driver_fd = stripe_members[0].fd;
+    myfs_super.stripe_members = stripe_cnt;
+    myfs_super.stripe_unit = stripe_cnt > 1 && !stripe_mirror ? unit : 0;
+    myfs_super.mirror = stripe_mirror;
+
+    for (int m = 0; m < stripe_cnt && stripe_cnt > 1; m++)
+    {
+        pthread_mutex_init(&stripe_members[m].lock, NULL);
+        pthread_cond_init(&stripe_members[m].cond, NULL);
+    }
+    for (int m = 0; m < stripe_cnt; m++)
+    {
+        ddriver_ioctl(stripe_members[m].fd, IOC_REQ_DEVICE_SIZE, &sz_disk);
+        if (myfs_dirty_init(&stripe_members[m].dirty, sz_disk) != MYFS_ERROR_NONE)
+        {
+            myfs_stripe_close();
+            return -MYFS_ERROR_NOSPACE;
+        }
+    }
+    for (int m = 0; m < stripe_cnt && stripe_cnt > 1; m++)
+    {
+        stripe_members[m].running =
+            pthread_create(&stripe_members[m].thread, NULL, myfs_stripe_worker, &stripe_members[m]) == 0;
+        if (!stripe_members[m].running)
+        {
+            myfs_stripe_close();
+            return -MYFS_ERROR_NOSPACE;
+        }
+    }
+
+    depth = depth > 0 ? depth : MYFS_QUEUE_DEPTH;
+    for (int m = 0; m < stripe_cnt; m++)
+    {
+        if (ddriver_ioctl(stripe_members[m].fd, IOC_REQ_QUEUE_DEPTH, &depth) != 0)
+        {
+            MYFS_DBG("[%s] invalid queue depth %d\n", __func__, depth);
+            myfs_stripe_close();
+            return -MYFS_ERROR_INVAL;
+        }
+    }
+    memset(&stripe_stat, 0, sizeof(stripe_stat));
+    stripe_ring_busy = 0;
+    for (stripe_ring_cnt = 0; stripe_ring_cnt < MYFS_QUEUE_RINGS; stripe_ring_cnt++)
+    {
+        for (m = 0; m < stripe_cnt; m++)
+        {
+            stripe_members[m].rings[stripe_ring_cnt] = ddriver_queue_init(MYFS_QUEUE_ENTRIES, DDRIVER_QUEUE_EVENTFD);
+            if (stripe_members[m].rings[stripe_ring_cnt] < 0)
+            {
+                break;
+            }
+        }
+        // 某个成员建不出队列时，这一组不完整，连同已建的一起放弃
+        if (m < stripe_cnt)
+        {
+            while (--m >= 0)
+            {
+                ddriver_queue_exit(stripe_members[m].rings[stripe_ring_cnt]);
+            }
+            break;
+        }
+    }
+    if (stripe_mirror)
+    {
+        MYFS_DBG("[%s] %d mirrors, size: %d\n", __func__, stripe_cnt, stripe_member_sz);
+    }
+    else if (stripe_cnt > 1)
+    {
+        MYFS_DBG("[%s] %d devices, stripe unit: %d, size: %d\n", __func__, stripe_cnt, unit,
+                 stripe_cnt * stripe_member_sz);
+    }
+    return MYFS_ERROR_NONE;
+}
+
+/**
+ * @brief 为全部成员设备设置调度策略
+ *
+ * @param name fifo、clook或deadline
+ * @return int 未知的策略返回-MYFS_ERROR_INVAL
+ */
+int myfs_stripe_sched(const char *name)
+{
+    int policy;
+
+    for (policy = 0; policy < DDRIVER_SCHED_NR && strcmp(name, stripe_sched_names[policy]) != 0; policy++)
+        ;
+    if (policy == DDRIVER_SCHED_NR)
+    {
+        MYFS_DBG("[%s] unknown scheduler %s\n", __func__, name);
+        return -MYFS_ERROR_INVAL;
+    }
+    for (int m = 0; m < stripe_cnt; m++)
+    {
+        ddriver_ioctl(stripe_members[m].fd, IOC_REQ_SCHED_POLICY, &policy);
+    }
+    return MYFS_ERROR_NONE;
+}
+
+/**
+ * @brief 将全部成员设备上已写入的数据同步到后备文件，分层时另有快速设备。
+ * ddriver的定位写只写入后备文件的共享映射，需要持久的时刻由此显式提交，只同步写过的范围
+ *
+ * @return int 任一设备失败返回-MYFS_ERROR_IO
+ */
+int myfs_stripe_commit(void)
+{
+    int ret = myfs_super.tiered ? myfs_tier_commit() : MYFS_ERROR_NONE;
+
+    for (int m = 0; m < stripe_cnt; m++)
+    {
+        if (myfs_dirty_commit(&stripe_members[m].dirty, stripe_members[m].fd) != MYFS_ERROR_NONE)
+        {
+            ret = -MYFS_ERROR_IO;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief 释放异步队列，停止I/O线程，提交并关闭全部成员设备。打印各成员用过的调度策略的统计，
+ *        多个成员时另有各成员的读写统计，镜像时另有分到的读请求数
+ */
+void myfs_stripe_close(void)
+{
+    struct ddriver_state state;
+    struct ddriver_sched_stats sched;
+
+    for (int i = 0; i < stripe_ring_cnt; i++)
+    {
+        for (int m = 0; m < stripe_cnt; m++)
+        {
+            ddriver_queue_exit(stripe_members[m].rings[i]);
+        }
+    }
+    if (stripe_ring_cnt > 0)
+    {
+        MYFS_DBG("[%s] batches: %d, batched ios: %d\n", __func__, stripe_stat.batches, stripe_stat.ios);
+    }
+    stripe_ring_cnt = 0;
+    for (int m = 0; m < stripe_cnt; m++)
+    {
+        if (stripe_members[m].running)
+        {
+            pthread_mutex_lock(&stripe_members[m].lock);
+            stripe_members[m].stop = TRUE;
+            pthread_cond_signal(&stripe_members[m].cond);
+            pthread_mutex_unlock(&stripe_members[m].lock);
+            pthread_join(stripe_members[m].thread, NULL);
+            stripe_members[m].running = FALSE;
+        }
+        if (stripe_cnt > 1)
+        {
+            pthread_cond_destroy(&stripe_members[m].cond);
+            pthread_mutex_destroy(&stripe_members[m].lock);
+            ddriver_ioctl(stripe_members[m].fd, IOC_REQ_DEVICE_STATE, &state);
+            MYFS_DBG("[%s] member %d: read: %d, write: %d, seek: %d, routed reads: %d\n", __func__, m,
+                     state.read_cnt, state.write_cnt, state.seek_cnt, stripe_members[m].reads);
+        }
+        for (sched.policy = 0; sched.policy < DDRIVER_SCHED_NR; sched.policy++)
+        {
+            if (ddriver_ioctl(stripe_members[m].fd, IOC_REQ_SCHED_STATS, &sched) == 0 && sched.dispatched > 0)
+            {
+                MYFS_DBG("[%s] member %d %s: dispatched: %d, queued: %d, expired: %d, seek: %lld us, "
+                         "wait: %lld us, max wait: %lld us\n", __func__, m, stripe_sched_names[sched.policy],
+                         sched.dispatched, sched.queued, sched.expired, sched.seek_us, sched.wait_us,
+                         sched.max_wait_us);
+            }
+        }
+        myfs_dirty_commit(&stripe_members[m].dirty, stripe_members[m].fd);
+        myfs_dirty_destroy(&stripe_members[m].dirty);
+        ddriver_close(stripe_members[m].fd);
+    }
+    stripe_cnt = 0;
+}
+
+/**
+ * @brief 定位读，可多线程并发。分层时先经快速层的映射
+ *
+ * @param out_content
+ * @param size IO单位的整数倍
+ * @param offset 与IO单位对齐
+ * @return int
+ */
+int myfs_stripe_pread(uint8_t *out_content, int size, int offset)
+{
+    if (myfs_super.tiered)
+    {
+        return myfs_tier_rw(out_content, size, offset, FALSE);
+    }
+    return myfs_stripe_rw(out_content, size, offset, FALSE);
+}
+
+/**
+ * @brief 定位写，可多线程并发。分层时先经快速层的映射
+ *
+ * @param in_content
+ * @param size IO单位的整数倍
+ * @param offset 与IO单位对齐
+ * @return int
+ */
+int myfs_stripe_pwrite(uint8_t *in_content, int size, int offset)
+{
+    if (myfs_super.tiered)
+    {
+        return myfs_tier_rw(in_content, size, offset, TRUE);
+    }
+    return myfs_stripe_rw(in_content, size, offset, TRUE);
+}
+
+/**
+ * @brief 设备控制。容量为各成员之和(镜像时为单个成员)，状态为各成员计数之和；多个成员时不支持分区命令
+ *
+ * @param cmd
+ * @param arg
+ * @return int 与ddriver_ioctl相同
+ */
+int myfs_stripe_ioctl(unsigned long cmd, void *arg)
+{
+    struct ddriver_state state, sum;
+    int ret = 0;
+
+    if (stripe_cnt == 1)
+    {
+        return ddriver_ioctl(stripe_members[0].fd, cmd, arg);
+    }
+    switch (cmd)
+    {
+    case IOC_REQ_DEVICE_SIZE:
+        *(int *)arg = stripe_mirror ? stripe_member_sz : stripe_cnt * stripe_member_sz;
+        break;
+    case IOC_REQ_DEVICE_IO_SZ:
+        ret = ddriver_ioctl(stripe_members[0].fd, cmd, arg);
+        break;
+    case IOC_REQ_DEVICE_STATE:
+        memset(&sum, 0, sizeof(sum));
+        for (int m = 0; m < stripe_cnt && ret == 0; m++)
+        {
+            ret = ddriver_ioctl(stripe_members[m].fd, cmd, &state);
+            sum.read_cnt += state.read_cnt;
+            sum.write_cnt += state.write_cnt;
+            sum.seek_cnt += state.seek_cnt;
+        }
+        memcpy(arg, &sum, sizeof(sum));
+        break;
+    case IOC_REQ_DEVICE_RESET:
+        for (int m = 0; m < stripe_cnt && ret == 0; m++)
+        {
+            ret = ddriver_ioctl(stripe_members[m].fd, cmd, arg);
+        }
+        break;
+    case IOC_REQ_ZONE_INFO:
+        memset(arg, 0, sizeof(struct ddriver_zone_info));
+        break;
+    default:
+        ret = -ENOTTY;
+        break;
+    }
+    return ret;
+}
@@ -0,0 +1,621 @@
+/**
+ * 分层存储
+ *
+ * 以--tier-device给出一个小而快的设备时，它作为主设备(--device，可为条带或镜像)之上的快速层。
+ * 文件系统看到的仍是主设备大小的一个虚拟设备，按扩展块(MYFS_TIER_EXTENT)划分：
+ * 每个扩展块在主设备上都有自己的位置，其中一部分当前存放在快速设备的某个槽中，
+ * 此时以快速设备上的内容为准，主设备上的副本可能已过期。
+ *
+ * 快速设备开头为映射表，记录每个槽存放的扩展块，修改映射时按IO单位写回，重新挂载后映射不丢失。
+ * 每个扩展块有访问热度，每次读写加1，访问次数达到扩展块数时全部减半，只反映近期的访问。
+ * 整块写入元数据区的新内容直接放到快速设备的空槽中；其余扩展块由后台线程按热度迁移：
+ * 空槽不足时把最冷的扩展块写回主设备(未写过的不必写回)，有空槽时把最热的扩展块提升上来。
+ * 迁移每秒最多--tier-rate次，单次只占用一个扩展块，其余访问不受影响。
+ */
+
+#include "../include/myfs.h"
+
+extern struct myfs_super myfs_super;
+
+/* 快速设备开头的映射表，extents[i]为第i个槽存放的扩展块号，-1表示空槽 */
+struct myfs_tier_table_d
+{
+    int magic;
+    int slots;
+    int extent_sz;
+    int disk_sz;  /* 虚拟设备大小，与主设备不符时映射表作废 */
+    int extents[];
+};
+
+struct myfs_tier_stat
+{
+    int fast_ios;
+    int slow_ios;
+    int placed;     /* 写入时直接放到快速设备的扩展块 */
+    int promoted;
+    int demoted;
+    int writebacks; /* 降级时需要写回主设备的扩展块 */
+};
+
+static int tier_fd = -1;
+static int tier_slots;
+static int tier_table_sz;                  /* 映射表占用的字节数，按扩展块对齐 */
+static int tier_extents;                   /* 虚拟设备的扩展块数 */
+static struct myfs_tier_table_d *tier_table; /* 映射表在快速设备上的映像，由tier_table_lock保护 */
+static int *tier_slot_of;                  /* 扩展块所在的槽，-1表示在主设备上 */
+static int *tier_owner;                    /* 槽中的扩展块，-1表示空槽，MYFS_TIER_RESERVED表示正在提升 */
+static uint32_t *tier_heat;
+static int *tier_users;                    /* 正在读写该扩展块的请求数 */
+static uint8_t *tier_busy;                 /* 正在迁移或放置，其他请求需等待 */
+static uint8_t *tier_dirty;                /* 槽中内容比主设备上的新 */
+static struct myfs_dirty_map tier_uncommitted; /* 快速设备上写入后尚未提交的范围 */
+static int tier_free;
+static int tier_accesses;
+static int tier_rate;
+static struct myfs_tier_stat tier_stat;
+static pthread_mutex_t tier_lock = PTHREAD_MUTEX_INITIALIZER; /* 保护内存中的映射、热度与计数 */
+static pthread_mutex_t tier_table_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tier_idle = PTHREAD_COND_INITIALIZER;   /* 扩展块的busy或users清零 */
+static pthread_cond_t tier_wake = PTHREAD_COND_INITIALIZER;
+static pthread_t tier_thread;
+static boolean tier_running;
+static boolean tier_stop;
+
+/******************************************************************************
+ * SECTION: 映射表
+ *******************************************************************************/
+static int myfs_tier_slot_ofs(int slot)
+{
+    return tier_table_sz + slot * MYFS_TIER_EXTENT;
+}
+
+/* 快速设备上的定位写，记下写过的范围供提交 */
+static int myfs_tier_pwrite(uint8_t *buf, int size, int offset)
+{
+    int done = ddriver_pwrite(tier_fd, (char *)buf, size, offset);
+    if (done == size)
+    {
+        myfs_dirty_mark(&tier_uncommitted, offset, size);
+    }
+    return done;
+}
+
+/**
+ * @brief 修改并写回一个映射表项所在的IO单位，写回串行进行，较晚的修改不会被较早的覆盖
+ *
+ * @param slot
+ * @param extent -1表示空槽
+ * @return int
+ */
+static int myfs_tier_table_set(int slot, int extent)
+{
+    int offset = MYFS_ROUND_DOWN((int)((uint8_t *)&tier_table->extents[slot] - (uint8_t *)tier_table), MYFS_IO_SZ());
+    int ret;
+
+    pthread_mutex_lock(&tier_table_lock);
+    tier_table->extents[slot] = extent;
+    ret = myfs_tier_pwrite((uint8_t *)tier_table + offset, MYFS_IO_SZ(), offset) == MYFS_IO_SZ()
+              ? MYFS_ERROR_NONE
+              : -MYFS_ERROR_IO;
+    pthread_mutex_unlock(&tier_table_lock);
+    return ret;
+}
+
+/**
+ * @brief 修改内存中的映射，调用者需持有tier_lock
+ *
+ * @param slot
+ * @param extent -1表示释放该槽，MYFS_TIER_RESERVED表示预留给正在进行的提升
+ */
+static void myfs_tier_map(int slot, int extent)
+{
+    if (tier_owner[slot] >= 0)
+    {
+        tier_slot_of[tier_owner[slot]] = -1;
+    }
+    if (extent >= 0)
+    {
+        tier_slot_of[extent] = slot;
+    }
+    tier_free += (extent == -1) - (tier_owner[slot] == -1);
+    tier_owner[slot] = extent;
+}
+
+static int myfs_tier_free_slot(void)
+{
+    for (int slot = 0; slot < tier_slots; slot++)
+    {
+        if (tier_owner[slot] == -1)
+        {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief 超级块所在的扩展块始终留在主设备上，不带快速设备挂载时能读到tiered标志而拒绝挂载，
+ * 不会把主设备当作未格式化的设备
+ *
+ * @param extent
+ * @return boolean
+ */
+static boolean myfs_tier_pinned(int extent)
+{
+    return extent == MYFS_SUPER_OFS / MYFS_TIER_EXTENT;
+}
+
+/**
+ * @brief 元数据区：超级块、位图、inode表与检查点。日志结构模式下为日志区之前的部分
+ *
+ * @param offset
+ * @return boolean
+ */
+static boolean myfs_tier_is_meta(int offset)
+{
+    if (myfs_super.group_blks == 0)
+    {
+        return FALSE;
+    }
+    if (myfs_super.lfs)
+    {
+        return offset < myfs_super.seg_offset;
+    }
+    if (offset >= MYFS_GROUP_OFS(myfs_super.groups))
+    {
+        return TRUE;
+    }
+    return offset % MYFS_BLKS_SZ(myfs_super.group_blks) < myfs_super.data_offset;
+}
+
+/******************************************************************************
+ * SECTION: 后台迁移
+ *******************************************************************************/
+/**
+ * @brief 在主设备与快速设备之间搬移一个扩展块，调用者已将其标记为busy
+ *
+ * @param extent
+ * @param slot 提升时为目标槽，降级时为所在槽
+ * @param promote
+ * @return int
+ */
+static int myfs_tier_move(int extent, int slot, boolean promote)
+{
+    uint8_t buf[MYFS_TIER_EXTENT];
+    int offset = extent * MYFS_TIER_EXTENT;
+
+    // 先搬数据再改映射表，中途掉电时映射表仍指向内容完整的一侧
+    if (promote)
+    {
+        if (myfs_stripe_rw(buf, MYFS_TIER_EXTENT, offset, FALSE) != MYFS_ERROR_NONE ||
+            myfs_tier_pwrite(buf, MYFS_TIER_EXTENT, myfs_tier_slot_ofs(slot)) != MYFS_TIER_EXTENT ||
+            myfs_tier_table_set(slot, extent) != MYFS_ERROR_NONE)
+        {
+            return -MYFS_ERROR_IO;
+        }
+        pthread_mutex_lock(&tier_lock);
+        tier_dirty[slot] = FALSE;
+        myfs_tier_map(slot, extent);
+        tier_stat.promoted++;
+        pthread_mutex_unlock(&tier_lock);
+        return MYFS_ERROR_NONE;
+    }
+    if (tier_dirty[slot])
+    {
+        if (ddriver_pread(tier_fd, (char *)buf, MYFS_TIER_EXTENT, myfs_tier_slot_ofs(slot)) != MYFS_TIER_EXTENT ||
+            myfs_stripe_rw(buf, MYFS_TIER_EXTENT, offset, TRUE) != MYFS_ERROR_NONE)
+        {
+            return -MYFS_ERROR_IO;
+        }
+        tier_stat.writebacks++;
+    }
+    if (myfs_tier_table_set(slot, -1) != MYFS_ERROR_NONE)
+    {
+        return -MYFS_ERROR_IO;
+    }
+    pthread_mutex_lock(&tier_lock);
+    myfs_tier_map(slot, -1);
+    tier_stat.demoted++;
+    pthread_mutex_unlock(&tier_lock);
+    return MYFS_ERROR_NONE;
+}
+
+/**
+ * @brief 选出一次迁移：空槽低于水位(留给新元数据)时降级已完全冷却的扩展块；
+ * 有空槽时提升最热的扩展块，没有空槽时只在最热者明显比最冷者热时降级最冷者，为下次提升腾出空槽
+ *
+ * @param extent 输出
+ * @param promote 输出
+ * @return boolean 是否有需要迁移的扩展块，调用者需持有tier_lock
+ */
+static boolean myfs_tier_pick(int *extent, boolean *promote)
+{
+    int hot = -1, cold = -1;
+    int low = tier_slots / 16 > 1 ? tier_slots / 16 : 1;
+
+    for (int e = 0; e < tier_extents; e++)
+    {
+        if (tier_busy[e] || tier_users[e] > 0 || myfs_tier_pinned(e))
+        {
+            continue;
+        }
+        if (tier_slot_of[e] < 0 && tier_heat[e] >= MYFS_TIER_PROMOTE_HEAT &&
+            (hot < 0 || tier_heat[e] > tier_heat[hot]))
+        {
+            hot = e;
+        }
+        if (tier_slot_of[e] >= 0 && (cold < 0 || tier_heat[e] < tier_heat[cold]))
+        {
+            cold = e;
+        }
+    }
+    if (cold >= 0 && ((tier_free < low && tier_heat[cold] == 0) ||
+                      (hot >= 0 && tier_free == 0 && tier_heat[hot] > 2 * tier_heat[cold] + 1)))
+    {
+        *extent = cold;
+        *promote = FALSE;
+        return TRUE;
+    }
+    if (hot >= 0 && tier_free > 0)
+    {
+        *extent = hot;
+        *promote = TRUE;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static void *myfs_tier_worker(void *arg)
+{
+    struct timespec deadline;
+    int extent, slot;
+    boolean promote;
+
+    (void)arg;
+    pthread_mutex_lock(&tier_lock);
+    while (!tier_stop)
+    {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += 1000000000L / tier_rate;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&tier_wake, &tier_lock, &deadline);
+        if (tier_stop || !myfs_tier_pick(&extent, &promote))
+        {
+            continue;
+        }
+        slot = promote ? myfs_tier_free_slot() : tier_slot_of[extent];
+        if (slot < 0)
+        {
+            continue;
+        }
+        tier_busy[extent] = TRUE;
+        if (promote)
+        {
+            myfs_tier_map(slot, MYFS_TIER_RESERVED);
+        }
+        pthread_mutex_unlock(&tier_lock);
+
+        if (myfs_tier_move(extent, slot, promote) != MYFS_ERROR_NONE)
+        {
+            MYFS_DBG("[%s] %s extent %d failed\n", __func__, promote ? "promote" : "demote", extent);
+        }
+
+        pthread_mutex_lock(&tier_lock);
+        if (tier_owner[slot] == MYFS_TIER_RESERVED)
+        {
+            myfs_tier_map(slot, -1);
+        }
+        tier_busy[extent] = FALSE;
+        pthread_cond_broadcast(&tier_idle);
+    }
+    pthread_mutex_unlock(&tier_lock);
+    return NULL;
+}
+
+/******************************************************************************
+ * SECTION: 读写
+ *******************************************************************************/
+static int myfs_tier_io(boolean fast, uint8_t *buf, int size, int offset, boolean write)
+{
+    __atomic_add_fetch(fast ? &tier_stat.fast_ios : &tier_stat.slow_ios, 1, __ATOMIC_RELAXED);
+    if (!fast)
+    {
+        return myfs_stripe_rw(buf, size, offset, write);
+    }
+    int done = write ? myfs_tier_pwrite(buf, size, offset)
+                     : ddriver_pread(tier_fd, (char *)buf, size, offset);
+    return done == size ? MYFS_ERROR_NONE : -MYFS_ERROR_IO;
+}
+
+/**
+ * @brief 按扩展块拆分读写，同一设备上连续的部分合并为一次I/O
+ *
+ * @param content
+ * @param size IO单位的整数倍
+ * @param offset 与IO单位对齐
+ * @param write
+ * @return int
+ */
+int myfs_tier_rw(uint8_t *content, int size, int offset, boolean write)
+{
+    int first = offset / MYFS_TIER_EXTENT, last = (offset + size - 1) / MYFS_TIER_EXTENT;
+    int e, slot, pos, next = offset, dev = 0, run_pos = offset, run_dev = 0;
+    int placed[MYFS_TIER_PLACE_MAX];
+    int nr_placed = 0, committed = 0;
+    boolean busy, fast = FALSE, run_fast = FALSE;
+    int ret = MYFS_ERROR_NONE;
+
+    pthread_mutex_lock(&tier_lock);
+    do
+    {
+        busy = FALSE;
+        for (e = first; e <= last && !busy; e++)
+        {
+            busy = tier_busy[e];
+        }
+        if (busy)
+        {
+            pthread_cond_wait(&tier_idle, &tier_lock);
+        }
+    } while (busy);
+    for (e = first; e <= last; e++)
+    {
+        tier_users[e]++;
+        tier_heat[e]++;
+        // 整块写入元数据区且有空槽时直接放到快速设备，无需先读出旧内容。只有本请求在访问时才放置，
+        // 并在数据与映射表写完之前保持busy，其他请求不会经新映射读到尚未写入的槽
+        if (write && tier_slot_of[e] < 0 && tier_free > 0 && nr_placed < MYFS_TIER_PLACE_MAX &&
+            tier_users[e] == 1 && e * MYFS_TIER_EXTENT >= offset && (e + 1) * MYFS_TIER_EXTENT <= offset + size &&
+            myfs_tier_is_meta(e * MYFS_TIER_EXTENT) && !myfs_tier_pinned(e) && (slot = myfs_tier_free_slot()) >= 0)
+        {
+            myfs_tier_map(slot, e);
+            tier_busy[e] = TRUE;
+            placed[nr_placed++] = slot;
+            tier_stat.placed++;
+        }
+        if (write && tier_slot_of[e] >= 0)
+        {
+            tier_dirty[tier_slot_of[e]] = TRUE;
+        }
+    }
+    if (++tier_accesses >= tier_extents)
+    {
+        for (e = 0; e < tier_extents; e++)
+        {
+            tier_heat[e] /= 2;
+        }
+        tier_accesses = 0;
+    }
+    pthread_mutex_unlock(&tier_lock);
+
+    // 有请求在读写的扩展块不会被迁移，以下读取映射无需持锁
+    for (pos = offset; ret == MYFS_ERROR_NONE; pos = next)
+    {
+        if (pos < offset + size)
+        {
+            e = pos / MYFS_TIER_EXTENT;
+            next = (e + 1) * MYFS_TIER_EXTENT < offset + size ? (e + 1) * MYFS_TIER_EXTENT : offset + size;
+            slot = tier_slot_of[e];
+            fast = slot >= 0;
+            dev = fast ? myfs_tier_slot_ofs(slot) + pos % MYFS_TIER_EXTENT : pos;
+            if (pos != run_pos && fast == run_fast && dev == run_dev + pos - run_pos)
+            {
+                continue;
+            }
+        }
+        if (pos != run_pos)
+        {
+            ret = myfs_tier_io(run_fast, content + run_pos - offset, pos - run_pos, run_dev, write);
+        }
+        if (pos == offset + size)
+        {
+            break;
+        }
+        run_pos = pos;
+        run_fast = fast;
+        run_dev = dev;
+    }
+    // 新放置的扩展块在数据写入后才记入映射表
+    while (ret == MYFS_ERROR_NONE && committed < nr_placed)
+    {
+        ret = myfs_tier_table_set(placed[committed], tier_owner[placed[committed]]);
+        committed += ret == MYFS_ERROR_NONE;
+    }
+
+    pthread_mutex_lock(&tier_lock);
+    for (int i = 0; i < nr_placed; i++)
+    {
+        e = tier_owner[placed[i]];
+        // 未能记入映射表的扩展块退回主设备，那里仍是写入前的内容
+        if (i >= committed)
+        {
+            myfs_tier_map(placed[i], -1);
+        }
+        tier_busy[e] = FALSE;
+    }
+    if (nr_placed > 0)
+    {
+        pthread_cond_broadcast(&tier_idle);
+    }
+    for (e = first; e <= last; e++)
+    {
+        if (--tier_users[e] == 0)
+        {
+            pthread_cond_broadcast(&tier_idle);
+        }
+    }
+    pthread_mutex_unlock(&tier_lock);
+    return ret;
+}
+
+/******************************************************************************
+ * SECTION: 对外接口
+ *******************************************************************************/
+/**
+ * @brief 打开快速设备，载入或新建映射表，启动迁移线程。调用前myfs_super.sz_disk须已设置
+ *
+ * @param device 快速设备的后备文件
+ * @param size 用作快速层的字节数，0表示整个设备；已有映射表时以映射表为准
+ * @param rate 每秒最多迁移的扩展块数，0表示MYFS_TIER_RATE
+ * @return int
+ */
+int myfs_tier_open(const char *device, int size, int rate)
+{
+    struct ddriver_lat lat = {MYFS_TIER_READ_US, MYFS_TIER_WRITE_US, MYFS_TIER_SEEK_US};
+    struct myfs_tier_table_d hdr;
+    uint8_t unit[MYFS_TIER_EXTENT];
+    int sz_disk, e;
+
+    if (myfs_super.sz_disk % MYFS_TIER_EXTENT != 0 || (tier_fd = ddriver_open((char *)device)) < 0)
+    {
+        tier_fd = -1;
+        return -MYFS_ERROR_IO;
+    }
+    // 模拟设备默认按磁盘计延迟，改为快速设备的延迟模型
+    ddriver_ioctl(tier_fd, IOC_REQ_DEVICE_LAT, &lat);
+    ddriver_ioctl(tier_fd, IOC_REQ_DEVICE_SIZE, &sz_disk);
+    size = size > 0 && size < sz_disk ? size : sz_disk;
+    tier_extents = myfs_super.sz_disk / MYFS_TIER_EXTENT;
+    tier_rate = rate > 0 ? rate : MYFS_TIER_RATE;
+
+    if (ddriver_pread(tier_fd, (char *)unit, MYFS_IO_SZ(), 0) != MYFS_IO_SZ())
+    {
+        ddriver_close(tier_fd);
+        tier_fd = -1;
+        return -MYFS_ERROR_IO;
+    }
+    memcpy(&hdr, unit, sizeof(hdr));
+    if (hdr.magic == MYFS_TIER_MAGIC && hdr.extent_sz == MYFS_TIER_EXTENT && hdr.disk_sz == myfs_super.sz_disk &&
+        hdr.slots > 0 && hdr.slots <= sz_disk / MYFS_TIER_EXTENT)
+    {
+        tier_slots = hdr.slots;
+    }
+    else
+    {
+        // 映射表占用开头的若干扩展块，其余为槽
+        tier_slots = size / MYFS_TIER_EXTENT;
+        tier_slots -= MYFS_ROUND_UP((sizeof(hdr) + tier_slots * sizeof(int)), MYFS_TIER_EXTENT) / MYFS_TIER_EXTENT;
+        hdr.magic = 0;
+    }
+    tier_table_sz = MYFS_ROUND_UP((sizeof(hdr) + tier_slots * sizeof(int)), MYFS_TIER_EXTENT);
+    tier_table = (struct myfs_tier_table_d *)malloc(tier_table_sz);
+    tier_owner = (int *)malloc(tier_slots * sizeof(int));
+    tier_dirty = (uint8_t *)calloc(tier_slots, 1);
+    tier_slot_of = (int *)malloc(tier_extents * sizeof(int));
+    tier_heat = (uint32_t *)calloc(tier_extents, sizeof(uint32_t));
+    tier_users = (int *)calloc(tier_extents, sizeof(int));
+    tier_busy = (uint8_t *)calloc(tier_extents, 1);
+    if (tier_slots <= 0 || tier_table == NULL || tier_owner == NULL || tier_dirty == NULL || tier_slot_of == NULL ||
+        tier_heat == NULL || tier_users == NULL || tier_busy == NULL ||
+        myfs_dirty_init(&tier_uncommitted, sz_disk) != MYFS_ERROR_NONE)
+    {
+        myfs_tier_close();
+        return -MYFS_ERROR_NOSPACE;
+    }
+
+    if (hdr.magic == MYFS_TIER_MAGIC)
+    {
+        if (ddriver_pread(tier_fd, (char *)tier_table, tier_table_sz, 0) != tier_table_sz)
+        {
+            myfs_tier_close();
+            return -MYFS_ERROR_IO;
+        }
+    }
+    else
+    {
+        memset(tier_table, 0, tier_table_sz);
+        tier_table->magic = MYFS_TIER_MAGIC;
+        tier_table->slots = tier_slots;
+        tier_table->extent_sz = MYFS_TIER_EXTENT;
+        tier_table->disk_sz = myfs_super.sz_disk;
+        memset(tier_table->extents, 0xff, tier_slots * sizeof(int));
+        if (myfs_tier_pwrite((uint8_t *)tier_table, tier_table_sz, 0) != tier_table_sz)
+        {
+            myfs_tier_close();
+            return -MYFS_ERROR_IO;
+        }
+    }
+    for (e = 0; e < tier_extents; e++)
+    {
+        tier_slot_of[e] = -1;
+    }
+    tier_free = tier_slots;
+    for (int slot = 0; slot < tier_slots; slot++)
+    {
+        tier_owner[slot] = -1;
+        e = tier_table->extents[slot];
+        if (e >= 0 && e < tier_extents && tier_slot_of[e] < 0)
+        {
+            // 不知道上次卸载前是否写过，降级时一律写回
+            myfs_tier_map(slot, e);
+            tier_dirty[slot] = TRUE;
+        }
+    }
+
+    tier_stop = FALSE;
+    memset(&tier_stat, 0, sizeof(tier_stat));
+    tier_running = pthread_create(&tier_thread, NULL, myfs_tier_worker, NULL) == 0;
+    if (!tier_running)
+    {
+        myfs_tier_close();
+        return -MYFS_ERROR_NOSPACE;
+    }
+    myfs_super.tiered = TRUE;
+    MYFS_DBG("[%s] slots: %d x %d, in use: %d, rate: %d/s\n", __func__, tier_slots, MYFS_TIER_EXTENT,
+             tier_slots - tier_free, tier_rate);
+    return MYFS_ERROR_NONE;
+}
+
+/**
+ * @brief 停止迁移线程，提交并关闭快速设备，映射表已随每次修改写回
+ */
+void myfs_tier_close(void)
+{
+    if (tier_running)
+    {
+        pthread_mutex_lock(&tier_lock);
+        tier_stop = TRUE;
+        pthread_cond_signal(&tier_wake);
+        pthread_mutex_unlock(&tier_lock);
+        pthread_join(tier_thread, NULL);
+        tier_running = FALSE;
+        MYFS_DBG("[%s] slots in use: %d/%d, fast ios: %d, slow ios: %d, placed: %d, promoted: %d, demoted: %d, "
+                 "writebacks: %d\n",
+                 __func__, tier_slots - tier_free, tier_slots, tier_stat.fast_ios, tier_stat.slow_ios,
+                 tier_stat.placed, tier_stat.promoted, tier_stat.demoted, tier_stat.writebacks);
+    }
+    free(tier_table);
+    free(tier_owner);
+    free(tier_dirty);
+    free(tier_slot_of);
+    free(tier_heat);
+    free(tier_users);
+    free(tier_busy);
+    tier_table = NULL;
+    tier_owner = tier_slot_of = tier_users = NULL;
+    tier_dirty = tier_busy = NULL;
+    tier_heat = NULL;
+    if (tier_fd >= 0)
+    {
+        myfs_tier_commit();
+        myfs_dirty_destroy(&tier_uncommitted);
+        ddriver_close(tier_fd);
+        tier_fd = -1;
+    }
+    myfs_super.tiered = FALSE;
+}
+
+/**
+ * @brief 将快速设备上写过的范围同步到后备文件
+ *
+ * @return int
+ */
+int myfs_tier_commit(void)
+{
+    if (tier_fd < 0)
+    {
+        return MYFS_ERROR_NONE;
+    }
+    return myfs_dirty_commit(&tier_uncommitted, tier_fd);
+}
@@ -4,106 +4,768 @@
 extern struct myfs_super myfs_super;
 extern struct custom_options myfs_options;
 
+/* seek与read/write需成对执行，后台预读线程与FUSE线程共用设备时以此互斥 */
+static pthread_mutex_t myfs_driver_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int myfs_group_rotor; /* 新建目录依次放到下一个块组 */
+
+/* 保护myfs_super中的已删除文件记录，unlink与release可能在不同线程 */
+static pthread_mutex_t orphan_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief 获取文件名
+ *
+ * @param path
+ * @return char*
+ */
+char *myfs_get_fname(const char *path)
+{
+    char ch = '/';
+    char *q = strrchr(path, ch) + 1;
+    return q;
+}
+
+/**
+ * @brief 计算路径的层级
+ * exm: /av/c/d/f
+ * -> lvl = 4
+ * @param path
+ * @return int
+ */
+int myfs_calc_lvl(const char *path)
+{
+    char *str = path;
+    int lvl = 0;
+    if (strcmp(path, "/") == 0)
+    {
+        return lvl;
+    }
+    while (*str != NULL)
+    {
+        if (*str == '/')
+        {
+            lvl++;
+        }
+        str++;
+    }
+    return lvl;
+}
+
+/**
+ * @brief 创建dentry，文件名存入名字区
+ *
+ * @param fname
+ * @param ftype
+ * @return struct myfs_dentry* 文件名过长或内存不足时返回NULL
+ */
+struct myfs_dentry *new_dentry(const char *fname, MYFS_FILE_TYPE ftype)
+{
+    struct myfs_dentry *dentry = (struct myfs_dentry *)myfs_slab_alloc(MYFS_SLAB_DENTRY);
+    if (dentry == NULL)
+    {
+        return NULL;
+    }
+    dentry->fname = myfs_name_alloc(fname);
+    if (dentry->fname == NULL)
+    {
+        myfs_slab_free(MYFS_SLAB_DENTRY, dentry);
+        return NULL;
+    }
+    dentry->ftype = ftype;
+    dentry->ino = -1;
+    dentry->inode = NULL;
+    dentry->parent = NULL;
+    dentry->brother = NULL;
+    return dentry;
+}
+
+/**
+ * @brief 释放dentry及其文件名，不涉及其指向的inode
+ *
+ * @param dentry
+ */
+void free_dentry(struct myfs_dentry *dentry)
+{
+    myfs_name_free(dentry->fname);
+    myfs_slab_free(MYFS_SLAB_DENTRY, dentry);
+}
+
+/**
+ * @brief 按IO单位逐个读取，offset与size均需IO单位对齐，调用者需持有myfs_driver_lock。
+ * 多个成员设备或分层时按位置读，由myfs_stripe_pread拆分到各成员、选择一个镜像或经快速层映射
+ *
+ * @param offset
+ * @param out_content
+ * @param size
+ */
+static void myfs_driver_read_units(int offset, uint8_t *out_content, int size)
+{
+    if (MYFS_DRIVER_STACKED())
+    {
+        myfs_stripe_pread(out_content, size, offset);
+        return;
+    }
+    // lseek(MYFS_DRIVER(), offset, SEEK_SET);
+    ddriver_seek(MYFS_DRIVER(), offset, SEEK_SET);
+    while (size != 0)
+    {
+        // read(SFS_DRIVER(), cur, SFS_IO_SZ());
+        // 每次设备只可以读写512B
+        ddriver_read(MYFS_DRIVER(), (char *)out_content, MYFS_IO_SZ());
+        out_content += MYFS_IO_SZ();
+        size -= MYFS_IO_SZ();
+    }
+}
+
+/**
+ * @brief 驱动读。对齐的请求直接读入调用者的缓冲区，否则经本线程暂存区补齐。
+ * 日志结构模式下日志区中的虚拟地址经myfs_lfs_read映射
+ *
+ * @param offset
+ * @param out_content
+ * @param size
+ * @return int
+ */
+int myfs_driver_read(int offset, uint8_t *out_content, int size)
+{
+    int offset_aligned = MYFS_ROUND_DOWN(offset, MYFS_IO_SZ());
+    int bias = offset - offset_aligned;
+    int size_aligned = MYFS_ROUND_UP((size + bias), MYFS_IO_SZ());
+    uint8_t *temp_content = out_content;
+    if (MYFS_LFS_OWNS(offset))
+    {
+        return myfs_lfs_read(offset, out_content, size);
+    }
+    if (bias != 0 || size != size_aligned)
+    {
+        temp_content = myfs_scratch_get(size_aligned);
+        if (temp_content == NULL)
+        {
+            return -MYFS_ERROR_NOSPACE;
+        }
+    }
+    pthread_mutex_lock(&myfs_driver_lock);
+    myfs_driver_read_units(offset_aligned, temp_content, size_aligned);
+    pthread_mutex_unlock(&myfs_driver_lock);
+    if (temp_content != out_content)
+    {
+        memcpy(out_content, temp_content + bias, size);
+    }
+    return MYFS_ERROR_NONE;
+}
+
+/**
+ * @brief 驱动定位读，不移动共享的设备偏移，无需持有myfs_driver_lock，可多线程并发。
+ * 读取内容不经过缓存，只应在没有并发写入时使用（如挂载阶段）
+ *
+ * @param offset
+ * @param out_content
+ * @param size
+ * @return int
+ */
+int myfs_driver_pread(int offset, uint8_t *out_content, int size)
+{
+    int offset_aligned = MYFS_ROUND_DOWN(offset, MYFS_IO_SZ());
+    int bias = offset - offset_aligned;
+    int size_aligned = MYFS_ROUND_UP((size + bias), MYFS_IO_SZ());
+    uint8_t *temp_content = out_content;
+    if (MYFS_LFS_OWNS(offset))
+    {
+        return myfs_lfs_read(offset, out_content, size);
+    }
+    if (bias != 0 || size != size_aligned)
+    {
+        temp_content = myfs_scratch_get(size_aligned);
+        if (temp_content == NULL)
+        {
+            return -MYFS_ERROR_NOSPACE;
+        }
+    }
+    if (myfs_stripe_pread(temp_content, size_aligned, offset_aligned) != MYFS_ERROR_NONE)
+    {
+        return -MYFS_ERROR_IO;
+    }
+    if (temp_content != out_content)
+    {
+        memcpy(out_content, temp_content + bias, size);
+    }
+    return MYFS_ERROR_NONE;
+}
+
+/**
+ * @brief 原地读，返回设备内容的只读指针，供解析inode与目录块时省去拷贝。
+ * 与myfs_driver_pread一样无需持有myfs_driver_lock、不经过缓存，只应在没有并发写入时使用
+ *
+ * @param offset
+ * @param size
+ * @return const uint8_t* 多个成员设备、分层、位于日志区或设备无法原地读时返回NULL，调用者改用读函数
+ */
+const uint8_t *myfs_driver_map(int offset, int size)
+{
+    int offset_aligned = MYFS_ROUND_DOWN(offset, MYFS_IO_SZ());
+    int bias = offset - offset_aligned;
+    int size_aligned = MYFS_ROUND_UP((size + bias), MYFS_IO_SZ());
+    const char *mapped;
+    if (MYFS_DRIVER_STACKED() || MYFS_LFS_OWNS(offset))
+    {
+        return NULL;
+    }
+    mapped = ddriver_map(MYFS_DRIVER(), offset_aligned, size_aligned);
+    return mapped != NULL ? (const uint8_t *)mapped + bias : NULL;
+}
+
+/**
+ * @brief 驱动写，写入范围内的缓存块同时失效。对齐的请求直接写出调用者的缓冲区，
+ * 否则在本线程暂存区中读改写。日志结构模式下日志区中的虚拟地址由myfs_lfs_write追加到日志
+ *
+ * @param offset
+ * @param in_content
+ * @param size
+ * @return int
+ */
+int myfs_driver_write(int offset, uint8_t *in_content, int size)
+{
+    int offset_aligned = MYFS_ROUND_DOWN(offset, MYFS_IO_SZ());
+    int bias = offset - offset_aligned;
+    int size_aligned = MYFS_ROUND_UP((size + bias), MYFS_IO_SZ());
+    uint8_t *temp_content = in_content;
+    uint8_t *cur;
+    if (MYFS_LFS_OWNS(offset))
+    {
+        return myfs_lfs_write(offset, in_content, size);
+    }
+    if (bias != 0 || size != size_aligned)
+    {
+        temp_content = myfs_scratch_get(size_aligned);
+        if (temp_content == NULL)
+        {
+            return -MYFS_ERROR_NOSPACE;
+        }
+    }
+    pthread_mutex_lock(&myfs_driver_lock);
+    if (temp_content != in_content)
+    {
+        // 只有未被完全覆盖的首尾两个IO单位需要先读出旧内容
+        boolean head = bias != 0 || size < MYFS_IO_SZ();
+        boolean tail = (bias + size) % MYFS_IO_SZ() != 0 && !(head && size_aligned == MYFS_IO_SZ());
+        if (head)
+        {
+            myfs_driver_read_units(offset_aligned, temp_content, MYFS_IO_SZ());
+        }
+        if (tail)
+        {
+            myfs_driver_read_units(offset_aligned + size_aligned - MYFS_IO_SZ(),
+                                   temp_content + size_aligned - MYFS_IO_SZ(), MYFS_IO_SZ());
+        }
+        memcpy(temp_content + bias, in_content, size);
+    }
+
+    cur = temp_content;
+    if (MYFS_DRIVER_STACKED())
+    {
+        // 多个成员设备时由myfs_stripe_pwrite按条带拆分或复制到各镜像并行写出，分层时经快速层映射
+        myfs_stripe_pwrite(cur, size_aligned, offset_aligned);
+    }
+    else
+    {
+        // lseek(SFS_DRIVER(), offset_aligned, SEEK_SET);
+        ddriver_seek(MYFS_DRIVER(), offset_aligned, SEEK_SET);
+        while (size_aligned != 0)
+        {
+            // write(SFS_DRIVER(), cur, SFS_IO_SZ());
+            // 每次设备只可以读写512B
+            ddriver_write(MYFS_DRIVER(), (char *)cur, MYFS_IO_SZ());
+            cur += MYFS_IO_SZ();
+            size_aligned -= MYFS_IO_SZ();
+        }
+        myfs_stripe_dirty(offset_aligned, (int)(cur - temp_content));
+    }
+    myfs_cache_invalidate(offset, size);
+    pthread_mutex_unlock(&myfs_driver_lock);
+    return MYFS_ERROR_NONE;
+}
+
+/**
+ * @brief 批量驱动读写，各请求的范围互不重叠。对齐的请求由myfs_stripe_batch同时发出，
+ * 设备时延相互重叠；不对齐或位于日志区的请求逐个经myfs_driver_read/myfs_driver_write完成。
+ * 与myfs_driver_pread一样不移动共享的设备偏移，读取内容不经过缓存；写入范围内的缓存块失效
+ *
+ * @param vecs
+ * @param num
+ * @param write
+ * @return int 任一请求失败则返回其错误
+ */
+int myfs_driver_batch(struct myfs_vec *vecs, int num, boolean write)
+{
+    struct myfs_vec *direct;
+    int cnt = 0, i, r;
+    int ret = MYFS_ERROR_NONE;
+
+    if (num <= 0)
+    {
+        return MYFS_ERROR_NONE;
+    }
+    direct = (struct myfs_vec *)malloc(num * sizeof(struct myfs_vec));
+    if (direct == NULL)
+    {
+        return -MYFS_ERROR_NOSPACE;
+    }
+    for (i = 0; i < num; i++)
+    {
+        if (MYFS_LFS_OWNS(vecs[i].offset) || vecs[i].offset % MYFS_IO_SZ() != 0 || vecs[i].size % MYFS_IO_SZ() != 0)
+        {
+            r = write ? myfs_driver_write(vecs[i].offset, vecs[i].buf, vecs[i].size)
+                      : myfs_driver_read(vecs[i].offset, vecs[i].buf, vecs[i].size);
+            ret = r != MYFS_ERROR_NONE ? r : ret;
+        }
+        else if (vecs[i].size > 0)
+        {
+            direct[cnt++] = vecs[i];
+        }
+    }
+    if (cnt > 0 && myfs_stripe_batch(direct, cnt, write) != MYFS_ERROR_NONE)
+    {
+        ret = -MYFS_ERROR_IO;
+    }
+    for (i = 0; write && i < cnt; i++)
+    {
+        myfs_cache_invalidate(direct[i].offset, direct[i].size);
+    }
+    free(direct);
+    return ret;
+}
+
+/**
+ * @brief 内存中位图的第blk块在设备上的偏移。分组时各块组的位图在内存中依次相接
+ *
+ * @param offset 块组0中位图的偏移
+ * @param idx
+ * @param blk 位图内块号
+ * @return int
+ */
+static inline int myfs_map_blk_ofs(int offset, struct myfs_map_index *idx, int blk)
+{
+    return MYFS_GROUP_OFS(blk / idx->group_blks) + offset + MYFS_BLKS_SZ(blk % idx->group_blks);
+}
+
+/**
+ * @brief 按需读入位图的第blk块。位图在挂载时只分配内存，首次访问某块时才经块缓存读盘
+ *
+ * @param map 位图
+ * @param loaded 摘要位图，每位表示一个位图块是否已读入
+ * @param offset 块组0中位图的偏移
+ * @param idx
+ * @param blk 位图内块号
+ * @return int
+ */
+static int myfs_map_load(uint8_t *map, uint8_t *loaded, int offset, struct myfs_map_index *idx, int blk)
+{
+    if (test_bit(loaded, blk))
+    {
+        return MYFS_ERROR_NONE;
+    }
+    if (myfs_cache_read(MYFS_BLK_NO(myfs_map_blk_ofs(offset, idx, blk)), map + MYFS_BLKS_SZ(blk), 0,
+                        MYFS_BLK_SZ()) != MYFS_ERROR_NONE)
+    {
+        return -MYFS_ERROR_IO;
+    }
+    set_bit(&loaded, blk);
+    return MYFS_ERROR_NONE;
+}
+
+/**
+ * @brief 把摘要位图中标记的位图块加入写回链表
+ *
+ * @param list
+ * @param map 位图
+ * @param dirty 摘要位图，每位表示一个位图块自上次写回后是否被修改
+ * @param offset 块组0中位图的偏移
+ * @param idx
+ * @param blks 位图块数
+ * @return int 加入的块数
+ */
+static int myfs_map_sync_io(struct myfs_io_list *list, uint8_t *map, uint8_t *dirty, int offset,
+                            struct myfs_map_index *idx, int blks)
+{
+    int cnt = 0;
+    for (int blk = 0; blk < blks; blk++)
+    {
+        if (test_bit(dirty, blk))
+        {
+            // 先清除再复制，复制期间的修改会重新置位，留给下一次写回
+            clear_bit(&dirty, blk);
+            myfs_io_add(list, myfs_map_blk_ofs(offset, idx, blk), map + MYFS_BLKS_SZ(blk), MYFS_BLK_SZ());
+            cnt++;
+        }
+    }
+    return cnt;
+}
+
+/**
+ * @brief 立即写出两个位图中被修改过的块
+ *
+ * @return int
+ */
+static int myfs_map_sync(void)
+{
+    struct myfs_io_list list;
+
+    myfs_io_init(&list);
+    myfs_map_sync_io(&list, myfs_super.map_inode, myfs_super.map_inode_dirty, myfs_super.map_inode_offset,
+                     &myfs_super.map_inode_idx, myfs_super.map_inode_blks);
+    myfs_map_sync_io(&list, myfs_super.map_data, myfs_super.map_data_dirty, myfs_super.map_data_offset,
+                     &myfs_super.map_data_idx, myfs_super.map_data_blks);
+    return myfs_io_submit(&list);
+}
+
+/**
+ * @brief 建立位图的两级空闲索引。各段在首次被查找时读入并统计，此前视为可能有空闲位
+ *
+ * @param idx
+ * @param bits 位图有效位数
+ * @param chunk_bits 每段位数
+ * @param group_blks 每个块组的位图块数
+ * @return int
+ */
+static int myfs_map_index_init(struct myfs_map_index *idx, int bits, int chunk_bits, int group_blks)
+{
+    idx->bits = bits;
+    idx->chunk_bits = chunk_bits;
+    idx->group_blks = group_blks;
+    idx->chunks = (bits + chunk_bits - 1) / chunk_bits;
+    idx->free = (int *)malloc(idx->chunks * sizeof(int));
+    idx->avail = (uint64_t *)calloc((idx->chunks + 63) / 64, sizeof(uint64_t));
+    if (idx->free == NULL || idx->avail == NULL)
+    {
+        return -MYFS_ERROR_NOSPACE;
+    }
+    for (int c = 0; c < idx->chunks; c++)
+    {
+        idx->free[c] = -1;
+        idx->avail[c / 64] |= 1ULL << (c % 64);
+    }
+    return MYFS_ERROR_NONE;
+}
+
+static void myfs_map_index_destroy(struct myfs_map_index *idx)
+{
+    free(idx->free);
+    free(idx->avail);
+    idx->free = NULL;
+    idx->avail = NULL;
+}
+
+/**
+ * @brief 位图中一位变化后同步该段的空闲计数与顶层摘要，尚未统计的段不必维护
+ *
+ * @param idx
+ * @param bit
+ * @param delta 空闲位数的变化
+ */
+static void myfs_map_index_update(struct myfs_map_index *idx, int bit, int delta)
+{
+    int c = bit / idx->chunk_bits;
+
+    if (idx->free[c] < 0)
+    {
+        return;
+    }
+    idx->free[c] += delta;
+    if (idx->free[c] > 0)
+    {
+        idx->avail[c / 64] |= 1ULL << (c % 64);
+    }
+    else
+    {
+        idx->avail[c / 64] &= ~(1ULL << (c % 64));
+    }
+}
+
+/**
+ * @brief 读入一段位图的全部块，并按字统计其空闲位数
+ *
+ * @param map 位图
+ * @param loaded 摘要位图，每位表示一个位图块是否已读入
+ * @param offset 块组0中位图的偏移
+ * @param idx
+ * @param c 段号
+ * @return int
+ */
+static int myfs_map_load_chunk(uint8_t *map, uint8_t *loaded, int offset, struct myfs_map_index *idx, int c)
+{
+    int blk_bits = MYFS_BLK_SZ() * UINT8_BITS;
+    int begin = c * idx->chunk_bits;
+    int end = begin + idx->chunk_bits < idx->bits ? begin + idx->chunk_bits : idx->bits;
+    uint64_t *words = (uint64_t *)map;
+    uint64_t word;
+    int used = 0;
+
+    if (idx->free[c] >= 0)
+    {
+        return MYFS_ERROR_NONE;
+    }
+    for (int blk = begin / blk_bits; blk <= (end - 1) / blk_bits; blk++)
+    {
+        if (myfs_map_load(map, loaded, offset, idx, blk) != MYFS_ERROR_NONE)
+        {
+            return -MYFS_ERROR_IO;
+        }
+    }
+    // 段起点按64位对齐，末尾不足一个字的部分屏蔽掉有效位以外的位
+    for (int w = begin / 64; w * 64 < end; w++)
+    {
+        word = words[w];
+        if (w * 64 + 64 > end)
+        {
+            word &= (1ULL << (end - w * 64)) - 1;
+        }
+        used += __builtin_popcountll(word);
+    }
+    idx->free[c] = 0;
+    myfs_map_index_update(idx, begin, end - begin - used);
+    return MYFS_ERROR_NONE;
+}
+
+/**
+ * @brief 在一段已读入的位图中按字查找第一个空闲位
+ *
+ * @return int 无空闲位时返回-1
+ */
+static int myfs_map_scan_chunk(uint8_t *map, struct myfs_map_index *idx, int c)
+{
+    int begin = c * idx->chunk_bits;
+    int end = begin + idx->chunk_bits < idx->bits ? begin + idx->chunk_bits : idx->bits;
+    uint64_t *words = (uint64_t *)map;
+    int bit;
+
+    for (int w = begin / 64; w * 64 < end; w++)
+    {
+        if (~words[w] != 0)
+        {
+            bit = w * 64 + __builtin_ctzll(~words[w]);
+            return bit < end ? bit : -1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief 查找位图中的一个空闲位。先试goal段，再沿顶层摘要找第一个含空闲位的段，
+ * 只读入查找经过的段
+ *
+ * @param map 位图
+ * @param loaded 摘要位图，每位表示一个位图块是否已读入
+ * @param offset 块组0中位图的偏移
+ * @param idx 两级空闲索引
+ * @param goal 优先查找的段号，-1表示不指定
+ * @return int 无空闲位或读盘失败时返回-1
+ */
+static int myfs_map_find_free(uint8_t *map, uint8_t *loaded, int offset, struct myfs_map_index *idx, int goal)
+{
+    uint64_t word;
+    int c;
+
+    if (goal >= 0 && goal < idx->chunks)
+    {
+        if (myfs_map_load_chunk(map, loaded, offset, idx, goal) != MYFS_ERROR_NONE)
+        {
+            return -1;
+        }
+        if (idx->free[goal] > 0)
+        {
+            return myfs_map_scan_chunk(map, idx, goal);
+        }
+    }
+    for (int w = 0; w < (idx->chunks + 63) / 64; w++)
+    {
+        for (word = idx->avail[w]; word != 0; word &= word - 1)
+        {
+            c = w * 64 + __builtin_ctzll(word);
+            if (myfs_map_load_chunk(map, loaded, offset, idx, c) != MYFS_ERROR_NONE)
+            {
+                return -1;
+            }
+            if (idx->free[c] > 0)
+            {
+                return myfs_map_scan_chunk(map, idx, c);
+            }
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief 已统计的段中空闲位最多的一段，供需要连续空间的分配使用
+ *
+ * @param idx
+ * @return int 尚无已统计且有空闲的段时返回-1
+ */
+static int myfs_map_emptiest(struct myfs_map_index *idx)
+{
+    uint64_t word;
+    int c, best = -1;
+
+    for (int w = 0; w < (idx->chunks + 63) / 64; w++)
+    {
+        for (word = idx->avail[w]; word != 0; word &= word - 1)
+        {
+            c = w * 64 + __builtin_ctzll(word);
+            if (idx->free[c] > 0 && (best < 0 || idx->free[c] > idx->free[best]))
+            {
+                best = c;
+            }
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief 读入两张位图的全部块，供调试打印与重新统计空闲计数
+ *
+ * @return int
+ */
+int myfs_map_load_all(void)
+{
+    for (int blk = 0; blk < myfs_super.map_inode_blks; blk++)
+    {
+        if (myfs_map_load(myfs_super.map_inode, myfs_super.map_inode_loaded, myfs_super.map_inode_offset,
+                          &myfs_super.map_inode_idx, blk) != MYFS_ERROR_NONE)
+        {
+            return -MYFS_ERROR_IO;
+        }
+    }
+    for (int blk = 0; blk < myfs_super.map_data_blks; blk++)
+    {
+        if (myfs_map_load(myfs_super.map_data, myfs_super.map_data_loaded, myfs_super.map_data_offset,
+                          &myfs_super.map_data_idx, blk) != MYFS_ERROR_NONE)
+        {
+            return -MYFS_ERROR_IO;
+        }
+    }
+    return MYFS_ERROR_NONE;
+}
+
+/**
+ * @brief 由位图重新统计空闲inode与数据块数。旧格式的超级块没有空闲计数，
+ * 异常卸载时计数也没有写回，挂载时以位图为准
+ *
+ * @return int
+ */
+static int myfs_map_recount(void)
+{
+    int ino_per_group = myfs_super.max_ino / myfs_super.groups;
+    int data_per_group = myfs_super.max_data / myfs_super.groups;
+    if (myfs_map_load_all() != MYFS_ERROR_NONE)
+    {
+        return -MYFS_ERROR_IO;
+    }
+    myfs_super.free_ino = 0;
+    myfs_super.free_data = 0;
+    for (int group = 0; group < myfs_super.groups; group++)
+    {
+        for (int bit = 0; bit < ino_per_group; bit++)
+        {
+            myfs_super.free_ino += !test_bit(myfs_super.map_inode, group * myfs_super.ino_stride + bit);
+        }
+        for (int bit = 0; bit < data_per_group; bit++)
+        {
+            myfs_super.free_data += !test_bit(myfs_super.map_data, group * myfs_super.data_stride + bit);
+        }
+    }
+    MYFS_DBG("[%s] free inodes: %d, free blocks: %d\n", __func__, myfs_super.free_ino, myfs_super.free_data);
+    return MYFS_ERROR_NONE;
+}
+
 /**
- * @brief 获取文件名
+ * @brief 占用inode位图中的一位，同步维护空闲inode计数
  *
- * @param path
- * @return char*
+ * @param ino
  */
-char *myfs_get_fname(const char *path)
+void myfs_map_inode_set(int ino)
 {
-    char ch = '/';
-    char *q = strrchr(path, ch) + 1;
-    return q;
+    if (myfs_map_load(myfs_super.map_inode, myfs_super.map_inode_loaded, myfs_super.map_inode_offset,
+                      &myfs_super.map_inode_idx, ino / (MYFS_BLK_SZ() * UINT8_BITS)) != MYFS_ERROR_NONE)
+    {
+        return;
+    }
+    if (!test_bit(myfs_super.map_inode, ino))
+    {
+        set_bit(&myfs_super.map_inode, ino);
+        set_bit(&myfs_super.map_inode_dirty, ino / (MYFS_BLK_SZ() * UINT8_BITS));
+        myfs_map_index_update(&myfs_super.map_inode_idx, ino, -1);
+        myfs_super.free_ino--;
+    }
 }
 
 /**
- * @brief 计算路径的层级
- * exm: /av/c/d/f
- * -> lvl = 4
- * @param path
- * @return int
+ * @brief 释放inode位图中的一位，同步维护空闲inode计数
+ *
+ * @param ino
  */
-int myfs_calc_lvl(const char *path)
+void myfs_map_inode_clear(int ino)
 {
-    char *str = path;
-    int lvl = 0;
-    if (strcmp(path, "/") == 0)
+    if (myfs_map_load(myfs_super.map_inode, myfs_super.map_inode_loaded, myfs_super.map_inode_offset,
+                      &myfs_super.map_inode_idx, ino / (MYFS_BLK_SZ() * UINT8_BITS)) != MYFS_ERROR_NONE)
     {
-        return lvl;
+        return;
     }
-    while (*str != NULL)
+    if (test_bit(myfs_super.map_inode, ino))
     {
-        if (*str == '/')
+        clear_bit(&myfs_super.map_inode, ino);
+        set_bit(&myfs_super.map_inode_dirty, ino / (MYFS_BLK_SZ() * UINT8_BITS));
+        myfs_map_index_update(&myfs_super.map_inode_idx, ino, 1);
+        myfs_super.free_ino++;
+        if (myfs_super.lfs)
         {
-            lvl++;
+            myfs_lfs_discard(MYFS_INO_OFS(ino), MYFS_BLK_SZ());
         }
-        str++;
     }
-    return lvl;
 }
 
 /**
- * @brief 驱动读
+ * @brief 占用数据位图中的一位，同步维护空闲数据块计数
  *
- * @param offset
- * @param out_content
- * @param size
- * @return int
+ * @param blk
  */
-int myfs_driver_read(int offset, uint8_t *out_content, int size)
+void myfs_map_data_set(int blk)
 {
-    int offset_aligned = MYFS_ROUND_DOWN(offset, MYFS_IO_SZ());
-    int bias = offset - offset_aligned;
-    int size_aligned = MYFS_ROUND_UP((size + bias), MYFS_IO_SZ());
-    uint8_t *temp_content = (uint8_t *)malloc(size_aligned);
-    uint8_t *cur = temp_content;
-    // lseek(MYFS_DRIVER(), offset_aligned, SEEK_SET);
-    ddriver_seek(MYFS_DRIVER(), offset_aligned, SEEK_SET);
-    while (size_aligned != 0)
+    if (myfs_map_load(myfs_super.map_data, myfs_super.map_data_loaded, myfs_super.map_data_offset,
+                      &myfs_super.map_data_idx, blk / (MYFS_BLK_SZ() * UINT8_BITS)) != MYFS_ERROR_NONE)
     {
-        // read(SFS_DRIVER(), cur, SFS_IO_SZ());
-        // 每次设备只可以读写512B
-        ddriver_read(MYFS_DRIVER(), cur, MYFS_IO_SZ());
-        cur += MYFS_IO_SZ();
-        size_aligned -= MYFS_IO_SZ();
+        return;
+    }
+    if (!test_bit(myfs_super.map_data, blk))
+    {
+        set_bit(&myfs_super.map_data, blk);
+        set_bit(&myfs_super.map_data_dirty, blk / (MYFS_BLK_SZ() * UINT8_BITS));
+        myfs_map_index_update(&myfs_super.map_data_idx, blk, -1);
+        myfs_super.free_data--;
     }
-    memcpy(out_content, temp_content + bias, size);
-    free(temp_content);
-    return MYFS_ERROR_NONE;
 }
 
 /**
- * @brief 驱动写
+ * @brief 释放数据位图中的一位，同步维护空闲数据块计数
  *
- * @param offset
- * @param in_content
- * @param size
- * @return int
+ * @param blk
  */
-int myfs_driver_write(int offset, uint8_t *in_content, int size)
+void myfs_map_data_clear(int blk)
 {
-    int offset_aligned = MYFS_ROUND_DOWN(offset, MYFS_IO_SZ());
-    int bias = offset - offset_aligned;
-    int size_aligned = MYFS_ROUND_UP((size + bias), MYFS_IO_SZ());
-    uint8_t *temp_content = (uint8_t *)malloc(size_aligned);
-    uint8_t *cur = temp_content;
-    myfs_driver_read(offset_aligned, temp_content, size_aligned);
-    memcpy(temp_content + bias, in_content, size);
-
-    // lseek(SFS_DRIVER(), offset_aligned, SEEK_SET);
-    ddriver_seek(MYFS_DRIVER(), offset_aligned, SEEK_SET);
-    while (size_aligned != 0)
+    if (myfs_map_load(myfs_super.map_data, myfs_super.map_data_loaded, myfs_super.map_data_offset,
+                      &myfs_super.map_data_idx, blk / (MYFS_BLK_SZ() * UINT8_BITS)) != MYFS_ERROR_NONE)
     {
-        // write(SFS_DRIVER(), cur, SFS_IO_SZ());
-        // 每次设备只可以读写512B
-        ddriver_write(MYFS_DRIVER(), cur, MYFS_IO_SZ());
-        cur += MYFS_IO_SZ();
-        size_aligned -= MYFS_IO_SZ();
+        return;
+    }
+    if (test_bit(myfs_super.map_data, blk))
+    {
+        clear_bit(&myfs_super.map_data, blk);
+        set_bit(&myfs_super.map_data_dirty, blk / (MYFS_BLK_SZ() * UINT8_BITS));
+        myfs_map_index_update(&myfs_super.map_data_idx, blk, 1);
+        myfs_super.free_data++;
+        if (myfs_super.lfs)
+        {
+            myfs_lfs_discard(MYFS_DATA_OFS(blk), MYFS_BLK_SZ());
+        }
     }
-
-    free(temp_content);
-    return MYFS_ERROR_NONE;
 }
 
 /**
@@ -125,6 +787,7 @@ int myfs_alloc_dentry(struct myfs_inode *inode, struct myfs_dentry *dentry)
         inode->dentrys = dentry;
     }
     inode->dir_cnt++;
+    inode->dirty = TRUE;
     return inode->dir_cnt;
 }
 
@@ -164,37 +827,180 @@ int myfs_drop_dentry(struct myfs_inode *inode, struct myfs_dentry *dentry)
         return -MYFS_ERROR_NOTFOUND;
     }
     inode->dir_cnt--;
+    inode->dirty = TRUE;
     return inode->dir_cnt;
 }
 
+/**
+ * @brief 初始化目录块：整块为一条空闲记录
+ *
+ * @param blk
+ */
+void myfs_dirent_init(uint8_t *blk)
+{
+    struct myfs_dentry_d *rec = (struct myfs_dentry_d *)blk;
+    memset(blk, 0, MYFS_BLK_SZ());
+    rec->rec_len = MYFS_BLK_SZ();
+}
+
+/**
+ * @brief 在目录块中插入一条目录项，复用空闲记录或切分尾部有富余的记录
+ *
+ * @param blk
+ * @param fname
+ * @param ino
+ * @param ftype
+ * @return int 块内空间不足时返回-MYFS_ERROR_NOSPACE
+ */
+int myfs_dirent_add(uint8_t *blk, const char *fname, int ino, MYFS_FILE_TYPE ftype)
+{
+    int name_len = strlen(fname);
+    int need = MYFS_DIRENT_LEN(name_len);
+    int off = 0;
+    while (off < MYFS_BLK_SZ())
+    {
+        struct myfs_dentry_d *rec = (struct myfs_dentry_d *)(blk + off);
+        int used = rec->name_len == 0 ? 0 : MYFS_DIRENT_LEN(rec->name_len);
+        if (rec->rec_len == 0)
+        {
+            break;
+        }
+        if (rec->rec_len - used >= need)
+        {
+            if (used != 0)
+            {
+                // 切出本记录尾部的空闲空间作为新记录
+                struct myfs_dentry_d *next = (struct myfs_dentry_d *)(blk + off + used);
+                next->rec_len = rec->rec_len - used;
+                rec->rec_len = used;
+                rec = next;
+            }
+            rec->ino = ino;
+            rec->name_len = name_len;
+            rec->ftype = ftype;
+            memcpy(rec->fname, fname, name_len);
+            return MYFS_ERROR_NONE;
+        }
+        off += rec->rec_len;
+    }
+    return -MYFS_ERROR_NOSPACE;
+}
+
+/**
+ * @brief 判断目录再加入fname后能否装入其数据块，装填顺序与myfs_sync_inode一致
+ *
+ * @param inode
+ * @param fname 新目录项，将插在目录项链表头部
+ * @return boolean
+ */
+boolean myfs_dir_fits(struct myfs_inode *inode, const char *fname)
+{
+    struct myfs_dentry *dentry_cursor = inode->dentrys;
+    int blks = 1;
+    int used = MYFS_DIRENT_LEN(strlen(fname));
+    while (dentry_cursor != NULL)
+    {
+        int len = MYFS_DIRENT_LEN(MYFS_FNAME_LEN(dentry_cursor->fname));
+        if (used + len > MYFS_BLK_SZ())
+        {
+            blks++;
+            used = 0;
+        }
+        used += len;
+        dentry_cursor = dentry_cursor->brother;
+    }
+    return blks <= MYFS_DATA_PER_FILE;
+}
+
+/**
+ * @brief 目录项记录的总长度，作为目录的st_size
+ *
+ * @param inode
+ * @return int
+ */
+int myfs_dir_size(struct myfs_inode *inode)
+{
+    struct myfs_dentry *dentry_cursor = inode->dentrys;
+    int size = 0;
+    while (dentry_cursor != NULL)
+    {
+        size += MYFS_DIRENT_LEN(MYFS_FNAME_LEN(dentry_cursor->fname));
+        dentry_cursor = dentry_cursor->brother;
+    }
+    return size;
+}
+
 /**
  * @brief 分配一个inode，占用位图
  *
  * @param dentry 该dentry指向分配的inode
- * @return myfs_inode
+ * @return myfs_inode 空间不足时返回NULL
  */
 struct myfs_inode *myfs_alloc_inode(struct myfs_dentry *dentry)
 {
     struct myfs_inode *inode;
-    int ino_curse = get_first_unset_bit(myfs_super.map_inode, MYFS_BLKS_SZ(myfs_super.map_inode_blks));
-    if (ino_curse == -1)
+    int ino_curse, goal;
+    int data_curses[MYFS_DATA_PER_FILE];
+
+    // 空闲计数不足时直接失败，不必扫描位图
+    if (myfs_super.free_ino < 1 || myfs_super.free_data < MYFS_DATA_PER_FILE)
     {
-        return -MYFS_ERROR_NOSPACE;
+        return NULL;
+    }
+    inode = (struct myfs_inode *)myfs_slab_alloc(MYFS_SLAB_INODE);
+    if (inode == NULL)
+    {
+        return NULL;
+    }
+    // 分组时一段即一个块组：普通文件与父目录同组，子目录轮流放到各组，使目录树分散开
+    goal = -1;
+    if (myfs_super.groups > 1 && dentry->parent != NULL && dentry->parent->inode != NULL)
+    {
+        goal = dentry->parent->inode->ino / myfs_super.ino_stride;
+        if (dentry->ftype == MYFS_DIR)
+        {
+            goal = (goal + ++myfs_group_rotor) % myfs_super.groups;
+        }
+    }
+    // 位图块读盘失败时回滚已占用的位
+    ino_curse = myfs_map_find_free(myfs_super.map_inode, myfs_super.map_inode_loaded, myfs_super.map_inode_offset,
+                                   &myfs_super.map_inode_idx, goal);
+    if (ino_curse < 0)
+    {
+        myfs_slab_free(MYFS_SLAB_INODE, inode);
+        return NULL;
+    }
+    myfs_map_inode_set(ino_curse);
+    // 文件的数据块一次性分配，同一文件的块尽量落在一起：分组时放在inode所在块组，否则从空闲最多的段开始
+    if (myfs_super.groups > 1)
+    {
+        goal = ino_curse / myfs_super.ino_stride;
+    }
+    else
+    {
+        goal = myfs_map_emptiest(&myfs_super.map_data_idx);
     }
-    set_bit(&myfs_super.map_inode, ino_curse);
-    inode = (struct myfs_inode *)malloc(sizeof(struct myfs_inode));
     for (int i = 0; i < MYFS_DATA_PER_FILE; i++)
     {
-        int data_curse = get_first_unset_bit(myfs_super.map_data, MYFS_BLKS_SZ(myfs_super.map_data_blks));
-        if (data_curse == -1)
+        data_curses[i] = myfs_map_find_free(myfs_super.map_data, myfs_super.map_data_loaded,
+                                            myfs_super.map_data_offset, &myfs_super.map_data_idx, goal);
+        if (data_curses[i] < 0)
         {
-            return -MYFS_ERROR_NOSPACE;
+            while (i-- > 0)
+            {
+                myfs_map_data_clear(data_curses[i]);
+            }
+            myfs_map_inode_clear(ino_curse);
+            myfs_slab_free(MYFS_SLAB_INODE, inode);
+            return NULL;
         }
-        set_bit(&myfs_super.map_data, data_curse);
-        inode->block_pointer[i] = data_curse;
+        myfs_map_data_set(data_curses[i]);
+        inode->block_pointer[i] = data_curses[i];
+        goal = data_curses[i] / myfs_super.map_data_idx.chunk_bits;
     }
     inode->ino = ino_curse;
     inode->size = 0;
+    inode->atime = inode->mtime = inode->ctime = time(NULL);
     // dentry指向inode
     dentry->inode = inode;
     dentry->ino = ino_curse;
@@ -202,17 +1008,15 @@ struct myfs_inode *myfs_alloc_inode(struct myfs_dentry *dentry)
     inode->dentry = dentry;
     inode->dir_cnt = 0;
     inode->dentrys = NULL;
-
-    if (MYFS_IS_REG(inode))
-    {
-        inode->data = (uint8_t *)malloc(MYFS_BLKS_SZ(MYFS_DATA_PER_FILE));
-    }
+    inode->files = NULL;
+    inode->target_path = NULL;
+    inode->dirty = TRUE;
 
     return inode;
 }
 
 /**
- * @brief 删除内存中的一个inode， 暂时不释放
+ * @brief 删除inode及其下方整棵子树，归还位图与内存
  * Case 1: Reg File
  *
  *                  Inode
@@ -239,134 +1043,402 @@ struct myfs_inode *myfs_alloc_inode(struct myfs_dentry *dentry)
  * @param inode
  * @return int
  */
-int myfs_drop_inode(struct myfs_inode *inode)
+static void myfs_drop_inode_tree(struct myfs_inode *inode)
 {
     struct myfs_dentry *dentry_cursor;
-    struct myfs_dentry *dentry_to_free;
-    struct myfs_inode *inode_cursor;
 
+    if (MYFS_IS_DIR(inode))
+    {
+        while ((dentry_cursor = inode->dentrys) != NULL)
+        {
+            myfs_drop_dentry(inode, dentry_cursor);
+            // 尚未读入内存的子inode同样占用位图，需读入后才能释放
+            if (dentry_cursor->inode == NULL)
+            {
+                dentry_cursor->inode = myfs_read_inode(dentry_cursor, dentry_cursor->ino);
+            }
+            if (dentry_cursor->inode != NULL)
+            {
+                myfs_drop_inode_tree(dentry_cursor->inode);
+            }
+            free_dentry(dentry_cursor);
+        }
+    }
+    myfs_map_inode_clear(inode->ino);
+    for (int i = 0; i < MYFS_DATA_PER_FILE; i++)
+    {
+        myfs_map_data_clear(inode->block_pointer[i]);
+    }
+    inode->dentry->inode = NULL;
+    free(inode->target_path);
+    myfs_slab_free(MYFS_SLAB_INODE, inode);
+}
+
+/**
+ * @brief 删除inode及其子树，调用者负责将指向它的dentry从父目录摘下并释放
+ *
+ * @param inode
+ * @return int
+ */
+int myfs_drop_inode(struct myfs_inode *inode)
+{
     if (inode == myfs_super.root_dentry->inode)
     {
-        return MYFS_ERROR_INVAL;
+        return -MYFS_ERROR_INVAL;
     }
+    myfs_drop_inode_tree(inode);
+    // 整棵子树的对象都已回到本线程弹匣，清空弹匣使空slab得以归还
+    myfs_slab_drain();
+    return MYFS_ERROR_NONE;
+}
 
-    if (MYFS_IS_DIR(inode))
+/**
+ * @brief 记录已删除但仍打开的文件，其inode与数据块在最后一次关闭时才释放
+ *
+ * 记录随超级块写出，写出后异常退出时挂载会据此释放。表满时不记录，
+ * 这样的文件在异常退出后仍占用空间
+ *
+ * @param inode
+ */
+void myfs_orphan_add(struct myfs_inode *inode)
+{
+    pthread_mutex_lock(&orphan_lock);
+    if (myfs_super.orphan_cnt < MYFS_ORPHAN_MAX)
     {
-        dentry_cursor = inode->dentrys;
-        clear_bit(&myfs_super.map_inode, inode->ino);
+        myfs_super.orphans[myfs_super.orphan_cnt++] = inode;
+    }
+    else
+    {
+        MYFS_DBG("[%s] orphan table full, ino %d not recorded\n", __func__, inode->ino);
+    }
+    pthread_mutex_unlock(&orphan_lock);
+}
 
-        while (dentry_cursor)
+/**
+ * @brief 文件最后一次关闭、即将释放时移出记录
+ *
+ * @param inode
+ */
+void myfs_orphan_del(struct myfs_inode *inode)
+{
+    pthread_mutex_lock(&orphan_lock);
+    for (int i = 0; i < myfs_super.orphan_cnt; i++)
+    {
+        if (myfs_super.orphans[i] == inode)
         {
-            inode_cursor = dentry_cursor->inode;
-            myfs_drop_inode(inode_cursor);
-            myfs_drop_dentry(inode, dentry_cursor);
+            myfs_super.orphans[i] = myfs_super.orphans[--myfs_super.orphan_cnt];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&orphan_lock);
+}
 
-            for (int i = 0; i < MYFS_DATA_PER_FILE; i++)
-            {
-                clear_bit(&myfs_super.map_data, inode->block_pointer[i]);
-            }
+/**
+ * @brief 挂载时释放超级块中记录的文件：上次写出超级块时它们已被删除，没有目录项再指向它们
+ *
+ * 超级块与位图总是一并写出，记录中的位在位图中仍被占用
+ *
+ * @param myfs_super_d 读出的超级块
+ * @return int 释放的文件数
+ */
+static int myfs_orphan_reclaim(struct myfs_super_d *myfs_super_d)
+{
+    struct myfs_orphan_d *orphan;
+    int cnt = myfs_super_d->orphan_cnt;
 
-            dentry_to_free = dentry_cursor;
-            dentry_cursor = dentry_cursor->brother;
-            free(dentry_to_free);
+    if (cnt < 0 || cnt > MYFS_ORPHAN_MAX)
+    {
+        return 0;
+    }
+    for (int i = 0; i < cnt; i++)
+    {
+        orphan = &myfs_super_d->orphans[i];
+        myfs_map_inode_clear(orphan->ino);
+        for (int blk = 0; blk < MYFS_DATA_PER_FILE; blk++)
+        {
+            myfs_map_data_clear(orphan->block_pointer[blk]);
+        }
+    }
+    return cnt;
+}
+
+/**
+ * @brief 卸载时释放仍未关闭的已删除文件，此后不会再有对它们的访问
+ */
+static void myfs_orphan_drop_all(void)
+{
+    struct myfs_inode *inode;
+    struct myfs_dentry *dentry;
+
+    while (myfs_super.orphan_cnt > 0)
+    {
+        inode = myfs_super.orphans[0];
+        myfs_orphan_del(inode);
+        dentry = inode->dentry;
+        myfs_drop_inode(inode);
+        free_dentry(dentry);
+    }
+}
+
+/**
+ * @brief 初始化写回链表
+ *
+ * @param list
+ */
+void myfs_io_init(struct myfs_io_list *list)
+{
+    list->ios = NULL;
+    list->cnt = 0;
+    list->cap = 0;
+}
+
+/**
+ * @brief 向写回链表追加一段待写内容，内容被复制，调用者可立即复用缓冲区
+ *
+ * @param list
+ * @param offset 设备偏移
+ * @param in_content
+ * @param size
+ * @return int
+ */
+int myfs_io_add(struct myfs_io_list *list, int offset, const uint8_t *in_content, int size)
+{
+    struct myfs_io *io;
+    if (list->cnt == list->cap)
+    {
+        int cap = list->cap == 0 ? MYFS_IO_LIST_INIT : list->cap * 2;
+        struct myfs_io *ios = (struct myfs_io *)realloc(list->ios, cap * sizeof(struct myfs_io));
+        if (ios == NULL)
+        {
+            return -MYFS_ERROR_NOSPACE;
         }
+        list->ios = ios;
+        list->cap = cap;
     }
-    else if (MYFS_IS_REG(inode) || MYFS_IS_SYM_LINK(inode))
+    io = &list->ios[list->cnt];
+    io->data = (uint8_t *)malloc(size);
+    if (io->data == NULL)
     {
-        clear_bit(&myfs_super.map_inode, inode->ino);
-        if (inode->data)
+        return -MYFS_ERROR_NOSPACE;
+    }
+    memcpy(io->data, in_content, size);
+    io->offset = offset;
+    io->size = size;
+    io->seq = list->cnt++;
+    return MYFS_ERROR_NONE;
+}
+
+static int myfs_io_cmp_offset(const void *a, const void *b)
+{
+    const struct myfs_io *x = (const struct myfs_io *)a;
+    const struct myfs_io *y = (const struct myfs_io *)b;
+    if (x->offset != y->offset)
+    {
+        return x->offset < y->offset ? -1 : 1;
+    }
+    return x->seq - y->seq;
+}
+
+static int myfs_io_cmp_seq(const void *a, const void *b)
+{
+    return ((const struct myfs_io *)a)->seq - ((const struct myfs_io *)b)->seq;
+}
+
+/**
+ * @brief 提交写回链表：按设备偏移排序，相邻或重叠的请求拼成一次写，重叠部分按加入顺序覆盖。
+ * 拼好的各段按地址顺序经myfs_driver_batch同时发出。提交后链表被清空
+ *
+ * @param list
+ * @return int
+ */
+int myfs_io_submit(struct myfs_io_list *list)
+{
+    int ret = MYFS_ERROR_NONE;
+    int i = 0, j, k, cnt = 0;
+    struct myfs_vec *vecs = (struct myfs_vec *)malloc((list->cnt + 1) * sizeof(struct myfs_vec));
+    if (vecs == NULL)
+    {
+        ret = -MYFS_ERROR_NOSPACE;
+        i = list->cnt;
+    }
+    qsort(list->ios, list->cnt, sizeof(struct myfs_io), myfs_io_cmp_offset);
+    while (i < list->cnt)
+    {
+        int start = list->ios[i].offset;
+        int end = start + list->ios[i].size;
+        uint8_t *merged;
+        for (j = i + 1; j < list->cnt && list->ios[j].offset <= end; j++)
         {
-            for (int i = 0; i < MYFS_DATA_PER_FILE; i++)
+            if (list->ios[j].offset + list->ios[j].size > end)
             {
-                clear_bit(&myfs_super.map_data, inode->block_pointer[i]);
+                end = list->ios[j].offset + list->ios[j].size;
             }
-            free(inode->data);
         }
-        free(inode);
+        merged = (uint8_t *)malloc(end - start);
+        if (merged == NULL)
+        {
+            ret = -MYFS_ERROR_NOSPACE;
+            break;
+        }
+        qsort(list->ios + i, j - i, sizeof(struct myfs_io), myfs_io_cmp_seq);
+        for (k = i; k < j; k++)
+        {
+            memcpy(merged + list->ios[k].offset - start, list->ios[k].data, list->ios[k].size);
+        }
+        vecs[cnt].offset = start;
+        vecs[cnt].size = end - start;
+        vecs[cnt].buf = merged;
+        cnt++;
+        i = j;
+    }
+    if (ret == MYFS_ERROR_NONE && myfs_driver_batch(vecs, cnt, TRUE) != MYFS_ERROR_NONE)
+    {
+        MYFS_DBG("[%s] io error\n", __func__);
+        ret = -MYFS_ERROR_IO;
+    }
+    for (i = 0; i < cnt; i++)
+    {
+        free(vecs[i].buf);
     }
-    return MYFS_ERROR_NONE;
+    free(vecs);
+    for (i = 0; i < list->cnt; i++)
+    {
+        free(list->ios[i].data);
+    }
+    free(list->ios);
+    myfs_io_init(list);
+    return ret;
 }
 
 /**
- * @brief 将内存inode及其下方结构全部刷回磁盘
+ * @brief 收集inode及其下方结构中被修改部分的待写内容，不直接访问设备
  *
  * @param inode
+ * @param list
  * @return int
  */
-int myfs_sync_inode(struct myfs_inode *inode)
+int myfs_sync_inode_io(struct myfs_inode *inode, struct myfs_io_list *list)
 {
-    struct myfs_inode_d inode_d;
+    struct myfs_inode_d *inode_d;
     struct myfs_dentry *dentry_cursor;
-    struct myfs_dentry_d dentry_d;
     int ino = inode->ino;
-    inode_d.ino = ino;
-    inode_d.size = inode->size;
-    memcpy(inode_d.target_path, inode->target_path, MYFS_MAX_FILE_NAME);
-    inode_d.ftype = inode->dentry->ftype;
-    inode_d.dir_cnt = inode->dir_cnt;
-    int offset;
+    int ret;
+    uint8_t *inode_blk;
+
+    // 未修改的inode及其目录块不必重写，但已读入的子项可能被修改过
+    if (!inode->dirty)
+    {
+        for (dentry_cursor = inode->dentrys; dentry_cursor != NULL; dentry_cursor = dentry_cursor->brother)
+        {
+            if (dentry_cursor->inode != NULL &&
+                (ret = myfs_sync_inode_io(dentry_cursor->inode, list)) != MYFS_ERROR_NONE)
+            {
+                return ret;
+            }
+        }
+        return MYFS_ERROR_NONE;
+    }
+    // 每个inode独占一块，整块写入使相邻inode可以拼接，且免去读改写
+    inode_blk = (uint8_t *)calloc(1, MYFS_BLK_SZ());
+    if (inode_blk == NULL)
+    {
+        return -MYFS_ERROR_NOSPACE;
+    }
+    inode_d = (struct myfs_inode_d *)inode_blk;
+    inode_d->ino = ino;
+    inode_d->size = inode->size;
+    if (inode->target_path != NULL)
+    {
+        strncpy(inode_d->target_path, inode->target_path, MYFS_MAX_FILE_NAME - 1);
+    }
+    inode_d->ftype = inode->dentry->ftype;
+    inode_d->dir_cnt = inode->dir_cnt;
+    inode_d->atime = inode->atime;
+    inode_d->mtime = inode->mtime;
+    inode_d->ctime = inode->ctime;
     for (int i = 0; i < MYFS_DATA_PER_FILE; i++)
     {
-        inode_d.block_pointer[i] = inode->block_pointer[i];
+        inode_d->block_pointer[i] = inode->block_pointer[i];
     }
-    // 写入
-    if (myfs_driver_write(MYFS_INO_OFS(ino), (uint8_t *)&inode_d, sizeof(struct myfs_inode_d)) != MYFS_ERROR_NONE)
+    ret = myfs_io_add(list, MYFS_INO_OFS(ino), inode_blk, MYFS_BLK_SZ());
+    free(inode_blk);
+    if (ret != MYFS_ERROR_NONE)
     {
-        MYFS_DBG("[%s] io error\n", __func__);
-        return -MYFS_ERROR_IO;
+        return ret;
     }
     if (MYFS_IS_DIR(inode))
     {
-        int index = 0;
+        // 目录项先在内存中按块拼好，每个目录块只整块写一次
+        int index = 0, pos = 0;
+        uint8_t *dir_blk = (uint8_t *)malloc(MYFS_BLK_SZ());
+        if (dir_blk == NULL)
+        {
+            return -MYFS_ERROR_NOSPACE;
+        }
+        myfs_dirent_init(dir_blk);
         dentry_cursor = inode->dentrys;
-        offset = MYFS_DATA_OFS(inode->block_pointer[index]);
         while (dentry_cursor != NULL)
         {
-            memcpy(dentry_d.fname, dentry_cursor->fname, MYFS_MAX_FILE_NAME);
-            dentry_d.ftype = dentry_cursor->ftype;
-            dentry_d.ino = dentry_cursor->ino;
-
-            if (myfs_driver_write(offset, (uint8_t *)&dentry_d, sizeof(struct myfs_dentry_d)) != MYFS_ERROR_NONE)
-            {
-                MYFS_DBG("[%s] io error\n", __func__);
-                return -MYFS_ERROR_IO;
-            }
-
-            // 偏移量超过块大小，则在新数据块记录数据
-            offset += sizeof(struct myfs_dentry_d);
-            if ((offset >= MYFS_DATA_OFS(inode->block_pointer[index]) + MYFS_BLK_SZ()))
+            if (myfs_dirent_add(dir_blk, dentry_cursor->fname, dentry_cursor->ino, dentry_cursor->ftype) !=
+                MYFS_ERROR_NONE)
             {
-                if (index < MYFS_DATA_PER_FILE - 1)
-                {
-                    offset = MYFS_DATA_OFS(inode->block_pointer[index++]);
-                }
-                else
+                // 当前块已满，提交后在下一数据块继续记录
+                ret = myfs_io_add(list, MYFS_DATA_OFS(inode->block_pointer[index]), dir_blk, MYFS_BLK_SZ());
+                if (ret != MYFS_ERROR_NONE || ++index == MYFS_DATA_PER_FILE)
                 {
-                    return -MYFS_ERROR_NOSPACE;
+                    free(dir_blk);
+                    return ret != MYFS_ERROR_NONE ? ret : -MYFS_ERROR_NOSPACE;
                 }
+                myfs_dirent_init(dir_blk);
+                pos = 0;
+                myfs_dirent_add(dir_blk, dentry_cursor->fname, dentry_cursor->ino, dentry_cursor->ftype);
             }
+            pos++;
 
             if (dentry_cursor->inode != NULL)
             {
-                myfs_sync_inode(dentry_cursor->inode);
+                if ((ret = myfs_sync_inode_io(dentry_cursor->inode, list)) != MYFS_ERROR_NONE)
+                {
+                    free(dir_blk);
+                    return ret;
+                }
             }
 
             dentry_cursor = dentry_cursor->brother;
         }
-    }
-    else if (MYFS_IS_REG(inode))
-    {
-        for (int i = 0; i < MYFS_DATA_PER_FILE; i++)
+        if (pos != 0)
         {
-            // 内存中数据连续
-            if (myfs_driver_write(MYFS_DATA_OFS(inode->block_pointer[i]), (uint8_t *)(inode->data + i * MYFS_BLK_SZ()),
-                                  MYFS_BLK_SZ()) != MYFS_ERROR_NONE)
-            {
-                MYFS_DBG("[%s] io error\n", __func__);
-                return -MYFS_ERROR_IO;
-            }
+            ret = myfs_io_add(list, MYFS_DATA_OFS(inode->block_pointer[index]), dir_blk, MYFS_BLK_SZ());
+        }
+        free(dir_blk);
+        if (ret != MYFS_ERROR_NONE)
+        {
+            return ret;
         }
     }
+    // 普通文件的数据经由缓存直接读写数据块，这里无需回写
+    inode->dirty = FALSE;
+    return MYFS_ERROR_NONE;
+}
+
+/**
+ * @brief 将内存inode及其下方结构全部刷回磁盘，写请求先收集再按地址顺序合并提交
+ *
+ * @param inode
+ * @return int
+ */
+int myfs_sync_inode(struct myfs_inode *inode)
+{
+    struct myfs_io_list list;
+    int ret;
+    myfs_io_init(&list);
+    ret = myfs_sync_inode_io(inode, &list);
+    if (ret != MYFS_ERROR_NONE)
+    {
+        myfs_io_submit(&list);
+        return ret;
+    }
+    return myfs_io_submit(&list);
 }
 
 /**
@@ -378,80 +1450,208 @@ int myfs_sync_inode(struct myfs_inode *inode)
  */
 struct myfs_inode *myfs_read_inode(struct myfs_dentry *dentry, int ino)
 {
-    struct myfs_inode *inode = (struct myfs_inode *)malloc(sizeof(struct myfs_inode));
-    struct myfs_inode_d inode_d;
+    return myfs_read_inode_by(dentry, ino, myfs_driver_read);
+}
+
+/**
+ * @brief 以指定的读函数读取inode及其目录项，预加载线程以此使用定位读
+ *
+ * @param dentry dentry指向ino，读取该inode
+ * @param ino inode唯一编号
+ * @param reader myfs_driver_read或myfs_driver_pread
+ * @return struct myfs_inode*
+ */
+struct myfs_inode *myfs_read_inode_by(struct myfs_dentry *dentry, int ino, myfs_reader_t reader)
+{
+    const struct myfs_inode_d *inode_d;
+    struct myfs_inode_d inode_buf;
+
+    // 能原地读时直接在设备内容上解析，否则读入inode_buf
+    inode_d = (const struct myfs_inode_d *)myfs_driver_map(MYFS_INO_OFS(ino), sizeof(struct myfs_inode_d));
+    if (inode_d == NULL)
+    {
+        if (reader(MYFS_INO_OFS(ino), (uint8_t *)&inode_buf, sizeof(struct myfs_inode_d)) != MYFS_ERROR_NONE)
+        {
+            MYFS_DBG("[%s] io error\n", __func__);
+            return NULL;
+        }
+        inode_d = &inode_buf;
+    }
+    return myfs_parse_inode(dentry, inode_d, reader);
+}
+
+/**
+ * @brief 由已读出的inode_d建立inode，目录另以reader读入其目录项。预加载批量读出一个目录下的
+ * 全部inode_d后逐个以此建立
+ *
+ * @param dentry dentry指向该inode
+ * @param inode_d
+ * @param reader myfs_driver_read或myfs_driver_pread
+ * @return struct myfs_inode*
+ */
+struct myfs_inode *myfs_parse_inode(struct myfs_dentry *dentry, const struct myfs_inode_d *inode_d,
+                                    myfs_reader_t reader)
+{
+    struct myfs_inode *inode = (struct myfs_inode *)myfs_slab_alloc(MYFS_SLAB_INODE);
     struct myfs_dentry *sub_dentry;
-    struct myfs_dentry_d dentry_d;
+    const struct myfs_dentry_d *dentry_d;
     int dir_cnt = 0, i;
-    int offset;
 
-    if (myfs_driver_read(MYFS_INO_OFS(ino), (uint8_t *)&inode_d, sizeof(struct myfs_inode_d)) != MYFS_ERROR_NONE)
+    if (inode == NULL)
     {
-        MYFS_DBG("[%s] io error\n", __func__);
         return NULL;
     }
-
     inode->dir_cnt = 0;
-    inode->ino = inode_d.ino;
-    inode->size = inode_d.size;
-    memcpy(inode->target_path, inode_d.target_path, MYFS_MAX_FILE_NAME);
+    inode->ino = inode_d->ino;
+    inode->size = inode_d->size;
+    inode->atime = inode_d->atime;
+    inode->mtime = inode_d->mtime;
+    inode->ctime = inode_d->ctime;
+    inode->target_path = NULL;
+    if (dentry->ftype == MYFS_SYM_LINK)
+    {
+        inode->target_path = strndup(inode_d->target_path, MYFS_MAX_FILE_NAME - 1);
+    }
     inode->dentry = dentry;
     inode->dentrys = NULL;
+    inode->files = NULL;
     for (int j = 0; j < MYFS_DATA_PER_FILE; j++)
     {
-        inode->block_pointer[j] = inode_d.block_pointer[j];
+        inode->block_pointer[j] = inode_d->block_pointer[j];
     }
     if (MYFS_IS_DIR(inode))
     {
-        dir_cnt = inode_d.dir_cnt;
-        int index = 0;
-        offset = MYFS_DATA_OFS(inode->block_pointer[index]);
-        for (i = 0; i < dir_cnt; i++)
+        // 每个目录块整块读入一次，再沿rec_len逐条解析；第一块能原地读时不拷贝，
+        // 第一块装不下全部目录项时，其余的块批量同时读入
+        uint8_t *dir_blks = (uint8_t *)malloc(MYFS_BLKS_SZ(MYFS_DATA_PER_FILE));
+        const uint8_t *dir_blk;
+        struct myfs_vec vecs[MYFS_DATA_PER_FILE];
+        char fname[MYFS_MAX_FILE_NAME];
+        int index, off, k, ret = MYFS_ERROR_NONE;
+        dir_cnt = inode_d->dir_cnt;
+        if (dir_blks == NULL)
+        {
+            ret = -MYFS_ERROR_NOSPACE;
+        }
+        for (index = 0, i = 0; ret == MYFS_ERROR_NONE && i < dir_cnt && index < MYFS_DATA_PER_FILE; index++)
         {
-            if (myfs_driver_read(MYFS_DATA_OFS(ino) + i * sizeof(struct myfs_dentry_d), (uint8_t *)&dentry_d,
-                                 sizeof(struct myfs_dentry_d)) != MYFS_ERROR_NONE)
+            dir_blk = dir_blks + MYFS_BLKS_SZ(index);
+            if (index == 0)
+            {
+                dir_blk = myfs_driver_map(MYFS_DATA_OFS(inode->block_pointer[0]), MYFS_BLK_SZ());
+                if (dir_blk == NULL)
+                {
+                    dir_blk = dir_blks;
+                    ret = reader(MYFS_DATA_OFS(inode->block_pointer[0]), dir_blks, MYFS_BLK_SZ());
+                }
+            }
+            else if (index == 1)
+            {
+                for (k = 1; k < MYFS_DATA_PER_FILE; k++)
+                {
+                    vecs[k - 1].offset = MYFS_DATA_OFS(inode->block_pointer[k]);
+                    vecs[k - 1].size = MYFS_BLK_SZ();
+                    vecs[k - 1].buf = dir_blks + MYFS_BLKS_SZ(k);
+                }
+                ret = myfs_driver_batch(vecs, MYFS_DATA_PER_FILE - 1, FALSE);
+            }
+            if (ret != MYFS_ERROR_NONE)
             {
                 MYFS_DBG("[%s] io error\n", __func__);
-                return NULL;
+                break;
             }
-
-            // 偏移量超过块大小，则在新数据块记录数据
-            offset += sizeof(struct myfs_dentry_d);
-            if ((offset >= MYFS_DATA_OFS(inode->block_pointer[index]) + MYFS_BLK_SZ()))
+            for (off = 0; off < MYFS_BLK_SZ() && i < dir_cnt; off += dentry_d->rec_len)
             {
-                if (index < MYFS_DATA_PER_FILE - 1)
+                dentry_d = (const struct myfs_dentry_d *)(dir_blk + off);
+                if (off + (int)sizeof(struct myfs_dentry_d) > MYFS_BLK_SZ())
+                {
+                    ret = -MYFS_ERROR_IO;
+                    break;
+                }
+                if (dentry_d->rec_len == 0)
+                {
+                    break;
+                }
+                // 记录须容纳其名字且不越过块尾，否则目录块已损坏，不能再沿rec_len走下去
+                if (dentry_d->name_len >= MYFS_MAX_FILE_NAME ||
+                    (int)MYFS_DIRENT_LEN(dentry_d->name_len) > dentry_d->rec_len ||
+                    off + dentry_d->rec_len > MYFS_BLK_SZ())
+                {
+                    ret = -MYFS_ERROR_IO;
+                    break;
+                }
+                if (dentry_d->name_len == 0)
                 {
-                    offset = MYFS_DATA_OFS(inode->block_pointer[index++]);
+                    continue;
                 }
-                else
+                memcpy(fname, dentry_d->fname, dentry_d->name_len);
+                fname[dentry_d->name_len] = '\0';
+                sub_dentry = new_dentry(fname, dentry_d->ftype);
+                if (sub_dentry == NULL)
                 {
-                    return -MYFS_ERROR_NOSPACE;
+                    ret = -MYFS_ERROR_NOSPACE;
+                    break;
                 }
+                sub_dentry->parent = inode->dentry;
+                sub_dentry->ino = dentry_d->ino;
+                myfs_alloc_dentry(inode, sub_dentry);
+                i++;
+            }
+            if (ret == -MYFS_ERROR_IO)
+            {
+                MYFS_DBG("[%s] corrupted dir block %d of ino %d\n", __func__, index, inode->ino);
             }
-
-            sub_dentry = new_dentry(dentry_d.fname, dentry_d.ftype);
-            sub_dentry->parent = inode->dentry;
-            sub_dentry->ino = dentry_d.ino;
-            myfs_alloc_dentry(inode, sub_dentry);
         }
-    }
-    else if (MYFS_IS_REG(inode))
-    {
-        inode->data = (uint8_t *)malloc(MYFS_BLKS_SZ(MYFS_DATA_PER_FILE));
-        for (int j = 0; j < MYFS_DATA_PER_FILE; j++)
+        free(dir_blks);
+        if (ret != MYFS_ERROR_NONE)
         {
-            // 内存中数据连续
-            if (myfs_driver_read(MYFS_DATA_OFS(inode->block_pointer[j]), (uint8_t *)(inode->data + j * MYFS_BLK_SZ()),
-                                 MYFS_BLK_SZ()) != MYFS_ERROR_NONE)
+            // 已解析出的目录项随inode一起释放
+            while ((sub_dentry = inode->dentrys) != NULL)
             {
-                MYFS_DBG("[%s] io error\n", __func__);
-                return -MYFS_ERROR_IO;
+                inode->dentrys = sub_dentry->brother;
+                free_dentry(sub_dentry);
             }
+            free(inode->target_path);
+            myfs_slab_free(MYFS_SLAB_INODE, inode);
+            return NULL;
         }
     }
+    // 解析目录项时加入的子项不算修改
+    inode->dirty = FALSE;
     return inode;
 }
 
+/**
+ * @brief 按relatime规则更新atime：只有atime不晚于mtime/ctime，或距上次
+ * 更新超过MYFS_ATIME_WINDOW时才写入，避免每次读都改动inode
+ *
+ * @param inode
+ * @return boolean 是否更新了atime
+ */
+boolean myfs_update_atime(struct myfs_inode *inode)
+{
+    time_t now = time(NULL);
+    if (inode->atime <= inode->mtime || inode->atime <= inode->ctime ||
+        now - inode->atime >= MYFS_ATIME_WINDOW)
+    {
+        inode->atime = now;
+        inode->dirty = TRUE;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/**
+ * @brief 内容被修改，更新mtime与ctime
+ *
+ * @param inode
+ */
+void myfs_update_mtime(struct myfs_inode *inode)
+{
+    inode->mtime = inode->ctime = time(NULL);
+    inode->dirty = TRUE;
+}
+
 /**
  * @brief
  *
@@ -488,7 +1688,7 @@ struct myfs_dentry *myfs_get_dentry(struct myfs_inode *inode, int dir)
  *      2) find qwe's dentry
  *
  * @param path
- * @return struct myfs_inode*
+ * @return struct myfs_inode* 路径上的inode读不出来（I/O错误或目录块损坏）时返回NULL，is_find为FALSE
  */
 struct myfs_dentry *myfs_lookup(const char *path, boolean *is_find, boolean *is_root)
 {
@@ -499,9 +1699,8 @@ struct myfs_dentry *myfs_lookup(const char *path, boolean *is_find, boolean *is_
     int lvl = 0;
     boolean is_hit;
     char *fname = NULL;
-    char *path_cpy = (char *)malloc(sizeof(path));
+    char *path_cpy = strdup(path);
     *is_root = FALSE;
-    strcpy(path_cpy, path);
 
     if (total_lvl == 0)
     { /* 根目录 */
@@ -515,10 +1714,16 @@ struct myfs_dentry *myfs_lookup(const char *path, boolean *is_find, boolean *is_
         lvl++;
         if (dentry_cursor->inode == NULL)
         { /* Cache机制 */
-            myfs_read_inode(dentry_cursor, dentry_cursor->ino);
+            dentry_cursor->inode = myfs_read_inode(dentry_cursor, dentry_cursor->ino);
         }
 
         inode = dentry_cursor->inode;
+        if (inode == NULL)
+        {
+            *is_find = FALSE;
+            dentry_ret = NULL;
+            break;
+        }
 
         if (MYFS_IS_REG(inode) && lvl < total_lvl)
         {
@@ -528,12 +1733,14 @@ struct myfs_dentry *myfs_lookup(const char *path, boolean *is_find, boolean *is_
         }
         if (MYFS_IS_DIR(inode))
         {
+            int fname_len = strlen(fname);
             dentry_cursor = inode->dentrys;
             is_hit = FALSE;
 
             while (dentry_cursor)
             {
-                if (memcmp(dentry_cursor->fname, fname, strlen(fname)) == 0)
+                if (MYFS_FNAME_LEN(dentry_cursor->fname) == fname_len &&
+                    memcmp(dentry_cursor->fname, fname, fname_len) == 0)
                 {
                     is_hit = TRUE;
                     break;
@@ -559,28 +1766,222 @@ struct myfs_dentry *myfs_lookup(const char *path, boolean *is_find, boolean *is_
         fname = strtok(NULL, "/");
     }
 
-    if (dentry_ret->inode == NULL)
+    if (dentry_ret != NULL && dentry_ret->inode == NULL)
     {
         dentry_ret->inode = myfs_read_inode(dentry_ret, dentry_ret->ino);
+        if (dentry_ret->inode == NULL)
+        {
+            *is_find = FALSE;
+            dentry_ret = NULL;
+        }
     }
 
+    free(path_cpy);
     return dentry_ret;
 }
 
+/**
+ * @brief 按内存中的超级块写回磁盘超级块，补齐为整块
+ *
+ * @param clean 是否标记为正常卸载
+ * @param ckpt_size 随之生效的检查点字节数，0表示无检查点
+ * @param list 非NULL时加入写回链表，与其他写一并提交；否则立即写出
+ * @return int
+ */
+static int myfs_super_write(int offset, boolean clean, int ckpt_size, struct myfs_io_list *list)
+{
+    struct myfs_super_d *myfs_super_d;
+    uint8_t *super_blk = (uint8_t *)calloc(1, MYFS_BLK_SZ());
+    int ret;
+    if (super_blk == NULL)
+    {
+        return -MYFS_ERROR_NOSPACE;
+    }
+    myfs_super_d = (struct myfs_super_d *)super_blk;
+    myfs_super_d->magic_num = MYFS_MAGIC_NUM;
+    myfs_super_d->max_ino = myfs_super.max_ino;
+    myfs_super_d->map_inode_blks = myfs_super.map_inode_blks;
+    myfs_super_d->map_inode_offset = myfs_super.map_inode_offset;
+    myfs_super_d->map_data_blks = myfs_super.map_data_blks;
+    myfs_super_d->map_data_offset = myfs_super.map_data_offset;
+    myfs_super_d->inode_offset = myfs_super.inode_offset;
+    myfs_super_d->data_offset = myfs_super.data_offset;
+    myfs_super_d->sz_usage = myfs_super.sz_usage;
+    myfs_super_d->ckpt_offset = myfs_super.ckpt_offset;
+    myfs_super_d->ckpt_blks = myfs_super.ckpt_blks;
+    myfs_super_d->ckpt_size = ckpt_size;
+    myfs_super_d->generation = myfs_super.generation;
+    myfs_super_d->ckpt_gen = myfs_super.generation;
+    myfs_super_d->clean = clean;
+    myfs_super_d->groups = myfs_super.groups;
+    myfs_super_d->group_blks = myfs_super.group_blks;
+    myfs_super_d->group_data = myfs_super.max_data / myfs_super.groups;
+    myfs_super_d->lfs = myfs_super.lfs;
+    myfs_super_d->seg_offset = myfs_super.seg_offset;
+    myfs_super_d->seg_blks = myfs_super.seg_blks;
+    myfs_super_d->segs = myfs_super.segs;
+    myfs_super_d->lfs_ckpt_offset = myfs_super.lfs_ckpt_offset;
+    myfs_super_d->lfs_ckpt_blks = myfs_super.lfs_ckpt_blks;
+    myfs_super_d->zoned = myfs_super.zoned;
+    myfs_super_d->stripe_members = myfs_super.stripe_members;
+    myfs_super_d->stripe_unit = myfs_super.stripe_unit;
+    myfs_super_d->mirror = myfs_super.mirror;
+    myfs_super_d->tiered = myfs_super.tiered;
+    myfs_super_d->free_ino = myfs_super.free_ino;
+    myfs_super_d->free_data = myfs_super.free_data;
+    myfs_super_d->free_valid = TRUE;
+    pthread_mutex_lock(&orphan_lock);
+    myfs_super_d->orphan_cnt = myfs_super.orphan_cnt;
+    for (int i = 0; i < myfs_super.orphan_cnt; i++)
+    {
+        myfs_super_d->orphans[i].ino = myfs_super.orphans[i]->ino;
+        memcpy(myfs_super_d->orphans[i].block_pointer, myfs_super.orphans[i]->block_pointer,
+               sizeof(myfs_super_d->orphans[i].block_pointer));
+    }
+    pthread_mutex_unlock(&orphan_lock);
+    if (list != NULL)
+    {
+        ret = myfs_io_add(list, offset, super_blk, MYFS_BLK_SZ());
+    }
+    else
+    {
+        ret = myfs_driver_write(offset, super_blk, MYFS_BLK_SZ());
+    }
+    free(super_blk);
+    return ret;
+}
+
+/**
+ * @brief fsync提交设备前写出inode及其依赖的元数据：inode块(目录另有目录块)与被修改的位图块同批写出，
+ * 日志结构模式下再写一份日志检查点使其在映射中可见，最后写出记录已删除仍打开文件的超级块。
+ * 超级块仍标记为未正常卸载，挂载时使旧检查点失效的标记保持不变
+ *
+ * @param inode NULL时只写出位图、日志检查点与超级块
+ * @return int
+ */
+int myfs_sync_meta(struct myfs_inode *inode)
+{
+    struct myfs_io_list list;
+    int ret = MYFS_ERROR_NONE;
+
+    myfs_io_init(&list);
+    if (inode != NULL)
+    {
+        myfs_inode_lock(inode->ino);
+        ret = myfs_sync_inode_io(inode, &list);
+        myfs_inode_unlock(inode->ino);
+    }
+    myfs_map_sync_io(&list, myfs_super.map_inode, myfs_super.map_inode_dirty, myfs_super.map_inode_offset,
+                     &myfs_super.map_inode_idx, myfs_super.map_inode_blks);
+    myfs_map_sync_io(&list, myfs_super.map_data, myfs_super.map_data_dirty, myfs_super.map_data_offset,
+                     &myfs_super.map_data_idx, myfs_super.map_data_blks);
+    if (myfs_io_submit(&list) != MYFS_ERROR_NONE && ret == MYFS_ERROR_NONE)
+    {
+        ret = -MYFS_ERROR_IO;
+    }
+    if (ret == MYFS_ERROR_NONE && myfs_super.lfs && myfs_lfs_checkpoint() != MYFS_ERROR_NONE)
+    {
+        ret = -MYFS_ERROR_IO;
+    }
+    return ret != MYFS_ERROR_NONE ? ret : myfs_super_write(MYFS_SUPER_OFS, FALSE, 0, NULL);
+}
+
+/**
+ * @brief 按块组格式化，仿照ext2。各块组布局相同，检查点区放在最后一个块组之后
+ *
+ * | Group 0 | Group 1 | ... | Group n-1 | Checkpoint | 剩余 |
+ * Group: | Super(1) | Inode Map | Data Map | Inodes | Data |
+ *
+ * @param myfs_super_d 输出的超级块
+ * @param groups 块组数
+ * @return int 设备太小、无法分出这么多块组时返回-MYFS_ERROR_INVAL
+ */
+static int myfs_format_groups(struct myfs_super_d *myfs_super_d, int groups)
+{
+    int blk_bits = MYFS_BLK_SZ() * UINT8_BITS;
+    int inode_num = MYFS_DISK_SZ() / ((MYFS_DATA_PER_FILE + MYFS_INODE_PER_FILE) * MYFS_BLK_SZ());
+    int ckpt_blks = MYFS_ROUND_UP(inode_num * MYFS_CKPT_PER_INODE, MYFS_BLK_SZ()) / MYFS_BLK_SZ();
+    int group_blks = (MYFS_DISK_SZ() / MYFS_BLK_SZ() - ckpt_blks) / groups;
+    int group_ino = (group_blks - 3) / (MYFS_DATA_PER_FILE + MYFS_INODE_PER_FILE);
+    int map_inode_blks = (group_ino + blk_bits - 1) / blk_bits;
+    int map_data_blks = (group_blks - 1 - map_inode_blks - group_ino + blk_bits - 1) / blk_bits;
+    int group_data = group_blks - 1 - map_inode_blks - map_data_blks - group_ino;
+
+    if (group_ino < 1 || group_data < MYFS_DATA_PER_FILE)
+    {
+        return -MYFS_ERROR_INVAL;
+    }
+    myfs_super_d->groups = groups;
+    myfs_super_d->group_blks = group_blks;
+    myfs_super_d->group_data = group_data;
+    myfs_super_d->max_ino = groups * group_ino;
+    myfs_super_d->map_inode_offset = MYFS_SUPER_OFS + MYFS_BLKS_SZ(1);
+    myfs_super_d->map_data_offset = myfs_super_d->map_inode_offset + MYFS_BLKS_SZ(map_inode_blks);
+    myfs_super_d->inode_offset = myfs_super_d->map_data_offset + MYFS_BLKS_SZ(map_data_blks);
+    myfs_super_d->data_offset = myfs_super_d->inode_offset + MYFS_BLKS_SZ(group_ino);
+    myfs_super_d->map_inode_blks = groups * map_inode_blks;
+    myfs_super_d->map_data_blks = groups * map_data_blks;
+    myfs_super_d->ckpt_offset = MYFS_BLKS_SZ(groups * group_blks);
+    myfs_super_d->ckpt_blks = ckpt_blks;
+    myfs_super_d->free_ino = myfs_super_d->max_ino;
+    myfs_super_d->free_data = groups * group_data;
+    MYFS_DBG("groups: %d, group_blks: %d, inodes/group: %d, data/group: %d\n", groups, group_blks, group_ino,
+             group_data);
+    return MYFS_ERROR_NONE;
+}
+
+/**
+ * @brief 挂载失败时释放已建立的状态，顺序与myfs_umount相同，但不写回位图与超级块
+ *
+ * @param ret 返回给调用者的错误码
+ * @param maps 位图与其索引已分配
+ * @param lfs 日志结构模式已挂载，停止清理线程并释放映射表
+ * @return int ret
+ */
+static int myfs_mount_fail(int ret, boolean maps, boolean lfs)
+{
+    if (lfs)
+    {
+        // 清理线程只能经myfs_lfs_umount停止，其顺带写出的检查点与当前映射一致
+        myfs_lfs_umount();
+    }
+    if (maps)
+    {
+        free(myfs_super.map_inode);
+        free(myfs_super.map_inode_loaded);
+        free(myfs_super.map_inode_dirty);
+        free(myfs_super.map_data);
+        free(myfs_super.map_data_loaded);
+        free(myfs_super.map_data_dirty);
+        myfs_super.map_inode = myfs_super.map_inode_loaded = myfs_super.map_inode_dirty = NULL;
+        myfs_super.map_data = myfs_super.map_data_loaded = myfs_super.map_data_dirty = NULL;
+        myfs_map_index_destroy(&myfs_super.map_inode_idx);
+        myfs_map_index_destroy(&myfs_super.map_data_idx);
+    }
+    myfs_cache_destroy();
+    myfs_slab_destroy();
+    myfs_name_destroy();
+    myfs_tier_close();
+    myfs_stripe_close();
+    return ret;
+}
+
 /**
  * @brief 挂载myfs, Layout 如下
  *
  * Layout
- * | Super(1) | Inode Map(1) | Data Map(1) | Inodes | Data |
+ * | Super(1) | Inode Map(1) | Data Map(1) | Inodes | Checkpoint | Data |
  *  BLK_SZ = 2 * IO_SZ
  * 每个Inode占用1个Blk
+ * 以--groups=n格式化时按块组布局，见myfs_format_groups
+ * 以--lfs格式化时为日志结构布局，见myfs_lfs_format
+ * 以--zoned格式化或设备为分区设备时，为分区设备上的日志结构布局
  * @param options
  * @return int
  */
 int myfs_mount(struct custom_options options)
 {
     int ret = MYFS_ERROR_NONE;
-    int driver_fd;
     struct myfs_super_d myfs_super_d;
     struct myfs_dentry *root_dentry;
     struct myfs_inode *root_inode;
@@ -592,29 +1993,109 @@ int myfs_mount(struct custom_options options)
 
     int super_blks;
     boolean is_init = FALSE;
+    boolean zoned;
+    struct ddriver_zone_info zone_info;
+    struct timespec t_begin, t_super, t_map, t_root;
 
     myfs_super.is_mounted = FALSE;
+    clock_gettime(CLOCK_MONOTONIC, &t_begin);
 
-    driver_fd = ddriver_open(options.device);
-    if (driver_fd < 0)
+    // device可以是逗号分隔的多个设备，按条带或镜像组成一个设备
+    ret = myfs_stripe_open(options.device, options.stripe_unit, options.mirror, options.queue_depth);
+    if (ret != MYFS_ERROR_NONE)
+    {
+        return ret;
+    }
+    if (options.sched != NULL && (ret = myfs_stripe_sched(options.sched)) != MYFS_ERROR_NONE)
     {
-        return driver_fd;
+        return myfs_mount_fail(ret, FALSE, FALSE);
+    }
+    myfs_stripe_ioctl(IOC_REQ_DEVICE_SIZE, &myfs_super.sz_disk);
+    myfs_stripe_ioctl(IOC_REQ_DEVICE_IO_SZ, &myfs_super.sz_io);
+    if (options.tier_device != NULL)
+    {
+        ret = myfs_tier_open(options.tier_device, options.tier_size, options.tier_rate);
+        if (ret != MYFS_ERROR_NONE)
+        {
+            return myfs_mount_fail(ret, FALSE, FALSE);
+        }
     }
-    myfs_super.driver_fd = driver_fd;
-    ddriver_ioctl(MYFS_DRIVER(), IOC_REQ_DEVICE_SIZE, &myfs_super.sz_disk);
-    ddriver_ioctl(MYFS_DRIVER(), IOC_REQ_DEVICE_IO_SZ, &myfs_super.sz_io);
     myfs_super.sz_blk = 2 * myfs_super.sz_io;
+    if (myfs_cache_init() != MYFS_ERROR_NONE)
+    {
+        return myfs_mount_fail(-MYFS_ERROR_NOSPACE, FALSE, FALSE);
+    }
     MYFS_DBG("sz_disk: %d, sz_io: %d\n", myfs_super.sz_disk, myfs_super.sz_io);
+    memset(&zone_info, 0, sizeof(struct ddriver_zone_info));
+    myfs_stripe_ioctl(IOC_REQ_ZONE_INFO, &zone_info);
+    zoned = options.zoned || zone_info.zone_sz != 0;
+    if (zoned && myfs_super.tiered)
+    {
+        // 快速层中的扩展块会遮住分区写指针处追加的内容
+        MYFS_DBG("tiering needs a conventional device\n");
+        return myfs_mount_fail(-MYFS_ERROR_INVAL, FALSE, FALSE);
+    }
     root_dentry = new_dentry("/", MYFS_DIR);
+    if (root_dentry == NULL)
+    {
+        return myfs_mount_fail(-MYFS_ERROR_NOSPACE, FALSE, FALSE);
+    }
 
     if (myfs_driver_read(MYFS_SUPER_OFS, (uint8_t *)(&myfs_super_d), sizeof(struct myfs_super_d)) != MYFS_ERROR_NONE)
     {
-        return -MYFS_ERROR_IO;
+        return myfs_mount_fail(-MYFS_ERROR_IO, FALSE, FALSE);
     }
+    clock_gettime(CLOCK_MONOTONIC, &t_super);
 
+    if (myfs_super_d.magic_num == MYFS_MAGIC_FIXED)
+    {
+        // 旧格式的目录块按定长记录排布，按rec_len解析会读错；不自动重新格式化，以免抹掉其中的数据
+        MYFS_DBG("device holds the old fixed-length dentry format, refusing to mount\n");
+        return myfs_mount_fail(-MYFS_ERROR_INVAL, FALSE, FALSE);
+    }
     if (myfs_super_d.magic_num != MYFS_MAGIC_NUM)
     {
-        // | Super(1) | Inode Map(1) | Data Map(1) | Inodes(816) | Data(*) |
+        // 未格式化的设备上残留的内容没有意义，未设置的字段均为0
+        memset(&myfs_super_d, 0, sizeof(struct myfs_super_d));
+    }
+    else if ((myfs_super_d.stripe_members > 1 ? myfs_super_d.stripe_members : 1) != myfs_super.stripe_members ||
+             (myfs_super.stripe_members > 1 && (myfs_super_d.stripe_unit != myfs_super.stripe_unit ||
+                                                myfs_super_d.mirror != myfs_super.mirror)))
+    {
+        // 条带几何与格式化时不同则各块落在不同的成员设备上，不能挂载
+        MYFS_DBG("stripe mismatch: formatted %d x %d%s, given %d x %d%s\n", myfs_super_d.stripe_members,
+                 myfs_super_d.stripe_unit, myfs_super_d.mirror ? " mirror" : "", myfs_super.stripe_members,
+                 myfs_super.stripe_unit, myfs_super.mirror ? " mirror" : "");
+        return myfs_mount_fail(-MYFS_ERROR_INVAL, FALSE, FALSE);
+    }
+    else if (myfs_super_d.tiered != myfs_super.tiered)
+    {
+        // 快速层中的内容比主设备上的新，两者只能一起挂载
+        MYFS_DBG("tier mismatch: formatted %s, given %s\n", myfs_super_d.tiered ? "tiered" : "untiered",
+                 myfs_super.tiered ? "tiered" : "untiered");
+        return myfs_mount_fail(-MYFS_ERROR_INVAL, FALSE, FALSE);
+    }
+    if (myfs_super_d.magic_num != MYFS_MAGIC_NUM &&
+        (options.lfs || zoned
+             ? myfs_lfs_format(&myfs_super_d, zoned) == MYFS_ERROR_NONE
+             : options.groups > 1 && myfs_format_groups(&myfs_super_d, options.groups) == MYFS_ERROR_NONE))
+    {
+        myfs_super_d.magic_num = MYFS_MAGIC_NUM;
+        myfs_super_d.sz_usage = 0;
+        myfs_super_d.ckpt_size = 0;
+        myfs_super_d.generation = 0;
+        myfs_super_d.clean = FALSE;
+        is_init = TRUE;
+    }
+    else if (myfs_super_d.magic_num != MYFS_MAGIC_NUM && zoned)
+    {
+        // 顺序写分区不能原地写，分区设备上只能用日志结构布局
+        MYFS_DBG("zoned format failed\n");
+        return myfs_mount_fail(-MYFS_ERROR_INVAL, FALSE, FALSE);
+    }
+    else if (myfs_super_d.magic_num != MYFS_MAGIC_NUM)
+    {
+        // | Super(1) | Inode Map(1) | Data Map(1) | Inodes(816) | Checkpoint(77) | Data(*) |
         super_blks = MYFS_ROUND_UP(sizeof(struct myfs_super_d), MYFS_BLK_SZ()) / MYFS_BLK_SZ();
         inode_num = MYFS_DISK_SZ() / ((MYFS_DATA_PER_FILE + MYFS_INODE_PER_FILE) * MYFS_BLK_SZ());
         map_inode_blks = MYFS_ROUND_UP(MYFS_ROUND_UP(inode_num, UINT32_BITS) / UINT8_BITS, MYFS_IO_SZ()) / MYFS_IO_SZ();
@@ -622,58 +2103,189 @@ int myfs_mount(struct custom_options options)
             MYFS_ROUND_UP(MYFS_ROUND_UP(MYFS_DISK_SZ() / MYFS_BLK_SZ(), UINT32_BITS) / UINT8_BITS, MYFS_BLK_SZ()) /
             MYFS_BLK_SZ();
 
-        myfs_super.max_ino = (inode_num - super_blks - map_data_blks - map_inode_blks);
+        myfs_super_d.max_ino = (inode_num - super_blks - map_data_blks - map_inode_blks);
+        myfs_super.max_ino = myfs_super_d.max_ino;
         myfs_super_d.map_inode_offset = MYFS_SUPER_OFS + MYFS_BLKS_SZ(super_blks);
         myfs_super_d.map_data_offset = myfs_super_d.map_inode_offset + MYFS_BLKS_SZ(map_inode_blks);
         myfs_super_d.inode_offset = myfs_super_d.map_data_offset + MYFS_BLKS_SZ(map_data_blks);
-        myfs_super_d.data_offset = myfs_super_d.inode_offset + MYFS_BLKS_SZ(myfs_super.max_ino);
+        myfs_super_d.ckpt_blks =
+            MYFS_ROUND_UP(myfs_super_d.max_ino * MYFS_CKPT_PER_INODE, MYFS_BLK_SZ()) / MYFS_BLK_SZ();
+        myfs_super_d.ckpt_offset = myfs_super_d.inode_offset + MYFS_BLKS_SZ(myfs_super.max_ino);
+        myfs_super_d.ckpt_size = 0;
+        myfs_super_d.generation = 0;
+        myfs_super_d.clean = FALSE;
+        myfs_super_d.data_offset = myfs_super_d.ckpt_offset + MYFS_BLKS_SZ(myfs_super_d.ckpt_blks);
         myfs_super_d.map_inode_blks = map_inode_blks;
         myfs_super_d.map_data_blks = map_data_blks;
         myfs_super_d.sz_usage = 0;
+        myfs_super_d.free_ino = myfs_super_d.max_ino;
+        myfs_super_d.free_data = (MYFS_DISK_SZ() - myfs_super_d.data_offset) / MYFS_BLK_SZ();
+        myfs_super_d.groups = 1;
+        myfs_super_d.group_blks = MYFS_DISK_SZ() / MYFS_BLK_SZ();
         MYFS_DBG("max_ino: %d\n", myfs_super.max_ino);
         MYFS_DBG("super_blks: %d, inode_num: %d\n", super_blks, inode_num);
         MYFS_DBG("map_inode_offsetc %d, map_data_offset: %d\n", myfs_super_d.map_inode_offset, myfs_super_d.map_data_offset);
         MYFS_DBG("map_inode_blks: %d, map_data_blks: %d\n", myfs_super_d.map_inode_blks, myfs_super_d.map_data_blks);
         MYFS_DBG("inode_offset: %d, data_offset: %d\n", myfs_super_d.inode_offset, myfs_super_d.data_offset);
+        MYFS_DBG("ckpt_offset: %d, ckpt_blks: %d\n", myfs_super_d.ckpt_offset, myfs_super_d.ckpt_blks);
         is_init = TRUE;
     }
     myfs_super.sz_usage = myfs_super_d.sz_usage;
+    myfs_super.max_ino = myfs_super_d.max_ino;
+    // 旧格式的设备上没有块组字段，即单个块组
+    myfs_super.groups = myfs_super_d.groups > 1 ? myfs_super_d.groups : 1;
+    myfs_super.group_blks = myfs_super_d.group_blks;
+    if (myfs_super.groups > 1 || myfs_super_d.lfs)
+    {
+        myfs_super.max_data = myfs_super.groups * myfs_super_d.group_data;
+    }
+    else
+    {
+        myfs_super.max_data = (MYFS_DISK_SZ() - myfs_super_d.data_offset) / MYFS_BLK_SZ();
+    }
+    myfs_super.ino_stride = MYFS_BLKS_SZ(myfs_super_d.map_inode_blks / myfs_super.groups) * UINT8_BITS;
+    myfs_super.data_stride = MYFS_BLKS_SZ(myfs_super_d.map_data_blks / myfs_super.groups) * UINT8_BITS;
+    myfs_super.free_ino = myfs_super_d.free_ino;
+    myfs_super.free_data = myfs_super_d.free_data;
+    // 位图只分配内存，各块在首次访问时读入，挂载开销与设备大小无关
     myfs_super.map_inode = (uint8_t *)malloc(MYFS_BLKS_SZ(myfs_super_d.map_inode_blks));
+    myfs_super.map_inode_loaded = (uint8_t *)calloc(
+        MYFS_ROUND_UP(myfs_super_d.map_inode_blks, UINT8_BITS) / UINT8_BITS, 1);
+    myfs_super.map_inode_dirty = (uint8_t *)calloc(
+        MYFS_ROUND_UP(myfs_super_d.map_inode_blks, UINT8_BITS) / UINT8_BITS, 1);
     myfs_super.map_inode_blks = myfs_super_d.map_inode_blks;
     myfs_super.map_inode_offset = myfs_super_d.map_inode_offset;
     myfs_super.map_data = (uint8_t *)malloc(MYFS_BLKS_SZ(myfs_super_d.map_data_blks));
+    myfs_super.map_data_loaded = (uint8_t *)calloc(
+        MYFS_ROUND_UP(myfs_super_d.map_data_blks, UINT8_BITS) / UINT8_BITS, 1);
+    myfs_super.map_data_dirty = (uint8_t *)calloc(
+        MYFS_ROUND_UP(myfs_super_d.map_data_blks, UINT8_BITS) / UINT8_BITS, 1);
     myfs_super.map_data_blks = myfs_super_d.map_data_blks;
     myfs_super.map_data_offset = myfs_super_d.map_data_offset;
-
-    myfs_super.inode_offset = myfs_super_d.inode_offset;
-    myfs_super.data_offset = myfs_super_d.data_offset;
-
-    // 从磁盘读数据和索引位图
-    if (myfs_driver_read(myfs_super_d.map_inode_offset, (uint8_t *)(myfs_super.map_inode),
-                         MYFS_BLKS_SZ(myfs_super_d.map_inode_blks)) != MYFS_ERROR_NONE)
+    if (myfs_super.map_inode == NULL || myfs_super.map_inode_loaded == NULL || myfs_super.map_inode_dirty == NULL ||
+        myfs_super.map_data == NULL || myfs_super.map_data_loaded == NULL || myfs_super.map_data_dirty == NULL ||
+        myfs_map_index_init(&myfs_super.map_inode_idx,
+                            (myfs_super.groups - 1) * myfs_super.ino_stride + myfs_super.max_ino / myfs_super.groups,
+                            myfs_super.groups > 1 ? myfs_super.ino_stride : MYFS_MAP_CHUNK_SZ * UINT8_BITS,
+                            myfs_super.map_inode_blks / myfs_super.groups) != MYFS_ERROR_NONE ||
+        myfs_map_index_init(&myfs_super.map_data_idx,
+                            (myfs_super.groups - 1) * myfs_super.data_stride + myfs_super.max_data / myfs_super.groups,
+                            myfs_super.groups > 1 ? myfs_super.data_stride : MYFS_MAP_CHUNK_SZ * UINT8_BITS,
+                            myfs_super.map_data_blks / myfs_super.groups) != MYFS_ERROR_NONE)
     {
-        return -MYFS_ERROR_IO;
+        return myfs_mount_fail(-MYFS_ERROR_NOSPACE, TRUE, FALSE);
     }
 
-    if (myfs_driver_read(myfs_super_d.map_data_offset, (uint8_t *)(myfs_super.map_data),
-                         MYFS_BLKS_SZ(myfs_super_d.map_data_blks)) != MYFS_ERROR_NONE)
+    myfs_super.inode_offset = myfs_super_d.inode_offset;
+    myfs_super.data_offset = myfs_super_d.data_offset;
+    myfs_super.ckpt_offset = myfs_super_d.ckpt_offset;
+    myfs_super.ckpt_blks = myfs_super_d.ckpt_blks;
+    myfs_super.generation = myfs_super_d.generation;
+    myfs_super.lfs = myfs_super_d.lfs;
+    myfs_super.seg_offset = myfs_super_d.seg_offset;
+    myfs_super.seg_blks = myfs_super_d.seg_blks;
+    myfs_super.segs = myfs_super_d.segs;
+    myfs_super.lfs_ckpt_offset = myfs_super_d.lfs_ckpt_offset;
+    myfs_super.lfs_ckpt_blks = myfs_super_d.lfs_ckpt_blks;
+    myfs_super.zoned = myfs_super_d.zoned;
+    // myfs_lfs_mount失败时已自行释放映射表
+    if (myfs_super.lfs && myfs_lfs_mount(is_init) != MYFS_ERROR_NONE)
     {
-        return -MYFS_ERROR_IO;
+        return myfs_mount_fail(-MYFS_ERROR_IO, TRUE, FALSE);
     }
 
     if (is_init)
     {
+        // 新格式化的设备上残留的位图内容无效，与空闲计数保持一致，全部块视为已读入且需写回
+        memset(myfs_super.map_inode, 0, MYFS_BLKS_SZ(myfs_super_d.map_inode_blks));
+        memset(myfs_super.map_data, 0, MYFS_BLKS_SZ(myfs_super_d.map_data_blks));
+        for (int blk = 0; blk < myfs_super_d.map_inode_blks; blk++)
+        {
+            set_bit(&myfs_super.map_inode_loaded, blk);
+            set_bit(&myfs_super.map_inode_dirty, blk);
+        }
+        for (int blk = 0; blk < myfs_super_d.map_data_blks; blk++)
+        {
+            set_bit(&myfs_super.map_data_loaded, blk);
+            set_bit(&myfs_super.map_data_dirty, blk);
+        }
+        // 各块组位图末尾不对应inode或数据块的位标记为占用，与ext2相同
+        for (int group = 0; group < myfs_super.groups && myfs_super.groups > 1; group++)
+        {
+            for (int bit = myfs_super.max_ino / myfs_super.groups; bit < myfs_super.ino_stride; bit++)
+            {
+                set_bit(&myfs_super.map_inode, group * myfs_super.ino_stride + bit);
+            }
+            for (int bit = myfs_super.max_data / myfs_super.groups; bit < myfs_super.data_stride; bit++)
+            {
+                set_bit(&myfs_super.map_data, group * myfs_super.data_stride + bit);
+            }
+            if (group > 0)
+            {
+                myfs_super_write(MYFS_GROUP_OFS(group), FALSE, 0, NULL);
+            }
+        }
         root_inode = myfs_alloc_inode(root_dentry);
-        myfs_sync_inode(root_inode);
+        if (root_inode == NULL || myfs_sync_inode(root_inode) != MYFS_ERROR_NONE)
+        {
+            return myfs_mount_fail(-MYFS_ERROR_IO, TRUE, myfs_super.lfs);
+        }
+        // 日志为空时没有可用的检查点，先写一份使根目录可见
+        if (myfs_super.lfs)
+        {
+            myfs_lfs_checkpoint();
+        }
+    }
+    else if ((!myfs_super_d.free_valid || !myfs_super_d.clean) && myfs_map_recount() != MYFS_ERROR_NONE)
+    {
+        return myfs_mount_fail(-MYFS_ERROR_IO, TRUE, myfs_super.lfs);
     }
+    clock_gettime(CLOCK_MONOTONIC, &t_map);
 
-    root_inode = myfs_read_inode(root_dentry, MYFS_ROOT_INO);
-    root_dentry->inode = root_inode;
+    // 上次正常卸载且检查点与超级块同代，则一次读入整棵目录树
+    if (is_init || !myfs_super_d.clean || myfs_super_d.ckpt_size == 0 ||
+        myfs_super_d.ckpt_gen != myfs_super_d.generation ||
+        myfs_ckpt_load(root_dentry, myfs_super_d.ckpt_size) != MYFS_ERROR_NONE)
+    {
+        root_inode = myfs_read_inode(root_dentry, MYFS_ROOT_INO);
+        if (root_inode == NULL)
+        {
+            return myfs_mount_fail(-MYFS_ERROR_IO, TRUE, myfs_super.lfs);
+        }
+        root_dentry->inode = root_inode;
+    }
     myfs_super.root_dentry = root_dentry;
     myfs_super.is_mounted = TRUE;
+    clock_gettime(CLOCK_MONOTONIC, &t_root);
+    MYFS_DBG("[%s] super: %ld us, bitmap: %ld us, root: %ld us\n", __func__,
+             (t_super.tv_sec - t_begin.tv_sec) * 1000000 + (t_super.tv_nsec - t_begin.tv_nsec) / 1000,
+             (t_map.tv_sec - t_super.tv_sec) * 1000000 + (t_map.tv_nsec - t_super.tv_nsec) / 1000,
+             (t_root.tv_sec - t_map.tv_sec) * 1000000 + (t_root.tv_nsec - t_map.tv_nsec) / 1000);
+
+    // 释放上次异常退出时仍打开的已删除文件；先写出位图，再写出清空了记录的超级块
+    if (myfs_orphan_reclaim(&myfs_super_d) > 0 &&
+        (myfs_map_sync() != MYFS_ERROR_NONE || (myfs_super.lfs && myfs_lfs_checkpoint() != MYFS_ERROR_NONE)))
+    {
+        MYFS_DBG("[%s] orphans freed in memory only\n", __func__);
+    }
+
+    // 立即标记为未正常卸载，异常退出后下次挂载不会使用过期的检查点
+    myfs_super.generation++;
+    myfs_super_write(MYFS_SUPER_OFS, FALSE, 0, NULL);
 
-    myfs_dump_map_inode();
-    myfs_dump_map_data();
+    // 预加载只是提前填充缓存，未读入的dentry在查找时按需读入，失败不影响挂载
+    if (options.preload && myfs_preload() != MYFS_ERROR_NONE)
+    {
+        MYFS_DBG("[%s] preload incomplete, the rest loads on demand\n", __func__);
+    }
+
+    if (options.dump_maps && myfs_map_load_all() == MYFS_ERROR_NONE)
+    {
+        MYFS_DBG("[%s] inode map: %d blocks\n", __func__, myfs_super.map_inode_blks);
+        myfs_dump_map_inode();
+        MYFS_DBG("[%s] data map: %d blocks\n", __func__, myfs_super.map_data_blks);
+        myfs_dump_map_data();
+    }
     return ret;
 }
 
@@ -684,45 +2296,55 @@ int myfs_mount(struct custom_options options)
  */
 int myfs_umount()
 {
-    struct myfs_super_d myfs_super_d;
+    struct myfs_io_list list;
+    int ckpt_size;
+    int map_blks;
 
     if (!myfs_super.is_mounted)
     {
         return MYFS_ERROR_NONE;
     }
 
-    myfs_sync_inode(myfs_super.root_dentry->inode);
-
-    myfs_super_d.magic_num = MYFS_MAGIC_NUM;
-    myfs_super_d.map_inode_blks = myfs_super.map_inode_blks;
-    myfs_super_d.map_inode_offset = myfs_super.map_inode_offset;
-    myfs_super_d.map_data_blks = myfs_super.map_data_blks;
-    myfs_super_d.map_data_offset = myfs_super.map_data_offset;
-    myfs_super_d.inode_offset = myfs_super.inode_offset;
-    myfs_super_d.data_offset = myfs_super.data_offset;
-    myfs_super_d.sz_usage = myfs_super.sz_usage;
-    // write back superblock
-    if (myfs_driver_write(MYFS_SUPER_OFS, (uint8_t *)&myfs_super_d,
-                          sizeof(struct myfs_super_d)) != MYFS_ERROR_NONE)
+    myfs_orphan_drop_all();
+    myfs_io_init(&list);
+    myfs_sync_inode_io(myfs_super.root_dentry->inode, &list);
+    // 检查点与超级块同批写出；检查点带有校验和，部分写入时挂载会退回常规路径
+    ckpt_size = myfs_ckpt_save(&list);
+    // 日志结构模式下超级块须等日志检查点写出后再标记正常卸载，否则目录树检查点可能引用映射中还没有的块
+    if (!myfs_super.lfs)
     {
-        return -MYFS_ERROR_IO;
+        myfs_super_write(MYFS_SUPER_OFS, ckpt_size > 0, ckpt_size > 0 ? ckpt_size : 0, &list);
     }
-    // write back map_inode
-    if (myfs_driver_write(myfs_super_d.map_inode_offset, (uint8_t *)(myfs_super.map_inode),
-                          MYFS_BLKS_SZ(myfs_super_d.map_inode_blks)) != MYFS_ERROR_NONE)
+    // 只写回被修改过的位图块
+    map_blks = myfs_map_sync_io(&list, myfs_super.map_inode, myfs_super.map_inode_dirty, myfs_super.map_inode_offset,
+                                &myfs_super.map_inode_idx, myfs_super.map_inode_blks);
+    map_blks += myfs_map_sync_io(&list, myfs_super.map_data, myfs_super.map_data_dirty, myfs_super.map_data_offset,
+                                 &myfs_super.map_data_idx, myfs_super.map_data_blks);
+    MYFS_DBG("[%s] dirty bitmap blocks: %d\n", __func__, map_blks);
+    if (myfs_io_submit(&list) != MYFS_ERROR_NONE)
     {
         return -MYFS_ERROR_IO;
     }
-    // write back map_data
-    if (myfs_driver_write(myfs_super_d.map_data_offset, (uint8_t *)(myfs_super.map_data),
-                          MYFS_BLKS_SZ(myfs_super_d.map_data_blks)) != MYFS_ERROR_NONE)
+    if (myfs_super.lfs && (myfs_lfs_umount() != MYFS_ERROR_NONE ||
+                           myfs_super_write(MYFS_SUPER_OFS, ckpt_size > 0, ckpt_size > 0 ? ckpt_size : 0, NULL) !=
+                               MYFS_ERROR_NONE))
     {
         return -MYFS_ERROR_IO;
     }
 
     free(myfs_super.map_inode);
+    free(myfs_super.map_inode_loaded);
+    free(myfs_super.map_inode_dirty);
     free(myfs_super.map_data);
-    ddriver_close(MYFS_DRIVER());
+    free(myfs_super.map_data_loaded);
+    free(myfs_super.map_data_dirty);
+    myfs_map_index_destroy(&myfs_super.map_inode_idx);
+    myfs_map_index_destroy(&myfs_super.map_data_idx);
+    myfs_cache_destroy();
+    myfs_slab_destroy();
+    myfs_name_destroy();
+    myfs_tier_close();
+    myfs_stripe_close();
 
     return MYFS_ERROR_NONE;
 }
@@ -3,10 +3,16 @@ POINTS=0
 TOTAL_POINTS=0
 TEST_CASES=(mount.sh mkdir.sh touch.sh ls.sh remount.sh)
 # mount.sh mkdir.sh touch.sh ls.sh remount.sh (read.sh write.sh cp.sh)
-ALL_TEST_CASES=(mount.sh mkdir.sh touch.sh ls.sh remount.sh rw.sh cp.sh)
-ALL_TEST_SCORES=(1 4 5 4 16 2 2)
+ALL_TEST_CASES=(mount.sh mkdir.sh touch.sh ls.sh remount.sh rw.sh cp.sh attr.sh statfs.sh wbuf.sh readahead.sh
+                writeback.sh dirent.sh unlink.sh preload.sh ckpt.sh dumpmaps.sh groups.sh lfs.sh zoned.sh stripe.sh
+                mirror.sh tier.sh)
+ALL_TEST_SCORES=(1 4 5 4 16 2 2 3 3 3 3 3 4 3 3 3 2 3 4 4 2 2 4)
 MNTPOINT='./mnt'
 PROJECT_NAME="myfs"
+TREE_DIRS=3
+TREE_FILES=10
+TREE_FILE_SZ=2048
+CKPT_SIZE_OFS=44 # 超级块中检查点有效字节数ckpt_size的偏移
 
 LEVEL=$1
 
@@ -35,6 +41,11 @@ elif [[ "${LEVEL}" == "6" ]]; then
     echo "开始mount, mkdir, touch, ls, read&write, cp, umount测试"
     TEST_CASES=(mount.sh mkdir.sh touch.sh ls.sh remount.sh rw.sh cp.sh)
     sleep 1
+elif [[ "${LEVEL}" == "7" ]]; then
+    echo "开始进阶特性测试"
+    TEST_CASES=(attr.sh statfs.sh wbuf.sh readahead.sh writeback.sh dirent.sh unlink.sh preload.sh ckpt.sh dumpmaps.sh
+                groups.sh lfs.sh zoned.sh stripe.sh mirror.sh tier.sh)
+    sleep 1
 else
     echo "未知测试参数"
     exit 1
@@ -99,6 +110,11 @@ function mount_fuse() {
     "$ROOT_PATH"/../build/"${PROJECT_NAME}" --device="$HOME"/ddriver "${MNTPOINT}"
 }
 
+# 以给定参数挂载，如 mount_fuse_with --device="$HOME"/ddriver --lfs
+function mount_fuse_with() {
+    "$ROOT_PATH"/../build/"${PROJECT_NAME}" "$@" "${MNTPOINT}"
+}
+
 function check_mount() {
     ABS_MNTPOINT=$(realpath "$MNTPOINT")
     if ! mount | grep "${ABS_MNTPOINT}" >/dev/null; then
@@ -128,6 +144,31 @@ function clean_mount() {
     done
 }
 
+# 模拟异常退出: 杀死文件系统进程，不经过destroy，再拆掉残留的挂载点
+function kill_fuse() {
+    pkill -9 -f -- "build/${PROJECT_NAME} .*${MNTPOINT}"
+    sleep 1
+    if check_mount; then
+        umount -l "${MNTPOINT}"
+    fi
+}
+
+# 卸载并等待文件系统进程退出
+function umount_and_wait() {
+    clean_mount
+    # 卸载返回时旧进程可能还在写回，等它退出后再挂载，免得两个进程同时访问设备
+    while pgrep -f -- "build/${PROJECT_NAME} .*${MNTPOINT}" > /dev/null; do
+        sleep 0.1
+    done
+}
+
+# 卸载后以给定参数重新挂载，失败返回1
+function remount_with() {
+    umount_and_wait
+    mount_fuse_with "$@"
+    check_mount
+}
+
 function mkdir_and_check () {
     DIR=$1
     if [ ! -d "$DIR" ]; then
@@ -150,6 +191,50 @@ function touch_and_check () {
     fi
 }
 
+# 正常卸载后作废检查点，再以给定参数挂载，目录树只能从写回的inode和目录项中读出；失败返回1
+function remount_without_ckpt() {
+    umount_and_wait
+    dd if=/dev/zero of="$HOME"/ddriver bs=1 seek=$CKPT_SIZE_OFS count=4 conv=notrunc status=none
+    mount_fuse_with "$@"
+    check_mount
+}
+
+# 输出目录树中每一项的路径、inode号、权限、大小、修改时间及文件内容摘要
+function snapshot_tree () {
+    (cd "${MNTPOINT}" && find . -printf "%p %i %m %s %T@\n" | sort &&
+        find . -type f -exec md5sum {} + | sort -k 2)
+}
+
+# 生成第$1轮写入文件$2的内容
+function gen_content () {
+    yes "round $1 file $2" | head -c $TREE_FILE_SZ
+}
+
+# 建立TREE_DIRS x TREE_FILES个文件，内容按轮次$1生成；已存在的文件被覆盖
+function build_tree () {
+    ROUND=$1
+    for ((D = 0; D < TREE_DIRS; D++)); do
+        mkdir_and_check "${MNTPOINT}"/dir$D
+        for ((F = 0; F < TREE_FILES; F++)); do
+            gen_content "$ROUND" "$D.$F" > "${MNTPOINT}"/dir$D/file$F
+        done
+    done
+}
+
+# 检查build_tree建立的文件内容是否为第$1轮写入的
+function verify_tree () {
+    ROUND=$1
+    for ((D = 0; D < TREE_DIRS; D++)); do
+        for ((F = 0; F < TREE_FILES; F++)); do
+            if ! cmp -s "${MNTPOINT}"/dir$D/file$F <(gen_content "$ROUND" "$D.$F"); then
+                fail "$TEST_CASE: 文件${MNTPOINT}/dir$D/file$F内容与第${ROUND}轮写入的不同"
+                return 1
+            fi
+        done
+    done
+    return 0
+}
+
 # Test
 function register_testcase() {
     for target_test_case in "${TEST_CASES[@]}"; do
@@ -0,0 +1,49 @@
+#!/bin/bash
+# 调度策略测试：建好分散在各块组中的目录树后，以--preload在队列深度为1时重新挂载，
+# 比较各调度策略下预加载的耗时与设备统计的寻道时间
+# 用法: ./sched_bench.sh [调度策略 ...]
+WORK_DIR=$(cd `dirname $0`; pwd)
+cd $WORK_DIR || exit
+
+MNTPOINT='./mnt'
+PROJECT_NAME="myfs"
+DEV="$HOME"/ddriver
+NDIRS=${NDIRS:-8}
+NFILES=${NFILES:-60}
+DEPTH=${DEPTH:-1}
+CKPT_SIZE_OFS=44
+POLICIES=${@:-"fifo clook deadline"}
+OUT=/tmp/${PROJECT_NAME}_sched_bench.txt
+
+function wait_mount() {
+    for ((I = 0; I < 100; I++)); do
+        mount | grep -q "$(realpath ${MNTPOINT})" && return 0
+        sleep 0.1
+    done
+    return 1
+}
+
+mkdir -p ${MNTPOINT}
+rm -f "$DEV"
+../build/${PROJECT_NAME} --device="$DEV" --groups=4 ${MNTPOINT} || exit 1
+for ((D = 0; D < NDIRS; D++)); do
+    mkdir ${MNTPOINT}/d$D
+    for ((F = 0; F < NFILES; F++)); do
+        echo "$D.$F" > ${MNTPOINT}/d$D/f$F
+    done
+done
+fusermount -u ${MNTPOINT}
+sleep 1
+
+for POLICY in $POLICIES; do
+    # 作废检查点，挂载时从磁盘读入全部inode
+    dd if=/dev/zero of="$DEV" bs=1 seek=$CKPT_SIZE_OFS count=4 conv=notrunc status=none
+    ../build/${PROJECT_NAME} --device="$DEV" --preload --queue-depth=$DEPTH --sched=$POLICY -f ${MNTPOINT} > $OUT &
+    FUSE_PID=$!
+    wait_mount || exit 1
+    fusermount -u ${MNTPOINT}
+    wait $FUSE_PID
+    PRELOAD=$(grep -o "inodes: [0-9]*, .*elapsed: [0-9]* ms" $OUT | sed 's/, steals.*elapsed/, elapsed/')
+    SEEK=$(grep -o "$POLICY: dispatched: .*" $OUT | grep -o "queued: [0-9]*\|seek: [0-9]* us" | paste -sd ' ')
+    echo "sched=$POLICY depth=$DEPTH: $PRELOAD, $SEEK"
+done
@@ -0,0 +1,79 @@
+#!/bin/bash
+
+TEST_CASE="case 8 - attributes"
+
+ATTR_FILE="${MNTPOINT}"/file0
+ATTR_MTIME=$(date -d "2020-01-02 03:04:05" +%s)
+ATTR_ATIME=$(date -d "2021-06-07 08:09:10" +%s)
+
+function check_ino_remount () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    INO=$(stat -c %i "$ATTR_FILE")
+    if ! remount_with --device="$HOME"/ddriver; then
+        fail "$_TEST_CASE: 卸载后重新挂载失败"
+        return 1
+    fi
+    if [[ "$(stat -c %i "$ATTR_FILE")" != "$INO" ]]; then
+        fail "$_TEST_CASE: 重新挂载后${ATTR_FILE}的inode号由$INO变为$(stat -c %i "$ATTR_FILE")"
+        return 1
+    fi
+    return 0
+}
+
+function check_times_remount () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    touch -m -d @"$ATTR_MTIME" "$ATTR_FILE"
+    touch -a -d @"$ATTR_ATIME" "$ATTR_FILE"
+    if ! remount_with --device="$HOME"/ddriver; then
+        fail "$_TEST_CASE: 卸载后重新挂载失败"
+        return 1
+    fi
+    if [[ "$(stat -c %Y "$ATTR_FILE")" != "$ATTR_MTIME" || "$(stat -c %X "$ATTR_FILE")" != "$ATTR_ATIME" ]]; then
+        fail "$_TEST_CASE: 重新挂载后${ATTR_FILE}的mtime/atime为$(stat -c %Y/%X "$ATTR_FILE"), 应为$ATTR_MTIME/$ATTR_ATIME"
+        return 1
+    fi
+    return 0
+}
+
+function check_relatime_remount () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # atime早于mtime，读一次即按relatime更新；重新挂载后才读，确保读请求到达文件系统
+    touch -a -d @"$ATTR_MTIME" "$ATTR_FILE"
+    touch -m -d @"$ATTR_ATIME" "$ATTR_FILE"
+    if ! remount_with --device="$HOME"/ddriver; then
+        fail "$_TEST_CASE: 卸载后重新挂载失败"
+        return 1
+    fi
+    START=$(date +%s)
+    cat "$ATTR_FILE" > /dev/null
+    if ! remount_with --device="$HOME"/ddriver; then
+        fail "$_TEST_CASE: 卸载后重新挂载失败"
+        return 1
+    fi
+    if (( $(stat -c %X "$ATTR_FILE") < START )); then
+        fail "$_TEST_CASE: 读${ATTR_FILE}后atime未按relatime更新并写回"
+        return 1
+    fi
+    return 0
+}
+
+clean_mount
+clean_ddriver
+
+try_mount_or_fail
+echo "attr" > "$ATTR_FILE"
+
+TEST_CASE="case 8.1 - st_ino survives remount"
+core_tester ls "${MNTPOINT}" check_ino_remount "$TEST_CASE"
+
+TEST_CASE="case 8.2 - mtime/atime survive remount"
+core_tester ls "${MNTPOINT}" check_times_remount "$TEST_CASE"
+
+TEST_CASE="case 8.3 - relatime atime survives remount"
+core_tester ls "${MNTPOINT}" check_relatime_remount "$TEST_CASE"
@@ -0,0 +1,61 @@
+#!/bin/bash
+
+TEST_CASE="case 16 - checkpoint"
+
+function check_clean_remount () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    build_tree 0
+    # 第一次从检查点恢复，第二次确认未修改时重写的检查点同样可用
+    for I in 1 2; do
+        if ! remount_with --device="$HOME"/ddriver; then
+            fail "$_TEST_CASE: 第$I次正常卸载后重新挂载失败"
+            return 1
+        fi
+        verify_tree 0 || return 1
+    done
+    return 0
+}
+
+function check_unclean_remount () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 异常退出后检查点已过期，挂载时应退回逐个读取inode，得到上次正常卸载时的目录树
+    touch "${MNTPOINT}"/dir0/after_ckpt
+    sync
+    kill_fuse
+    if ! remount_with --device="$HOME"/ddriver; then
+        fail "$_TEST_CASE: 异常退出后重新挂载失败"
+        return 1
+    fi
+    verify_tree 0
+}
+
+function check_recovered_remount () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 恢复后仍可写，正常卸载后重新生成的检查点包含新内容
+    build_tree 1
+    if ! remount_with --device="$HOME"/ddriver; then
+        fail "$_TEST_CASE: 恢复后正常卸载再挂载失败"
+        return 1
+    fi
+    verify_tree 1
+}
+
+clean_mount
+clean_ddriver
+
+try_mount_or_fail
+
+TEST_CASE="case 16.1 - remount after clean umount"
+core_tester ls "${MNTPOINT}" check_clean_remount "$TEST_CASE"
+
+TEST_CASE="case 16.2 - remount after unclean exit"
+core_tester ls "${MNTPOINT}" check_unclean_remount "$TEST_CASE"
+
+TEST_CASE="case 16.3 - write and remount after recovery"
+core_tester ls "${MNTPOINT}" check_recovered_remount "$TEST_CASE"
@@ -0,0 +1,94 @@
+#!/bin/bash
+
+TEST_CASE="case 13 - dir records"
+
+DIRENT_DIR="${MNTPOINT}"/dir0
+DIRENT_FILES=40
+EXPECT=()
+
+# 文件名长度在几字节到一百余字节之间变化，使变长目录项跨越目录块边界
+function dirent_name () {
+    printf "%s%d_%s" "$1" "$2" "$(head -c $(($2 * 37 % 100)) /dev/zero | tr '\0' 'x')"
+}
+
+function check_ls_expect () {
+    _TEST_CASE=$1
+    OUTPUT=$(ls -1 "$DIRENT_DIR" | sort)
+    GOLDEN=$(printf "%s\n" "${EXPECT[@]}" | sort)
+    if [[ "${OUTPUT}" != "${GOLDEN}" ]]; then
+        fail "$_TEST_CASE: ls ${DIRENT_DIR}的结果与创建/删除的文件不一致"
+        return 1
+    fi
+    return 0
+}
+
+function check_add () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    for ((I = 0; I < DIRENT_FILES; I++)); do
+        NAME=$(dirent_name f $I)
+        touch "$DIRENT_DIR/$NAME"
+        EXPECT+=("$NAME")
+    done
+    check_ls_expect "$_TEST_CASE"
+}
+
+function check_del () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    KEEP=()
+    for ((I = 0; I < DIRENT_FILES; I++)); do
+        NAME=$(dirent_name f $I)
+        if ((I % 3 == 0)); then
+            rm "$DIRENT_DIR/$NAME"
+        else
+            KEEP+=("$NAME")
+        fi
+    done
+    EXPECT=("${KEEP[@]}")
+    check_ls_expect "$_TEST_CASE"
+}
+
+function check_readd () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 新文件名长度与删除的不同，复用删除留下的空间
+    for ((I = 0; I < DIRENT_FILES; I += 3)); do
+        NAME=$(dirent_name g $((I + 1)))
+        touch "$DIRENT_DIR/$NAME"
+        EXPECT+=("$NAME")
+    done
+    check_ls_expect "$_TEST_CASE"
+}
+
+function check_dirent_remount () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    if ! remount_with --device="$HOME"/ddriver; then
+        fail "$_TEST_CASE: 卸载后重新挂载失败"
+        return 1
+    fi
+    check_ls_expect "$_TEST_CASE"
+}
+
+clean_mount
+clean_ddriver
+
+try_mount_or_fail
+mkdir_and_check "$DIRENT_DIR"
+
+TEST_CASE="case 13.1 - add ${DIRENT_FILES} records to ${DIRENT_DIR}"
+core_tester ls "$DIRENT_DIR" check_add "$TEST_CASE"
+
+TEST_CASE="case 13.2 - delete every third record"
+core_tester ls "$DIRENT_DIR" check_del "$TEST_CASE"
+
+TEST_CASE="case 13.3 - add records of other lengths"
+core_tester ls "$DIRENT_DIR" check_readd "$TEST_CASE"
+
+TEST_CASE="case 13.4 - remount and list ${DIRENT_DIR}"
+core_tester ls "$DIRENT_DIR" check_dirent_remount "$TEST_CASE"
@@ -0,0 +1,87 @@
+#!/bin/bash
+
+TEST_CASE="case 17 - bitmap dump"
+
+DUMP_OUT=/tmp/${PROJECT_NAME}_dump_maps.txt
+
+# 在前台以给定参数挂载，标准输出写入$DUMP_OUT，挂载完成后返回
+function mount_foreground () {
+    umount_and_wait
+    mount_fuse_with "$@" -f > "$DUMP_OUT" &
+    FUSE_PID=$!
+    for ((I = 0; I < 50; I++)); do
+        check_mount && stat -f "${MNTPOINT}" > /dev/null && return 0
+        sleep 0.1
+    done
+    return 1
+}
+
+# 卸载前台挂载的进程，等它退出后$DUMP_OUT才完整
+function umount_foreground () {
+    clean_mount
+    wait $FUSE_PID
+}
+
+# 输出"inode位图中1的个数 inode位图行数 数据位图中1的个数 数据位图行数 inode位图块数 数据位图块数"
+function count_dump () {
+    awk '/^MYFS_DBG: .*inode map: / { s = "inode"; blks["inode"] = $(NF - 1); next }
+         /^MYFS_DBG: .*data map: /  { s = "data"; blks["data"] = $(NF - 1); next }
+         /^MYFS_DBG/                { s = ""; next }
+         s != "" && /^[01] /        { ones[s] += gsub(/1/, ""); lines[s]++ }
+         END { print ones["inode"] + 0, lines["inode"] + 0, ones["data"] + 0, lines["data"] + 0,
+                     blks["inode"] + 0, blks["data"] + 0 }' "$DUMP_OUT"
+}
+
+function check_quiet_mount () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    if ! mount_foreground --device="$HOME"/ddriver; then
+        fail "$_TEST_CASE: 前台挂载失败"
+        return 1
+    fi
+    umount_foreground
+    read -r _ INODE_LINES _ DATA_LINES _ _ <<< "$(count_dump)"
+    if (( INODE_LINES != 0 || DATA_LINES != 0 )) || grep -q "^[01] [01] " "$DUMP_OUT"; then
+        fail "$_TEST_CASE: 未带--dump-maps挂载时输出了位图"
+        return 1
+    fi
+    return 0
+}
+
+function check_dump_maps () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    if ! mount_foreground --device="$HOME"/ddriver --dump-maps; then
+        fail "$_TEST_CASE: 带--dump-maps前台挂载失败"
+        return 1
+    fi
+    read -r BLOCKS BFREE FILES FFREE <<< "$(stat -f -c "%b %f %c %d" "${MNTPOINT}")"
+    umount_foreground
+    read -r INODE_ONES INODE_LINES DATA_ONES DATA_LINES INODE_BLKS DATA_BLKS <<< "$(count_dump)"
+    # 每行输出4字节共32位
+    if (( INODE_LINES == 0 || INODE_LINES * 4 != INODE_BLKS * 1024 || DATA_LINES * 4 != DATA_BLKS * 1024 )); then
+        fail "$_TEST_CASE: 位图输出为$INODE_LINES/$DATA_LINES行, 与位图块数$INODE_BLKS/$DATA_BLKS不符"
+        return 1
+    fi
+    if (( INODE_ONES != FILES - FFREE || DATA_ONES != BLOCKS - BFREE )); then
+        fail "$_TEST_CASE: 位图中已用inode/数据块为$INODE_ONES/$DATA_ONES, statfs为$((FILES - FFREE))/$((BLOCKS - BFREE))"
+        return 1
+    fi
+    return 0
+}
+
+clean_mount
+clean_ddriver
+
+try_mount_or_fail
+build_tree 0
+
+TEST_CASE="case 17.1 - no bitmap output without --dump-maps"
+core_tester ls "${MNTPOINT}" check_quiet_mount "$TEST_CASE"
+
+TEST_CASE="case 17.2 - --dump-maps matches the used inodes and blocks"
+core_tester ls "${MNTPOINT}" check_dump_maps "$TEST_CASE"
+
+rm -f "$DUMP_OUT"
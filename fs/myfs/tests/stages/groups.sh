@@ -0,0 +1,84 @@
+#!/bin/bash
+
+TEST_CASE="case 18 - block groups"
+
+GROUPS_NUM=4
+
+# st_ino所在的块组：每组在inode位图中占整数个位图块，即8192的整数倍位
+function ino_group () {
+    read -r FILES <<< "$(stat -f -c "%c" "${MNTPOINT}")"
+    STRIDE=$(( (FILES / GROUPS_NUM + 8191) / 8192 * 8192 ))
+    echo $(( ($(stat -c %i "$1") - 1) / STRIDE ))
+}
+
+function check_dir_spread () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 子目录轮流放到各块组
+    SEEN=""
+    for ((D = 0; D < GROUPS_NUM; D++)); do
+        mkdir_and_check "${MNTPOINT}"/dir$D
+        G=$(ino_group "${MNTPOINT}"/dir$D)
+        if [[ " $SEEN " == *" $G "* ]]; then
+            fail "$_TEST_CASE: ${MNTPOINT}/dir$D与之前的目录同在块组$G"
+            return 1
+        fi
+        SEEN="$SEEN $G"
+    done
+    return 0
+}
+
+function check_file_locality () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 普通文件与父目录同组
+    for ((D = 0; D < GROUPS_NUM; D++)); do
+        G=$(ino_group "${MNTPOINT}"/dir$D)
+        for ((F = 0; F < TREE_FILES; F++)); do
+            gen_content 0 "$D.$F" > "${MNTPOINT}"/dir$D/file$F
+            if [[ "$(ino_group "${MNTPOINT}"/dir$D/file$F)" != "$G" ]]; then
+                fail "$_TEST_CASE: ${MNTPOINT}/dir$D/file$F不在父目录所在的块组$G"
+                return 1
+            fi
+        done
+    done
+    return 0
+}
+
+function check_groups_remount () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 块组数记录在超级块中，重新挂载时不必再指定
+    if ! remount_with --device="$HOME"/ddriver; then
+        fail "$_TEST_CASE: 卸载后重新挂载失败"
+        return 1
+    fi
+    TREE_DIRS=$GROUPS_NUM verify_tree 0 || return 1
+    G=$(ino_group "${MNTPOINT}"/dir1)
+    touch "${MNTPOINT}"/dir1/after_remount
+    if [[ "$(ino_group "${MNTPOINT}"/dir1/after_remount)" != "$G" ]]; then
+        fail "$_TEST_CASE: 重新挂载后新建的文件不在父目录所在的块组$G"
+        return 1
+    fi
+    return 0
+}
+
+clean_mount
+clean_ddriver
+
+if ! remount_with --device="$HOME"/ddriver --groups=$GROUPS_NUM; then
+    fail "$TEST_CASE: 带--groups=$GROUPS_NUM挂载失败"
+    exit 1
+fi
+
+TEST_CASE="case 18.1 - subdirectories rotate across groups"
+core_tester ls "${MNTPOINT}" check_dir_spread "$TEST_CASE"
+
+TEST_CASE="case 18.2 - files stay in their directory's group"
+core_tester ls "${MNTPOINT}" check_file_locality "$TEST_CASE"
+
+TEST_CASE="case 18.3 - group layout survives remount"
+core_tester ls "${MNTPOINT}" check_groups_remount "$TEST_CASE"
@@ -0,0 +1,69 @@
+#!/bin/bash
+
+TEST_CASE="case 19 - log-structured layout"
+
+# 每轮覆盖写约60KiB，总写入量超过4MiB的设备容量，必须由清理器回收旧段
+LFS_ROUNDS=80
+
+function check_lfs_build () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    build_tree 0
+    verify_tree 0
+}
+
+function check_lfs_clean () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    for ((R = 1; R <= LFS_ROUNDS; R++)); do
+        build_tree $R
+    done
+    verify_tree $LFS_ROUNDS
+}
+
+function check_lfs_remount () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 日志结构布局记录在超级块中，重新挂载无需再给--lfs
+    if ! remount_with --device="$HOME"/ddriver; then
+        fail "$_TEST_CASE: 清理后重新挂载失败"
+        return 1
+    fi
+    verify_tree $LFS_ROUNDS
+}
+
+function check_lfs_unclean () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 上次卸载后没有写入，异常退出后从最近的日志检查点恢复出同样的内容
+    kill_fuse
+    if ! remount_with --device="$HOME"/ddriver; then
+        fail "$_TEST_CASE: 异常退出后重新挂载失败"
+        return 1
+    fi
+    verify_tree $LFS_ROUNDS
+}
+
+clean_mount
+clean_ddriver
+
+if ! mount_fuse_with --device="$HOME"/ddriver --lfs || ! check_mount; then
+    fail "$TEST_CASE: 以--lfs挂载失败"
+    exit 1
+fi
+
+TEST_CASE="case 19.1 - build files on the log"
+core_tester ls "${MNTPOINT}" check_lfs_build "$TEST_CASE"
+
+TEST_CASE="case 19.2 - overwrite past the device size"
+core_tester ls "${MNTPOINT}" check_lfs_clean "$TEST_CASE"
+
+TEST_CASE="case 19.3 - remount after cleaning"
+core_tester ls "${MNTPOINT}" check_lfs_remount "$TEST_CASE"
+
+TEST_CASE="case 19.4 - remount after unclean exit"
+core_tester ls "${MNTPOINT}" check_lfs_unclean "$TEST_CASE"
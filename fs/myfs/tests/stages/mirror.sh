@@ -0,0 +1,60 @@
+#!/bin/bash
+
+TEST_CASE="case 22 - mirror"
+
+MIRROR_DEVS="$HOME"/ddriver,"$HOME"/ddriver1
+
+function check_layout_remount () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    shift 2
+
+    build_tree 0
+    if ! remount_with "$@"; then
+        fail "$_TEST_CASE: 以$*重新挂载失败"
+        return 1
+    fi
+    verify_tree 0
+}
+
+# 镜像与否与格式化时不同，挂载应当失败
+function check_layout_refused () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    shift 2
+
+    # 挂载失败时init中退出，挂载点随后才拆除
+    remount_with "$@"
+    sleep 1
+    if check_mount; then
+        fail "$_TEST_CASE: 以$*挂载与格式化时不同的镜像布局, 应当拒绝挂载"
+        clean_mount
+        return 1
+    fi
+    return 0
+}
+
+function check_mirror () {
+    check_layout_remount "$1" "$2" --device="$MIRROR_DEVS" --mirror
+}
+
+function check_mirror_refused () {
+    check_layout_refused "$1" "$2" --device="$MIRROR_DEVS"
+}
+
+function reset_mirror () {
+    clean_mount
+    clean_ddriver
+    rm -f "$HOME"/ddriver1
+    if ! mount_fuse_with "$@" || ! check_mount; then
+        fail "$TEST_CASE: 以$*挂载失败"
+        exit 1
+    fi
+}
+
+TEST_CASE="case 22.1 - remount a mirror over two devices"
+reset_mirror --device="$MIRROR_DEVS" --mirror
+core_tester ls "${MNTPOINT}" check_mirror "$TEST_CASE"
+
+TEST_CASE="case 22.2 - refuse the mirror without --mirror"
+core_tester ls "${MNTPOINT}" check_mirror_refused "$TEST_CASE"
@@ -0,0 +1,84 @@
+#!/bin/bash
+
+TEST_CASE="case 15 - preload"
+
+PRELOAD_DEPTH=6
+
+function check_preload_tree () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 先逐个按需读入得到参照，再由多个线程并行预加载同一份磁盘内容
+    if ! remount_without_ckpt --device="$HOME"/ddriver; then
+        fail "$_TEST_CASE: 作废检查点后重新挂载失败"
+        return 1
+    fi
+    SNAPSHOT=$(snapshot_tree)
+    if ! remount_without_ckpt --device="$HOME"/ddriver --preload; then
+        fail "$_TEST_CASE: 带--preload重新挂载失败"
+        return 1
+    fi
+    if [[ "$(snapshot_tree)" != "$SNAPSHOT" ]]; then
+        fail "$_TEST_CASE: 预加载得到的目录树与按需读入的不同"
+        return 1
+    fi
+    return 0
+}
+
+function check_preload_changes () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 预加载的目录树上修改后写回，按需读入时应看到同样的结果
+    rm "${MNTPOINT}"/dir1/file0
+    gen_content 1 "deep" > "${MNTPOINT}"/deep/file
+    touch "${MNTPOINT}"/dir2/new0
+    SNAPSHOT=$(snapshot_tree)
+    if ! remount_without_ckpt --device="$HOME"/ddriver; then
+        fail "$_TEST_CASE: 作废检查点后重新挂载失败"
+        return 1
+    fi
+    if [[ "$(snapshot_tree)" != "$SNAPSHOT" ]]; then
+        fail "$_TEST_CASE: 预加载后修改并写回的目录树与卸载前不同"
+        return 1
+    fi
+    return 0
+}
+
+function check_preload_ckpt () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 从检查点挂载时目录树已在内存中，预加载不应改变它
+    SNAPSHOT=$(snapshot_tree)
+    if ! remount_with --device="$HOME"/ddriver --preload; then
+        fail "$_TEST_CASE: 带--preload重新挂载失败"
+        return 1
+    fi
+    if [[ "$(snapshot_tree)" != "$SNAPSHOT" ]]; then
+        fail "$_TEST_CASE: 从检查点挂载并预加载后的目录树与卸载前不同"
+        return 1
+    fi
+    return 0
+}
+
+clean_mount
+clean_ddriver
+
+try_mount_or_fail
+build_tree 0
+DIR="${MNTPOINT}"
+for ((I = 0; I < PRELOAD_DEPTH; I++)); do
+    DIR="$DIR"/deep
+    mkdir_and_check "$DIR"
+    gen_content 0 "deep.$I" > "$DIR"/file
+done
+
+TEST_CASE="case 15.1 - preloaded tree matches an on-demand mount"
+core_tester ls "${MNTPOINT}" check_preload_tree "$TEST_CASE"
+
+TEST_CASE="case 15.2 - changes to a preloaded tree are written back"
+core_tester ls "${MNTPOINT}" check_preload_changes "$TEST_CASE"
+
+TEST_CASE="case 15.3 - preload after a checkpoint mount"
+core_tester ls "${MNTPOINT}" check_preload_ckpt "$TEST_CASE"
@@ -0,0 +1,71 @@
+#!/bin/bash
+
+TEST_CASE="case 11 - readahead"
+
+RA_FILE="${MNTPOINT}"/file0
+RA_GOLDEN=$(for ((I = 0; I < 800; I++)); do printf "%04d," $I; done)
+
+function check_sequential_read () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 重新挂载后缓存为空，顺序读逐步扩大预读窗口
+    if ! remount_with --device="$HOME"/ddriver; then
+        fail "$_TEST_CASE: 卸载后重新挂载失败"
+        return 1
+    fi
+    if [[ "$(dd if="$RA_FILE" bs=512 status=none)" != "$RA_GOLDEN" ]]; then
+        fail "$_TEST_CASE: 顺序读出${RA_FILE}的内容与写入的不同"
+        return 1
+    fi
+    return 0
+}
+
+function check_random_read () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 跳跃读重置窗口，读到的仍应是对应位置的内容
+    if ! remount_with --device="$HOME"/ddriver; then
+        fail "$_TEST_CASE: 卸载后重新挂载失败"
+        return 1
+    fi
+    for BLK in 3 0 2 1; do
+        OUTPUT=$(dd if="$RA_FILE" bs=1000 skip=$BLK count=1 status=none)
+        if [[ "$OUTPUT" != "${RA_GOLDEN:$((BLK * 1000)):1000}" ]]; then
+            fail "$_TEST_CASE: 读出${RA_FILE}第${BLK}个1000字节的内容与写入的不同"
+            return 1
+        fi
+    done
+    return 0
+}
+
+function check_read_after_write () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 预读窗口中的块被改写后，再读应看到新内容
+    cat "$RA_FILE" > /dev/null
+    printf "ABCD" | dd of="$RA_FILE" bs=1 seek=3000 conv=notrunc status=none
+    EXPECT="${RA_GOLDEN:0:3000}ABCD${RA_GOLDEN:3004}"
+    if [[ "$(cat "$RA_FILE")" != "$EXPECT" ]]; then
+        fail "$_TEST_CASE: 改写后读出${RA_FILE}的内容与写入的不同"
+        return 1
+    fi
+    return 0
+}
+
+clean_mount
+clean_ddriver
+
+try_mount_or_fail
+printf "%s" "$RA_GOLDEN" > "$RA_FILE"
+
+TEST_CASE="case 11.1 - sequential read after remount"
+core_tester ls "${MNTPOINT}" check_sequential_read "$TEST_CASE"
+
+TEST_CASE="case 11.2 - non-sequential read after remount"
+core_tester ls "${MNTPOINT}" check_random_read "$TEST_CASE"
+
+TEST_CASE="case 11.3 - read sees a write into the readahead window"
+core_tester ls "${MNTPOINT}" check_read_after_write "$TEST_CASE"
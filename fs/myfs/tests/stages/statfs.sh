@@ -0,0 +1,68 @@
+#!/bin/bash
+
+TEST_CASE="case 9 - statfs"
+
+# 输出"空闲块数 空闲inode数"
+function free_counts () {
+    stat -f -c "%f %d" "${MNTPOINT}"
+}
+
+function check_create () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    read -r BFREE FFREE <<< "$(free_counts)"
+    touch "${MNTPOINT}"/file0
+    read -r BFREE1 FFREE1 <<< "$(free_counts)"
+    if (( FFREE1 != FFREE - 1 || BFREE1 >= BFREE )); then
+        fail "$_TEST_CASE: 创建文件后空闲块/inode由$BFREE/$FFREE变为$BFREE1/$FFREE1, 应当减少"
+        return 1
+    fi
+    return 0
+}
+
+function check_unlink () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    read -r BFREE1 FFREE1 <<< "$(free_counts)"
+    rm "${MNTPOINT}"/file0
+    read -r BFREE2 FFREE2 <<< "$(free_counts)"
+    if (( BFREE2 != BFREE || FFREE2 != FFREE )); then
+        fail "$_TEST_CASE: 删除文件后空闲块/inode由$BFREE1/$FFREE1变为$BFREE2/$FFREE2, 应恢复为$BFREE/$FFREE"
+        return 1
+    fi
+    return 0
+}
+
+function check_statfs_remount () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    touch "${MNTPOINT}"/file1
+    read -r BFREE1 FFREE1 <<< "$(free_counts)"
+    if ! remount_with --device="$HOME"/ddriver; then
+        fail "$_TEST_CASE: 卸载后重新挂载失败"
+        return 1
+    fi
+    read -r BFREE2 FFREE2 <<< "$(free_counts)"
+    if (( BFREE2 != BFREE1 || FFREE2 != FFREE1 )); then
+        fail "$_TEST_CASE: 重新挂载后空闲块/inode由$BFREE1/$FFREE1变为$BFREE2/$FFREE2"
+        return 1
+    fi
+    return 0
+}
+
+clean_mount
+clean_ddriver
+
+try_mount_or_fail
+
+TEST_CASE="case 9.1 - free counts drop after create"
+core_tester ls "${MNTPOINT}" check_create "$TEST_CASE"
+
+TEST_CASE="case 9.2 - free counts return after unlink"
+core_tester ls "${MNTPOINT}" check_unlink "$TEST_CASE"
+
+TEST_CASE="case 9.3 - free counts survive remount"
+core_tester ls "${MNTPOINT}" check_statfs_remount "$TEST_CASE"
@@ -0,0 +1,60 @@
+#!/bin/bash
+
+TEST_CASE="case 21 - stripe"
+
+STRIPE_DEVS="$HOME"/ddriver,"$HOME"/ddriver1
+
+function check_layout_remount () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    shift 2
+
+    build_tree 0
+    if ! remount_with "$@"; then
+        fail "$_TEST_CASE: 以$*重新挂载失败"
+        return 1
+    fi
+    verify_tree 0
+}
+
+# 条带几何与格式化时不同，挂载应当失败
+function check_layout_refused () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    shift 2
+
+    # 挂载失败时init中退出，挂载点随后才拆除
+    remount_with "$@"
+    sleep 1
+    if check_mount; then
+        fail "$_TEST_CASE: 以$*挂载与格式化时不同的条带几何, 应当拒绝挂载"
+        clean_mount
+        return 1
+    fi
+    return 0
+}
+
+function check_stripe () {
+    check_layout_remount "$1" "$2" --device="$STRIPE_DEVS"
+}
+
+function check_stripe_refused () {
+    check_layout_refused "$1" "$2" --device="$HOME"/ddriver
+}
+
+function reset_stripe () {
+    clean_mount
+    clean_ddriver
+    rm -f "$HOME"/ddriver1
+    if ! mount_fuse_with "$@" || ! check_mount; then
+        fail "$TEST_CASE: 以$*挂载失败"
+        exit 1
+    fi
+}
+
+TEST_CASE="case 21.1 - remount a stripe over two devices"
+reset_stripe --device="$STRIPE_DEVS"
+core_tester ls "${MNTPOINT}" check_stripe "$TEST_CASE"
+
+TEST_CASE="case 21.2 - refuse the stripe with one device"
+core_tester ls "${MNTPOINT}" check_stripe_refused "$TEST_CASE"
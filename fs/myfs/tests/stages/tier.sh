@@ -0,0 +1,84 @@
+#!/bin/bash
+
+TEST_CASE="case 23 - tier"
+
+# 快速设备只有几十个槽，写入量超过槽数后冷的扩展块须写回主设备
+TIER_DEV="$HOME"/ddriver_fast
+TIER_ARGS=(--device="$HOME"/ddriver --tier-device="$TIER_DEV" --tier-size=32768)
+TIER_ROUNDS=5
+
+function check_tier_build () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 快速设备开头为映射表，魔数按小端存放即为"TIER"
+    if [[ "$(head -c 4 "$TIER_DEV")" != "TIER" ]]; then
+        fail "$_TEST_CASE: 以--tier-device挂载后快速设备上没有映射表"
+        return 1
+    fi
+    build_tree 0
+    verify_tree 0
+}
+
+function check_tier_remount () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 快速设备上比主设备新的扩展块，经映射表在重新挂载后仍然可见
+    if ! remount_with "${TIER_ARGS[@]}"; then
+        fail "$_TEST_CASE: 重新挂载分层存储失败"
+        return 1
+    fi
+    verify_tree 0
+}
+
+function check_tier_demote () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    for ((R = 1; R <= TIER_ROUNDS; R++)); do
+        build_tree $R
+    done
+    verify_tree $TIER_ROUNDS || return 1
+    if ! remount_with "${TIER_ARGS[@]}"; then
+        fail "$_TEST_CASE: 重新挂载分层存储失败"
+        return 1
+    fi
+    verify_tree $TIER_ROUNDS
+}
+
+# 格式化时使用了快速层，不带--tier-device挂载应当失败
+function check_tier_refused () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 挂载失败时init中退出，挂载点随后才拆除
+    remount_with --device="$HOME"/ddriver
+    sleep 1
+    if check_mount; then
+        fail "$_TEST_CASE: 不带--tier-device挂载格式化为分层存储的设备, 应当拒绝挂载"
+        clean_mount
+        return 1
+    fi
+    return 0
+}
+
+clean_mount
+clean_ddriver
+rm -f "$TIER_DEV"
+if ! mount_fuse_with "${TIER_ARGS[@]}" || ! check_mount; then
+    fail "$TEST_CASE: 以${TIER_ARGS[*]}挂载失败"
+    exit 1
+fi
+
+TEST_CASE="case 23.1 - build a tree on a tiered mount"
+core_tester ls "${MNTPOINT}" check_tier_build "$TEST_CASE"
+
+TEST_CASE="case 23.2 - fast tier contents survive remount"
+core_tester ls "${MNTPOINT}" check_tier_remount "$TEST_CASE"
+
+TEST_CASE="case 23.3 - overwrite past the fast tier size"
+core_tester ls "${MNTPOINT}" check_tier_demote "$TEST_CASE"
+
+TEST_CASE="case 23.4 - refuse the tiered device without --tier-device"
+core_tester ls "${MNTPOINT}" check_tier_refused "$TEST_CASE"
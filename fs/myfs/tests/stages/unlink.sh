@@ -0,0 +1,86 @@
+#!/bin/bash
+
+TEST_CASE="case 14 - unlink and rmdir"
+
+# 输出"空闲块数 空闲inode数"
+function free_counts () {
+    stat -f -c "%f %d" "${MNTPOINT}"
+}
+
+function check_unlink_rmdir () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    FREE=$(free_counts)
+    mkdir_and_check "${MNTPOINT}"/dir0
+    echo "unlink" > "${MNTPOINT}"/dir0/file0
+    if rmdir "${MNTPOINT}"/dir0 2> /dev/null; then
+        fail "$_TEST_CASE: 非空目录${MNTPOINT}/dir0被rmdir删除"
+        return 1
+    fi
+    if ! rm "${MNTPOINT}"/dir0/file0 || ! rmdir "${MNTPOINT}"/dir0; then
+        fail "$_TEST_CASE: 删除${MNTPOINT}/dir0/file0或${MNTPOINT}/dir0失败"
+        return 1
+    fi
+    if [[ -e "${MNTPOINT}"/dir0 || "$(free_counts)" != "$FREE" ]]; then
+        fail "$_TEST_CASE: 删除后目录仍存在或空闲块/inode为$(free_counts), 应为$FREE"
+        return 1
+    fi
+    return 0
+}
+
+function check_unlink_open () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 仍打开的文件删除后可继续读，最后一次关闭时才释放空间
+    FREE=$(free_counts)
+    echo "still open" > "${MNTPOINT}"/file0
+    exec 3< "${MNTPOINT}"/file0
+    rm "${MNTPOINT}"/file0
+    OUTPUT=$(cat <&3)
+    exec 3<&-
+    if [[ -e "${MNTPOINT}"/file0 || "$OUTPUT" != "still open" ]]; then
+        fail "$_TEST_CASE: 删除后文件仍可见或经打开的文件读出$OUTPUT, 应为still open"
+        return 1
+    fi
+    # 内核在close返回后才发出release，稍等空间释放
+    for ((I = 0; I < 10; I++)); do
+        [[ "$(free_counts)" == "$FREE" ]] && return 0
+        sleep 0.1
+    done
+    fail "$_TEST_CASE: 关闭后空闲块/inode为$(free_counts), 应为$FREE"
+    return 1
+}
+
+function check_unlink_remount () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    touch "${MNTPOINT}"/file1
+    rm "${MNTPOINT}"/file1
+    FREE=$(free_counts)
+    if ! remount_with --device="$HOME"/ddriver; then
+        fail "$_TEST_CASE: 卸载后重新挂载失败"
+        return 1
+    fi
+    if [[ -e "${MNTPOINT}"/file1 || "$(free_counts)" != "$FREE" ]]; then
+        fail "$_TEST_CASE: 重新挂载后已删除的文件仍存在或空闲块/inode为$(free_counts), 应为$FREE"
+        return 1
+    fi
+    return 0
+}
+
+clean_mount
+clean_ddriver
+
+try_mount_or_fail
+
+TEST_CASE="case 14.1 - unlink a file and rmdir its directory"
+core_tester ls "${MNTPOINT}" check_unlink_rmdir "$TEST_CASE"
+
+TEST_CASE="case 14.2 - unlink a file that is still open"
+core_tester ls "${MNTPOINT}" check_unlink_open "$TEST_CASE"
+
+TEST_CASE="case 14.3 - unlinked files stay freed after remount"
+core_tester ls "${MNTPOINT}" check_unlink_remount "$TEST_CASE"
@@ -0,0 +1,68 @@
+#!/bin/bash
+
+TEST_CASE="case 10 - write buffer"
+
+WBUF_FILE="${MNTPOINT}"/file0
+WBUF_GOLDEN=$(for ((I = 0; I < 300; I++)); do printf "%04d," $I; done)
+
+function check_small_writes () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 同一个打开文件上的一串小写，在缓冲区中聚合后整块写回
+    exec 3> "$WBUF_FILE"
+    for ((I = 0; I < 300; I++)); do
+        printf "%04d," $I >&3
+    done
+    exec 3>&-
+    if [[ "$(cat "$WBUF_FILE")" != "$WBUF_GOLDEN" ]]; then
+        fail "$_TEST_CASE: 逐次小写后读出${WBUF_FILE}的内容不同"
+        return 1
+    fi
+    return 0
+}
+
+function check_read_while_open () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 写入者尚未关闭时，经另一个打开文件读到的也应是已写入的内容
+    exec 3> "${MNTPOINT}"/file1
+    printf "buffered" >&3
+    OUTPUT=$(cat "${MNTPOINT}"/file1)
+    exec 3>&-
+    if [[ "$OUTPUT" != "buffered" ]]; then
+        fail "$_TEST_CASE: 写入者未关闭时读出的内容为$OUTPUT, 应为buffered"
+        return 1
+    fi
+    return 0
+}
+
+function check_wbuf_remount () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    if ! remount_with --device="$HOME"/ddriver; then
+        fail "$_TEST_CASE: 卸载后重新挂载失败"
+        return 1
+    fi
+    if [[ "$(cat "$WBUF_FILE")" != "$WBUF_GOLDEN" || "$(cat "${MNTPOINT}"/file1)" != "buffered" ]]; then
+        fail "$_TEST_CASE: 重新挂载后读出的内容与写入的不同"
+        return 1
+    fi
+    return 0
+}
+
+clean_mount
+clean_ddriver
+
+try_mount_or_fail
+
+TEST_CASE="case 10.1 - small writes through one handle"
+core_tester ls "${MNTPOINT}" check_small_writes "$TEST_CASE"
+
+TEST_CASE="case 10.2 - read while the writer is open"
+core_tester ls "${MNTPOINT}" check_read_while_open "$TEST_CASE"
+
+TEST_CASE="case 10.3 - buffered data survives remount"
+core_tester ls "${MNTPOINT}" check_wbuf_remount "$TEST_CASE"
@@ -0,0 +1,57 @@
+#!/bin/bash
+
+TEST_CASE="case 12 - writeback image"
+
+function check_writeback_tree () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    SNAPSHOT=$(snapshot_tree)
+    if ! remount_without_ckpt --device="$HOME"/ddriver; then
+        fail "$_TEST_CASE: 作废检查点后重新挂载失败"
+        return 1
+    fi
+    if [[ "$(snapshot_tree)" != "$SNAPSHOT" ]]; then
+        fail "$_TEST_CASE: 从磁盘读出的目录树与卸载前不同"
+        return 1
+    fi
+    return 0
+}
+
+function check_writeback_changes () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 删除后再创建会复用空出的inode和目录项，同一位置的多次写入在写回时合并
+    for ((F = 0; F < TREE_FILES; F += 2)); do
+        rm "${MNTPOINT}"/dir1/file$F
+    done
+    for ((F = 0; F < TREE_FILES; F++)); do
+        gen_content 1 "new.$F" > "${MNTPOINT}"/dir2/new$F
+    done
+    gen_content 1 "0.0" > "${MNTPOINT}"/dir0/file0
+    check_writeback_tree "$_PARAM" "$_TEST_CASE"
+}
+
+function check_writeback_idle () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 没有修改时再卸载一次，写回的内容不应改变目录树
+    check_writeback_tree "$_PARAM" "$_TEST_CASE"
+}
+
+clean_mount
+clean_ddriver
+
+try_mount_or_fail
+build_tree 0
+
+TEST_CASE="case 12.1 - tree read back from the written image"
+core_tester ls "${MNTPOINT}" check_writeback_tree "$TEST_CASE"
+
+TEST_CASE="case 12.2 - unlink, recreate and overwrite before writeback"
+core_tester ls "${MNTPOINT}" check_writeback_changes "$TEST_CASE"
+
+TEST_CASE="case 12.3 - writeback without changes"
+core_tester ls "${MNTPOINT}" check_writeback_idle "$TEST_CASE"
@@ -0,0 +1,79 @@
+#!/bin/bash
+
+TEST_CASE="case 20 - zoned device"
+
+# 顺序写分区只接受写指针处的写入，写满的分区须先重置；越过写指针的写会被ddriver拒绝，文件内容随之出错
+ZONED_ROUNDS=80
+ZONED_DISK_SZ=$((4 * 1024 * 1024))
+
+function check_zoned_build () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 分区表保存在设备容量之后，格式化为分区设备后设备文件变大
+    if (( $(stat -c %s "$HOME"/ddriver) <= ZONED_DISK_SZ )); then
+        fail "$_TEST_CASE: 以--zoned挂载后设备上没有分区表"
+        return 1
+    fi
+    build_tree 0
+    verify_tree 0
+}
+
+function check_zoned_reset () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 总写入量超过设备容量，段重用前必须重置其分区的写指针
+    for ((R = 1; R <= ZONED_ROUNDS; R++)); do
+        build_tree $R
+    done
+    verify_tree $ZONED_ROUNDS
+}
+
+function check_zoned_remount () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 不带--zoned也应从设备的分区信息识别出分区设备
+    if ! remount_with --device="$HOME"/ddriver; then
+        fail "$_TEST_CASE: 重新挂载分区设备失败"
+        return 1
+    fi
+    verify_tree $ZONED_ROUNDS
+}
+
+function check_zoned_tier_refused () {
+    _PARAM=$1
+    _TEST_CASE=$2
+
+    # 快速层中的扩展块会遮住写指针处追加的内容，分区设备不能分层
+    rm -f "$HOME"/ddriver_fast
+    remount_with --device="$HOME"/ddriver --tier-device="$HOME"/ddriver_fast --tier-size=262144
+    sleep 1
+    if check_mount; then
+        fail "$_TEST_CASE: 分区设备上启用了分层存储, 应当拒绝挂载"
+        clean_mount
+        return 1
+    fi
+    return 0
+}
+
+clean_mount
+clean_ddriver
+
+if ! mount_fuse_with --device="$HOME"/ddriver --zoned || ! check_mount; then
+    fail "$TEST_CASE: 以--zoned挂载失败"
+    exit 1
+fi
+
+TEST_CASE="case 20.1 - format and write a zoned device"
+core_tester ls "${MNTPOINT}" check_zoned_build "$TEST_CASE"
+
+TEST_CASE="case 20.2 - overwrite past the device size"
+core_tester ls "${MNTPOINT}" check_zoned_reset "$TEST_CASE"
+
+TEST_CASE="case 20.3 - remount without --zoned"
+core_tester ls "${MNTPOINT}" check_zoned_remount "$TEST_CASE"
+
+TEST_CASE="case 20.4 - refuse tiering on a zoned device"
+core_tester ls "${MNTPOINT}" check_zoned_tier_refused "$TEST_CASE"
@@ -0,0 +1,86 @@
+#!/bin/bash
+# 分层存储测试：在不同快速设备大小下，对挂载点做Zipf分布的随机读，比较平均/p50/p99时延
+# 用法: ./tier_bench.sh [快速设备大小(KiB) ...]，0表示不启用分层
+WORK_DIR=$(cd `dirname $0`; pwd)
+cd $WORK_DIR || exit
+
+MNTPOINT='./mnt'
+PROJECT_NAME="myfs"
+SLOW_DEV="$HOME"/ddriver
+FAST_DEV="$HOME"/ddriver_fast
+NDIRS=${NDIRS:-5}
+NFILES=${NFILES:-40}
+FILE_SZ=${FILE_SZ:-4096}
+WARM=${WARM:-3000}
+OPS=${OPS:-2000}
+THETA=${THETA:-0.99}
+TIER_SIZES=${@:-"0 128 256 512 1024"}
+
+function zipf() {
+    MODE=$1
+    python3 - "$MODE" "$MNTPOINT" "$NDIRS" "$NFILES" "$FILE_SZ" "$WARM" "$OPS" "$THETA" <<'EOF'
+import os, random, sys, time
+mode, mnt = sys.argv[1], sys.argv[2]
+nd, nf, sz, warm, ops = map(int, sys.argv[3:8])
+theta = float(sys.argv[8])
+names = ["%s/d%02d/file_%03d" % (mnt, i // nf, i % nf) for i in range(nd * nf)]
+if mode == "build":
+    for d in range(nd):
+        os.mkdir("%s/d%02d" % (mnt, d))
+    for i, name in enumerate(names):
+        with open(name, "wb") as f:
+            f.write(bytes([ord('a') + i % 26]) * sz)
+    sys.exit(0)
+rng = random.Random(7)
+rank = names[:]
+rng.shuffle(rank)
+cdf, acc = [], 0.0
+for k in range(len(rank)):
+    acc += 1.0 / (k + 1) ** theta
+    cdf.append(acc)
+def sample():
+    x, lo, hi = rng.random() * acc, 0, len(cdf) - 1
+    while lo < hi:
+        mid = (lo + hi) // 2
+        if cdf[mid] < x:
+            lo = mid + 1
+        else:
+            hi = mid
+    return rank[lo]
+lat, bad = [], 0
+for i in range(warm + ops):
+    name = sample()
+    t = time.perf_counter_ns()
+    fd = os.open(name, os.O_RDONLY)
+    n = len(os.pread(fd, sz, 0))
+    os.close(fd)
+    if n != sz:
+        bad += 1
+    if i >= warm:
+        lat.append((time.perf_counter_ns() - t) // 1000)
+lat.sort()
+print("errors=%d ops=%d mean=%d us p50=%d us p99=%d us"
+      % (bad, ops, sum(lat) // max(len(lat), 1), lat[len(lat) // 2], lat[len(lat) * 99 // 100]))
+EOF
+}
+
+function mount_fs() {
+    TIER_KB=$1
+    TIER_ARGS=""
+    if [ "$TIER_KB" -ne 0 ]; then
+        TIER_ARGS="--tier-device=$FAST_DEV --tier-size=$(($TIER_KB * 1024)) --tier-rate=1000"
+    fi
+    ../build/${PROJECT_NAME} --device="$SLOW_DEV" $TIER_ARGS -o direct_io ${MNTPOINT} || exit 1
+}
+
+mkdir -p ${MNTPOINT}
+for TIER_KB in $TIER_SIZES; do
+    rm -f "$SLOW_DEV" "$FAST_DEV"
+    mount_fs $TIER_KB
+    zipf build
+    fusermount -u ${MNTPOINT}
+    # 重新挂载，测量从冷缓存开始
+    mount_fs $TIER_KB
+    echo "tier=${TIER_KB}KiB: $(zipf read)"
+    fusermount -u ${MNTPOINT}
+done
@@ -1,10 +1,182 @@
 #include "../include/ddriver.h"
 #include <linux/fs.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#define QUEUE_IOS 8
+
+/**
+ * @brief 异步队列：eventfd通知加轮询收取完成事件写入，再以阻塞等待读回比较
+ *
+ * @param fd
+ * @return int 0表示通过
+ */
+static int test_queue(int fd)
+{
+    static char wbuf[QUEUE_IOS][512], rbuf[QUEUE_IOS][512];
+    struct ddriver_sqe *sqe;
+    struct ddriver_cqe cqe;
+    struct pollfd pfd;
+    uint64_t events;
+    int ring, plain, i, done;
+
+    ring = ddriver_queue_init(QUEUE_IOS, DDRIVER_QUEUE_EVENTFD);
+    plain = ddriver_queue_init(QUEUE_IOS, 0);
+    if (ring < 0 || plain < 0) {
+        return -1;
+    }
+    pfd.fd = ddriver_queue_eventfd(ring);
+    pfd.events = POLLIN;
+    if (pfd.fd < 0 || ddriver_queue_eventfd(plain) != -EINVAL) {
+        return -1;
+    }
+
+    /* 相隔较远的写，服务线程同时在设备延迟中等待 */
+    for (i = 0; i < QUEUE_IOS; i++) {
+        memset(wbuf[i], 'a' + i, 512);
+        sqe = ddriver_get_sqe(ring);
+        sqe->opcode = DDRIVER_OP_WRITE;
+        sqe->fd = fd;
+        sqe->buf = wbuf[i];
+        sqe->size = 512;
+        sqe->offset = (off_t)i * 64 * 512;
+        sqe->user_data = i;
+    }
+    if (ddriver_get_sqe(ring) != NULL || ddriver_submit(ring) != QUEUE_IOS) {
+        return -1;
+    }
+    for (done = 0; done < QUEUE_IOS; ) {
+        if (poll(&pfd, 1, 1000) != 1 || read(pfd.fd, &events, sizeof(events)) != sizeof(events)) {
+            return -1;
+        }
+        while (ddriver_peek_cqe(ring, &cqe) == 0) {
+            if (cqe.res != 512 || cqe.user_data >= QUEUE_IOS) {
+                return -1;
+            }
+            done++;
+        }
+    }
+    if (ddriver_peek_cqe(ring, &cqe) != -EAGAIN) {
+        return -1;
+    }
+
+    for (i = 0; i < QUEUE_IOS; i++) {
+        sqe = ddriver_get_sqe(plain);
+        sqe->opcode = DDRIVER_OP_READ;
+        sqe->fd = fd;
+        sqe->buf = rbuf[i];
+        sqe->size = 512;
+        sqe->offset = (off_t)i * 64 * 512;
+        sqe->user_data = i;
+    }
+    ddriver_submit(plain);
+    for (i = 0; i < QUEUE_IOS; i++) {
+        if (ddriver_wait_cqe(plain, &cqe) != 0 || cqe.res != 512) {
+            return -1;
+        }
+    }
+    if (ddriver_wait_cqe(plain, &cqe) != -EAGAIN || memcmp(wbuf, rbuf, sizeof(wbuf)) != 0) {
+        return -1;
+    }
+    ddriver_queue_exit(ring);
+    ddriver_queue_exit(plain);
+    return 0;
+}
+
+/**
+ * @brief 调度策略：队列深度为1时同一组分散的读，C-LOOK的总寻道距离应短于按到达顺序服务
+ *
+ * @param fd
+ * @param policy
+ * @return long long 该策略累计的寻道字节数，出错返回-1
+ */
+static long long test_sched(int fd, int policy)
+{
+    static char buf[QUEUE_IOS * 4][512];
+    struct ddriver_sched_stats stats;
+    struct ddriver_sqe *sqe;
+    struct ddriver_cqe cqe;
+    int ring, depth = 1, size, i;
+
+    ring = ddriver_queue_init(QUEUE_IOS * 4, 0);
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_SIZE, &size);
+    if (ring < 0 || ddriver_ioctl(fd, IOC_REQ_QUEUE_DEPTH, &depth) != 0 ||
+        ddriver_ioctl(fd, IOC_REQ_SCHED_POLICY, &policy) != 0) {
+        return -1;
+    }
+    for (i = 0; i < QUEUE_IOS * 4; i++) {
+        sqe = ddriver_get_sqe(ring);
+        sqe->opcode = DDRIVER_OP_READ;
+        sqe->fd = fd;
+        sqe->buf = buf[i];
+        sqe->size = 512;
+        /* 在整个设备上来回跳动 */
+        sqe->offset = (off_t)((i * 37) % (QUEUE_IOS * 4)) * (size / (QUEUE_IOS * 4) / 512) * 512;
+        sqe->user_data = i;
+    }
+    ddriver_submit(ring);
+    for (i = 0; i < QUEUE_IOS * 4; i++) {
+        if (ddriver_wait_cqe(ring, &cqe) != 0 || cqe.res != 512) {
+            return -1;
+        }
+    }
+    ddriver_queue_exit(ring);
+    stats.policy = policy;
+    if (ddriver_ioctl(fd, IOC_REQ_SCHED_STATS, &stats) != 0) {
+        return -1;
+    }
+    return stats.seek_bytes;
+}
+
+/**
+ * @brief 共享映射：定位写后原地读到的与写入的相同，之后的写入在指针上可见；
+ *        后备文件上读到的也相同；提交写过的范围成功，越过设备末尾的范围被拒绝
+ *
+ * @param fd
+ * @return int 0表示通过
+ */
+static int test_map(int fd)
+{
+    static char wbuf[1024], rbuf[1024];
+    const char *p;
+    int size;
+    off_t offset;
+
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_SIZE, &size);
+    offset = size / 2 / 512 * 512;
+    memset(wbuf, 'm', sizeof(wbuf));
+    if (ddriver_pwrite(fd, wbuf, sizeof(wbuf), offset) != sizeof(wbuf)) {
+        return -1;
+    }
+    p = ddriver_map(fd, offset, sizeof(wbuf));
+    if (p == NULL || memcmp(p, wbuf, sizeof(wbuf)) != 0) {
+        return -1;
+    }
+    memset(wbuf, 'n', 512);
+    if (ddriver_pwrite(fd, wbuf, 512, offset) != 512 || memcmp(p, wbuf, sizeof(wbuf)) != 0) {
+        return -1;
+    }
+    if (pread(fd, rbuf, sizeof(rbuf), offset) != sizeof(rbuf) || memcmp(rbuf, wbuf, sizeof(rbuf)) != 0) {
+        return -1;
+    }
+    if (ddriver_commit(fd, offset, sizeof(wbuf)) != 0 ||
+        ddriver_commit(fd, size - 512, sizeof(wbuf)) != -EINVAL || ddriver_commit(fd, -512, 512) != -EINVAL) {
+        return -1;
+    }
+    if (ddriver_map(fd, size - 512, sizeof(wbuf)) != NULL || errno != EINVAL) {
+        return -1;
+    }
+    return 0;
+}
 
 int main(int argc, char const *argv[])
 {
     int size;
     struct ddriver_state state;
+    long long fifo_seek, clook_seek;
     int fd = ddriver_open("/home/meteor/ddriver");
     if (fd < 0) {
         return -1;
@@ -42,6 +214,32 @@ int main(int argc, char const *argv[])
     printf("write_cnt: %d\n", state.write_cnt);
     printf("seek_cnt: %d\n", state.seek_cnt);
 
+    /* Cycle 5: async submission/completion queues */
+    if (test_queue(fd) != 0) {
+        printf("queue test failed\n");
+        ddriver_close(fd);
+        return -1;
+    }
+    printf("queue: %d ios\n", QUEUE_IOS);
+
+    /* Cycle 6: C-LOOK saves seeks over FIFO on the same requests */
+    fifo_seek = test_sched(fd, DDRIVER_SCHED_FIFO);
+    clook_seek = test_sched(fd, DDRIVER_SCHED_CLOOK);
+    printf("seek bytes: fifo %lld, clook %lld\n", fifo_seek, clook_seek);
+    if (fifo_seek < 0 || clook_seek < 0 || clook_seek >= fifo_seek) {
+        printf("sched test failed\n");
+        ddriver_close(fd);
+        return -1;
+    }
+
+    /* Cycle 7: shared mapping and range commit */
+    if (test_map(fd) != 0) {
+        printf("map test failed\n");
+        ddriver_close(fd);
+        return -1;
+    }
+    printf("map: commit ok\n");
+
     ddriver_close(fd);
 
     printf("Test Pass :)\n");